@@ -451,6 +451,23 @@ void        nopoll_mutex_destroy (noPollPtr mutex)
 	return;
 }
 
+/** 
+ * @internal Updates the provided reference counter (when atomic
+ * operations aren't available) protected by the provided mutex,
+ * returning the new value.
+ */
+int         __nopoll_ref_update (int * ref, noPollPtr mutex, int value)
+{
+	int result;
+
+	nopoll_mutex_lock (mutex);
+	(*ref) += value;
+	result  = (*ref);
+	nopoll_mutex_unlock (mutex);
+
+	return result;
+}
+
 /** 
  * @brief Global optional mutex handlers used by noPoll library to
  * create, destroy, lock and unlock mutex.
@@ -487,6 +504,226 @@ void        nopoll_thread_handlers (noPollMutexCreate  mutex_create,
 	return;
 }
 
+noPollThreadCreate  __nopoll_thread_create = NULL;
+noPollThreadJoin    __nopoll_thread_join   = NULL;
+
+/** 
+ * @brief Global optional thread handlers used by noPoll library to
+ * create and join threads (for example, to run loop workers with
+ * \ref nopoll_loop_run_threads).
+ *
+ * The library doesn't depend on any thread library, so, as with \ref
+ * nopoll_thread_handlers, you have to provide these handlers to use
+ * functions that create threads.
+ *
+ * @param thread_create The handler used to create threads.
+ *
+ * @param thread_join The handler used to wait for a thread to finish.
+ *
+ * The function must receive all handlers defined. In the case NULL
+ * values are provided, they will be uninstalled.
+ */
+void        nopoll_thread_create_handlers (noPollThreadCreate thread_create,
+					   noPollThreadJoin   thread_join)
+{
+	/* configured received handlers */
+	__nopoll_thread_create = thread_create;
+	__nopoll_thread_join   = thread_join;
+
+	return;
+}
+
+/** 
+ * @brief Creates a thread running the provided function with the
+ * defined thread create handler.
+ *
+ * See \ref nopoll_thread_create_handlers for more information.
+ *
+ * @param func The function to run.
+ *
+ * @param user_data User defined pointer passed to func.
+ *
+ * @return A thread reference or NULL if it fails (or no handler was
+ * installed).
+ */
+noPollPtr   nopoll_thread_create (noPollThreadFunc func, noPollPtr user_data)
+{
+	if (! __nopoll_thread_create || ! func)
+		return NULL;
+
+	/* call defined handler */
+	return __nopoll_thread_create (func, user_data);
+}
+
+/** 
+ * @brief Waits for the provided thread to finish with the defined
+ * thread join handler.
+ *
+ * See \ref nopoll_thread_create_handlers for more information.
+ *
+ * @param thread The thread to wait for.
+ */
+void        nopoll_thread_join   (noPollPtr thread)
+{
+	if (! __nopoll_thread_join || ! thread)
+		return;
+
+	/* call defined handler */
+	__nopoll_thread_join (thread);
+	return;
+}
+
+noPollCondCreate     __nopoll_cond_create    = NULL;
+noPollCondDestroy    __nopoll_cond_destroy   = NULL;
+noPollCondWait       __nopoll_cond_wait      = NULL;
+noPollCondSignal     __nopoll_cond_signal    = NULL;
+noPollCondBroadcast  __nopoll_cond_broadcast = NULL;
+
+/** 
+ * @brief Global optional condition variable handlers used by noPoll
+ * library to let its threads (for example, the asynchronous log
+ * writer or resolver threads) sleep until there is work to do.
+ *
+ * As with \ref nopoll_thread_handlers, the library doesn't depend on
+ * any thread library. Without these handlers, threads waiting for
+ * work check for it every NOPOLL_THREAD_COND_WAIT microseconds.
+ * Condition variables are used with mutexes created by the handlers
+ * configured with \ref nopoll_thread_handlers.
+ *
+ * Install these handlers before creating contexts (they are used by
+ * objects created from then on).
+ *
+ * @param cond_create The handler used to create condition variables.
+ *
+ * @param cond_destroy The handler used to destroy condition variables.
+ *
+ * @param cond_wait The handler used to wait on a condition variable.
+ *
+ * @param cond_signal The handler used to wake up one waiting thread.
+ *
+ * @param cond_broadcast The handler used to wake up all waiting threads.
+ *
+ * The function must receive all handlers defined. In the case NULL
+ * values are provided, they will be uninstalled.
+ */
+void        nopoll_thread_cond_handlers (noPollCondCreate    cond_create,
+					 noPollCondDestroy   cond_destroy,
+					 noPollCondWait      cond_wait,
+					 noPollCondSignal    cond_signal,
+					 noPollCondBroadcast cond_broadcast)
+{
+	/* configured received handlers */
+	__nopoll_cond_create    = cond_create;
+	__nopoll_cond_destroy   = cond_destroy;
+	__nopoll_cond_wait      = cond_wait;
+	__nopoll_cond_signal    = cond_signal;
+	__nopoll_cond_broadcast = cond_broadcast;
+
+	return;
+}
+
+/** 
+ * @brief Creates a condition variable with the defined create
+ * handler.
+ *
+ * See \ref nopoll_thread_cond_handlers for more information.
+ *
+ * @return A condition variable reference or NULL if it fails (or no
+ * handler was installed).
+ */
+noPollPtr   nopoll_cond_create    (void)
+{
+	if (! __nopoll_cond_create)
+		return NULL;
+
+	/* call defined handler */
+	return __nopoll_cond_create ();
+}
+
+/** 
+ * @brief Destroys the provided condition variable with the defined
+ * destroy handler.
+ *
+ * See \ref nopoll_thread_cond_handlers for more information.
+ *
+ * @param cond The condition variable to destroy.
+ */
+void        nopoll_cond_destroy   (noPollPtr cond)
+{
+	if (! __nopoll_cond_destroy || ! cond)
+		return;
+
+	/* call defined handler */
+	__nopoll_cond_destroy (cond);
+	return;
+}
+
+/** 
+ * @brief Waits on the provided condition variable with the defined
+ * wait handler. The caller must have the mutex locked, which is
+ * released while waiting.
+ *
+ * When the condition variable wasn't created (no handler installed),
+ * the mutex is released for NOPOLL_THREAD_COND_WAIT microseconds, so
+ * callers check again what they wait for. As with any condition
+ * variable, callers must check it again after returning.
+ *
+ * See \ref nopoll_thread_cond_handlers for more information.
+ *
+ * @param cond The condition variable to wait on.
+ *
+ * @param mutex The mutex locked by the caller.
+ */
+void        nopoll_cond_wait      (noPollPtr cond, noPollPtr mutex)
+{
+	if (! __nopoll_cond_wait || ! cond) {
+		nopoll_mutex_unlock (mutex);
+		nopoll_sleep (NOPOLL_THREAD_COND_WAIT);
+		nopoll_mutex_lock (mutex);
+		return;
+	} /* end if */
+
+	/* call defined handler */
+	__nopoll_cond_wait (cond, mutex);
+	return;
+}
+
+/** 
+ * @brief Wakes up one thread waiting on the provided condition
+ * variable with the defined signal handler.
+ *
+ * See \ref nopoll_thread_cond_handlers for more information.
+ *
+ * @param cond The condition variable to signal.
+ */
+void        nopoll_cond_signal    (noPollPtr cond)
+{
+	if (! __nopoll_cond_signal || ! cond)
+		return;
+
+	/* call defined handler */
+	__nopoll_cond_signal (cond);
+	return;
+}
+
+/** 
+ * @brief Wakes up all threads waiting on the provided condition
+ * variable with the defined broadcast handler.
+ *
+ * See \ref nopoll_thread_cond_handlers for more information.
+ *
+ * @param cond The condition variable to signal.
+ */
+void        nopoll_cond_broadcast (noPollPtr cond)
+{
+	if (! __nopoll_cond_broadcast || ! cond)
+		return;
+
+	/* call defined handler */
+	__nopoll_cond_broadcast (cond);
+	return;
+}
+
 /** 
  * @brief Allows to encode the provided content, leaving the output on
  * the buffer allocated by the caller.
@@ -1295,6 +1532,16 @@ void nopoll_cleanup_library (void)
  * bytes_written = nopoll_conn_flush_writes (conn, 2000000, bytes_written);
  *
  * \endcode
+ *
+ * Connections watched by a loop (\ref nopoll_loop_wait or \ref
+ * nopoll_loop_run_threads) don't need any of this: content that
+ * can't be written is queued (in order) and the loop writes it as
+ * soon as the socket is writable, so send operations return without
+ * waiting and without blocking other connections served by the loop.
+ *
+ * On the contrary, send operations on connections not watched by a
+ * loop block the caller while the socket doesn't accept the frame,
+ * up to 5 seconds, before reporting the content left as pending.
  * 
  * \section nopoll_implementing_port_sharing  2.2. Implementing protocol port sharing: running WebSocket and legacy protocol on the same port
  *
@@ -87,6 +87,29 @@ void        nopoll_mutex_unlock  (noPollPtr mutex);
 
 void        nopoll_mutex_destroy (noPollPtr mutex);
 
+void        nopoll_thread_create_handlers (noPollThreadCreate thread_create,
+					   noPollThreadJoin   thread_join);
+
+noPollPtr   nopoll_thread_create (noPollThreadFunc func, noPollPtr user_data);
+
+void        nopoll_thread_join   (noPollPtr thread);
+
+void        nopoll_thread_cond_handlers (noPollCondCreate    cond_create,
+					 noPollCondDestroy   cond_destroy,
+					 noPollCondWait      cond_wait,
+					 noPollCondSignal    cond_signal,
+					 noPollCondBroadcast cond_broadcast);
+
+noPollPtr   nopoll_cond_create    (void);
+
+void        nopoll_cond_destroy   (noPollPtr cond);
+
+void        nopoll_cond_wait      (noPollPtr cond, noPollPtr mutex);
+
+void        nopoll_cond_signal    (noPollPtr cond);
+
+void        nopoll_cond_broadcast (noPollPtr cond);
+
 nopoll_bool nopoll_base64_encode (const char * content, 
 				  int          length, 
 				  char       * output, 
@@ -50,6 +50,29 @@
 
 #if defined(NOPOLL_OS_UNIX)
 # include <netinet/tcp.h>
+# include <sys/uio.h>
+#endif
+
+/* max time (microseconds) a send operation waits for the socket to
+ * be writable on connections not watched by a loop (content not
+ * written after that is queued) */
+#define NOPOLL_CONN_SEND_WAIT (5000000)
+
+/* vector masking kernels (define NOPOLL_MASK_NO_SIMD to disable
+ * them): sse2 is part of the base x86_64 instruction set while avx2
+ * is compiled with a target attribute and selected at runtime */
+#if ! defined(NOPOLL_MASK_NO_SIMD)
+# if defined(__SSE2__)
+#  define NOPOLL_MASK_SSE2
+#  include <emmintrin.h>
+# endif
+/* avx2 is only built together with the sse2 kernel (i386 builds
+ * without __SSE2__ fall back to the word64 kernel) */
+# if defined(NOPOLL_MASK_SSE2) && (defined(__x86_64__) || defined(__i386__)) && \
+     ((defined(__clang__) && __clang_major__ >= 4) || (! defined(__clang__) && defined(__GNUC__) && __GNUC__ >= 5))
+#  define NOPOLL_MASK_AVX2
+#  include <immintrin.h>
+# endif
 #endif
 
 
@@ -194,20 +217,15 @@ nopoll_bool                 nopoll_conn_set_sock_tcp_nodelay   (NOPOLL_SOCKET so
 
 
 /** 
- * @brief Allows to configure which network interface to bind to.
- * 
- * @param socket The socket to be configured.
- *
- * @param options The options defining the interface value to be configured.
- * 
- * @return nopoll_true if the operation is completed.
+ * @internal Binds the provided socket to the network interface
+ * provided (if any).
  */
-nopoll_bool                 nopoll_conn_set_bind_interface (NOPOLL_SOCKET socket,
-							    noPollConnOpts  * options)
+nopoll_bool                 __nopoll_conn_bind_interface (NOPOLL_SOCKET socket,
+							  const char  * _interface)
 {
 	/* no local variable here please */
 
-	if ((NULL != options) && (NULL != options->_interface)) {
+	if (NULL != _interface) {
 #if defined(NOPOLL_OS_WIN32) || defined(NOPOLL_OS_WIN64)
 		/* Windows still not supported: send us a patch! */ 
 		return nopoll_false;
@@ -215,12 +233,12 @@ nopoll_bool                 nopoll_conn_set_bind_interface (NOPOLL_SOCKET socket
 		/* Mac/OSX: that supports  */
 		/* bind to the interface */
 		return setsockopt (socket, SOL_SOCKET, IP_RECVIF,
-				   options->_interface, strlen(options->_interface) ) == 0;
+				   _interface, strlen(_interface) ) == 0;
 #else
 		/* Linux/Unix case: that supports SO_BINDTODEVICE */
 		/* bind to the interface */
 		return setsockopt (socket, SOL_SOCKET, SO_BINDTODEVICE,
-				   options->_interface, strlen (options->_interface) ) == 0;
+				   _interface, strlen (_interface) ) == 0;
 #endif
 	}
 
@@ -228,6 +246,21 @@ nopoll_bool                 nopoll_conn_set_bind_interface (NOPOLL_SOCKET socket
 	return nopoll_true;
 } /* end */
 
+/** 
+ * @brief Allows to configure which network interface to bind to.
+ * 
+ * @param socket The socket to be configured.
+ *
+ * @param options The options defining the interface value to be configured.
+ * 
+ * @return nopoll_true if the operation is completed.
+ */
+nopoll_bool                 nopoll_conn_set_bind_interface (NOPOLL_SOCKET socket,
+							    noPollConnOpts  * options)
+{
+	return __nopoll_conn_bind_interface (socket, options ? options->_interface : NULL);
+} /* end */
+
 NOPOLL_SOCKET __nopoll_conn_sock_connect_opts_internal (noPollCtx       * ctx,
 							noPollTransport   transport,
 							const char      * host,
@@ -583,6 +616,70 @@ int nopoll_conn_tls_send (noPollConn * conn, char * buffer, int buffer_size)
 }
 
 
+/** 
+ * @internal Configures how SSL_write works on the provided
+ * connection: it reports records written as soon as the socket
+ * doesn't accept more (TLS sockets are non-blocking) and accepts
+ * retrying from another buffer, because the rest is retried from the
+ * copy queued on the connection.
+ */
+void __nopoll_conn_tls_set_modes (noPollConn * conn)
+{
+	SSL_set_mode (conn->ssl, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+	return;
+}
+
+/** 
+ * @internal Requests kernel TLS offload for the provided connection
+ * when enabled by the connection options (see \ref
+ * nopoll_conn_opts_set_ktls). Must be called before the handshake.
+ */
+void __nopoll_conn_ktls_enable (noPollCtx * ctx, noPollConn * conn, noPollConnOpts * opts)
+{
+	if (opts == NULL || ! opts->ktls || conn->ssl == NULL)
+		return;
+
+#if defined(SSL_OP_ENABLE_KTLS) && defined(NOPOLL_OS_UNIX)
+	SSL_set_options (conn->ssl, SSL_OP_ENABLE_KTLS);
+	nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Kernel TLS offload requested for conn id %d", conn->id);
+#else
+	nopoll_log (ctx, NOPOLL_LEVEL_WARNING, "Kernel TLS offload requested for conn id %d but it isn't supported by this build", conn->id);
+#endif
+	return;
+}
+
+/** 
+ * @internal Checks, once the handshake is finished, if the kernel
+ * took over the TLS records of the connection. When sending is
+ * offloaded, application data is written straight to the socket
+ * (like plain connections, including gather writes). Receiving is
+ * still done through SSL_read, which reads from the kernel when
+ * offloaded and handles control records. Connections with ciphers or
+ * kernels without support keep using OpenSSL.
+ */
+void __nopoll_conn_ktls_check (noPollCtx * ctx, noPollConn * conn)
+{
+	conn->ktls_send = nopoll_false;
+	conn->ktls_recv = nopoll_false;
+
+#if defined(SSL_OP_ENABLE_KTLS) && defined(NOPOLL_OS_UNIX)
+	if (conn->ssl == NULL || (SSL_get_options (conn->ssl) & SSL_OP_ENABLE_KTLS) == 0)
+		return;
+
+	conn->ktls_send = BIO_get_ktls_send (SSL_get_wbio (conn->ssl)) ? nopoll_true : nopoll_false;
+	conn->ktls_recv = BIO_get_ktls_recv (SSL_get_rbio (conn->ssl)) ? nopoll_true : nopoll_false;
+
+	/* write application data without OpenSSL */
+	if (conn->ktls_send)
+		conn->send = nopoll_conn_default_send;
+
+	nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Kernel TLS offload for conn id %d (cipher %s): send=%d, recv=%d",
+		    conn->id, SSL_get_cipher_name (conn->ssl), conn->ktls_send, conn->ktls_recv);
+#endif
+	return;
+}
+
+
 SSL_CTX * __nopoll_conn_get_ssl_context (noPollCtx * ctx, noPollConn * conn, noPollConnOpts * opts, nopoll_bool is_client)
 {
 
@@ -778,172 +875,1525 @@ nopoll_bool __nopoll_conn_set_ssl_client_options (noPollCtx * ctx, noPollConn *
 	return nopoll_true;
 }
 
-/** 
- * @internal Internal implementation used to do a connect.
+/**
+ * @internal Acquires a reference to the provided SSL context.
  */
-noPollConn * __nopoll_conn_new_common (noPollCtx       * ctx,
-				       noPollConnOpts  * options,
-				       noPollTransport   transport,
-				       nopoll_bool       enable_tls,
-				       int               socket,
-				       const char      * host_ip, 
-				       const char      * host_port, 
-				       const char      * host_name,
-				       const char      * get_url, 
-				       const char      * protocols,
-				       const char      * origin)
+void __nopoll_conn_ssl_ctx_ref (SSL_CTX * ssl_ctx)
 {
-	noPollConn     * conn;
-	NOPOLL_SOCKET    session;
-	char           * content;
-	int              size;
-	int              ssl_error;
-	X509           * server_cert;
-	int              iterator;
-	long             remaining_timeout;
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+	CRYPTO_add (&ssl_ctx->references, 1, CRYPTO_LOCK_SSL_CTX);
+#else
+	SSL_CTX_up_ref (ssl_ctx);
+#endif
+	return;
+}
 
-	if (! ctx || ! host_ip) {
-		/* release connection options */
-		__nopoll_conn_opts_release_if_needed (options);
-		return NULL;
-	} /* end if */
+/**
+ * @internal Finds the cached SSL context for the provided
+ * configuration (listener_id is 0 for client contexts). The
+ * ctx->ref_mutex must be locked.
+ */
+noPollSslCtxEntry * __nopoll_conn_find_ssl_context (noPollCtx   * ctx,
+						    int           listener_id,
+						    int           ssl_protocol,
+						    const char  * certificateFile,
+						    const char  * privateKey,
+						    const char  * chainCertificate,
+						    const char  * caCertificate,
+						    nopoll_bool   verify)
+{
+	noPollSslCtxEntry * entry = ctx->ssl_ctx_cache;
 
-	/* set default connection port */
-	if (host_port == NULL)
-		host_port = "80";
+	while (entry) {
+		if (entry->listener_id == listener_id && entry->ssl_protocol == ssl_protocol && entry->verify == verify &&
+		    nopoll_cmp (entry->certificate, certificateFile) && nopoll_cmp (entry->private_key, privateKey) &&
+		    nopoll_cmp (entry->chain_certificate, chainCertificate) && nopoll_cmp (entry->ca_certificate, caCertificate))
+			return entry;
 
-	session = socket;
-	/* create socket connection in a non block manner */
-	if (session == NOPOLL_INVALID_SOCKET)
-		session = __nopoll_conn_sock_connect_opts_internal (ctx, transport, host_ip, host_port, options);
-	if (session == NOPOLL_INVALID_SOCKET) {
-		/* release connection options */
-		__nopoll_conn_opts_release_if_needed (options);
-		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Failed to connect to remote host %s:%s", host_ip, host_port);
-		return NULL;
+		/* next entry */
+		entry = entry->next;
+	} /* end while */
+
+	return NULL;
+}
+
+/**
+ * @internal Stores the client TLS session received for the provided
+ * key (taking the reference), releasing the least recently used
+ * sessions above the cache size.
+ */
+void __nopoll_conn_ssl_session_store (noPollCtx * ctx, const char * key, SSL_SESSION * session)
+{
+	noPollSslSession  * entry;
+	noPollSslSession ** prev;
+	noPollSslSession  * released = NULL;
+
+	nopoll_mutex_lock (ctx->ref_mutex);
+
+	/* find current session for the key (or the last one) */
+	prev = &ctx->ssl_sessions;
+	while (*prev && ! nopoll_cmp ((*prev)->key, key) && (*prev)->next)
+		prev = &(*prev)->next;
+
+	entry = *prev;
+	if (entry && nopoll_cmp (entry->key, key)) {
+		/* replace session */
+		(*prev) = entry->next;
+		SSL_SESSION_free (entry->session);
+	} else if (ctx->ssl_sessions_length >= ctx->ssl_sessions_size) {
+		/* reuse the least recently used one */
+		if (entry == NULL) {
+			nopoll_mutex_unlock (ctx->ref_mutex);
+			SSL_SESSION_free (session);
+			return;
+		} /* end if */
+		(*prev)  = NULL;
+		released = entry;
+		entry    = nopoll_new (noPollSslSession, 1);
+		entry->key = nopoll_strdup (key);
+	} else {
+		entry      = nopoll_new (noPollSslSession, 1);
+		entry->key = nopoll_strdup (key);
+		ctx->ssl_sessions_length++;
 	} /* end if */
 
-	/* create the connection */
-	conn = nopoll_new (noPollConn, 1);
-	if (conn == NULL) {
-		/* release connection options */
-		__nopoll_conn_opts_release_if_needed (options);
-		return NULL;
+	/* place it first */
+	entry->session    = session;
+	entry->next       = ctx->ssl_sessions;
+	ctx->ssl_sessions = entry;
+
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	if (released) {
+		SSL_SESSION_free (released->session);
+		nopoll_free (released->key);
+		nopoll_free (released);
 	} /* end if */
+	return;
+}
 
-	conn->refs = 1;
+/**
+ * @internal Called by OpenSSL when a client TLS session is received
+ * (during the handshake or after it, with TLSv1.3).
+ */
+int __nopoll_conn_ssl_session_new (SSL * ssl, SSL_SESSION * session)
+{
+	noPollConn * conn = SSL_get_app_data (ssl);
 
-	/* create mutexes */
-	conn->ref_mutex = nopoll_mutex_create ();
-	conn->handshake_mutex = nopoll_mutex_create ();
+	if (conn == NULL || conn->ctx == NULL || conn->ssl_session_key == NULL)
+		return 0;
 
-	/* register connection into context */
-	if (! nopoll_ctx_register_conn (ctx, conn)) {
-		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Failed to register connection into the context, unable to create connection");
-		nopoll_free (conn);
-		/* release connection options */
-		__nopoll_conn_opts_release_if_needed (options);
+	__nopoll_conn_ssl_session_store (conn->ctx, conn->ssl_session_key, session);
+	return 1;
+}
 
-		return NULL;
-	}
+/**
+ * @internal Configures the client SSL context to be used by the
+ * provided connection (conn->ssl_ctx). Contexts are configured once
+ * per protocol, certificates and verification mode and then shared
+ * by all client connections with the same configuration (unless a
+ * context creator is defined, see nopoll_ctx_set_ssl_context_creator).
+ */
+nopoll_bool __nopoll_conn_get_client_ssl_context (noPollCtx * ctx, noPollConn * conn, noPollConnOpts * options)
+{
+	noPollSslCtxEntry * entry;
+	int                 ssl_protocol = options ? (int) options->ssl_protocol : -1;
+	const char        * certificate  = options ? options->certificate : NULL;
+	const char        * private_key  = options ? options->private_key : NULL;
+	const char        * chain        = options ? options->chain_certificate : NULL;
+	const char        * ca           = options ? options->ca_certificate : NULL;
+	nopoll_bool         verify       = options == NULL || ! options->disable_ssl_verify;
+
+	/* check cached context */
+	if (! ctx->context_creator) {
+		nopoll_mutex_lock (ctx->ref_mutex);
+		entry = __nopoll_conn_find_ssl_context (ctx, 0, ssl_protocol, certificate, private_key, chain, ca, verify);
+		if (entry) {
+			conn->ssl_ctx = entry->ssl_ctx;
+			__nopoll_conn_ssl_ctx_ref (conn->ssl_ctx);
+		} /* end if */
+		nopoll_mutex_unlock (ctx->ref_mutex);
+		if (conn->ssl_ctx)
+			return nopoll_true;
+	} /* end if */
 
-	nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Created noPoll conn-id=%d (ptr: %p, context: %p, socket: %d)",
-		    conn->id, conn, ctx, session);
-	
-	/* configure context */
-	conn->ctx     = ctx;
-	conn->session = session;
-	conn->role    = NOPOLL_ROLE_CLIENT;
+	/* found TLS connection request, enable it */
+	conn->ssl_ctx  = __nopoll_conn_get_ssl_context (ctx, conn, options, nopoll_true);
+	if (conn->ssl_ctx == NULL) {
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to enable TLS, internal __nopoll_conn_get_ssl_context (ctx=%p, conn=%p, options=%p, nopoll_true) failed",
+			    ctx, conn, options);
+		return nopoll_false;
+	} /* end if */
 
-	/* record host and port */
-	conn->host    = nopoll_strdup (host_ip);
-	conn->port    = nopoll_strdup (host_port);
+	/* check for client side SSL configuration */
+	if (! __nopoll_conn_set_ssl_client_options (ctx, conn, options)) {
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to configure additional SSL options, unable to continue, conn->ssl_ctx=%p, conn->ssl=%p",
+			    conn->ssl_ctx, conn->ssl);
+		return nopoll_false;
+	} /* end if */
 
-	/* configure default handlers */
-	conn->receive = nopoll_conn_default_receive;
-	conn->send    = nopoll_conn_default_send;
+	/* user defined contexts are created for each connection */
+	if (ctx->context_creator)
+		return nopoll_true;
+
+	/* sessions received are stored by the context (see
+	 * __nopoll_conn_ssl_session_offer), configured here once as
+	 * the context is shared by connections running on other
+	 * threads */
+	SSL_CTX_set_session_cache_mode (conn->ssl_ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+	SSL_CTX_sess_set_new_cb (conn->ssl_ctx, __nopoll_conn_ssl_session_new);
+
+	nopoll_mutex_lock (ctx->ref_mutex);
+	if (__nopoll_conn_find_ssl_context (ctx, 0, ssl_protocol, certificate, private_key, chain, ca, verify) == NULL) {
+		entry                    = nopoll_new (noPollSslCtxEntry, 1);
+		if (entry == NULL) {
+			nopoll_mutex_unlock (ctx->ref_mutex);
+			/* conn->ssl_ctx is released with the connection */
+			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to allocate memory to cache client SSL context");
+			return nopoll_false;
+		} /* end if */
+		entry->ssl_protocol      = ssl_protocol;
+		entry->certificate       = certificate ? nopoll_strdup (certificate) : NULL;
+		entry->private_key       = private_key ? nopoll_strdup (private_key) : NULL;
+		entry->chain_certificate = chain ? nopoll_strdup (chain) : NULL;
+		entry->ca_certificate    = ca ? nopoll_strdup (ca) : NULL;
+		entry->verify            = verify;
+		entry->ssl_ctx           = conn->ssl_ctx;
+		__nopoll_conn_ssl_ctx_ref (conn->ssl_ctx);
+
+		entry->next              = ctx->ssl_ctx_cache;
+		ctx->ssl_ctx_cache       = entry;
+	} /* end if */
+	nopoll_mutex_unlock (ctx->ref_mutex);
 
-	/* build host name */
-	if (host_name == NULL)
-		conn->host_name = nopoll_strdup (host_ip);
-	else
-		conn->host_name = nopoll_strdup (host_name);
+	return nopoll_true;
+}
 
-	/* build origin */
-	if (origin == NULL)
-		conn->origin = nopoll_strdup_printf ("http://%s", conn->host_name);
-	else
-		conn->origin = nopoll_strdup (origin);
+/**
+ * @internal Prepares the client TLS connection to store the sessions
+ * received and offers the session cached for the same destination
+ * (if any).
+ */
+void __nopoll_conn_ssl_session_offer (noPollCtx * ctx, noPollConn * conn, noPollConnOpts * options)
+{
+	noPollSslSession  * entry;
+	noPollSslSession ** prev;
 
-	/* get url */
-	if (get_url == NULL)
-		conn->get_url = nopoll_strdup ("/");
-	else
-		conn->get_url = nopoll_strdup (get_url);
+	/* sessions aren't cached for user defined contexts */
+	if (ctx->context_creator || ctx->ssl_sessions_size == 0)
+		return;
 
-	/* protocols */
-	if (protocols != NULL)
-		conn->protocols = nopoll_strdup (protocols);
+	/* sessions are only offered to connections with the same
+	 * destination, certificate and peer verification settings
+	 * (a session negotiated without verification must not be
+	 * resumed by a connection requiring it) */
+	conn->ssl_session_key = nopoll_strdup_printf ("%s:%s:%s:%s:%s:%s", conn->host, conn->port,
+						      conn->host_name ? conn->host_name : "",
+						      options && options->certificate ? options->certificate : "",
+						      options && options->ca_certificate ? options->ca_certificate : "",
+						      (options == NULL || ! options->disable_ssl_verify) ? "verify" : "no-verify");
+	SSL_set_app_data (conn->ssl, conn);
+
+	nopoll_mutex_lock (ctx->ref_mutex);
+	prev = &ctx->ssl_sessions;
+	while (*prev && ! nopoll_cmp ((*prev)->key, conn->ssl_session_key))
+		prev = &(*prev)->next;
+	entry = *prev;
+	if (entry) {
+		SSL_set_session (conn->ssl, entry->session);
+
+		/* move it first (most recently used) */
+		(*prev)           = entry->next;
+		entry->next       = ctx->ssl_sessions;
+		ctx->ssl_sessions = entry;
+	} /* end if */
+	nopoll_mutex_unlock (ctx->ref_mutex);
 
-	/* default to no close frame received */
-	conn->peer_close_status = 1006;
+	return;
+}
 
-	/* get client init payload */
-	content = __nopoll_conn_get_client_init (conn, options);
+/**
+ * @internal Updates client TLS session stats once the handshake is
+ * finished.
+ */
+void __nopoll_conn_ssl_session_check (noPollCtx * ctx, noPollConn * conn)
+{
+	if (conn->ssl_session_key == NULL)
+		return;
 
-	if (content == NULL) {
-		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Failed to build client init message, unable to connect");
-		nopoll_conn_shutdown (conn);
+	nopoll_mutex_lock (ctx->ref_mutex);
+	if (SSL_session_reused (conn->ssl))
+		ctx->ssl_session_hits++;
+	else
+		ctx->ssl_session_misses++;
+	nopoll_mutex_unlock (ctx->ref_mutex);
 
-		/* release connection options */
-		__nopoll_conn_opts_release_if_needed (options);
+	nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "TLS session %s for %s (conn id %d)",
+		    SSL_session_reused (conn->ssl) ? "resumed" : "not resumed", conn->ssl_session_key, conn->id);
+	return;
+}
 
-		return NULL;
-	} /* end if */
+/**
+ * @internal Finishes the client TLS handshake: checks the server
+ * certificate and the post check (if any) and configures TLS I/O
+ * handlers. The connection is shutdown if the post check fails.
+ */
+nopoll_bool __nopoll_conn_tls_client_finish (noPollCtx * ctx, noPollConn * conn)
+{
+	X509 * server_cert;
 
-	/* check for TLS support */
-	if (enable_tls) {
-		/* found TLS connection request, enable it */
-		conn->ssl_ctx  = __nopoll_conn_get_ssl_context (ctx, conn, options, nopoll_true);
-		if (conn->ssl_ctx == NULL) {
-			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to enable TLS, internal __nopoll_conn_get_ssl_context (ctx=%p, conn=%p, options=%p, nopoll_true) failed",
-				    ctx, conn, options);
-			goto fail_ssl_connection;
-		} /* end if */
+	nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Client TLS handshake finished, configuring I/O handlers");
+	__nopoll_conn_ssl_session_check (ctx, conn);
 
-		/* check for client side SSL configuration */
-		if (! __nopoll_conn_set_ssl_client_options (ctx, conn, options)) {
-			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to configure additional SSL options, unable to continue, conn->ssl_ctx=%p, conn->ssl=%p",
-				    conn->ssl_ctx, conn->ssl);
-			goto fail_ssl_connection;
+	/* check remote certificate (if it is present) */
+	server_cert = SSL_get_peer_certificate (conn->ssl);
+	if (server_cert == NULL) {
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "server side didn't set a certificate for this session, these are bad news");
+		return nopoll_false;
+	}
+	X509_free (server_cert);
+
+	/* call to check post ssl checks after SSL finalization */
+	if (conn->ctx && conn->ctx->post_ssl_check) {
+		if (! conn->ctx->post_ssl_check (conn->ctx, conn, conn->ssl_ctx, conn->ssl, conn->ctx->post_ssl_check_data)) {
+			/* TLS post check failed */
+			nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, "TLS/SSL post check function failed, dropping connection");
+			nopoll_conn_shutdown (conn);
+			return nopoll_false;
 		} /* end if */
+	} /* end if */
 
-		/* create context and check for result */
-		conn->ssl      = SSL_new (conn->ssl_ctx);       
-		if (conn->ssl_ctx == NULL || conn->ssl == NULL) {
-			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to create SSL context internal references are null (conn->ssl_ctx=%p, conn->ssl=%p)",
-				    conn->ssl_ctx, conn->ssl);
-		fail_ssl_connection:
+	/* configure default handlers */
+	conn->receive = nopoll_conn_tls_receive;
+	conn->send    = nopoll_conn_tls_send;
+	__nopoll_conn_ktls_check (ctx, conn);
 
-			nopoll_free (content);
-			nopoll_conn_shutdown (conn);
+	nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "TLS I/O handlers configured");
+	conn->tls_on = nopoll_true;
+	return nopoll_true;
+}
 
-			/* release connection options */
-			__nopoll_conn_opts_release_if_needed (options);
+/** 
+ * @internal Returns microseconds ellapsed since the provided start
+ * time.
+ */
+long __nopoll_conn_ellapsed (struct timeval * start)
+{
+	struct timeval   stop;
+	struct timeval   diff;
 
-			return conn;
-		} /* end if */
-		
-		/* set server name indication (SNI) */
-		SSL_set_tlsext_host_name(conn->ssl, conn->host_name);
+#if defined(NOPOLL_OS_WIN32)
+	nopoll_win32_gettimeofday (&stop, NULL);
+#else
+	gettimeofday (&stop, NULL);
+#endif
+	nopoll_timeval_substract (&stop, start, &diff);
+	return (diff.tv_sec * 1000000) + diff.tv_usec;
+}
 
-		/* set socket */
-		SSL_set_fd (conn->ssl, conn->session);
+/**
+ * @internal Configures the events the asynchronous connect waits for
+ * on the io engine serving the connection.
+ */
+void __nopoll_conn_connect_wait (noPollConn * conn, int events)
+{
+	conn->connect_events = events;
+	nopoll_io_update_conn (conn->ctx, conn);
+	return;
+}
+
+/**
+ * @internal Finishes the asynchronous connect of the provided
+ * connection (if any) with ctx->ref_mutex held. The pending connect
+ * content is kept: the loop may still be writing it.
+ */
+void __nopoll_conn_connect_done_locked (noPollConn * conn)
+{
+	if (conn->connect_stage == NOPOLL_CONNECT_DONE)
+		return;
+
+	conn->connect_stage  = NOPOLL_CONNECT_DONE;
+	conn->connect_events = 0;
+	conn->ctx->conn_connecting--;
+	__nopoll_conn_connect_attempts_close_locked (conn);
+	if (conn->connect_failed) {
+		conn->connect_failed = nopoll_false;
+		conn->ctx->conn_connect_failed--;
+	} /* end if */
+	return;
+}
+
+/**
+ * @internal Finishes the asynchronous connect of the provided
+ * connection (if any), successfully or not. Called by the loop
+ * serving the connection (or on release).
+ */
+void __nopoll_conn_connect_done (noPollConn * conn)
+{
+	noPollConnectAttempts * attempts;
+
+	nopoll_mutex_lock (conn->ctx->ref_mutex);
+	__nopoll_conn_connect_done_locked (conn);
+	attempts               = conn->connect_attempts;
+	conn->connect_attempts = NULL;
+	nopoll_mutex_unlock (conn->ctx->ref_mutex);
+
+	__nopoll_conn_connect_attempts_free (attempts);
+	nopoll_free (conn->connect_content);
+	conn->connect_content = NULL;
+	return;
+}
+
+/**
+ * @internal Creates a request to resolve the provided connection.
+ */
+noPollResolveRequest * __nopoll_conn_resolve_request_new (noPollConn * conn, noPollTransport transport, noPollConnOpts * options)
+{
+	noPollResolveRequest * request = nopoll_new (noPollResolveRequest, 1);
+
+	if (request == NULL)
+		return NULL;
+
+	nopoll_conn_ref (conn);
+	request->conn   = conn;
+	/* IPv6 connections only try IPv6 addresses, the rest try
+	 * both families */
+	request->family = transport == NOPOLL_TRANSPORT_IPV6 ? AF_INET6 : AF_UNSPEC;
+	if (options && options->_interface)
+		request->_interface = nopoll_strdup (options->_interface);
+	return request;
+}
+
+/**
+ * @internal Releases the provided request (and its connection
+ * reference).
+ */
+void __nopoll_conn_resolve_request_free (noPollResolveRequest * request)
+{
+	nopoll_conn_unref (request->conn);
+	nopoll_free (request->_interface);
+	nopoll_free (request);
+	return;
+}
+
+/**
+ * @internal Sorts addresses found to be tried alternating address
+ * families, starting with the family of the first one (RFC 8305,
+ * section 4).
+ */
+void __nopoll_conn_addresses_sort (noPollAddresses * addresses)
+{
+	noPollAddresses sorted;
+	int             family;
+	int             cursor[2] = {0, 0};
+	int             turn      = 0;
+	int             iterator;
+
+	if (addresses->length < 2)
+		return;
+	family = addresses->items[0].ss_family;
+
+	sorted.length = 0;
+	while (sorted.length < addresses->length) {
+		/* next address of the family in turn */
+		for (iterator = cursor[turn]; iterator < addresses->length; iterator++) {
+			if ((addresses->items[iterator].ss_family == family) == (turn == 0))
+				break;
+		} /* end for */
+		cursor[turn] = iterator + 1;
+		if (iterator < addresses->length) {
+			sorted.items[sorted.length]   = addresses->items[iterator];
+			sorted.lengths[sorted.length] = addresses->lengths[iterator];
+			sorted.length++;
+		} /* end if */
+		turn = 1 - turn;
+	} /* end while */
+
+	(*addresses) = sorted;
+	return;
+}
+
+/**
+ * @internal Copies addresses (only the ones of the family requested
+ * unless it is AF_UNSPEC) setting the provided port (unless it is 0).
+ */
+void __nopoll_conn_addresses_copy (noPollAddresses * dest, noPollAddresses * source, int family, int port)
+{
+	int iterator;
+
+	dest->length = 0;
+	for (iterator = 0; iterator < source->length; iterator++) {
+		if (family != AF_UNSPEC && source->items[iterator].ss_family != family)
+			continue;
+		dest->items[dest->length]   = source->items[iterator];
+		dest->lengths[dest->length] = source->lengths[iterator];
+		if (port > 0 && dest->items[dest->length].ss_family == AF_INET)
+			((struct sockaddr_in *) &(dest->items[dest->length]))->sin_port = htons ((unsigned short) port);
+		else if (port > 0 && dest->items[dest->length].ss_family == AF_INET6)
+			((struct sockaddr_in6 *) &(dest->items[dest->length]))->sin6_port = htons ((unsigned short) port);
+		dest->length++;
+	} /* end for */
+	return;
+}
+
+/**
+ * @internal Releases the provided host name cache entry.
+ */
+void __nopoll_conn_dns_entry_free (noPollDnsEntry * entry)
+{
+	nopoll_free (entry->host);
+	nopoll_free (entry->port);
+	nopoll_free (entry);
+	return;
+}
+
+/**
+ * @internal Stores the addresses resolved for the provided host name
+ * into the cache (ctx->ref_mutex must be locked), releasing the
+ * oldest entries above the cache size. Returns the entry released
+ * (if any).
+ */
+noPollDnsEntry * __nopoll_conn_dns_store (noPollCtx * ctx, const char * host, const char * port, int family, noPollAddresses * addresses)
+{
+	noPollDnsEntry  * entry;
+	noPollDnsEntry ** prev;
+	noPollDnsEntry ** oldest = NULL;
+
+	entry = nopoll_new (noPollDnsEntry, 1);
+	if (entry == NULL)
+		return NULL;
+	entry->host      = nopoll_strdup (host);
+	entry->port      = nopoll_strdup (port);
+	entry->family    = family;
+	entry->addresses = (*addresses);
+	entry->expires   = (long) time (NULL) + ctx->dns_cache_ttl;
+
+	/* place it first */
+	entry->next    = ctx->dns_cache;
+	ctx->dns_cache = entry;
+	ctx->dns_cache_length++;
+	if (ctx->dns_cache_length <= NOPOLL_DNS_CACHE_SIZE)
+		return NULL;
+
+	/* find the oldest entry resolved (host names defined are kept) */
+	prev = &ctx->dns_cache;
+	while (*prev) {
+		if ((*prev)->port)
+			oldest = prev;
+		prev = &(*prev)->next;
+	} /* end while */
+
+	entry     = (*oldest);
+	(*oldest) = entry->next;
+	ctx->dns_cache_length--;
+	return entry;
+}
+
+/**
+ * @internal Gets the addresses of the host to connect to without
+ * blocking the caller: the ones defined (see
+ * nopoll_ctx_set_host_addresses) or the ones cached (see
+ * nopoll_ctx_set_dns_cache). Numeric hosts are converted too.
+ *
+ * @return nopoll_true if addresses were found, otherwise the host
+ * name has to be resolved (see __nopoll_conn_resolve_lookup).
+ */
+nopoll_bool __nopoll_conn_resolve_cached (noPollCtx * ctx, noPollResolveRequest * request, noPollAddresses * addresses)
+{
+	noPollConn       * conn     = request->conn;
+	noPollDnsEntry   * entry;
+	noPollDnsEntry  ** prev;
+	noPollDnsEntry   * released = NULL;
+	struct addrinfo    hints, * res = NULL, * item;
+	long               now      = (long) time (NULL);
+
+	addresses->length = 0;
+
+	/* numeric hosts (no lookup is done) */
+	memset (&hints, 0, sizeof (struct addrinfo));
+	hints.ai_family   = request->family;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags    = AI_NUMERICHOST | AI_NUMERICSERV;
+	if (getaddrinfo (conn->host, conn->port, &hints, &res) == 0) {
+		for (item = res; item && addresses->length < NOPOLL_DNS_CACHE_ADDRESSES; item = item->ai_next) {
+			if (item->ai_addrlen > sizeof (struct sockaddr_storage))
+				continue;
+			memcpy (&(addresses->items[addresses->length]), item->ai_addr, item->ai_addrlen);
+			addresses->lengths[addresses->length] = item->ai_addrlen;
+			addresses->length++;
+		} /* end for */
+		freeaddrinfo (res);
+		return addresses->length > 0;
+	} /* end if */
+
+	/* check host names defined and cached */
+	nopoll_mutex_lock (ctx->ref_mutex);
+	prev = &ctx->dns_cache;
+	while (*prev) {
+		entry = (*prev);
+		if (entry->port == NULL && nopoll_cmp (entry->host, conn->host)) {
+			/* addresses defined for the host (any port) */
+			__nopoll_conn_addresses_copy (addresses, &entry->addresses, request->family, atoi (conn->port));
+			break;
+		} /* end if */
+		if (entry->port && entry->family == request->family && nopoll_cmp (entry->host, conn->host) && nopoll_cmp (entry->port, conn->port)) {
+			if (entry->expires > now) {
+				__nopoll_conn_addresses_copy (addresses, &entry->addresses, AF_UNSPEC, 0);
+				break;
+			} /* end if */
+
+			/* expired */
+			(*prev)  = entry->next;
+			released = entry;
+			ctx->dns_cache_length--;
+			break;
+		} /* end if */
+		prev = &entry->next;
+	} /* end while */
+	if (addresses->length > 0)
+		ctx->dns_cache_hits++;
+	else
+		ctx->dns_cache_misses++;
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	if (released)
+		__nopoll_conn_dns_entry_free (released);
+	if (addresses->length > 0)
+		nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Found %d cached addresses for %s:%s (conn id %d)", addresses->length, conn->host, conn->port, conn->id);
+	return addresses->length > 0;
+}
+
+/**
+ * @internal Resolves the host name to connect to (called by resolver
+ * threads), caching the addresses found (see
+ * nopoll_ctx_set_dns_cache).
+ */
+nopoll_bool __nopoll_conn_resolve_lookup (noPollCtx * ctx, noPollResolveRequest * request, noPollAddresses * addresses)
+{
+	noPollConn       * conn     = request->conn;
+	noPollDnsEntry   * released = NULL;
+	struct addrinfo    hints, * res = NULL, * item;
+
+	addresses->length = 0;
+
+	/* resolve host name */
+	memset (&hints, 0, sizeof (struct addrinfo));
+	hints.ai_family   = request->family;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo (conn->host, conn->port, &hints, &res) != 0) {
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "unable to resolve host name %s (conn id %d), errno=%d", conn->host, conn->id, errno);
+		return nopoll_false;
+	} /* end if */
+
+	for (item = res; item && addresses->length < NOPOLL_DNS_CACHE_ADDRESSES; item = item->ai_next) {
+		if (item->ai_addrlen > sizeof (struct sockaddr_storage))
+			continue;
+		memcpy (&(addresses->items[addresses->length]), item->ai_addr, item->ai_addrlen);
+		addresses->lengths[addresses->length] = item->ai_addrlen;
+		addresses->length++;
+	} /* end for */
+	freeaddrinfo (res);
+	__nopoll_conn_addresses_sort (addresses);
+
+	/* cache them */
+	nopoll_mutex_lock (ctx->ref_mutex);
+	if (ctx->dns_cache_ttl > 0 && addresses->length > 0)
+		released = __nopoll_conn_dns_store (ctx, conn->host, conn->port, request->family, addresses);
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	if (released)
+		__nopoll_conn_dns_entry_free (released);
+	return addresses->length > 0;
+}
+
+/**
+ * @internal Starts a connection attempt to the next address not
+ * tried yet, skipping addresses that fail at once.
+ *
+ * @return The socket connecting (or already connected) or
+ * NOPOLL_INVALID_SOCKET if there are no more addresses to try.
+ */
+NOPOLL_SOCKET __nopoll_conn_attempt (noPollCtx * ctx, noPollConn * conn, noPollConnectAttempts * attempts)
+{
+	struct sockaddr * address;
+	NOPOLL_SOCKET     session;
+	int               position;
+
+	while (attempts->next < attempts->addresses.length) {
+		position = attempts->next;
+		address  = (struct sockaddr *) &(attempts->addresses.items[position]);
+		attempts->next++;
+#if defined(NOPOLL_OS_WIN32)
+		nopoll_win32_gettimeofday (&attempts->last, NULL);
+#else
+		gettimeofday (&attempts->last, NULL);
+#endif
+
+		session = socket (address->sa_family, SOCK_STREAM, 0);
+		if (session == NOPOLL_INVALID_SOCKET) {
+			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "unable to create socket");
+			continue;
+		} /* end if */
+
+		/* disable nagle */
+		nopoll_conn_set_sock_tcp_nodelay (session, nopoll_true);
+
+		/* bind to specified interface */
+		if (! __nopoll_conn_bind_interface (session, attempts->_interface)) {
+			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "unable to bind to specified interface");
+			nopoll_close_socket (session);
+			continue;
+		} /* end if */
+
+		/* set non blocking status */
+		nopoll_conn_set_sock_block (session, nopoll_false);
+
+		/* do a tcp connect (finished by the loop) */
+		if (connect (session, address, attempts->addresses.lengths[position]) == 0 ||
+		    errno == NOPOLL_EINPROGRESS || errno == NOPOLL_EWOULDBLOCK || errno == NOPOLL_ENOTCONN)
+			return session;
+
+		nopoll_log (ctx, NOPOLL_LEVEL_WARNING, "unable to connect to remote host %s:%s (address %d of %d), errno=%d",
+			    conn->host, conn->port, position + 1, attempts->addresses.length, errno);
+		nopoll_close_socket (session);
+	} /* end while */
+
+	return NOPOLL_INVALID_SOCKET;
+}
+
+/**
+ * @internal Reports if one of the connection attempts provided
+ * finished, without blocking the caller.
+ *
+ * @return The position of the attempt finished or -1 if none did.
+ */
+int __nopoll_conn_attempts_wait (NOPOLL_SOCKET * attempts, int length)
+{
+	int              iterator;
+#if defined(NOPOLL_HAVE_POLL)
+	struct pollfd    fds[NOPOLL_DNS_CACHE_ADDRESSES];
+
+	for (iterator = 0; iterator < length; iterator++) {
+		fds[iterator].fd      = attempts[iterator];
+		fds[iterator].events  = POLLOUT;
+		fds[iterator].revents = 0;
+	} /* end for */
+	if (poll (fds, length, 0) <= 0)
+		return -1;
+	for (iterator = 0; iterator < length; iterator++) {
+		if (fds[iterator].revents)
+			return iterator;
+	} /* end for */
+#else
+	fd_set           wset;
+	fd_set           eset;
+	struct timeval   tv;
+	NOPOLL_SOCKET    max = 0;
+
+	/* failed connects are reported as exceptions on windows */
+	FD_ZERO (&wset);
+	FD_ZERO (&eset);
+	for (iterator = 0; iterator < length; iterator++) {
+		if (attempts[iterator] < 0 || attempts[iterator] >= FD_SETSIZE)
+			return iterator;
+		FD_SET (attempts[iterator], &wset);
+		FD_SET (attempts[iterator], &eset);
+		if (attempts[iterator] > max)
+			max = attempts[iterator];
+	} /* end for */
+	tv.tv_sec  = 0;
+	tv.tv_usec = 0;
+	if (select (max + 1, NULL, &wset, &eset, &tv) <= 0)
+		return -1;
+	for (iterator = 0; iterator < length; iterator++) {
+		if (FD_ISSET (attempts[iterator], &wset) || FD_ISSET (attempts[iterator], &eset))
+			return iterator;
+	} /* end for */
+#endif
+	return -1;
+}
+
+/**
+ * @internal Closes the connection attempts in progress besides the
+ * one watched by the loop (must be called with ctx->ref_mutex
+ * acquired).
+ */
+void __nopoll_conn_connect_attempts_close_locked (noPollConn * conn)
+{
+	noPollConnectAttempts * attempts = conn->connect_attempts;
+
+	/* nopoll_close_socket evaluates its argument twice */
+	while (attempts && attempts->length > 0) {
+		attempts->length--;
+		nopoll_close_socket (attempts->sockets[attempts->length]);
+	} /* end while */
+	return;
+}
+
+/**
+ * @internal Releases the provided connection attempts (closing the
+ * ones in progress).
+ */
+void __nopoll_conn_connect_attempts_free (noPollConnectAttempts * attempts)
+{
+	if (attempts == NULL)
+		return;
+	while (attempts->length > 0) {
+		attempts->length--;
+		nopoll_close_socket (attempts->sockets[attempts->length]);
+	} /* end while */
+	nopoll_free (attempts->_interface);
+	nopoll_free (attempts);
+	return;
+}
+
+/**
+ * @internal Makes the provided connection attempt the one watched by
+ * the loop (called by the loop serving the connection). The attempt
+ * watched so far is kept in progress (keep) or closed.
+ *
+ * @return nopoll_false if the connect was stopped meanwhile (see
+ * nopoll_conn_shutdown), in which case the attempt is closed.
+ */
+nopoll_bool __nopoll_conn_connect_swap (noPollConn * conn, NOPOLL_SOCKET session, nopoll_bool keep)
+{
+	noPollCtx             * ctx      = conn->ctx;
+	noPollConnectAttempts * attempts = conn->connect_attempts;
+	noPollIoEngine        * engine;
+	NOPOLL_SOCKET           previous;
+
+	/* stop watching the current attempt */
+	nopoll_io_remove_conn (ctx, conn);
+
+	/* decided under ctx->ref_mutex, also taken by
+	 * nopoll_conn_shutdown to stop the connect (the engine is
+	 * locked before releasing it, so a shutdown removes the
+	 * attempt once added) */
+	nopoll_mutex_lock (ctx->ref_mutex);
+	if (conn->connect_stage != NOPOLL_CONNECT_TCP || conn->shutdown_started) {
+		nopoll_mutex_unlock (ctx->ref_mutex);
+		nopoll_close_socket (session);
+		return nopoll_false;
+	} /* end if */
+	previous      = conn->session;
+	conn->session = session;
+	if (conn->ssl)
+		SSL_set_fd (conn->ssl, session);
+	if (keep && previous != NOPOLL_INVALID_SOCKET) {
+		attempts->sockets[attempts->length] = previous;
+		attempts->length++;
+		previous = NOPOLL_INVALID_SOCKET;
+	} /* end if */
+	engine = __nopoll_io_add_conn_lock (ctx, conn);
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	if (previous != NOPOLL_INVALID_SOCKET)
+		nopoll_close_socket (previous);
+	__nopoll_io_add_conn_locked (ctx, conn, engine);
+	return nopoll_true;
+}
+
+/**
+ * @internal Continues the asynchronous connect of the provided
+ * connection once the attempt watched failed (called by the loop
+ * serving the connection): the next address is tried at once or, if
+ * there are no more, one of the attempts in progress is watched.
+ *
+ * @return nopoll_false if there is nothing left to try.
+ */
+nopoll_bool __nopoll_conn_connect_fallback (noPollConn * conn)
+{
+	noPollCtx             * ctx      = conn->ctx;
+	noPollConnectAttempts * attempts = conn->connect_attempts;
+	NOPOLL_SOCKET           session;
+
+	if (attempts == NULL)
+		return nopoll_false;
+
+	session = __nopoll_conn_attempt (ctx, conn, attempts);
+	if (session == NOPOLL_INVALID_SOCKET) {
+		nopoll_mutex_lock (ctx->ref_mutex);
+		if (conn->connect_stage == NOPOLL_CONNECT_TCP && attempts->length > 0) {
+			attempts->length--;
+			session = attempts->sockets[attempts->length];
+		} /* end if */
+		nopoll_mutex_unlock (ctx->ref_mutex);
+	} /* end if */
+	if (session == NOPOLL_INVALID_SOCKET)
+		return nopoll_false;
+
+	__nopoll_conn_connect_swap (conn, session, nopoll_false);
+	return nopoll_true;
+}
+
+/**
+ * @internal Removes the provided attempt from the attempts in
+ * progress of the connection (so the caller owns it).
+ *
+ * @return nopoll_false if the connect was stopped meanwhile (and the
+ * attempt closed, see nopoll_conn_shutdown).
+ */
+nopoll_bool __nopoll_conn_connect_attempt_take (noPollConn * conn, NOPOLL_SOCKET session)
+{
+	noPollConnectAttempts * attempts = conn->connect_attempts;
+	nopoll_bool             result   = nopoll_false;
+	int                     iterator;
+
+	nopoll_mutex_lock (conn->ctx->ref_mutex);
+	if (conn->connect_stage == NOPOLL_CONNECT_TCP) {
+		for (iterator = 0; iterator < attempts->length; iterator++) {
+			if (attempts->sockets[iterator] != session)
+				continue;
+			attempts->length--;
+			attempts->sockets[iterator] = attempts->sockets[attempts->length];
+			result = nopoll_true;
+			break;
+		} /* end for */
+	} /* end if */
+	nopoll_mutex_unlock (conn->ctx->ref_mutex);
+
+	return result;
+}
+
+/**
+ * @internal Checks the connection attempts of the provided connection
+ * (called periodically by the loop serving it, see
+ * NOPOLL_CONNECT_CHECK_PERIOD): the first attempt in progress that
+ * connects wins and, if the attempt watched didn't finish after
+ * NOPOLL_CONNECT_ATTEMPT_DELAY, the next address is tried (Happy
+ * Eyeballs, RFC 8305).
+ */
+void __nopoll_conn_connect_attempts_check (noPollConn * conn)
+{
+	noPollCtx             * ctx      = conn->ctx;
+	noPollConnectAttempts * attempts = conn->connect_attempts;
+	NOPOLL_SOCKET           sockets[NOPOLL_DNS_CACHE_ADDRESSES];
+	NOPOLL_SOCKET           session;
+	int                     length   = 0;
+	int                     position;
+	int                     error;
+	socklen_t               error_size;
+
+	/* attempts in progress besides the one watched */
+	nopoll_mutex_lock (ctx->ref_mutex);
+	if (conn->connect_stage == NOPOLL_CONNECT_TCP) {
+		length = attempts->length;
+		memcpy (sockets, attempts->sockets, sizeof (NOPOLL_SOCKET) * length);
+	} /* end if */
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	while (length > 0) {
+		position = __nopoll_conn_attempts_wait (sockets, length);
+		if (position < 0)
+			break;
+		session           = sockets[position];
+		sockets[position] = sockets[--length];
+		if (! __nopoll_conn_connect_attempt_take (conn, session))
+			return;
+
+		/* check attempt result */
+		error      = 0;
+		error_size = sizeof (error);
+		if (getsockopt (session, SOL_SOCKET, SO_ERROR, (char *) &error, &error_size) == 0 && error == 0) {
+			/* connected: watch it and continue */
+			if (__nopoll_conn_connect_swap (conn, session, nopoll_false))
+				__nopoll_conn_connect_continue (conn);
+			return;
+		} /* end if */
+
+		nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Connection attempt to %s:%s failed (conn id %d), error %d",
+			    conn->host, conn->port, conn->id, error);
+		nopoll_close_socket (session);
+	} /* end while */
+
+	/* the attempt watched didn't finish in time: try the next
+	 * address keeping it in progress */
+	if (attempts->next < attempts->addresses.length && __nopoll_conn_ellapsed (&attempts->last) >= NOPOLL_CONNECT_ATTEMPT_DELAY) {
+		session = __nopoll_conn_attempt (ctx, conn, attempts);
+		if (session != NOPOLL_INVALID_SOCKET)
+			__nopoll_conn_connect_swap (conn, session, nopoll_true);
+	} /* end if */
+
+	return;
+}
+
+/**
+ * @internal Starts connecting the connection requested to the
+ * addresses provided (NULL if resolving it failed) and hands it to
+ * the loop, which runs the rest of attempts, or reports the failure
+ * to the loop. Called by resolver threads or by the caller when
+ * addresses are found without blocking.
+ */
+void __nopoll_conn_connect_attempts_start (noPollCtx * ctx, noPollResolveRequest * request, noPollAddresses * addresses)
+{
+	noPollConn            * conn     = request->conn;
+	noPollConnectAttempts * attempts = NULL;
+	NOPOLL_SOCKET           session  = NOPOLL_INVALID_SOCKET;
+	nopoll_bool             closed;
+	noPollIoEngine        * engine   = NULL;
+
+	if (addresses && addresses->length > 0) {
+		attempts = nopoll_new (noPollConnectAttempts, 1);
+		if (attempts == NULL) {
+			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Failed to allocate memory to connect to %s:%s (conn id %d)", conn->host, conn->port, conn->id);
+		} else {
+			attempts->addresses  = (*addresses);
+			attempts->_interface = request->_interface;
+			request->_interface  = NULL;
+			session              = __nopoll_conn_attempt (ctx, conn, attempts);
+		} /* end if */
+	} /* end if */
+
+	/* hand the connection to the loop or drop the attempt if it
+	 * was closed meanwhile: decided under ctx->ref_mutex, also
+	 * taken by nopoll_conn_shutdown to stop the connect */
+	nopoll_mutex_lock (ctx->ref_mutex);
+	closed = conn->connect_stage != NOPOLL_CONNECT_RESOLVE;
+	if (closed) {
+		/* nothing to do */
+	} else if (session == NOPOLL_INVALID_SOCKET) {
+		/* report failure to the loop */
+		conn->connect_failed = nopoll_true;
+		ctx->conn_connect_failed++;
+	} else {
+		/* continue connect on the loop (the engine is locked
+		 * before releasing ctx->ref_mutex, so a shutdown
+		 * removes it once added) */
+		conn->session          = session;
+		conn->connect_stage    = NOPOLL_CONNECT_TCP;
+		conn->connect_events   = NOPOLL_IO_WRITE;
+		conn->connect_attempts = attempts;
+		attempts               = NULL;
+		if (conn->ssl)
+			SSL_set_fd (conn->ssl, session);
+		engine = __nopoll_io_add_conn_lock (ctx, conn);
+	} /* end if */
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	/* not handed to the loop */
+	__nopoll_conn_connect_attempts_free (attempts);
+
+	if (closed) {
+		if (session != NOPOLL_INVALID_SOCKET)
+			nopoll_close_socket (session);
+		return;
+	} /* end if */
+
+	if (session == NOPOLL_INVALID_SOCKET) {
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Failed to connect to remote host %s:%s (conn id %d)", conn->host, conn->port, conn->id);
+		nopoll_io_wakeup (ctx);
+		return;
+	} /* end if */
+
+	__nopoll_io_add_conn_locked (ctx, conn, engine);
+	nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Connecting to remote host %s:%s (conn id %d, socket %d)", conn->host, conn->port, conn->id, session);
+	return;
+}
+
+/**
+ * @internal Resolves the connection requested (called by resolver
+ * threads) and starts connecting it (see
+ * __nopoll_conn_connect_attempts_start).
+ */
+void __nopoll_conn_resolve_connect (noPollCtx * ctx, noPollResolveRequest * request)
+{
+	noPollConn       * conn    = request->conn;
+	noPollAddresses    addresses;
+	nopoll_bool        closed;
+
+	/* connection closed before being resolved */
+	nopoll_mutex_lock (ctx->ref_mutex);
+	closed = conn->connect_stage != NOPOLL_CONNECT_RESOLVE;
+	nopoll_mutex_unlock (ctx->ref_mutex);
+	if (closed)
+		return;
+
+	if (__nopoll_conn_resolve_lookup (ctx, request, &addresses))
+		__nopoll_conn_connect_attempts_start (ctx, request, &addresses);
+	else
+		__nopoll_conn_connect_attempts_start (ctx, request, NULL);
+	return;
+}
+
+/**
+ * @internal Resolver thread: resolves requests queued
+ * until the context is released.
+ */
+noPollPtr __nopoll_conn_resolver_run (noPollPtr user_data)
+{
+	noPollCtx            * ctx  = user_data;
+	noPollResolveRequest * request;
+
+	nopoll_mutex_lock (ctx->ref_mutex);
+	while (! ctx->resolver_stop) {
+		/* get next request (or wait for it) */
+		request = ctx->resolver_queue;
+		if (request == NULL) {
+			ctx->resolver_idle++;
+			nopoll_cond_wait (ctx->resolver_cond, ctx->ref_mutex);
+			ctx->resolver_idle--;
+			continue;
+		} /* end if */
+		ctx->resolver_queue = request->next;
+		if (ctx->resolver_queue == NULL)
+			ctx->resolver_last = NULL;
+		nopoll_mutex_unlock (ctx->ref_mutex);
+
+		__nopoll_conn_resolve_connect (ctx, request);
+		__nopoll_conn_resolve_request_free (request);
+
+		nopoll_mutex_lock (ctx->ref_mutex);
+	} /* end while */
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	return NULL;
+}
+
+/**
+ * @internal Queues the provided request to be served by a resolver
+ * thread, starting a new one if all are busy (up to the max
+ * configured).
+ *
+ * @return nopoll_true if the request was queued, nopoll_false if no
+ * resolver thread is available.
+ */
+nopoll_bool __nopoll_conn_resolver_queue (noPollCtx * ctx, noPollResolveRequest * request)
+{
+	noPollPtr * threads;
+
+	nopoll_mutex_lock (ctx->ref_mutex);
+	if (ctx->resolver_idle == 0 && ctx->resolver_threads_length < ctx->resolver_size && ! ctx->resolver_stop) {
+		threads = nopoll_realloc (ctx->resolver_threads, sizeof (noPollPtr) * (ctx->resolver_threads_length + 1));
+		if (threads) {
+			ctx->resolver_threads = threads;
+			threads[ctx->resolver_threads_length] = nopoll_thread_create (__nopoll_conn_resolver_run, ctx);
+			if (threads[ctx->resolver_threads_length])
+				ctx->resolver_threads_length++;
+		} /* end if */
+	} /* end if */
+
+	if (ctx->resolver_threads_length == 0 || ctx->resolver_stop) {
+		nopoll_mutex_unlock (ctx->ref_mutex);
+		return nopoll_false;
+	} /* end if */
+
+	if (ctx->resolver_last)
+		ctx->resolver_last->next = request;
+	else
+		ctx->resolver_queue = request;
+	ctx->resolver_last = request;
+
+	/* wake up an idle resolver thread (if any) */
+	nopoll_cond_signal (ctx->resolver_cond);
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	return nopoll_true;
+}
+
+/**
+ * @internal Stops resolver threads (waiting for requests in
+ * progress) and releases requests queued and host names cached.
+ * Called when the context is released.
+ */
+void __nopoll_conn_resolver_stop (noPollCtx * ctx)
+{
+	noPollResolveRequest * request;
+	noPollDnsEntry       * entry;
+	int                    iterator;
+
+	nopoll_mutex_lock (ctx->ref_mutex);
+	ctx->resolver_stop = nopoll_true;
+	nopoll_cond_broadcast (ctx->resolver_cond);
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	for (iterator = 0; iterator < ctx->resolver_threads_length; iterator++)
+		nopoll_thread_join (ctx->resolver_threads[iterator]);
+	nopoll_free (ctx->resolver_threads);
+	ctx->resolver_threads        = NULL;
+	ctx->resolver_threads_length = 0;
+
+	while (ctx->resolver_queue) {
+		request             = ctx->resolver_queue;
+		ctx->resolver_queue = request->next;
+		__nopoll_conn_resolve_request_free (request);
+	} /* end while */
+	ctx->resolver_last = NULL;
+
+	while (ctx->dns_cache) {
+		entry          = ctx->dns_cache;
+		ctx->dns_cache = entry->next;
+		__nopoll_conn_dns_entry_free (entry);
+	} /* end while */
+	ctx->dns_cache_length = 0;
+	return;
+}
+
+/**
+ * @internal Closes the provided connection because its asynchronous
+ * connect failed.
+ */
+void __nopoll_conn_connect_failed (noPollConn * conn)
+{
+	/* also stops the connect */
+	nopoll_conn_shutdown (conn);
+	return;
+}
+
+/**
+ * @internal Starts the asynchronous connect of the provided
+ * connection: the client init is kept to be sent by the loop once the
+ * connection is established. If the connection has no socket yet,
+ * the host name is resolved by a resolver thread (unless its
+ * addresses are found without blocking) and the loop connects to the
+ * addresses found.
+ */
+noPollConn * __nopoll_conn_connect_start (noPollCtx * ctx, noPollConn * conn, noPollTransport transport, char * content, noPollConnOpts * options)
+{
+	noPollResolveRequest * request = NULL;
+	noPollAddresses        addresses;
+
+	conn->connect_content = content;
+	conn->connect_size    = strlen (content);
+	conn->connect_desp    = 0;
+
+	if (conn->connect_stage == NOPOLL_CONNECT_RESOLVE)
+		request = __nopoll_conn_resolve_request_new (conn, transport, options);
+
+	/* release connection options */
+	__nopoll_conn_opts_release_if_needed (options);
+
+	nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Connecting to %s:%s asynchronously (conn id %d)", conn->host, conn->port, conn->id);
+	if (conn->connect_stage != NOPOLL_CONNECT_RESOLVE) {
+		/* the loop does the rest */
+		__nopoll_conn_connect_wait (conn, NOPOLL_IO_WRITE);
+		return conn;
+	} /* end if */
+
+	if (request == NULL) {
+		__nopoll_conn_connect_failed (conn);
+		return conn;
+	} /* end if */
+
+	/* addresses defined, cached or numeric: no resolver thread
+	 * is required */
+	if (__nopoll_conn_resolve_cached (ctx, request, &addresses)) {
+		__nopoll_conn_connect_attempts_start (ctx, request, &addresses);
+		__nopoll_conn_resolve_request_free (request);
+		return conn;
+	} /* end if */
+
+	/* no resolver thread available (for example, thread
+	 * handlers aren't defined): resolve on the caller */
+	if (! __nopoll_conn_resolver_queue (ctx, request)) {
+		__nopoll_conn_resolve_connect (ctx, request);
+		__nopoll_conn_resolve_request_free (request);
+	} /* end if */
+	return conn;
+}
+
+/**
+ * @internal Moves the asynchronous connect of the provided
+ * connection from stage to next unless it was stopped meanwhile
+ * (see nopoll_conn_shutdown), in which case nopoll_false is
+ * returned.
+ */
+nopoll_bool __nopoll_conn_connect_advance (noPollConn * conn, noPollConnectStage stage, noPollConnectStage next)
+{
+	nopoll_bool result;
+
+	nopoll_mutex_lock (conn->ctx->ref_mutex);
+	result = conn->connect_stage == stage;
+	if (result)
+		conn->connect_stage = next;
+	nopoll_mutex_unlock (conn->ctx->ref_mutex);
+
+	return result;
+}
+
+/**
+ * @internal Advances the asynchronous connect of the provided
+ * connection (called by the loop once the socket is ready for the
+ * events the connect waits for): completes the TCP connect, the TLS
+ * handshake and sends the client init. The upgrade reply is then
+ * handled like for the rest of connections, calling on ready.
+ */
+void __nopoll_conn_connect_continue (noPollConn * conn)
+{
+	noPollCtx * ctx        = conn->ctx;
+	int         error      = 0;
+	socklen_t   error_size = sizeof (error);
+	int         result;
+
+	if (conn->connect_stage == NOPOLL_CONNECT_TCP) {
+		/* check TCP connect result */
+		if (getsockopt (conn->session, SOL_SOCKET, SO_ERROR, (char *) &error, &error_size) != 0 || error != 0) {
+			/* try the rest of addresses (if any) */
+			nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Connection attempt to %s:%s failed (conn id %d), error %d",
+				    conn->host, conn->port, conn->id, error);
+			if (__nopoll_conn_connect_fallback (conn))
+				return;
+
+			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Failed to connect to remote host %s:%s (conn id %d), error %d",
+				    conn->host, conn->port, conn->id, error);
+			__nopoll_conn_connect_failed (conn);
+			return;
+		} /* end if */
+
+		/* connected: close the rest of attempts */
+		nopoll_mutex_lock (ctx->ref_mutex);
+		__nopoll_conn_connect_attempts_close_locked (conn);
+		nopoll_mutex_unlock (ctx->ref_mutex);
+		if (! __nopoll_conn_connect_advance (conn, NOPOLL_CONNECT_TCP, conn->ssl ? NOPOLL_CONNECT_TLS : NOPOLL_CONNECT_INIT))
+			return;
+	} /* end if */
+
+	if (conn->connect_stage == NOPOLL_CONNECT_TLS) {
+		result = SSL_connect (conn->ssl);
+		if (result <= 0) {
+			switch (SSL_get_error (conn->ssl, result)) {
+			case SSL_ERROR_WANT_READ:
+				__nopoll_conn_connect_wait (conn, NOPOLL_IO_READ);
+				return;
+			case SSL_ERROR_WANT_WRITE:
+				__nopoll_conn_connect_wait (conn, NOPOLL_IO_WRITE);
+				return;
+			default:
+				nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "there was an error with the TLS negotiation with %s:%s (conn id %d), errno=%d",
+					    conn->host, conn->port, conn->id, errno);
+				nopoll_conn_log_ssl (conn);
+				__nopoll_conn_connect_failed (conn);
+				return;
+			} /* end switch */
+		} /* end if */
+
+		if (! __nopoll_conn_tls_client_finish (ctx, conn)) {
+			__nopoll_conn_connect_failed (conn);
+			return;
+		} /* end if */
+		if (! __nopoll_conn_connect_advance (conn, NOPOLL_CONNECT_TLS, NOPOLL_CONNECT_INIT))
+			return;
+	} /* end if */
+
+	/* send client init (what is left) */
+	while (conn->connect_desp < conn->connect_size) {
+		result = conn->send (conn, conn->connect_content + conn->connect_desp, conn->connect_size - conn->connect_desp);
+		if (result <= 0) {
+			if (errno == NOPOLL_EWOULDBLOCK || errno == NOPOLL_EINPROGRESS || errno == NOPOLL_ENOTCONN) {
+				__nopoll_conn_connect_wait (conn, NOPOLL_IO_WRITE);
+				return;
+			} /* end if */
+
+			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Failed to send websocket init message, error code was: %d, closing session", errno);
+			__nopoll_conn_connect_failed (conn);
+			return;
+		} /* end if */
+		conn->connect_desp += result;
+	} /* end while */
+
+	nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Web socket initial client handshake sent (conn id %d)", conn->id);
+
+	/* now wait for the upgrade reply */
+	__nopoll_conn_connect_done (conn);
+	nopoll_io_update_conn (ctx, conn);
+	return;
+}
+
+/** 
+ * @internal Internal implementation used to do a connect.
+ */
+noPollConn * __nopoll_conn_new_common (noPollCtx       * ctx,
+				       noPollConnOpts  * options,
+				       noPollTransport   transport,
+				       nopoll_bool       enable_tls,
+				       int               socket,
+				       const char      * host_ip, 
+				       const char      * host_port, 
+				       const char      * host_name,
+				       const char      * get_url, 
+				       const char      * protocols,
+				       const char      * origin)
+{
+	noPollConn     * conn;
+	NOPOLL_SOCKET    session;
+	char           * content;
+	int              size;
+	int              ssl_error;
+	int              iterator;
+	long             remaining_timeout;
+
+	if (! ctx || ! host_ip) {
+		/* release connection options */
+		__nopoll_conn_opts_release_if_needed (options);
+		return NULL;
+	} /* end if */
+
+	/* set default connection port */
+	if (host_port == NULL)
+		host_port = "80";
+
+	session = socket;
+	/* create socket connection in a non block manner (unless the
+	 * loop does it, see nopoll_conn_opts_set_async_connect) */
+	if (session == NOPOLL_INVALID_SOCKET && ! (options && options->async_connect)) {
+		session = __nopoll_conn_sock_connect_opts_internal (ctx, transport, host_ip, host_port, options);
+		if (session == NOPOLL_INVALID_SOCKET) {
+			/* release connection options */
+			__nopoll_conn_opts_release_if_needed (options);
+			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Failed to connect to remote host %s:%s", host_ip, host_port);
+			return NULL;
+		} /* end if */
+	} /* end if */
+
+	/* create the connection */
+	conn = nopoll_new (noPollConn, 1);
+	if (conn == NULL) {
+		/* release connection options */
+		__nopoll_conn_opts_release_if_needed (options);
+		return NULL;
+	} /* end if */
+
+	conn->refs = 1;
+
+	/* create mutexes */
+#if !defined(NOPOLL_HAVE_ATOMIC_REFS)
+	conn->ref_mutex = nopoll_mutex_create ();
+#endif
+	conn->handshake_mutex = nopoll_mutex_create ();
+	conn->write_mutex = nopoll_mutex_create ();
+
+	/* configure context */
+	conn->ctx     = ctx;
+	conn->session = session;
+	conn->role    = NOPOLL_ROLE_CLIENT;
+
+	/* asynchronous connect: not watched by the loop until the
+	 * connection is created */
+	if (options && options->async_connect) {
+		conn->connect_stage = session == NOPOLL_INVALID_SOCKET ? NOPOLL_CONNECT_RESOLVE : NOPOLL_CONNECT_TCP;
+#if defined(NOPOLL_OS_WIN32)
+		nopoll_win32_gettimeofday (&conn->connect_start, NULL);
+#else
+		gettimeofday (&conn->connect_start, NULL);
+#endif
+	} /* end if */
+
+	/* register connection into context */
+	if (! nopoll_ctx_register_conn (ctx, conn)) {
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Failed to register connection into the context, unable to create connection");
+		nopoll_free (conn);
+		/* release connection options */
+		__nopoll_conn_opts_release_if_needed (options);
+
+		return NULL;
+	}
+
+	if (conn->connect_stage) {
+		nopoll_mutex_lock (ctx->ref_mutex);
+		ctx->conn_connecting++;
+		nopoll_mutex_unlock (ctx->ref_mutex);
+	} /* end if */
+
+	nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Created noPoll conn-id=%d (ptr: %p, context: %p, socket: %d)",
+		    conn->id, conn, ctx, session);
+
+	/* record host and port */
+	conn->host    = nopoll_strdup (host_ip);
+	conn->port    = nopoll_strdup (host_port);
+
+	/* configure default handlers */
+	conn->receive = nopoll_conn_default_receive;
+	conn->send    = nopoll_conn_default_send;
+
+	/* default write watermarks and limit */
+	__nopoll_conn_set_write_opts (conn, options);
+
+	/* build host name */
+	if (host_name == NULL)
+		conn->host_name = nopoll_strdup (host_ip);
+	else
+		conn->host_name = nopoll_strdup (host_name);
+
+	/* build origin */
+	if (origin == NULL)
+		conn->origin = nopoll_strdup_printf ("http://%s", conn->host_name);
+	else
+		conn->origin = nopoll_strdup (origin);
+
+	/* get url */
+	if (get_url == NULL)
+		conn->get_url = nopoll_strdup ("/");
+	else
+		conn->get_url = nopoll_strdup (get_url);
+
+	/* protocols */
+	if (protocols != NULL)
+		conn->protocols = nopoll_strdup (protocols);
+
+	/* default to no close frame received */
+	conn->peer_close_status = 1006;
+
+	/* get client init payload */
+	content = __nopoll_conn_get_client_init (conn, options);
+
+	if (content == NULL) {
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Failed to build client init message, unable to connect");
+		nopoll_conn_shutdown (conn);
+
+		/* release connection options */
+		__nopoll_conn_opts_release_if_needed (options);
+
+		return NULL;
+	} /* end if */
+
+	/* check for TLS support */
+	if (enable_tls) {
+		/* get ssl context (shared by client connections with
+		 * the same configuration) */
+		if (! __nopoll_conn_get_client_ssl_context (ctx, conn, options))
+			goto fail_ssl_connection;
+
+		/* create context and check for result */
+		conn->ssl      = SSL_new (conn->ssl_ctx);       
+		if (conn->ssl_ctx == NULL || conn->ssl == NULL) {
+			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to create SSL context internal references are null (conn->ssl_ctx=%p, conn->ssl=%p)",
+				    conn->ssl_ctx, conn->ssl);
+		fail_ssl_connection:
+
+			nopoll_free (content);
+			nopoll_conn_shutdown (conn);
+
+			/* release connection options */
+			__nopoll_conn_opts_release_if_needed (options);
+
+			return conn;
+		} /* end if */
+		
+		/* writes never block (see __nopoll_conn_tls_set_modes) */
+		__nopoll_conn_tls_set_modes (conn);
+
+		/* set server name indication (SNI) */
+		SSL_set_tlsext_host_name(conn->ssl, conn->host_name);
+
+		/* offer previous session (if any) */
+		__nopoll_conn_ssl_session_offer (ctx, conn, options);
+
+		/* request kernel TLS offload (if enabled) */
+		__nopoll_conn_ktls_enable (ctx, conn, options);
+
+		/* set socket (once the first connection attempt is
+		 * started if it is still being resolved) */
+		if (conn->session != NOPOLL_INVALID_SOCKET)
+			SSL_set_fd (conn->ssl, conn->session);
+
+		/* handshake done by the loop */
+		if (conn->connect_stage)
+			return __nopoll_conn_connect_start (ctx, conn, transport, content, options);
 
 		/* do the initial connect connect */
 		nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "connecting to remote TLS site %s:%s", conn->host, conn->port);
 		iterator = 0;
                 conn->pending_ssl_connect = nopoll_true;
+		nopoll_io_update_conn (ctx, conn);
 		while (SSL_connect (conn->ssl) <= 0) {
 		
 			/* get ssl error */
@@ -1012,40 +2462,21 @@ noPollConn * __nopoll_conn_new_common (noPollCtx       * ctx,
 
 		} /* end while */
 
-		nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Client TLS handshake finished, configuring I/O handlers");
-
-		/* check remote certificate (if it is present) */
-		server_cert = SSL_get_peer_certificate (conn->ssl);
-		if (server_cert == NULL) {
-			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "server side didn't set a certificate for this session, these are bad news");
-
+		if (! __nopoll_conn_tls_client_finish (ctx, conn)) {
 			/* release connection options */
 			nopoll_free (content);
 			__nopoll_conn_opts_release_if_needed (options);
 
-			return conn;
-		}
-		X509_free (server_cert);
-
-		/* call to check post ssl checks after SSL finalization */
-		if (conn->ctx && conn->ctx->post_ssl_check) {
-			if (! conn->ctx->post_ssl_check (conn->ctx, conn, conn->ssl_ctx, conn->ssl, conn->ctx->post_ssl_check_data)) {
-				/* TLS post check failed */
-				nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, "TLS/SSL post check function failed, dropping connection");
-				nopoll_conn_shutdown (conn);
-				return NULL;
-			} /* end if */
+			return nopoll_conn_is_ok (conn) ? conn : NULL;
 		} /* end if */
-
-		/* configure default handlers */
-		conn->receive = nopoll_conn_tls_receive;
-		conn->send    = nopoll_conn_tls_send;
-
-		nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "TLS I/O handlers configured");
                 conn->pending_ssl_connect = nopoll_false;
-		conn->tls_on = nopoll_true;
+		nopoll_io_update_conn (ctx, conn);
 	} /* end if */
 
+	/* client init sent by the loop */
+	if (conn->connect_stage)
+		return __nopoll_conn_connect_start (ctx, conn, transport, content, options);
+
 	nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Sending websocket client init: %s", content);
 	size = strlen (content);
 
@@ -1530,13 +2961,8 @@ nopoll_bool    nopoll_conn_ref (noPollConn * conn)
 	if (conn == NULL)
 		return nopoll_false;
 
-	/* lock the mutex */
-	nopoll_mutex_lock (conn->ref_mutex);
-	conn->refs++;
-	nopoll_mutex_unlock (conn->ref_mutex);
-		
 	/* report */
-	return conn->refs > 1;
+	return nopoll_ref_inc (&conn->refs, conn->ref_mutex) > 1;
 }
 
 /** 
@@ -1551,7 +2977,7 @@ int            nopoll_conn_ref_count (noPollConn * conn)
 {
 	if (! conn)
 		return -1;
-	return conn->refs;
+	return nopoll_ref_get (&conn->refs, conn->ref_mutex);
 }
 
 /** 
@@ -1570,6 +2996,9 @@ int            nopoll_conn_ref_count (noPollConn * conn)
  * session establishment didn't take place and hence
  * nopoll_conn_is_ready will fail.
  *
+ * Asynchronous connections (see \ref nopoll_conn_opts_set_async_connect)
+ * are reported as ok while their host name is being resolved.
+ *
  * Please, see the following link for a complete example that connects
  * and ensure the connection is ready (for a client):  http://www.aspl.es/nopoll/html/nopoll_core_library_manual.html#creating_basic_web_socket_client
  *
@@ -1584,7 +3013,7 @@ nopoll_bool    nopoll_conn_is_ok (noPollConn * conn)
 		return nopoll_false;
 
 	/* return current socket status */
-	return conn->session != NOPOLL_INVALID_SOCKET;
+	return conn->session != NOPOLL_INVALID_SOCKET || conn->connect_stage == NOPOLL_CONNECT_RESOLVE;
 }
 
 /** 
@@ -1635,6 +3064,35 @@ nopoll_bool    nopoll_conn_is_tls_on (noPollConn * conn)
 	return conn->tls_on;
 }
 
+/** 
+ * @brief Allows to check if TLS records of the provided connection
+ * are handled by the kernel (see \ref nopoll_conn_opts_set_ktls).
+ *
+ * @param conn The connection to check.
+ *
+ * @param send Optional reference where it is reported if sending is
+ * offloaded.
+ *
+ * @param recv Optional reference where it is reported if receiving
+ * is offloaded.
+ *
+ * @return nopoll_true if the kernel handles sending and/or receiving
+ * for this connection, otherwise nopoll_false is returned (including
+ * when offload wasn't requested, the handshake isn't finished or the
+ * negotiated cipher isn't supported by the kernel).
+ */
+nopoll_bool    nopoll_conn_is_ktls_on (noPollConn * conn, nopoll_bool * send, nopoll_bool * recv)
+{
+	if (send)
+		(*send) = conn ? conn->ktls_send : nopoll_false;
+	if (recv)
+		(*recv) = conn ? conn->ktls_recv : nopoll_false;
+	if (! conn)
+		return nopoll_false;
+
+	return conn->ktls_send || conn->ktls_recv;
+}
+
 /** 
  * @brief Allows to get the socket associated to this nopoll
  * connection.
@@ -1658,9 +3116,16 @@ NOPOLL_SOCKET nopoll_conn_socket (noPollConn * conn)
  */
 void           nopoll_conn_set_socket (noPollConn * conn, NOPOLL_SOCKET _socket)
 {
+	nopoll_bool watched;
+
 	if (conn == NULL)
 		return;
+
+	/* update io engine registration (if any) */
+	watched       = nopoll_io_remove_conn (conn->ctx, conn);
 	conn->session = _socket;
+	if (watched)
+		nopoll_io_add_conn (conn->ctx, conn);
 	return;
 }
 
@@ -1929,6 +3394,9 @@ const char * nopoll_conn_get_x_real_ip_header (noPollConn * conn)
  */
 void          nopoll_conn_shutdown (noPollConn * conn)
 {
+	nopoll_bool    resolving;
+	NOPOLL_SOCKET  session;
+	SSL          * ssl;
 #if defined(SHOW_DEBUG_LOG)
 	const char * role = NULL;
 #endif
@@ -1953,20 +3421,62 @@ void          nopoll_conn_shutdown (noPollConn * conn)
 		    conn->id, conn->session, role);
 #endif
 
+	/* stop asynchronous connect (if any): under ctx->ref_mutex
+	 * so a resolver thread either handed the socket to the loop
+	 * already (and it is removed below) or drops it (connection
+	 * attempts in progress are closed too) */
+	nopoll_mutex_lock (conn->ctx->ref_mutex);
+	resolving = conn->connect_stage == NOPOLL_CONNECT_RESOLVE;
+	__nopoll_conn_connect_done_locked (conn);
+	session   = conn->shutdown_started ? NOPOLL_INVALID_SOCKET : conn->session;
+	ssl       = conn->ssl;
+	if (session != NOPOLL_INVALID_SOCKET)
+		conn->shutdown_started = nopoll_true;
+	nopoll_mutex_unlock (conn->ctx->ref_mutex);
+
 	/* call to on close handler if defined */
-	if (conn->session != NOPOLL_INVALID_SOCKET && conn->on_close)
+	if ((session != NOPOLL_INVALID_SOCKET || resolving) && conn->on_close)
 	        conn->on_close (conn->ctx, conn, conn->on_close_data);
 
+	/* not watched by the loop yet (still being resolved):
+	 * unregister it */
+	if (resolving && session == NOPOLL_INVALID_SOCKET)
+		nopoll_ctx_unregister_conn (conn->ctx, conn);
+
 	/* shutdown connection here */
-	if (conn->session != NOPOLL_INVALID_SOCKET) {
-	        shutdown (conn->session, SHUT_RDWR);
-		nopoll_close_socket (conn->session);
+	if (session != NOPOLL_INVALID_SOCKET) {
+		/* stop watching the socket before closing it and
+		 * signal the loop to unregister the connection */
+		nopoll_io_shutdown_conn (conn->ctx, conn);
+
+		/* notify TLS close, otherwise the session can't be
+		 * resumed */
+		if (ssl && SSL_is_init_finished (ssl)) {
+			SSL_shutdown (ssl);
+			ERR_clear_error ();
+		} /* end if */
+
+	        shutdown (session, SHUT_RDWR);
+		nopoll_close_socket (session);
+
+		nopoll_mutex_lock (conn->ctx->ref_mutex);
+		conn->session = NOPOLL_INVALID_SOCKET;
+		nopoll_mutex_unlock (conn->ctx->ref_mutex);
 	}
-	conn->session = NOPOLL_INVALID_SOCKET;
 
 	return;
 }
 
+/** 
+ * @internal Returns if the provided connection is watched by a loop
+ * (nopoll_loop_wait or nopoll_loop_run_threads), which writes content
+ * queued when the socket is writable.
+ */
+nopoll_bool __nopoll_conn_loop_watched (noPollConn * conn)
+{
+	return conn->io_watched;
+}
+
 /** 
  * @brief Allows to close an opened \ref noPollConn no matter its role
  * (\ref noPollRole).
@@ -1982,7 +3492,6 @@ void          nopoll_conn_shutdown (noPollConn * conn)
  */ 
 void          nopoll_conn_close_ext  (noPollConn  * conn, int status, const char * reason, int reason_size)
 {
-	int    refs;
 	char * content;
 #if defined(SHOW_DEBUG_LOG)
 	const char * role = "unknown";
@@ -2031,12 +3540,72 @@ void          nopoll_conn_close_ext  (noPollConn  * conn, int status, const char
 		/* release content (if defined) */
 		nopoll_free (content);
 
-		/* call to shutdown connection */
-		nopoll_conn_shutdown (conn);
+		/* a loop watching the connection writes content still
+		 * queued and finishes the close (see
+		 * __nopoll_conn_close_check) */
+		if (nopoll_conn_pending_write_bytes (conn) > 0 && __nopoll_conn_loop_watched (conn)) {
+			__nopoll_conn_close_defer (conn);
+			return;
+		} /* end if */
+
+		/* write content still queued before closing */
+		if (nopoll_conn_pending_write_bytes (conn) > 0)
+			nopoll_conn_flush_writes (conn, NOPOLL_CONN_SEND_WAIT, 0);
+	} /* end if */
+
+	__nopoll_conn_close_finish (conn);
+	return;	
+}
+
+/** 
+ * @internal Leaves the close of the provided connection to the loop
+ * watching it, which only waits it to be writable from now on.
+ */
+void __nopoll_conn_close_defer (noPollConn * conn)
+{
+	nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "close of conn id=%d left to the loop (%d bytes queued)",
+		    conn->id, nopoll_conn_pending_write_bytes (conn));
+
+#if defined(NOPOLL_OS_WIN32)
+	nopoll_win32_gettimeofday (&conn->close_start, NULL);
+#else
+	gettimeofday (&conn->close_start, NULL);
+#endif
+	nopoll_mutex_lock (conn->ctx->ref_mutex);
+	conn->close_pending = nopoll_true;
+	conn->ctx->conn_closing++;
+	nopoll_mutex_unlock (conn->ctx->ref_mutex);
+
+	/* watch the socket for writes only */
+	nopoll_io_update_conn (conn->ctx, conn);
+	return;
+}
+
+/** 
+ * @internal Finishes the close of the provided connection: closes
+ * the socket, unregisters it from its context and releases the
+ * reference the context owns.
+ */
+void __nopoll_conn_close_finish (noPollConn * conn)
+{
+	int refs;
+
+	nopoll_mutex_lock (conn->ctx->ref_mutex);
+	if (conn->close_pending) {
+		conn->close_pending = nopoll_false;
+		conn->ctx->conn_closing--;
 	} /* end if */
+	nopoll_mutex_unlock (conn->ctx->ref_mutex);
+
+	/* call to shutdown connection (also when it has no socket
+	 * yet, to stop its asynchronous connect) */
+	nopoll_conn_shutdown (conn);
 
-	/* unregister connection from context */
-	refs = nopoll_conn_ref_count (conn);
+	/* unregister connection from context (references held by
+	 * registry snapshots are released on their own) */
+	nopoll_mutex_lock (conn->ctx->ref_mutex);
+	refs = nopoll_conn_ref_count (conn) - conn->snapshot_refs;
+	nopoll_mutex_unlock (conn->ctx->ref_mutex);
 	nopoll_ctx_unregister_conn (conn->ctx, conn);
 
 	/* avoid calling next unref in the case not enough references
@@ -2047,7 +3616,42 @@ void          nopoll_conn_close_ext  (noPollConn  * conn, int status, const char
 	/* call to unref connection */
 	nopoll_conn_unref (conn);
 
-	return;	
+	return;
+}
+
+/** 
+ * @internal Called by the loop on connections whose close was left
+ * to it (see __nopoll_conn_close_defer): finishes the close once the
+ * queue is written, the last write failed (failed) or
+ * NOPOLL_CONN_SEND_WAIT elapsed. Once the loop stops watching the
+ * connection, the queue is flushed here and the close finished.
+ *
+ * @return nopoll_true if the close was finished (the connection may
+ * no longer be used).
+ */
+nopoll_bool __nopoll_conn_close_check (noPollConn * conn, nopoll_bool failed)
+{
+	long remaining;
+
+	if (! conn->close_pending)
+		return nopoll_false;
+
+	/* the loop stopped watching it: write what is left here */
+	if (! conn->io_watched && ! failed && nopoll_conn_is_ok (conn)) {
+		remaining = NOPOLL_CONN_SEND_WAIT - __nopoll_conn_ellapsed (&conn->close_start);
+		if (remaining > 0 && nopoll_conn_pending_write_bytes (conn) > 0)
+			nopoll_conn_flush_writes (conn, remaining, 0);
+		failed = nopoll_true;
+	} /* end if */
+
+	if (! failed && nopoll_conn_is_ok (conn) && nopoll_conn_pending_write_bytes (conn) > 0 &&
+	    __nopoll_conn_ellapsed (&conn->close_start) < NOPOLL_CONN_SEND_WAIT)
+		return nopoll_false;
+
+	nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "finishing close of conn id=%d (%d bytes still queued)",
+		    conn->id, nopoll_conn_pending_write_bytes (conn));
+	__nopoll_conn_close_finish (conn);
+	return nopoll_true;
 }
 
 /** 
@@ -2113,16 +3717,10 @@ void nopoll_conn_unref (noPollConn * conn)
 	if (conn == NULL)
 		return;
 
-	/* acquire here the mutex */
-	nopoll_mutex_lock (conn->ref_mutex);
-
-	conn->refs--;
-	value = conn->refs;
+	value = nopoll_ref_dec (&conn->refs, conn->ref_mutex);
 	
 	nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Releasing connection id %d reference, current ref count status is: %d", 
 		    conn->id, value);
-	/* release here the mutex */
-	nopoll_mutex_unlock (conn->ref_mutex);
 	
 	if (value != 0) 
 		return;
@@ -2131,6 +3729,14 @@ void nopoll_conn_unref (noPollConn * conn)
 	if (conn->pending_msg)
 		nopoll_msg_unref (conn->pending_msg);
 
+	/* release ssl contexts configured for the listener (shared
+	 * with the listeners created to share its port) */
+	if (conn->ctx && conn->role == NOPOLL_ROLE_MAIN_LISTENER && conn->listener_origin == 0)
+		nopoll_ctx_invalidate_ssl_contexts (conn->ctx, conn);
+
+	/* finish asynchronous connect (if any) */
+	__nopoll_conn_connect_done (conn);
+
 	/* release ctx */
 	if (conn->ctx) {
 		nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Released context refs, now: %d", conn->ctx->refs);
@@ -2164,6 +3770,7 @@ void nopoll_conn_unref (noPollConn * conn)
 		SSL_free (conn->ssl);
 	if (conn->ssl_ctx)
 		SSL_CTX_free (conn->ssl_ctx);
+	nopoll_free (conn->ssl_session_key);
 
 	/* release handshake internal data */
 	if (conn->handshake) {
@@ -2179,32 +3786,182 @@ void nopoll_conn_unref (noPollConn * conn)
 	if (conn->opts && ! conn->opts->reuse)
 		nopoll_conn_opts_free (conn->opts);
 
-	/* release pending write buffer */
-	nopoll_free (conn->pending_write);
+	/* release queued frames */
+	__nopoll_conn_queue_free (conn);
+
+	/* release read buffer */
+	nopoll_free (conn->read_buf);
 
 	/* release mutexes */
 	nopoll_mutex_destroy (conn->handshake_mutex);
+	nopoll_mutex_destroy (conn->write_mutex);
+#if !defined(NOPOLL_HAVE_ATOMIC_REFS)
 	nopoll_mutex_destroy (conn->ref_mutex);
+#endif
 
 	nopoll_free (conn);	
 
 	return;
 }
 
+/** 
+ * @internal Flags used to read from the connection socket: reads on
+ * connections watched by a loop never block (accepted sockets are
+ * blocking), they report NOPOLL_EWOULDBLOCK instead.
+ */
+#if defined(MSG_DONTWAIT)
+#define NOPOLL_CONN_RECV_FLAGS(conn) (__nopoll_conn_loop_watched (conn) ? MSG_DONTWAIT : 0)
+#else
+#define NOPOLL_CONN_RECV_FLAGS(conn) (0)
+#endif
+
 /** 
  * @internal Default connection receive until handshake is complete.
  */
 int nopoll_conn_default_receive (noPollConn * conn, char * buffer, int buffer_size)
 {
-	return recv (conn->session, buffer, buffer_size, 0);
+	return recv (conn->session, buffer, buffer_size, NOPOLL_CONN_RECV_FLAGS (conn));
 }
 
+/** 
+ * @internal Flags used to write on the connection socket: writes on
+ * connections watched by a loop never block (accepted sockets are
+ * blocking), content not written is queued instead.
+ */
+#if defined(MSG_DONTWAIT)
+#define NOPOLL_CONN_SEND_FLAGS(conn) (__nopoll_conn_loop_watched (conn) ? MSG_DONTWAIT : 0)
+#else
+#define NOPOLL_CONN_SEND_FLAGS(conn) (0)
+#endif
+
 /** 
  * @internal Default connection send until handshake is complete.
  */
 int nopoll_conn_default_send (noPollConn * conn, char * buffer, int buffer_size)
 {
-	return send (conn->session, buffer, buffer_size, 0);
+	return send (conn->session, buffer, buffer_size, NOPOLL_CONN_SEND_FLAGS (conn));
+}
+
+/** 
+ * @internal Sends a frame header and its payload as two separate
+ * buffers with a single gather write (writev/WSASend), skipping the
+ * first desp bytes already written. Only usable on connections
+ * using \ref nopoll_conn_default_send.
+ *
+ * @return Bytes written (including header), or the same values
+ * reported by send().
+ */
+int __nopoll_conn_default_sendv (noPollConn * conn, const char * header, int header_size,
+				 const char * payload, int payload_size, int desp)
+{
+#if defined(NOPOLL_OS_WIN32)
+	WSABUF         iov[2];
+	DWORD          written = 0;
+#else
+	struct iovec   iov[2];
+	struct msghdr  msg;
+#endif
+	int            count   = 0;
+
+	if (desp < header_size) {
+#if defined(NOPOLL_OS_WIN32)
+		iov[count].buf = (char *) header + desp;
+		iov[count].len = header_size - desp;
+#else
+		iov[count].iov_base = (char *) header + desp;
+		iov[count].iov_len  = header_size - desp;
+#endif
+		count++;
+		desp = 0;
+	} else
+		desp -= header_size;
+
+	if (payload_size > desp) {
+#if defined(NOPOLL_OS_WIN32)
+		iov[count].buf = (char *) payload + desp;
+		iov[count].len = payload_size - desp;
+#else
+		iov[count].iov_base = (char *) payload + desp;
+		iov[count].iov_len  = payload_size - desp;
+#endif
+		count++;
+	} /* end if */
+
+	if (count == 0)
+		return 0;
+
+#if defined(NOPOLL_OS_WIN32)
+	if (WSASend (conn->session, iov, count, &written, 0, NULL, NULL) != 0)
+		return -1;
+	return (int) written;
+#else
+	memset (&msg, 0, sizeof (struct msghdr));
+	msg.msg_iov    = iov;
+	msg.msg_iovlen = count;
+	return sendmsg (conn->session, &msg, NOPOLL_CONN_SEND_FLAGS (conn));
+#endif
+}
+
+/** 
+ * @internal Waits (up to timeout microseconds) until the connection
+ * socket is writable.
+ *
+ * @return nopoll_true if the socket is writable (or failed, to let
+ * the next write report the error), otherwise nopoll_false.
+ */
+nopoll_bool __nopoll_conn_wait_writable (noPollConn * conn, long timeout)
+{
+#if defined(NOPOLL_HAVE_POLL)
+	struct pollfd    fds;
+
+	fds.fd      = conn->session;
+	fds.events  = POLLOUT;
+	fds.revents = 0;
+	return poll (&fds, 1, (int) ((timeout + 999) / 1000)) != 0;
+#else
+	fd_set           wset;
+	struct timeval   tv;
+
+	if (conn->session < 0 || conn->session >= FD_SETSIZE)
+		return nopoll_true;
+	FD_ZERO (&wset);
+	FD_SET (conn->session, &wset);
+	tv.tv_sec  = timeout / 1000000;
+	tv.tv_usec = timeout % 1000000;
+	return select (conn->session + 1, NULL, &wset, NULL, &tv) != 0;
+#endif
+}
+
+/**
+ * @internal Closes the provided connection if its asynchronous
+ * connect failed before being handed to the loop or didn't finish
+ * within the connect timeout (see nopoll_conn_connect_timeout). It
+ * also checks connection attempts in progress (see
+ * __nopoll_conn_connect_attempts_check).
+ */
+void __nopoll_conn_connect_check_timeout (noPollConn * conn)
+{
+	if (conn->connect_failed) {
+		__nopoll_conn_connect_failed (conn);
+		return;
+	} /* end if */
+
+	if (conn->connect_stage == NOPOLL_CONNECT_TCP && conn->connect_attempts) {
+		__nopoll_conn_connect_attempts_check (conn);
+		if (conn->connect_stage == NOPOLL_CONNECT_DONE)
+			return;
+	} /* end if */
+
+	/* skip connections still being created */
+	if (conn->connect_stage == NOPOLL_CONNECT_DONE || (conn->connect_events == 0 && conn->connect_content == NULL))
+		return;
+	if (__nopoll_conn_ellapsed (&conn->connect_start) < conn->ctx->conn_connect_std_timeout)
+		return;
+
+	nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, "Connect to %s:%s timed out (conn id %d, stage %d)",
+		    conn->host, conn->port, conn->id, conn->connect_stage);
+	__nopoll_conn_connect_failed (conn);
+	return;
 }
 
 /** 
@@ -2326,63 +4083,16 @@ noPollConn  * nopoll_conn_get_listener (noPollConn * conn)
 	return conn->listener;
 }
 
-void __nopoll_pack_content (char * buffer, int start, int bytes)
-{
-	int iterator = 0;
-	while (iterator < bytes) {
-		/* copy bytes to the begining of the array */
-		buffer[iterator] = buffer[start + iterator];
-		
-		/* next position */
-		iterator++;
-	} /* end while */
-
-	return;
-}
-
 /** 
- * @internal Function used to read bytes from the wire. 
+ * @internal Function used to read bytes from the wire (skipping the
+ * connection read buffer).
  *
  * @return The function returns the number of bytes read, 0 when no
  * bytes were available and -1 when it fails.
  */
-int         __nopoll_conn_receive  (noPollConn * conn, char  * buffer, int  maxlen)
+int         __nopoll_conn_receive_wire  (noPollConn * conn, char  * buffer, int  maxlen)
 {
 	int         nread;
-	int         bytes;
-
-	if (conn->pending_buf_bytes > 0) {
-		nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Calling with bytes we can reuse (%d), requested: %d",
-			    conn->pending_buf_bytes, maxlen);
-
-		if (conn->pending_buf_bytes >= maxlen) {
-			/* we have more in the buffer to serve than
-			 * requested, ok, copy into the buffer and
-			 * pack */
-
-			memcpy (buffer, conn->pending_buf, maxlen);
-			__nopoll_pack_content (conn->pending_buf, maxlen, conn->pending_buf_bytes - maxlen);
-			conn->pending_buf_bytes -= maxlen;
-			return maxlen;
-		} 
-
-		/* ok, we don't have enough bytes to serve
-		 * directly, so copy what we have */
-		memcpy (buffer, conn->pending_buf, conn->pending_buf_bytes);
-
-		/* copy number of bytes served to reduce next request */
-		nread = conn->pending_buf_bytes;
-		conn->pending_buf_bytes = 0;
-
-		/* call again to get bytes reducing the request in the
-		 * amount of bytes served */
-		bytes = __nopoll_conn_receive (conn, buffer + nread, maxlen - nread);
-		if (bytes < 0) {
-			return -1;
-		}
-
-		return bytes + nread;
-	} /* end if */
 
  keep_reading:
 	/* clear buffer */
@@ -2394,10 +4104,10 @@ int         __nopoll_conn_receive  (noPollConn * conn, char  * buffer, int  maxl
 #endif
 	if ((nread = conn->receive (conn, buffer, maxlen)) < 0) {
 		/* nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, " returning errno=%d (%s)", errno, strerror (errno)); */
-		if (errno == NOPOLL_EAGAIN) 
-			return 0;
-		if (errno == NOPOLL_EWOULDBLOCK) 
+		if (errno == NOPOLL_EAGAIN || errno == NOPOLL_EWOULDBLOCK) {
+			conn->wire_drained = nopoll_true;
 			return 0;
+		} /* end if */
 		if (errno == NOPOLL_EINTR) 
 			goto keep_reading;
 		
@@ -2412,6 +4122,7 @@ int         __nopoll_conn_receive  (noPollConn * conn, char  * buffer, int  maxl
 		if (errno == NOPOLL_EAGAIN || errno == NOPOLL_EWOULDBLOCK) {
 			nopoll_log (conn->ctx, NOPOLL_LEVEL_WARNING, "unable to read from conn-id=%d (%s:%s), connection is not ready (errno: %d : %s)",
 				    conn->id, conn->host, conn->port, errno, strerror (errno));
+			conn->wire_drained = nopoll_true;
 			return 0;
 		} /* end if */
 
@@ -2421,9 +4132,178 @@ int         __nopoll_conn_receive  (noPollConn * conn, char  * buffer, int  maxl
 		nopoll_conn_shutdown (conn);
 	} /* end if */
 
+	/* a short read leaves the socket without input (most of the
+	 * time): next reads can be skipped until it is readable */
+	conn->wire_drained = nread < maxlen;
+
 	return nread;
 }
 
+/** 
+ * @internal Moves up to maxlen bytes from the connection read buffer
+ * into the provided buffer.
+ *
+ * @return Number of bytes moved.
+ */
+int         __nopoll_conn_buffer_take (noPollConn * conn, char * buffer, int maxlen)
+{
+	int bytes = conn->read_buf_end - conn->read_buf_start;
+
+	if (bytes <= 0)
+		return 0;
+	if (bytes > maxlen)
+		bytes = maxlen;
+
+	memcpy (buffer, conn->read_buf + conn->read_buf_start, bytes);
+	conn->read_buf_start += bytes;
+	if (conn->read_buf_start == conn->read_buf_end) {
+		/* buffer consumed */
+		conn->read_buf_start = 0;
+		conn->read_buf_end   = 0;
+	} /* end if */
+
+	return bytes;
+}
+
+/** 
+ * @internal Reads from the wire into the connection read buffer
+ * (created on first use with the size configured on the context, see
+ * nopoll_ctx_set_read_buffer_size), getting as many bytes as
+ * available with a single read operation.
+ *
+ * @return Bytes read, 0 when no bytes were available and -1 when it
+ * fails.
+ */
+int         __nopoll_conn_buffer_fill (noPollConn * conn)
+{
+	int bytes;
+
+	if (conn->read_buf == NULL) {
+		conn->read_buf_size = conn->ctx->read_buffer_size;
+		conn->read_buf      = nopoll_new (char, conn->read_buf_size);
+		if (conn->read_buf == NULL) {
+			nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, "Unable to acquire memory for the read buffer, dropping connection id=%d", conn->id);
+			nopoll_conn_shutdown (conn);
+			return -1;
+		} /* end if */
+	} /* end if */
+
+	/* move bytes pending to be consumed to the beginning */
+	if (conn->read_buf_start > 0) {
+		memmove (conn->read_buf, conn->read_buf + conn->read_buf_start, conn->read_buf_end - conn->read_buf_start);
+		conn->read_buf_end   -= conn->read_buf_start;
+		conn->read_buf_start  = 0;
+	} /* end if */
+
+	if (conn->read_buf_end == conn->read_buf_size)
+		return 0;
+
+	bytes = __nopoll_conn_receive_wire (conn, conn->read_buf + conn->read_buf_end, conn->read_buf_size - conn->read_buf_end);
+	if (bytes > 0)
+		conn->read_buf_end += bytes;
+
+	return bytes;
+}
+
+/** 
+ * @internal Function used to read bytes from the connection: bytes
+ * already received on the read buffer are served first. Small reads
+ * fill the read buffer with a single read operation (getting next
+ * frames too) while big reads are done directly into the caller
+ * buffer.
+ *
+ * @return The function returns the number of bytes read, 0 when no
+ * bytes were available and -1 when it fails.
+ */
+int         __nopoll_conn_receive  (noPollConn * conn, char  * buffer, int  maxlen)
+{
+	int         served;
+	int         bytes;
+
+	/* serve bytes already received */
+	served = __nopoll_conn_buffer_take (conn, buffer, maxlen);
+	if (served == maxlen)
+		return served;
+
+	/* do not block the caller once some bytes were served */
+	if (served > 0 && ! __nopoll_conn_wire_pending (conn))
+		return served;
+
+	if ((maxlen - served) < (conn->read_buf ? conn->read_buf_size : conn->ctx->read_buffer_size)) {
+		/* small read: fill the read buffer */
+		bytes = __nopoll_conn_buffer_fill (conn);
+		if (bytes < 0)
+			return -1;
+
+		return served + __nopoll_conn_buffer_take (conn, buffer + served, maxlen - served);
+	} /* end if */
+
+	/* big read: read directly into the caller buffer */
+	bytes = __nopoll_conn_receive_wire (conn, buffer + served, maxlen - served);
+	if (bytes < 0)
+		return -1;
+
+	return served + bytes;
+}
+
+/** 
+ * @internal Returns the size of the frame header starting at the
+ * provided bytes (2 when it can't be known with the bytes available).
+ */
+int         __nopoll_conn_header_size (const char * header, int available)
+{
+	int size = 2;
+
+	if (available < 2)
+		return size;
+
+	/* extended payload length */
+	if ((header[1] & 0x7F) == 126)
+		size += 2;
+	else if ((header[1] & 0x7F) == 127)
+		size += 8;
+
+	/* masking key */
+	if (nopoll_get_bit (header[1], 7))
+		size += 4;
+
+	return size;
+}
+
+/** 
+ * @internal Makes the next frame header completely available on the
+ * connection read buffer, reading from the wire if required. Bytes
+ * of an incomplete header are kept on the read buffer until the rest
+ * is received.
+ *
+ * @return The header size, 0 if it wasn't completely received yet or
+ * -1 if it fails.
+ */
+int         __nopoll_conn_read_header (noPollConn * conn)
+{
+	int available;
+	int size;
+	int bytes;
+
+	while (nopoll_true) {
+		available = conn->read_buf_end - conn->read_buf_start;
+		size      = __nopoll_conn_header_size (conn->read_buf + conn->read_buf_start, available);
+		if (available >= size)
+			return size;
+
+		/* do not block the caller once part of the header
+		 * was received (wait for the rest) */
+		if (available > 0 && ! __nopoll_conn_wire_pending (conn))
+			return 0;
+
+		bytes = __nopoll_conn_buffer_fill (conn);
+		if (bytes <= 0)
+			return bytes;
+	} /* end while */
+
+	return 0;
+}
+
 nopoll_bool nopoll_conn_get_http_url (noPollConn * conn, const char * buffer, int buffer_size, const char * method, char ** url)
 {
 	int          iterator;
@@ -2988,78 +4868,324 @@ void nopoll_conn_complete_handshake (noPollConn * conn)
 	int         buffer_size;
 	noPollCtx * ctx = conn->ctx;
 
-	/* ensure we didn't complete handshake */
-	if (conn->handshake_ok)
+	/* ensure we didn't complete handshake (or the connection
+	 * is still connecting) */
+	if (conn->handshake_ok || conn->connect_stage)
 		return;
 
 	nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Checking to complete conn-id=%d WebSocket handshake, role %d", conn->id, conn->role);
 
-	/* ensure handshake object is created */
-	if (conn->handshake == NULL)
-		conn->handshake = nopoll_new (noPollHandShake, 1);
+	/* ensure handshake object is created */
+	if (conn->handshake == NULL)
+		conn->handshake = nopoll_new (noPollHandShake, 1);
+
+	/* get lines and complete the handshake data */
+	while (nopoll_true) {
+		/* clear buffer for debugging functions */
+		buffer[0] = 0;
+
+		/* get next line to process: for
+		   NOPOLL_HANDSHAKE_BUFFER_SIZE definition, see
+		   nopoll_decl.h */
+		buffer_size = nopoll_conn_readline (conn, buffer, NOPOLL_HANDSHAKE_BUFFER_SIZE);
+		if (buffer_size == 0 || buffer_size == -1) {
+			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unexpected connection close during handshake..closing connection");
+			nopoll_conn_shutdown (conn);
+			return;
+		} /* end if */
+
+		/* no data at this moment, return to avoid consuming data */
+		if (buffer_size == -2) {
+			nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "No more data available on connection id %d", conn->id);
+			return;
+		}
+
+		/* drop a debug line */
+		nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Bytes read %d from connection id %d: %s", buffer_size, conn->id, buffer);  
+			
+		/* check if we have received the end of the
+		   websocket client handshake */
+		if (buffer_size == 2 && nopoll_ncmp (buffer, "\r\n", 2)) {
+			nopoll_conn_complete_handshake_check (conn);
+			return;
+		}
+
+		if (conn->role == NOPOLL_ROLE_LISTENER) {
+			/* call to complete listener handshake */
+			if (nopoll_conn_complete_handshake_listener (ctx, conn, buffer, buffer_size) == 1)
+				continue;
+		} else if (conn->role == NOPOLL_ROLE_CLIENT) {
+			/* call to complete listener handshake */
+			if (nopoll_conn_complete_handshake_client (ctx, conn, buffer, buffer_size) == 1)
+				continue;
+		} else {
+			nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Called to handle connection handshake on a connection with an unexpected role: %d, closing session",
+				    conn->role);
+			nopoll_conn_shutdown (conn);
+			return;
+		}
+	} /* end while */
+
+	return;
+}
+
+/* masking kernels: all of them xor the payload against the mask
+ * rotated by desp, the wide ones using a pattern built with the
+ * mask rotated to the position where the wide loop starts (8, 16 or
+ * 32 bytes are always a multiple of the 4 bytes mask) */
+typedef void (*noPollMaskKernel) (char * payload, int payload_size, const char * mask, int desp);
+
+static void __nopoll_conn_mask_bytes (char * payload, int payload_size, const char * mask, int desp)
+{
+	int iter = 0;
+
+	while (iter < payload_size) {
+		/* rotate mask and apply it */
+		payload[iter] ^= mask[(iter + desp) & 3];
+		iter++;
+	} /* end while */
+
+	return;
+}
+
+static void __nopoll_conn_mask_pattern (unsigned char * pattern, int pattern_size, const char * mask, int desp)
+{
+	int iter;
+
+	for (iter = 0; iter < pattern_size; iter++)
+		pattern[iter] = (unsigned char) mask[(iter + desp) & 3];
+	return;
+}
+
+static void __nopoll_conn_mask_word64 (char * payload, int payload_size, const char * mask, int desp)
+{
+	unsigned char      pattern[8];
+	unsigned long long word_mask;
+	unsigned long long word;
+	int                head;
+	int                iter;
+
+	/* unmask until payload is word aligned */
+	head = (int) ((8 - ((unsigned long) payload & 7)) & 7);
+	if (head > payload_size)
+		head = payload_size;
+	__nopoll_conn_mask_bytes (payload, head, mask, desp);
+
+	__nopoll_conn_mask_pattern (pattern, 8, mask, desp + head);
+	memcpy (&word_mask, pattern, 8);
+
+	iter = head;
+	while (iter + 8 <= payload_size) {
+		memcpy (&word, payload + iter, 8);
+		word ^= word_mask;
+		memcpy (payload + iter, &word, 8);
+		iter += 8;
+	} /* end while */
+
+	/* remaining bytes */
+	__nopoll_conn_mask_bytes (payload + iter, payload_size - iter, mask, desp + iter);
+	return;
+}
+
+#if defined(NOPOLL_MASK_SSE2)
+static void __nopoll_conn_mask_sse2 (char * payload, int payload_size, const char * mask, int desp)
+{
+	unsigned char pattern[16];
+	__m128i       vector_mask;
+	__m128i       vector;
+	int           head;
+	int           iter;
+
+	head = (int) ((16 - ((unsigned long) payload & 15)) & 15);
+	if (head > payload_size)
+		head = payload_size;
+	__nopoll_conn_mask_bytes (payload, head, mask, desp);
+
+	__nopoll_conn_mask_pattern (pattern, 16, mask, desp + head);
+	vector_mask = _mm_loadu_si128 ((const __m128i *) pattern);
+
+	iter = head;
+	while (iter + 16 <= payload_size) {
+		vector = _mm_load_si128 ((const __m128i *) (payload + iter));
+		_mm_store_si128 ((__m128i *) (payload + iter), _mm_xor_si128 (vector, vector_mask));
+		iter += 16;
+	} /* end while */
+
+	__nopoll_conn_mask_word64 (payload + iter, payload_size - iter, mask, desp + iter);
+	return;
+}
+#endif
+
+#if defined(NOPOLL_MASK_AVX2)
+__attribute__ ((target ("avx2")))
+static void __nopoll_conn_mask_avx2 (char * payload, int payload_size, const char * mask, int desp)
+{
+	unsigned char pattern[32];
+	__m256i       vector_mask;
+	__m256i       vector;
+	int           head;
+	int           iter;
+
+	head = (int) ((32 - ((unsigned long) payload & 31)) & 31);
+	if (head > payload_size)
+		head = payload_size;
+	__nopoll_conn_mask_bytes (payload, head, mask, desp);
+
+	__nopoll_conn_mask_pattern (pattern, 32, mask, desp + head);
+	vector_mask = _mm256_loadu_si256 ((const __m256i *) pattern);
+
+	iter = head;
+	while (iter + 32 <= payload_size) {
+		vector = _mm256_load_si256 ((const __m256i *) (payload + iter));
+		_mm256_store_si256 ((__m256i *) (payload + iter), _mm256_xor_si256 (vector, vector_mask));
+		iter += 32;
+	} /* end while */
+
+	__nopoll_conn_mask_word64 (payload + iter, payload_size - iter, mask, desp + iter);
+	return;
+}
+#endif
+
+typedef struct _noPollMaskKernelDef {
+	const char       * name;
+	noPollMaskKernel   kernel;
+} noPollMaskKernelDef;
+
+static const noPollMaskKernelDef __nopoll_conn_mask_kernels[] = {
+	{ "bytes",  __nopoll_conn_mask_bytes },
+	{ "word64", __nopoll_conn_mask_word64 },
+#if defined(NOPOLL_MASK_SSE2)
+	{ "sse2",   __nopoll_conn_mask_sse2 },
+#endif
+#if defined(NOPOLL_MASK_AVX2)
+	{ "avx2",   __nopoll_conn_mask_avx2 },
+#endif
+	{ NULL,     NULL }
+};
+
+/* kernel selected (see __nopoll_conn_mask_init), read and written
+ * atomically when supported: connections on several threads mask at
+ * the same time */
+static const noPollMaskKernelDef * __nopoll_conn_mask_selected = NULL;
+
+#if defined(NOPOLL_HAVE_ATOMIC_REFS)
+#define __nopoll_conn_mask_load()       ((const noPollMaskKernelDef *) nopoll_atomic_get_ptr (&__nopoll_conn_mask_selected))
+#define __nopoll_conn_mask_store(value) ((void) nopoll_atomic_xchg_ptr (&__nopoll_conn_mask_selected, (noPollPtr) (value)))
+#else
+#define __nopoll_conn_mask_load()       (__nopoll_conn_mask_selected)
+#define __nopoll_conn_mask_store(value) (__nopoll_conn_mask_selected = (value))
+#endif
+
+/* returns the table entry for the provided kernel (the table
+ * layout depends on the kernels built in) */
+static const noPollMaskKernelDef * __nopoll_conn_mask_find (noPollMaskKernel kernel)
+{
+	int iter = 0;
+
+	while (__nopoll_conn_mask_kernels[iter].name) {
+		if (__nopoll_conn_mask_kernels[iter].kernel == kernel)
+			return &__nopoll_conn_mask_kernels[iter];
+		iter++;
+	} /* end while */
+
+	return NULL;
+}
+
+static const noPollMaskKernelDef * __nopoll_conn_mask_select (void)
+{
+	const noPollMaskKernelDef * selected = __nopoll_conn_mask_find (__nopoll_conn_mask_word64);
 
-	/* get lines and complete the handshake data */
-	while (nopoll_true) {
-		/* clear buffer for debugging functions */
-		buffer[0] = 0;
+	/* pick the widest kernel supported by the running cpu */
+#if defined(NOPOLL_MASK_SSE2)
+	selected = __nopoll_conn_mask_find (__nopoll_conn_mask_sse2);
+#endif
+#if defined(NOPOLL_MASK_AVX2)
+	__builtin_cpu_init ();
+	if (__builtin_cpu_supports ("avx2"))
+		selected = __nopoll_conn_mask_find (__nopoll_conn_mask_avx2);
+#endif
+	return selected;
+}
 
-		/* get next line to process: for
-		   NOPOLL_HANDSHAKE_BUFFER_SIZE definition, see
-		   nopoll_decl.h */
-		buffer_size = nopoll_conn_readline (conn, buffer, NOPOLL_HANDSHAKE_BUFFER_SIZE);
-		if (buffer_size == 0 || buffer_size == -1) {
-			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unexpected connection close during handshake..closing connection");
-			nopoll_conn_shutdown (conn);
-			return;
-		} /* end if */
+/** 
+ * @internal Selects the best masking kernel supported by the running
+ * cpu (called once by nopoll_ctx_new, so it is already selected
+ * when connections start masking).
+ */
+void __nopoll_conn_mask_init (void)
+{
+	if (__nopoll_conn_mask_load () == NULL)
+		__nopoll_conn_mask_store (__nopoll_conn_mask_select ());
+	return;
+}
 
-		/* no data at this moment, return to avoid consuming data */
-		if (buffer_size == -2) {
-			nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "No more data available on connection id %d", conn->id);
-			return;
-		}
+/** 
+ * @internal Allows to force the kernel used by \ref
+ * nopoll_conn_mask_content ("bytes", "word64", "sse2" or "avx2").
+ * Passing NULL selects again the best kernel supported by the
+ * running cpu. Intended for regression tests and benchmarks.
+ *
+ * @param name The kernel name.
+ *
+ * @return nopoll_true if the kernel was selected, otherwise
+ * nopoll_false is returned (kernel not available in this build).
+ */
+nopoll_bool __nopoll_conn_mask_set_kernel (const char * name)
+{
+	int iter = 0;
 
-		/* drop a debug line */
-		nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Bytes read %d from connection id %d: %s", buffer_size, conn->id, buffer);  
-			
-		/* check if we have received the end of the
-		   websocket client handshake */
-		if (buffer_size == 2 && nopoll_ncmp (buffer, "\r\n", 2)) {
-			nopoll_conn_complete_handshake_check (conn);
-			return;
-		}
+	if (name == NULL) {
+		__nopoll_conn_mask_store (__nopoll_conn_mask_select ());
+		return nopoll_true;
+	} /* end if */
 
-		if (conn->role == NOPOLL_ROLE_LISTENER) {
-			/* call to complete listener handshake */
-			if (nopoll_conn_complete_handshake_listener (ctx, conn, buffer, buffer_size) == 1)
-				continue;
-		} else if (conn->role == NOPOLL_ROLE_CLIENT) {
-			/* call to complete listener handshake */
-			if (nopoll_conn_complete_handshake_client (ctx, conn, buffer, buffer_size) == 1)
-				continue;
-		} else {
-			nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Called to handle connection handshake on a connection with an unexpected role: %d, closing session",
-				    conn->role);
-			nopoll_conn_shutdown (conn);
-			return;
-		}
+	while (__nopoll_conn_mask_kernels[iter].name) {
+		if (nopoll_cmp (__nopoll_conn_mask_kernels[iter].name, name)) {
+#if defined(NOPOLL_MASK_AVX2)
+			/* do not allow avx2 on cpus without it */
+			if (__nopoll_conn_mask_kernels[iter].kernel == __nopoll_conn_mask_avx2) {
+				__builtin_cpu_init ();
+				if (! __builtin_cpu_supports ("avx2"))
+					return nopoll_false;
+			} /* end if */
+#endif
+			__nopoll_conn_mask_store (&__nopoll_conn_mask_kernels[iter]);
+			return nopoll_true;
+		} /* end if */
+		iter++;
 	} /* end while */
 
-	return;
+	return nopoll_false;
+}
+
+/** 
+ * @internal Returns the name of the kernel used by \ref
+ * nopoll_conn_mask_content.
+ */
+const char  * __nopoll_conn_mask_get_kernel (void)
+{
+	__nopoll_conn_mask_init ();
+	return __nopoll_conn_mask_load ()->name;
 }
 
 void nopoll_conn_mask_content (noPollCtx * ctx, char * payload, int payload_size, char * mask, int desp)
 {
-	int iter       = 0;
-	int mask_index = 0;
+	const noPollMaskKernelDef * selected = __nopoll_conn_mask_load ();
 
-	while (iter < payload_size) {
-		/* rotate mask and apply it */
-		mask_index = (iter + desp) % 4;
-		payload[iter] ^= mask[mask_index];
-		iter++;
-	} /* end while */
+	/* small payloads (control frames, short text) are not worth
+	 * the wide loops setup */
+	if (payload_size < 16) {
+		__nopoll_conn_mask_bytes (payload, payload_size, mask, desp);
+		return;
+	} /* end if */
+
+	/* masking without context created yet */
+	if (selected == NULL) {
+		__nopoll_conn_mask_init ();
+		selected = __nopoll_conn_mask_load ();
+	} /* end if */
 
+	selected->kernel (payload, payload_size, mask, desp);
 	return;
 } 
 
@@ -3089,11 +5215,11 @@ void nopoll_conn_mask_content (noPollCtx * ctx, char * payload, int payload_size
  */
 noPollMsg   * nopoll_conn_get_msg (noPollConn * conn)
 {
-	char        buffer[20];
+	char      * header;
 	int         bytes;
 	noPollMsg * msg;
 	int         ssl_error;
-	int         header_size = 2;
+	int         header_size;
 #if defined(SHOW_DEBUG_LOG)
 	long        result;
 #endif
@@ -3105,6 +5231,10 @@ noPollMsg   * nopoll_conn_get_msg (noPollConn * conn)
         if (conn->pending_ssl_connect)
             return NULL;  /* Let the loop in conn_new_common handle this */
 
+	/* asynchronous connect in progress (advanced by the loop) */
+	if (conn->connect_stage)
+		return NULL;
+
 	nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, 
 		    "=== START: conn-id=%d (errno=%d, session: %d, conn->handshake_ok: %d, conn->pending_ssl_accept: %d) ===", 
 		    conn->id, errno, conn->session, conn->handshake_ok, conn->pending_ssl_accept);
@@ -3155,6 +5285,7 @@ noPollMsg   * nopoll_conn_get_msg (noPollConn * conn)
 		/* configure default handlers */
 		conn->receive = nopoll_conn_tls_receive;
 		conn->send    = nopoll_conn_tls_send;
+		__nopoll_conn_ktls_check (conn->ctx, conn);
 
 		/* call to check post ssl checks after SSL finalization */
 		if (conn->ctx && conn->ctx->post_ssl_check) {
@@ -3195,23 +5326,27 @@ noPollMsg   * nopoll_conn_get_msg (noPollConn * conn)
 
 		if (! conn->handshake_ok) 
 			return NULL;
+
+		/* accepted connections use blocking sockets: do not
+		 * block the caller (the loop) waiting for the first
+		 * frame if it wasn't received yet */
+		if (! nopoll_conn_has_pending_input (conn)) {
+#if defined(NOPOLL_OS_UNIX)
+			errno = NOPOLL_EWOULDBLOCK;
+#elif defined(NOPOLL_OS_WIN32)
+			WSASetLastError(NOPOLL_EWOULDBLOCK);
+#endif
+			return NULL;
+		} /* end if */
 	} /* end if */
 
 	if (conn->previous_msg) {
 		nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Reading bytes (previously read %d) from a previous unfinished frame (pending: %d) over conn-id=%d",
 			    conn->previous_msg->payload_size, conn->previous_msg->remain_bytes, conn->id);
 
-		if (conn->read_pending_header) {
-			/* detected pending read header, continue from here */
-			msg                       = conn->previous_msg;
-			conn->previous_msg        = NULL;
-			conn->read_pending_header = nopoll_false;
-			goto read_pending_header;
-		} /* end if */
-		
 		/* build next message holder to continue with this content */
 		if (conn->previous_msg->payload_size > 0) {
-			msg = nopoll_msg_new ();
+			msg = __nopoll_msg_new (conn->ctx);
 			if (msg == NULL) {
 				nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, "Failed to allocate memory for received message, closing session id: %d", 
 					    conn->id);
@@ -3236,10 +5371,10 @@ noPollMsg   * nopoll_conn_get_msg (noPollConn * conn)
 			
 			if (msg->is_masked) {
 				nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Reusing mask value = %d from previous frame", nopoll_get_32bit (msg->mask));
-				nopoll_show_byte (conn->ctx, msg->mask[0], "mask[0]");
-				nopoll_show_byte (conn->ctx, msg->mask[1], "mask[1]");
-				nopoll_show_byte (conn->ctx, msg->mask[2], "mask[2]");
-				nopoll_show_byte (conn->ctx, msg->mask[3], "mask[3]");
+				nopoll_log_byte (conn->ctx, msg->mask[0], "mask[0]");
+				nopoll_log_byte (conn->ctx, msg->mask[1], "mask[1]");
+				nopoll_log_byte (conn->ctx, msg->mask[2], "mask[2]");
+				nopoll_log_byte (conn->ctx, msg->mask[3], "mask[3]");
 			}
 
 			/* release previous reference because de don't need it anymore */
@@ -3250,7 +5385,7 @@ noPollMsg   * nopoll_conn_get_msg (noPollConn * conn)
 
 			/* update remaining bytes */
 			msg->payload_size = msg->remain_bytes;
-			nopoll_free (msg->payload);
+			__nopoll_msg_free_payload (msg);
 			nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "reusing noPollMsg reference (%p) since last payload read was 0, remaining: %d", msg,
 				    msg->payload_size);
 		}
@@ -3284,41 +5419,32 @@ noPollMsg   * nopoll_conn_get_msg (noPollConn * conn)
 	*/
 	/* nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Found data in opened connection id %d..", conn->id);*/ 
 
-	/* get the first 2 bytes from the websocket header */
-	bytes = __nopoll_conn_receive (conn, buffer, 2);
-	if (bytes == 0) {
+	/* get the complete websocket header (bytes of an incomplete
+	 * header are kept on the read buffer until the rest is
+	 * received) */
+	header_size = __nopoll_conn_read_header (conn);
+	if (header_size == 0) {
 		/* connection not ready */
-		nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Connection id=%d without data, errno=%d : %s, returning no message",
-			    conn->id, errno, strerror (errno));
+		nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Connection id=%d without complete frame header (%d bytes received), errno=%d : %s, returning no message",
+			    conn->id, conn->read_buf_end - conn->read_buf_start, errno, strerror (errno));
 		return NULL;
 	}
 
-	if (bytes <= 0) {
+	if (header_size < 0) {
 		nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, "Received connection close, finishing connection session");
 		nopoll_conn_shutdown (conn);
 		return NULL;
 	} /* end if */
 
-	if (bytes != 2) { 
-		/* ok, store content read into the pending buffer for next call */
-		memcpy (conn->pending_buf + conn->pending_buf_bytes, buffer, bytes);
-		conn->pending_buf_bytes += bytes;
-		
-		nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG,
-			    "Expected to receive complete websocket frame header but found only %d bytes over conn-id=%d, saving to reuse later",
-			    bytes, conn->id);
-		return NULL;
-	} /* end if */
-
-	/* record header size */
-	header_size = 2;
+	/* parse header in place */
+	header = conn->read_buf + conn->read_buf_start;
 
-	nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Received %d bytes for websocket header", bytes);
-	nopoll_show_byte (conn->ctx, buffer[0], "header[0]");
-	nopoll_show_byte (conn->ctx, buffer[1], "header[1]");
+	nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Received %d bytes for websocket header", header_size);
+	nopoll_log_byte (conn->ctx, header[0], "header[0]");
+	nopoll_log_byte (conn->ctx, header[1], "header[1]");
 
 	/* build next message */
-	msg = nopoll_msg_new ();
+	msg = __nopoll_msg_new (conn->ctx);
 	if (msg == NULL) {
 		nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, "Failed to allocate memory for received message, closing session id: %d", 
 			    conn->id);
@@ -3327,10 +5453,10 @@ noPollMsg   * nopoll_conn_get_msg (noPollConn * conn)
 	} /* end if */
 
 	/* get fin bytes */
-	msg->has_fin      = nopoll_get_bit (buffer[0], 7);
-	msg->op_code      = buffer[0] & 0x0F;
-	msg->is_masked    = nopoll_get_bit (buffer[1], 7);
-	msg->payload_size = buffer[1] & 0x7F;
+	msg->has_fin      = nopoll_get_bit (header[0], 7);
+	msg->op_code      = header[0] & 0x0F;
+	msg->is_masked    = nopoll_get_bit (header[1], 7);
+	msg->payload_size = header[1] & 0x7F;
 
 	/* ensure FIN = 1 in case we are listener */
 	if (conn->role == NOPOLL_ROLE_LISTENER && ! msg->is_masked) {
@@ -3341,16 +5467,6 @@ noPollMsg   * nopoll_conn_get_msg (noPollConn * conn)
 		return NULL;
 	} /* end if */
 
-	/* check payload size value */
-	if (msg->payload_size < 0) {
-		nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, "Received wrong payload size at first 7 bits, closing session id: %d", 
-			    conn->id);
-		nopoll_msg_unref (msg);
-		nopoll_conn_shutdown (conn);
-		return NULL;
-	} /* end if */
-
- read_pending_header:
 	nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "interim payload size received: %d", (int) msg->payload_size);
 
 	/* read the rest */
@@ -3360,49 +5476,13 @@ noPollMsg   * nopoll_conn_get_msg (noPollConn * conn)
 	} else if (msg->payload_size == 126) {
 		/* get extended 2 bytes length as unsigned 16 bit
 		   unsigned integer */
-		bytes = __nopoll_conn_receive (conn, buffer + 2, 2);
-		if (bytes != 2) {
-			nopoll_log (conn->ctx, NOPOLL_LEVEL_WARNING, "Failed to get next 2 bytes to read header from the wire, but received=%d, failed to received content, shutting down id=%d the connection, errno=%d (%s)",
-				    bytes, conn->id, errno, strerror (errno));
-			if (errno == NOPOLL_EWOULDBLOCK || errno == 0) { 
-				/* connection is not ready at this point */
-				conn->previous_msg = msg;
-				conn->read_pending_header = nopoll_true;
-
-				/* check amount of bytes to reuse them */
-				nopoll_log (conn->ctx, NOPOLL_LEVEL_WARNING, "Detected broken WebSocket peer sending header content using different frames, trying to save and resume later");
-				if (bytes > 0) {
-					/* ok, store content read into the pending buffer for next call */
-					memcpy (conn->pending_buf + conn->pending_buf_bytes, buffer + 2, bytes);
-					conn->pending_buf_bytes += bytes;
-				}
-				
-				return NULL;
-			}
+		msg->payload_size = nopoll_get_16bit (header + 2);
 
-			nopoll_msg_unref (msg);
-			nopoll_conn_shutdown (conn);
-			return NULL; 	
-		} /* end if */
-
-		/* add to the header bytes read */
-		header_size += bytes;
-			
-		msg->payload_size = nopoll_get_16bit (buffer + 2);
-
-		nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Received (%d) bytes in header (size %d) for payload size indication, which finally is: %d", bytes, header_size,(int) msg->payload_size);
+		nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Received header (size %d) for payload size indication, which finally is: %d", header_size, (int) msg->payload_size);
 		
 	} else if (msg->payload_size == 127) {
-		/* read more content (next 8 bytes) */
-		if ((bytes = __nopoll_conn_receive (conn, buffer, 8)) != 8) {
-			nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, 
-				    "Expected to receive next 6 bytes for websocket frame header but found only %d bytes, closing session: %d",
-				    bytes, conn->id);
-			nopoll_conn_shutdown (conn);
-			return NULL;
-		} /* end if */
-
-                len = (unsigned char*)buffer;
+		/* get extended 8 bytes length */
+                len = (unsigned char*) header + 2;
 		msg->payload_size = 0;
 #if defined(NOPOLL_64BIT_PLATFORM)
 		msg->payload_size |= ((long)(len[0]) << 56);
@@ -3423,6 +5503,20 @@ noPollMsg   * nopoll_conn_get_msg (noPollConn * conn)
 		msg->payload_size |= len[7];
 	} /* end if */
 
+	/* get mask */
+	if (msg->is_masked) {
+		memcpy (msg->mask, header + header_size - 4, 4);
+
+		nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Received mask value = %d", nopoll_get_32bit (msg->mask));
+		nopoll_log_byte (conn->ctx, msg->mask[0], "mask[0]");
+		nopoll_log_byte (conn->ctx, msg->mask[1], "mask[1]");
+		nopoll_log_byte (conn->ctx, msg->mask[2], "mask[2]");
+		nopoll_log_byte (conn->ctx, msg->mask[3], "mask[3]");
+	} /* end if */
+
+	/* header consumed */
+	conn->read_buf_start += header_size;
+
 	if (msg->op_code == NOPOLL_PONG_FRAME) {
 		nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "PONG received over connection id=%d", conn->id);
 		nopoll_msg_unref (msg);
@@ -3449,41 +5543,6 @@ noPollMsg   * nopoll_conn_get_msg (noPollConn * conn)
 			    conn->id, msg->payload_size);
 	} /* end if */
 
-	/* get more bytes */
-	if (msg->is_masked) {
-		bytes = __nopoll_conn_receive (conn, (char *) msg->mask, 4);
-		if (bytes != 4) {
-			/* record header read so far */
-			memcpy (conn->pending_buf, buffer, header_size);
-			conn->pending_buf_bytes = header_size;
-			/* record mask read so far if required */
-			if (bytes > 0) {
-				memcpy (conn->pending_buf + header_size, msg->mask, bytes);
-				conn->pending_buf_bytes += bytes;
-			} /* end if */
-
-			/* release message because it not available here */
-			nopoll_msg_unref (msg);
-			if (bytes >= 0 && nopoll_conn_is_ok (conn)) {
-				nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG,
-					    "Expected to receive incoming mask after header (4 bytes) but found %d bytes on conn-id=%d, saving %d for future operations ", 
-					    bytes, conn->id, conn->pending_buf_bytes);
-				return NULL;
-			} /* end if */
-
-			nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, "Expected to receive incoming mask after header (4 bytes) but found %d bytes, shutting down id=%d the connection", 
-				    bytes, conn->id);
-			nopoll_conn_shutdown (conn);
-			return NULL; 
-		} /* end if */
-		
-		nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Received mask value = %d", nopoll_get_32bit (msg->mask));
-		nopoll_show_byte (conn->ctx, msg->mask[0], "mask[0]");
-		nopoll_show_byte (conn->ctx, msg->mask[1], "mask[1]");
-		nopoll_show_byte (conn->ctx, msg->mask[2], "mask[2]");
-		nopoll_show_byte (conn->ctx, msg->mask[3], "mask[3]");
-	} /* end if */
-
 	nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Detected incoming websocket frame: fin(%d), op_code(%d), is_masked(%d), payload size(%ld), mask=%d", 
 		    msg->has_fin, msg->op_code, msg->is_masked, msg->payload_size, nopoll_get_32bit (msg->mask));
 
@@ -3515,8 +5574,7 @@ noPollMsg   * nopoll_conn_get_msg (noPollConn * conn)
 read_payload:
 
 	/* copy payload received */
-	msg->payload = nopoll_new (char, msg->payload_size + 1);	/* allow extra byte for string terminator */
-	if (msg->payload == NULL) {
+	if (! __nopoll_msg_alloc_payload (msg, msg->payload_size)) {
 		nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, "Unable to acquire memory to read the incoming frame, dropping connection id=%d", conn->id);
 		nopoll_msg_unref (msg);
 		nopoll_conn_shutdown (conn);
@@ -3685,6 +5743,13 @@ int           __nopoll_conn_send_common (noPollConn * conn, const char * content
  * failure, also check errno variable to know more what went wrong.
  *
  * See \ref nopoll_manual_retrying_write_operations to know more about error codes and when it is possible to retry write operations.
+ *
+ * On connections not watched by a loop, the function blocks the
+ * caller while the socket doesn't accept the whole frame, up to 5
+ * seconds (what is left after that is queued, see \ref
+ * nopoll_conn_complete_pending_write). Connections watched by a loop
+ * (\ref nopoll_loop_wait) never wait: content that can't be written
+ * is queued and written by the loop.
  * 
  * The function returns the number of bytes sent, being @length the 
  * max amount of bytes that can be reported as sent by
@@ -3724,6 +5789,13 @@ int           nopoll_conn_send_text (noPollConn * conn, const char * content, lo
  * See \ref nopoll_manual_retrying_write_operations to know more about
  * error codes and when it is possible to retry write operations.
  *
+ * On connections not watched by a loop, the function blocks the
+ * caller while the socket doesn't accept the whole frame, up to 5
+ * seconds (what is left after that is queued, see \ref
+ * nopoll_conn_complete_pending_write). Connections watched by a loop
+ * (\ref nopoll_loop_wait) never wait: content that can't be written
+ * is queued and written by the loop.
+ *
  * The function returns the number of bytes sent, being @length the 
  * max amount of bytes that can be reported as sent by
  * this funciton. This means value reported by this function do not
@@ -3759,6 +5831,13 @@ int           nopoll_conn_send_text_fragment (noPollConn * conn, const char * co
  *
  * See \ref nopoll_manual_retrying_write_operations to know more about error codes and when it is possible to retry write operations.
  *
+ * On connections not watched by a loop, the function blocks the
+ * caller while the socket doesn't accept the whole frame, up to 5
+ * seconds (what is left after that is queued, see \ref
+ * nopoll_conn_complete_pending_write). Connections watched by a loop
+ * (\ref nopoll_loop_wait) never wait: content that can't be written
+ * is queued and written by the loop.
+ *
  * The function returns the number of bytes sent, being @length the 
  * max amount of bytes that can be reported as sent by
  * this funciton. This means value reported by this function do not
@@ -3797,6 +5876,13 @@ int           nopoll_conn_send_binary (noPollConn * conn, const char * content,
  * See \ref nopoll_manual_retrying_write_operations to know more about
  * error codes and when it is possible to retry write operations.
  *
+ * On connections not watched by a loop, the function blocks the
+ * caller while the socket doesn't accept the whole frame, up to 5
+ * seconds (what is left after that is queued, see \ref
+ * nopoll_conn_complete_pending_write). Connections watched by a loop
+ * (\ref nopoll_loop_wait) never wait: content that can't be written
+ * is queued and written by the loop.
+ *
  * The function returns the number of bytes sent, being @length the 
  * max amount of bytes that can be reported as sent by
  * this funciton. This means value reported by this function do not
@@ -4079,6 +6165,91 @@ int nopoll_conn_read_pending (noPollConn * conn) {
 	return conn->pending_diff;
 }
 
+/** 
+ * @internal Allows to check if there is input available on the wire
+ * (bytes buffered by the TLS layer or pending on the socket) that can
+ * be read without blocking the caller, no matter the socket blocking
+ * configuration.
+ *
+ * @param conn The connection to check.
+ *
+ * @return nopoll_true if input is available, otherwise nopoll_false
+ * (also when the remote peer closed the connection).
+ */
+nopoll_bool __nopoll_conn_wire_pending (noPollConn * conn)
+{
+#if defined(NOPOLL_OS_WIN32)
+	u_long available = 0;
+#else
+	char   byte;
+#endif
+
+	if (conn == NULL || conn->session == NOPOLL_INVALID_SOCKET)
+		return nopoll_false;
+
+	/* check content already decrypted */
+	if (conn->ssl && SSL_pending (conn->ssl) > 0)
+		return nopoll_true;
+
+#if defined(MSG_DONTWAIT)
+	/* reads on connections watched by a loop never block: rely
+	 * on the last read instead of checking the socket (a read
+	 * finding nothing just reports NOPOLL_EWOULDBLOCK) */
+	if (__nopoll_conn_loop_watched (conn))
+		return ! conn->wire_drained;
+#endif
+
+#if defined(NOPOLL_OS_WIN32)
+	if (ioctlsocket (conn->session, FIONREAD, &available) != 0)
+		return nopoll_false;
+	return available > 0;
+#else
+	return recv (conn->session, &byte, 1, MSG_PEEK | MSG_DONTWAIT) > 0;
+#endif
+}
+
+/** 
+ * @internal Allows to check if input already received (read buffer
+ * or TLS layer) allows to make progress reading the next message, so
+ * there is no need to wait for the socket to be readable.
+ *
+ * @param conn The connection to check.
+ *
+ * @return nopoll_true if the input received allows to make progress,
+ * otherwise nopoll_false.
+ */
+nopoll_bool nopoll_conn_has_buffered_input (noPollConn * conn)
+{
+	int available;
+
+	if (conn == NULL || conn->session == NOPOLL_INVALID_SOCKET)
+		return nopoll_false;
+
+	/* complete header or payload of a frame pending */
+	available = conn->read_buf_end - conn->read_buf_start;
+	if (available > 0 &&
+	    (conn->previous_msg || available >= __nopoll_conn_header_size (conn->read_buf + conn->read_buf_start, available)))
+		return nopoll_true;
+
+	/* check content already decrypted */
+	return conn->ssl && SSL_pending (conn->ssl) > 0;
+}
+
+/** 
+ * @internal Allows to check if there is input available to be read
+ * from the connection without blocking the caller (read buffer, TLS
+ * layer or socket).
+ *
+ * @param conn The connection to check.
+ *
+ * @return nopoll_true if input is available, otherwise nopoll_false
+ * (also when the remote peer closed the connection).
+ */
+nopoll_bool nopoll_conn_has_pending_input (noPollConn * conn)
+{
+	return nopoll_conn_has_buffered_input (conn) || __nopoll_conn_wire_pending (conn);
+}
+
 /** 
  * @brief Allows to send a ping message over the Websocket connection
  * provided. The function will not block the caller.
@@ -4171,18 +6342,176 @@ void           nopoll_conn_set_on_ready (noPollConn            * conn,
  *
  * @param user_data A reference pointer to be passed in into the handler.
  */
-void          nopoll_conn_set_on_close (noPollConn            * conn,
-					noPollOnCloseHandler    on_close,
-					noPollPtr               user_data)
+void          nopoll_conn_set_on_close (noPollConn            * conn,
+					noPollOnCloseHandler    on_close,
+					noPollPtr               user_data)
+{
+	if (conn == NULL)
+		return;
+
+	/* configure on close handler */
+	conn->on_close      = on_close;
+	conn->on_close_data = user_data;
+
+        return;
+}
+
+/** 
+ * @brief Allows to configure write watermarks on the provided
+ * connection so producers can be throttled when the remote peer
+ * doesn't read as fast as content is sent.
+ *
+ * When content queued to be written (see \ref
+ * nopoll_conn_pending_write_bytes) reaches high bytes, the handler
+ * configured with \ref nopoll_conn_set_on_write_blocked is called
+ * (the producer should stop sending). Once it drops to low bytes,
+ * the handler configured with \ref nopoll_conn_set_on_write_drained is
+ * called (the producer can resume). Each handler is called once per
+ * transition, after the write operation has finished (so it can send
+ * over the connection).
+ *
+ * Default values for new connections can be configured with \ref
+ * nopoll_conn_opts_set_write_watermarks. To limit memory used by
+ * content queued, see \ref nopoll_conn_set_write_limit.
+ *
+ * @param conn The connection to configure.
+ *
+ * @param high High watermark in bytes (0 disables watermarks).
+ *
+ * @param low Low watermark in bytes. It must be lower than high,
+ * otherwise high / 2 is used.
+ */
+void          nopoll_conn_set_write_watermarks (noPollConn * conn, int high, int low)
+{
+	if (conn == NULL)
+		return;
+
+	if (high < 0)
+		high = 0;
+	if (low < 0 || low >= high)
+		low = high / 2;
+
+	nopoll_mutex_lock (conn->write_mutex);
+	conn->write_high = high;
+	conn->write_low  = low;
+	if (high == 0)
+		conn->write_blocked = nopoll_false;
+	nopoll_mutex_unlock (conn->write_mutex);
+
+	return;
+}
+
+/** 
+ * @brief Allows to check if the provided connection reached its
+ * write high watermark and didn't drop to the low one yet (see \ref
+ * nopoll_conn_set_write_watermarks).
+ *
+ * @param conn The connection to check.
+ *
+ * @return nopoll_true if the connection is blocked, otherwise
+ * nopoll_false.
+ */
+nopoll_bool   nopoll_conn_is_write_blocked (noPollConn * conn)
+{
+	if (conn == NULL)
+		return nopoll_false;
+	return conn->write_blocked;
+}
+
+/** 
+ * @brief Allows to configure a hard limit for content queued to be
+ * written on the provided connection, and what to do with new
+ * messages sent once it is reached (see \ref noPollWriteLimit).
+ *
+ * Only complete text and binary messages that can't be started
+ * because content is pending are dropped or coalesced: control frames
+ * and fragments are always queued.
+ *
+ * Default values for new connections can be configured with \ref
+ * nopoll_conn_opts_set_write_limit.
+ *
+ * @param conn The connection to configure.
+ *
+ * @param limit Max bytes queued (0 disables the limit).
+ *
+ * @param policy What to do with new messages above the limit.
+ */
+void          nopoll_conn_set_write_limit (noPollConn * conn, int limit, noPollWriteLimit policy)
+{
+	if (conn == NULL)
+		return;
+
+	nopoll_mutex_lock (conn->write_mutex);
+	conn->write_limit        = limit > 0 ? limit : 0;
+	conn->write_limit_policy = policy;
+	nopoll_mutex_unlock (conn->write_mutex);
+
+	return;
+}
+
+/** 
+ * @brief Allows to configure the handler called when content queued
+ * to be written on the connection reaches its high watermark (see
+ * \ref nopoll_conn_set_write_watermarks). It overrides the one
+ * configured with \ref nopoll_ctx_set_on_write_blocked.
+ *
+ * @param conn The connection to configure.
+ *
+ * @param on_write_blocked The handler to be called.
+ *
+ * @param user_data User defined pointer to be passed in into the handler.
+ */
+void          nopoll_conn_set_on_write_blocked (noPollConn            * conn,
+						noPollOnWriteHandler    on_write_blocked,
+						noPollPtr               user_data)
+{
+	if (conn == NULL)
+		return;
+
+	conn->on_write_blocked      = on_write_blocked;
+	conn->on_write_blocked_data = user_data;
+	return;
+}
+
+/** 
+ * @brief Allows to configure the handler called when content queued
+ * to be written on the connection drops to its low watermark after
+ * reaching the high one (see \ref nopoll_conn_set_write_watermarks).
+ * It overrides the one configured with \ref
+ * nopoll_ctx_set_on_write_drained.
+ *
+ * @param conn The connection to configure.
+ *
+ * @param on_write_drained The handler to be called.
+ *
+ * @param user_data User defined pointer to be passed in into the handler.
+ */
+void          nopoll_conn_set_on_write_drained (noPollConn            * conn,
+						noPollOnWriteHandler    on_write_drained,
+						noPollPtr               user_data)
+{
+	if (conn == NULL)
+		return;
+
+	conn->on_write_drained      = on_write_drained;
+	conn->on_write_drained_data = user_data;
+	return;
+}
+
+/** 
+ * @internal Configures write watermarks and limit on the provided
+ * connection from the options used to create it (if any).
+ */
+void          __nopoll_conn_set_write_opts (noPollConn * conn, noPollConnOpts * opts)
 {
-	if (conn == NULL)
+	if (opts == NULL)
 		return;
 
-	/* configure on close handler */
-	conn->on_close      = on_close;
-	conn->on_close_data = user_data;
-
-        return;
+	conn->write_high         = opts->write_high;
+	conn->write_low          = opts->write_low;
+	conn->write_limit        = opts->write_limit;
+	conn->write_limit_policy = opts->write_limit_policy;
+	return;
 }
 
 /** 
@@ -4203,28 +6532,15 @@ nopoll_bool      nopoll_conn_send_pong (noPollConn * conn, long length, noPollPt
 	return nopoll_conn_send_frame (conn, nopoll_true, conn->role == NOPOLL_ROLE_CLIENT, NOPOLL_PONG_FRAME, length, content, 0);
 }
 
-int __nopoll_conn_complete_pending_write_reduce_header (noPollConn * conn, int bytes_written)
-{
-        /* now check if the last write operation includes
-	   headers added by noPoll, to remove that size from
-	   reported value. Reported value should only include
-	   in its counting bytes requested by the upper level
-	   application not upper level application plus bytes
-	   added by noPoll */
-        while (conn->pending_write_added_header > 0 && bytes_written > 0) {
-	        bytes_written --;
-		conn->pending_write_added_header--;
-		nopoll_log (conn->ctx, NOPOLL_LEVEL_WARNING, "Reduced added header (bytes_written=%d, conn->pending_write_added_header=%d)", 
-			    bytes_written, conn->pending_write_added_header);
-	} /* end if */
-	return bytes_written;
-}
-
 /** 
  * @brief Allows to call to complete last pending write process that may be
  * pending from a previous uncompleted write operation. The function
  * returns the number of bytes that were written.
  *
+ * Connections watched by a loop (\ref nopoll_loop_wait) do not need
+ * to call this function: the loop writes pending content when the
+ * socket is writable.
+ *
  * @param conn The connection where the pending write operation
  * operation will take place. In the case conn == NULL is received, 0
  * is returned. Keep in mind this.
@@ -4238,33 +6554,21 @@ int __nopoll_conn_complete_pending_write_reduce_header (noPollConn * conn, int b
  */
 int nopoll_conn_complete_pending_write (noPollConn * conn)
 {
-	int    bytes_written = 0;
+	int    bytes_written;
+	int    state;
 
-	if (conn == NULL || conn->pending_write == NULL)
+	if (conn == NULL || conn->write_queue == NULL)
 		return 0;
 
-	/* simple implementation */
-	bytes_written = conn->send (conn, conn->pending_write + conn->pending_write_desp, conn->pending_write_bytes);
-	if (bytes_written == conn->pending_write_bytes) {
-		nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Completed pending write operation with bytes=%d", bytes_written);
-		nopoll_free (conn->pending_write);
-		conn->pending_write = NULL;
-
-		/* reduce/remove bytes written due to header */
-		return __nopoll_conn_complete_pending_write_reduce_header (conn, bytes_written);
-	} /* end if */
-
-	if (bytes_written > 0) {
-		/* bytes written but not everything */
-		conn->pending_write_bytes -= bytes_written;
-		conn->pending_write_desp += bytes_written;
+	nopoll_mutex_lock (conn->write_mutex);
+	bytes_written = __nopoll_conn_complete_write_queue (conn);
+	state         = __nopoll_conn_write_state (conn);
+	nopoll_mutex_unlock (conn->write_mutex);
+	__nopoll_conn_write_notify (conn, state);
 
-		/* reduce/remove bytes written due to header */
-		return __nopoll_conn_complete_pending_write_reduce_header (conn, bytes_written);
-	}
-
-	nopoll_log (conn->ctx, NOPOLL_LEVEL_WARNING, "Found complete write operation didn't finish well, result=%d, errno=%d, conn-id=%d",
-		    bytes_written, errno, conn->id);
+	if (bytes_written < 0 && errno != NOPOLL_EWOULDBLOCK && errno != NOPOLL_EINTR) 
+		nopoll_log (conn->ctx, NOPOLL_LEVEL_WARNING, "Found complete write operation didn't finish well, result=%d, errno=%d, conn-id=%d",
+			    bytes_written, errno, conn->id);
 	return bytes_written;
 }
 
@@ -4280,10 +6584,10 @@ int nopoll_conn_complete_pending_write (noPollConn * conn)
  */
 int           nopoll_conn_pending_write_bytes (noPollConn * conn)
 {
-	if (conn == NULL || conn->pending_write == NULL)
+	if (conn == NULL)
 		return 0;
 
-	return conn->pending_write_bytes;
+	return conn->write_queue_bytes;
 }
 
 /** 
@@ -4316,11 +6620,10 @@ int           nopoll_conn_pending_write_bytes (noPollConn * conn)
  */
 int nopoll_conn_flush_writes (noPollConn * conn, long timeout, int previous_result)
 {
-	int iterator = 0;
-	int bytes_written;
-	int total = 0;
-	int multiplier = 1;
-	long wait_implemented = 0;
+	int             bytes_written;
+	int             total = 0;
+	long            remaining;
+	struct timeval  start;
 
 	/* check for errno and pending write operations */
 	if ((errno != NOPOLL_EWOULDBLOCK && errno != NOPOLL_EINPROGRESS) && (nopoll_conn_pending_write_bytes (conn) == 0)) {
@@ -4328,25 +6631,29 @@ int nopoll_conn_flush_writes (noPollConn * conn, long timeout, int previous_resu
 		            nopoll_conn_pending_write_bytes (conn), errno, NOPOLL_EWOULDBLOCK);
 		return previous_result > 0 ? previous_result : 0;
 	} 
-		
-	while (iterator < 100 && nopoll_conn_pending_write_bytes (conn) > 0) {
-
-		/* stop operation if timeout reached */
-		if (wait_implemented >= timeout) 
-			break;
 
-		nopoll_sleep (100000 * multiplier);
-		wait_implemented += (100000 * multiplier);
+#if defined(NOPOLL_OS_WIN32)
+	nopoll_win32_gettimeofday (&start, NULL);
+#else
+	gettimeofday (&start, NULL);
+#endif
+	while (nopoll_conn_pending_write_bytes (conn) > 0) {
 
 		/* write content pending */
 		bytes_written = nopoll_conn_complete_pending_write (conn);
-
 		if (bytes_written > 0) 
 			total += bytes_written;
+		else if (bytes_written < 0 && errno != NOPOLL_EWOULDBLOCK && errno != NOPOLL_EINTR)
+			break;
+		if (nopoll_conn_pending_write_bytes (conn) == 0)
+			break;
 
-		/* next position */
-		iterator++;
-		multiplier++;
+		/* stop operation if timeout reached, otherwise wait
+		 * until the socket can be written */
+		remaining = timeout - __nopoll_conn_ellapsed (&start);
+		if (remaining <= 0)
+			break;
+		__nopoll_conn_wait_writable (conn, remaining);
 	} /* end while */
 
 	nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "finishing flush operation, total written=%d, added to previous result=%d, errno=%d",
@@ -4362,53 +6669,26 @@ int nopoll_conn_flush_writes (noPollConn * conn, long timeout, int previous_resu
 
 
 /** 
- * @internal Function used to send a frame over the provided
- * connection.
- *
- * @param conn The connection where the send operation will hapen.
- *
- * @param fin If the frame to be sent must be flagged as a fin frame.
- *
- * @param masked The frame to be sent is masked or not.
+ * @internal Builds the websocket frame header (RFC 6455 section 5.2)
+ * into the provided buffer (at least 14 bytes).
  *
- * @param op_code The frame op code to be configured.
+ * @param header Buffer where the header is placed.
  *
- * @param length The frame payload length.
+ * @param fin If the frame must be flagged as final.
  *
- * @param content Pointer to the data to be sent in the frame.
+ * @param op_code The frame op code.
  *
- * @return The function returns the number of bytes sent, being @length the 
- * max amount of bytes that can be reported as sent by
- * this funciton. This means value reported by this function do not
- * includes headers.  The funciton also returns the following general indications:
+ * @param length Payload length.
  *
- *   N : number of bytes sent (user land bytes sent, without including web socket headers).
- *   0 : no bytes sent (see errno indication). See also \ref nopoll_conn_complete_pending_write
- *  -1 : failure found
- *  -2 : retry operation needed (NOPOLL_EWOULDBLOCK)
+ * @param mask Optional mask to place in the header (NULL for
+ * unmasked frames).
  *
+ * @return Header size or -1 if the length is not supported by the
+ * platform.
  */
-int nopoll_conn_send_frame (noPollConn * conn, nopoll_bool fin, nopoll_bool masked,
-			    noPollOpCode op_code, long length, noPollPtr content, long sleep_in_header)
-
+int __nopoll_conn_build_header (char * header, nopoll_bool fin, noPollOpCode op_code, long length, const char * mask)
 {
-	char               header[14];
-	int                header_size;
-	char             * send_buffer;
-	int                bytes_written = 0;
-	int                bytes_sent    = 0;
-	char               mask[4];
-	unsigned int       mask_value = 0;
-	int                desp = 0;
-	int                tries;
-#if defined(SHOW_DEBUG_LOG)
-	noPollDebugLevel   level;
-#endif
-
-	/* check for pending send operation */
-	bytes_written = nopoll_conn_complete_pending_write (conn);
-	if (bytes_written < 0)
-		return bytes_written;
+	int header_size;
 
 	/* clear header */
 	memset (header, 0, 14);
@@ -4417,18 +6697,8 @@ int nopoll_conn_send_frame (noPollConn * conn, nopoll_bool fin, nopoll_bool mask
 	if (fin) 
 		nopoll_set_bit (header, 7);
 	
-	if (masked) {
+	if (mask)
 		nopoll_set_bit (header + 1, 7);
-		
-		/* define a random mask */
-#if defined(NOPOLL_OS_WIN32)
-		mask_value = (unsigned int) rand ();
-#else
-		mask_value = (unsigned int) random ();
-#endif
-		memset (mask, 0, 4);
-		nopoll_set_32bit (mask_value, mask);
-	} /* end if */
 
 	if (op_code) {
 		/* set initial 4 bits */
@@ -4457,51 +6727,489 @@ int nopoll_conn_send_frame (noPollConn * conn, nopoll_bool fin, nopoll_bool mask
 	} else if (length < 0x80000000) {
 		header[2] = header[3] = header[4] = header[5] = 0;
 #endif
-		header[1] |= 127;
-		header_size += 8;
-		header[6] = (length & 0x00000000FF000000) >> 24;
-		header[7] = (length & 0x0000000000FF0000) >> 16;
-		header[8] = (length & 0x000000000000FF00) >> 8;
-		header[9] = (length & 0x00000000000000FF);
-	} else {
-		nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, "Unable to send the requested message, this requested is bigger than the value that can be supported by this platform");
-		return -1;
-	}
+		header[1] |= 127;
+		header_size += 8;
+		header[6] = (length & 0x00000000FF000000) >> 24;
+		header[7] = (length & 0x0000000000FF0000) >> 16;
+		header[8] = (length & 0x000000000000FF00) >> 8;
+		header[9] = (length & 0x00000000000000FF);
+	} else {
+		return -1;
+	}
+
+	/* place mask */
+	if (mask) {
+		memcpy (header + header_size, mask, 4);
+		header_size += 4;
+	} /* end if */
+
+	return header_size;
+}
+
+/** 
+ * @internal Queues the provided frame (acquiring a reference) to be
+ * written after all content pending, starting at desp (must be
+ * called with conn->write_mutex acquired). When the queue was empty,
+ * the loop watching the connection (if any) is requested to report
+ * the socket writable.
+ */
+nopoll_bool __nopoll_conn_queue_frame (noPollConn * conn, noPollFrame * frame, int desp)
+{
+	noPollWriteItem * item;
+
+	item = nopoll_new (noPollWriteItem, 1);
+	if (item == NULL)
+		return nopoll_false;
+	if (! nopoll_frame_ref (frame)) {
+		nopoll_free (item);
+		return nopoll_false;
+	} /* end if */
+
+	item->frame = frame;
+	item->desp  = desp;
+
+	conn->write_queue_bytes += frame->size - desp;
+	if (conn->write_queue_last) {
+		conn->write_queue_last->next = item;
+		conn->write_queue_last       = item;
+		return nopoll_true;
+	} /* end if */
+	conn->write_queue      = item;
+	conn->write_queue_last = item;
+
+	/* watch the socket to be writable */
+	if (__nopoll_conn_loop_watched (conn))
+		nopoll_io_update_conn (conn->ctx, conn);
+
+	return nopoll_true;
+}
+
+/* watermark transitions reported by __nopoll_conn_write_state */
+#define NOPOLL_CONN_WRITE_BLOCKED 1
+#define NOPOLL_CONN_WRITE_DRAINED 2
+
+/** 
+ * @internal Checks content queued against the connection watermarks
+ * (must be called with conn->write_mutex acquired), returning the
+ * transition to be notified once the mutex is released (see
+ * __nopoll_conn_write_notify) or 0.
+ */
+int __nopoll_conn_write_state (noPollConn * conn)
+{
+	if (! conn->write_blocked) {
+		if (conn->write_high > 0 && conn->write_queue_bytes >= conn->write_high) {
+			conn->write_blocked = nopoll_true;
+			return NOPOLL_CONN_WRITE_BLOCKED;
+		} /* end if */
+		return 0;
+	} /* end if */
+
+	if (conn->write_queue_bytes <= conn->write_low) {
+		conn->write_blocked = nopoll_false;
+		return NOPOLL_CONN_WRITE_DRAINED;
+	} /* end if */
+	return 0;
+}
+
+/** 
+ * @internal Notifies the watermark transition reported by
+ * __nopoll_conn_write_state (the connection handler or the context
+ * one if not defined).
+ */
+void __nopoll_conn_write_notify (noPollConn * conn, int state)
+{
+	noPollCtx * ctx = conn->ctx;
+	int         error;
+
+	if (state == 0)
+		return;
+
+	/* keep errno reported by the write operation */
+	error = errno;
+	if (state == NOPOLL_CONN_WRITE_BLOCKED) {
+		nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Write high watermark reached (%d bytes queued), conn-id=%d", conn->write_queue_bytes, conn->id);
+		if (conn->on_write_blocked)
+			conn->on_write_blocked (ctx, conn, conn->on_write_blocked_data);
+		else if (ctx->on_write_blocked)
+			ctx->on_write_blocked (ctx, conn, ctx->on_write_blocked_data);
+	} else if (state == NOPOLL_CONN_WRITE_DRAINED) {
+		nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Write low watermark reached (%d bytes queued), conn-id=%d", conn->write_queue_bytes, conn->id);
+		if (conn->on_write_drained)
+			conn->on_write_drained (ctx, conn, conn->on_write_drained_data);
+		else if (ctx->on_write_drained)
+			ctx->on_write_drained (ctx, conn, ctx->on_write_drained_data);
+	} /* end if */
+	errno = error;
+	return;
+}
+
+/** 
+ * @internal Returns if the provided frame is a complete text or
+ * binary message (only frames not started are checked, so the header
+ * is complete).
+ */
+nopoll_bool __nopoll_conn_frame_is_message (noPollFrame * frame)
+{
+	int op_code;
+
+	if (frame->header_size < 2 || ! (frame->data[0] & 0x80))
+		return nopoll_false;
+	op_code = frame->data[0] & 0x0F;
+	return op_code == NOPOLL_TEXT_FRAME || op_code == NOPOLL_BINARY_FRAME;
+}
+
+/** 
+ * @internal Applies the hard limit configured before queueing a frame
+ * not started behind content pending (must be called with
+ * conn->write_mutex acquired).
+ *
+ * @return nopoll_false if the frame must be dropped (errno is set to
+ * NOPOLL_ENOBUFS).
+ */
+nopoll_bool __nopoll_conn_write_limit (noPollConn * conn, noPollFrame * frame)
+{
+	noPollWriteItem * item;
+	noPollWriteItem * next;
+
+	if (conn->write_limit <= 0 || (conn->write_queue_bytes + frame->size) <= conn->write_limit)
+		return nopoll_true;
+
+	/* control frames and fragments are always queued */
+	if (! __nopoll_conn_frame_is_message (frame))
+		return nopoll_true;
+
+	if (conn->write_limit_policy != NOPOLL_WRITE_LIMIT_COALESCE) {
+		nopoll_log (conn->ctx, NOPOLL_LEVEL_WARNING, "Dropping message of %d bytes, write limit reached (%d bytes queued, limit: %d), conn-id=%d",
+			    frame->size, conn->write_queue_bytes, conn->write_limit, conn->id);
+		errno = NOPOLL_ENOBUFS;
+		return nopoll_false;
+	} /* end if */
+
+	/* release messages queued not started (the first frame may be
+	 * being written) to be replaced by the new one */
+	item = conn->write_queue;
+	while (item && item->next) {
+		next = item->next;
+		if (! __nopoll_conn_frame_is_message (next->frame)) {
+			item = next;
+			continue;
+		} /* end if */
+
+		item->next = next->next;
+		if (conn->write_queue_last == next)
+			conn->write_queue_last = item;
+		conn->write_queue_bytes -= next->frame->size - next->desp;
+		nopoll_frame_unref (next->frame);
+		nopoll_free (next);
+	} /* end while */
+
+	return nopoll_true;
+}
+
+/** 
+ * @internal Releases all frames queued on the provided connection.
+ */
+void __nopoll_conn_queue_free (noPollConn * conn)
+{
+	noPollWriteItem * item;
+
+	while (conn->write_queue) {
+		item              = conn->write_queue;
+		conn->write_queue = item->next;
+		nopoll_frame_unref (item->frame);
+		nopoll_free (item);
+	} /* end while */
+	conn->write_queue_last  = NULL;
+	conn->write_queue_bytes = 0;
+	return;
+}
+
+/** 
+ * @internal Writes as many queued frames as possible (must be called
+ * with conn->write_mutex acquired). Returns the number of payload
+ * bytes written (headers not included), or the send result in the
+ * case nothing was written.
+ */
+int __nopoll_conn_complete_write_queue (noPollConn * conn)
+{
+	noPollWriteItem * item;
+	int               bytes_written = 0;
+	int               total         = 0;
+	int               header_desp;
+
+	while (conn->write_queue) {
+		item          = conn->write_queue;
+		bytes_written = conn->send (conn, item->frame->data + item->desp, item->frame->size - item->desp);
+		if (bytes_written <= 0)
+			break;
+
+		/* report only payload bytes */
+		header_desp = item->desp < item->frame->header_size ? item->frame->header_size - item->desp : 0;
+		if (bytes_written > header_desp)
+			total += bytes_written - header_desp;
+
+		item->desp              += bytes_written;
+		conn->write_queue_bytes -= bytes_written;
+		if (item->desp < item->frame->size)
+			break;
+
+		/* frame completed */
+		conn->write_queue = item->next;
+		nopoll_frame_unref (item->frame);
+		nopoll_free (item);
+		if (conn->write_queue == NULL) {
+			/* stop watching the socket to be writable */
+			conn->write_queue_last = NULL;
+			if (__nopoll_conn_loop_watched (conn))
+				nopoll_io_update_conn (conn->ctx, conn);
+		} /* end if */
+	} /* end while */
+
+	if (total == 0 && bytes_written < 0)
+		return bytes_written;
+	return total;
+}
+
+/** 
+ * @brief Sends a frame prepared with \ref nopoll_frame_new over the
+ * provided listener side connection, without encoding or copying its
+ * content again. 
+ *
+ * If the connection has content pending to be written (or the frame
+ * can only be written partially), the frame is queued (acquiring a
+ * reference) to be written by \ref nopoll_conn_complete_pending_write
+ * or \ref nopoll_conn_flush_writes. This way the same frame can be
+ * sent to many connections (see \ref nopoll_ctx_broadcast).
+ *
+ * Prepared frames are not masked, so they can only be sent by
+ * listener side connections (\ref NOPOLL_ROLE_LISTENER).
+ *
+ * @param conn The connection where the frame will be sent.
+ *
+ * @param frame The frame to be sent.
+ *
+ * @return Number of payload bytes written (the rest, if any, is
+ * pending to be written, see \ref nopoll_conn_pending_write_bytes),
+ * or -1 in the case of failure.
+ */
+int           nopoll_conn_send_prepared (noPollConn * conn, noPollFrame * frame)
+{
+	return __nopoll_conn_send_prepared (conn, frame, nopoll_true);
+}
+
+/** 
+ * @internal Implementation of \ref nopoll_conn_send_prepared. When
+ * write_unwatched is nopoll_false, the frame is only queued on
+ * connections not watched by a loop, leaving the caller to flush
+ * them (used by \ref nopoll_ctx_broadcast).
+ */
+int           __nopoll_conn_send_prepared (noPollConn * conn, noPollFrame * frame, nopoll_bool write_unwatched)
+{
+	int         desp          = 0;
+	int         bytes_written = 0;
+	int         state;
+	nopoll_bool write         = nopoll_true;
+
+	if (conn == NULL || frame == NULL)
+		return -1;
+
+	if (conn->role != NOPOLL_ROLE_LISTENER) {
+		nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, "Prepared frames are not masked and can only be sent by listener side connections (conn-id=%d)", conn->id);
+		return -1;
+	} /* end if */
+
+	if (conn->session == NOPOLL_INVALID_SOCKET || ! conn->handshake_ok)
+		return -1;
+
+	nopoll_mutex_lock (conn->write_mutex);
+
+	/* connections not watched by a loop may block writing, so
+	 * the frame is only queued when requested */
+	if (! write_unwatched && ! __nopoll_conn_loop_watched (conn))
+		write = nopoll_false;
+
+	/* complete previous pending content to keep order */
+	if (write && conn->write_queue)
+		__nopoll_conn_complete_write_queue (conn);
+
+	if (write && conn->write_queue == NULL) {
+		while (desp < frame->size) {
+			bytes_written = conn->send (conn, frame->data + desp, frame->size - desp);
+			if (bytes_written <= 0)
+				break;
+			desp += bytes_written;
+		} /* end while */
+
+		if (desp == frame->size) {
+			state = __nopoll_conn_write_state (conn);
+			nopoll_mutex_unlock (conn->write_mutex);
+			__nopoll_conn_write_notify (conn, state);
+			return frame->size - frame->header_size;
+		} /* end if */
+
+		if (bytes_written < 0 && errno != NOPOLL_EWOULDBLOCK && errno != NOPOLL_EINTR) {
+			nopoll_mutex_unlock (conn->write_mutex);
+			nopoll_log (conn->ctx, NOPOLL_LEVEL_WARNING, "Failed to send prepared frame, errno=%d (%s), conn-id=%d", 
+				    errno, strerror (errno), conn->id);
+			return -1;
+		} /* end if */
+	} /* end if */
+
+	/* frame not started behind content pending: check limit */
+	if (desp == 0 && conn->write_queue && ! __nopoll_conn_write_limit (conn, frame)) {
+		nopoll_mutex_unlock (conn->write_mutex);
+		return -1;
+	} /* end if */
+
+	/* queue the rest */
+	if (! __nopoll_conn_queue_frame (conn, frame, desp)) {
+		nopoll_mutex_unlock (conn->write_mutex);
+		nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, "Unable to allocate memory to queue frame");
+		return -1;
+	} /* end if */
+	state = __nopoll_conn_write_state (conn);
+	nopoll_mutex_unlock (conn->write_mutex);
+	__nopoll_conn_write_notify (conn, state);
+
+	return desp > frame->header_size ? desp - frame->header_size : 0;
+}
+
+/** 
+ * @internal Function used to send a frame over the provided
+ * connection.
+ *
+ * @param conn The connection where the send operation will hapen.
+ *
+ * @param fin If the frame to be sent must be flagged as a fin frame.
+ *
+ * @param masked The frame to be sent is masked or not.
+ *
+ * @param op_code The frame op code to be configured.
+ *
+ * @param length The frame payload length.
+ *
+ * @param content Pointer to the data to be sent in the frame.
+ *
+ * @return The function returns the number of bytes sent, being @length the 
+ * max amount of bytes that can be reported as sent by
+ * this funciton. This means value reported by this function do not
+ * includes headers.  The funciton also returns the following general indications:
+ *
+ *   N : number of bytes sent (user land bytes sent, without including web socket headers).
+ *       Frames queued whole behind content still pending report @length.
+ *   0 : no bytes sent (see errno indication). See also \ref nopoll_conn_complete_pending_write
+ *  -1 : failure found (nothing is queued when the connection failed)
+ *  -2 : retry operation needed (NOPOLL_EWOULDBLOCK)
+ *
+ */
+int nopoll_conn_send_frame (noPollConn * conn, nopoll_bool fin, nopoll_bool masked,
+			    noPollOpCode op_code, long length, noPollPtr content, long sleep_in_header)
+
+{
+	char               header[14];
+	int                header_size;
+	char             * send_buffer   = NULL;
+	int                bytes_written = 0;
+	int                bytes_sent    = 0;
+	char               mask[4];
+	unsigned int       mask_value = 0;
+	int                desp = 0;
+	int                total;
+	int                state;
+	nopoll_bool        watched;
+	nopoll_bool        waiting = nopoll_false;
+	nopoll_bool        failed  = nopoll_false;
+	long               remaining;
+	struct timeval     start;
+	noPollFrame      * frame;
+#if defined(SHOW_DEBUG_LOG)
+	noPollDebugLevel   level;
+#endif
 
-	/* place mask */
 	if (masked) {
-		nopoll_set_32bit (mask_value, header + header_size);
-		header_size += 4;
+		/* define a random mask */
+#if defined(NOPOLL_OS_WIN32)
+		mask_value = (unsigned int) rand ();
+#else
+		mask_value = (unsigned int) random ();
+#endif
+		memset (mask, 0, 4);
+		nopoll_set_32bit (mask_value, mask);
 	} /* end if */
 
-	/* allocate enough memory to send content */
-	send_buffer = nopoll_new (char, length + header_size + 2);
-	if (send_buffer == NULL) {
-		nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, "Unable to allocate memory to implement send operation");
+	/* build frame header */
+	header_size = __nopoll_conn_build_header (header, fin, op_code, length, masked ? mask : NULL);
+	if (header_size < 0) {
+		nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, "Unable to send the requested message, this requested is bigger than the value that can be supported by this platform");
 		return -1;
 	} /* end if */
-	
-	/* copy content to be sent */
-	nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Copying into the buffer %d bytes of header (total memory allocated: %d)", 
-		    header_size, (int) length + header_size + 1);
-	memcpy (send_buffer, header, header_size);
-	if (length > 0) {
-		memcpy (send_buffer + header_size, content, length);
-
-		/* mask content before sending if requested */
-		if (masked) {
-			nopoll_conn_mask_content (conn->ctx, send_buffer + header_size, length, mask, 0);
-		}
+	total = length + header_size;
+
+	nopoll_mutex_lock (conn->write_mutex);
+
+	/* check for pending send operation */
+	if (conn->write_queue) {
+		bytes_written = __nopoll_conn_complete_write_queue (conn);
+		if (bytes_written < 0 && errno != NOPOLL_EWOULDBLOCK && errno != NOPOLL_EINTR) {
+			nopoll_mutex_unlock (conn->write_mutex);
+			return bytes_written;
+		} /* end if */
 	} /* end if */
 
-	
-	/* send content */
-	nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Mask used for this delivery: %d (about to send %d bytes)",
-		    nopoll_get_32bit (send_buffer + header_size - 2), (int) length + header_size);
+	/* content is still pending to be written: place this frame
+	 * after it to keep order (unless the write limit drops it) */
+	if (conn->write_queue) {
+		frame = __nopoll_frame_new_encoded (header, header_size, content, length, masked ? mask : NULL);
+		if (frame && ! __nopoll_conn_write_limit (conn, frame)) {
+			nopoll_mutex_unlock (conn->write_mutex);
+			nopoll_frame_unref (frame);
+			return -1;
+		} /* end if */
+		if (frame == NULL || ! __nopoll_conn_queue_frame (conn, frame, 0)) {
+			nopoll_mutex_unlock (conn->write_mutex);
+			nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, "Unable to allocate memory to queue frame");
+			nopoll_frame_unref (frame);
+			return -1;
+		} /* end if */
+		state = __nopoll_conn_write_state (conn);
+		nopoll_mutex_unlock (conn->write_mutex);
+		__nopoll_conn_write_notify (conn, state);
+		nopoll_frame_unref (frame);
+
+		/* the whole frame was accepted */
+		return length;
+	} /* end if */
+
+	/* unmasked frames over plain sockets (server side frames) are
+	 * sent as header + caller's payload without building a copy,
+	 * which is only done for what cannot be written right now */
+	if (masked || length == 0 || conn->send != nopoll_conn_default_send ||
+	    sleep_in_header != 0 || conn->__force_stop_after_header != 0) {
+		/* allocate enough memory to send content */
+		send_buffer = nopoll_new (char, length + header_size + 2);
+		if (send_buffer == NULL) {
+			nopoll_mutex_unlock (conn->write_mutex);
+			nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, "Unable to allocate memory to implement send operation");
+			return -1;
+		} /* end if */
+
+		/* copy content to be sent */
+		nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Copying into the buffer %d bytes of header (total memory allocated: %d)", 
+			    header_size, (int) length + header_size + 1);
+		memcpy (send_buffer, header, header_size);
+		if (length > 0) {
+			memcpy (send_buffer + header_size, content, length);
+
+			/* mask content before sending if requested */
+			if (masked) {
+				nopoll_conn_mask_content (conn->ctx, send_buffer + header_size, length, mask, 0);
+			}
+		} /* end if */
 
-	/* clear errno status before writting */
-	desp  = 0;
-	tries = 0;
+		/* send content */
+		nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Mask used for this delivery: %d (about to send %d bytes)",
+			    nopoll_get_32bit (send_buffer + header_size - 2), (int) length + header_size);
+	} /* end if */
 
 	/***** BEGIN INTERNAL debug code for test_30, test_31, test_32, test_33, test_34, test_35 : nopoll-regression-client.c ******/
 	if ((conn->__force_stop_after_header > 0) && (conn->__force_stop_after_header < (length + header_size))) {
@@ -4523,115 +7231,135 @@ int nopoll_conn_send_frame (noPollConn * conn, nopoll_bool fin, nopoll_bool mask
 	} /* end if */
 	/****** END INTERNAL debug code for test_30 : nopoll-regression-client.c ******/
 
-	while (nopoll_true) {
-		/* try to write bytes */
-		if (sleep_in_header == 0) {
-			bytes_written = conn->send (conn, send_buffer + desp, length + header_size - desp);
-		} else {
-			nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Found sleep in header indication, sending header: %d bytes (waiting %ld)", header_size, sleep_in_header);
-			bytes_written = conn->send (conn, send_buffer, header_size);
-			if (bytes_written == header_size) {
-				/* sleep after header ... */
-				nopoll_sleep (sleep_in_header);
-				
-				/* now send the rest of the content (without the header) */
-				bytes_written = conn->send (conn, send_buffer + header_size, length);
-				nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Rest of content written %d (header size: %d, length: %d)", 
-					    bytes_written, header_size, length);
-				bytes_written = length + header_size;
-				nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "final bytes_written %d", bytes_written);
-			} else {
-				nopoll_log (conn->ctx, NOPOLL_LEVEL_WARNING, "Requested to write %d bytes for the header but %d were written",
-					    header_size, bytes_written);
-				return -1;
-			} /* end if */
+	if (sleep_in_header != 0) {
+		nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Found sleep in header indication, sending header: %d bytes (waiting %ld)", header_size, sleep_in_header);
+		bytes_written = conn->send (conn, send_buffer, header_size);
+		if (bytes_written != header_size) {
+			nopoll_mutex_unlock (conn->write_mutex);
+			nopoll_log (conn->ctx, NOPOLL_LEVEL_WARNING, "Requested to write %d bytes for the header but %d were written",
+				    header_size, bytes_written);
+			nopoll_free (send_buffer);
+			return -1;
 		} /* end if */
-		
-		if ((bytes_written + desp) != (length + header_size)) {
-			nopoll_log (conn->ctx, NOPOLL_LEVEL_WARNING, 
-				    "Requested to write %d bytes but found %d written (masked? %d, mask: %u, header size: %d, length: %d), errno = %d : %s", 
-				    (int) length + header_size - desp, bytes_written, masked, mask_value, header_size, (int) length, errno, strerror (errno));
-		} else {
-			/* accomulate bytes written to continue */
-			if (bytes_written > 0)
-				desp += bytes_written;
 
-			nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Bytes written to the wire %d (masked? %d, mask: %u, header size: %d, length: %d)", 
-				    bytes_written, masked, mask_value, header_size, (int) length);
-			break;
+		/* sleep after header ... */
+		nopoll_sleep (sleep_in_header);
+				
+		/* now send the rest of the content (without the header) */
+		bytes_written = conn->send (conn, send_buffer + header_size, length);
+		if (length > 0 && (bytes_written == 0 || (bytes_written < 0 && errno != NOPOLL_EWOULDBLOCK && errno != NOPOLL_EINTR))) {
+			nopoll_mutex_unlock (conn->write_mutex);
+			nopoll_log (conn->ctx, NOPOLL_LEVEL_WARNING, "Failed to write content after header, errno=%d (%s), conn-id=%d",
+				    errno, strerror (errno), conn->id);
+			nopoll_free (send_buffer);
+			return -1;
 		} /* end if */
+		nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Rest of content written %d (header size: %d, length: %d)", 
+			    bytes_written, header_size, length);
 
-		/* accomulate bytes written to continue */
-		if (bytes_written > 0)
-			desp += bytes_written;
+		/* the rest (if any) is written below */
+		desp = header_size + (bytes_written > 0 ? bytes_written : 0);
+	} /* end if */
 
-		/* increase tries */
-		tries++;
+	/* write without blocking: connections watched by a loop
+	 * queue what can't be written now (the loop writes it when
+	 * the socket is writable), otherwise wait for the socket to
+	 * be writable (up to NOPOLL_CONN_SEND_WAIT) */
+	watched = __nopoll_conn_loop_watched (conn);
+	while (desp < total) {
+		/* try to write bytes */
+		if (send_buffer)
+			bytes_written = conn->send (conn, send_buffer + desp, total - desp);
+		else
+			bytes_written = __nopoll_conn_default_sendv (conn, header, header_size, content, length, desp);
+		if (bytes_written > 0) {
+			desp += bytes_written;
+			continue;
+		} /* end if */
 
-		if ((errno != 0) || tries > 50) {
-			nopoll_log (conn->ctx, NOPOLL_LEVEL_WARNING, "Found errno=%d (%s) value while trying to bytes to the WebSocket conn-id=%d or max tries reached=%d",
-				    errno, strerror (errno), conn->id, tries);
+		if (bytes_written < 0 && errno == NOPOLL_EINTR)
+			continue;
+		if (bytes_written == 0 || errno != NOPOLL_EWOULDBLOCK) {
+			/* connection failed (EPIPE, ECONNRESET...):
+			 * nothing left to queue */
+			failed = nopoll_true;
 			break;
 		} /* end if */
+		if (watched)
+			break;
 
-		/* wait a bit */
-		nopoll_sleep (100000);
-
+		/* wait until the socket is writable */
+		if (! waiting) {
+#if defined(NOPOLL_OS_WIN32)
+			nopoll_win32_gettimeofday (&start, NULL);
+#else
+			gettimeofday (&start, NULL);
+#endif
+			waiting = nopoll_true;
+		} /* end if */
+		remaining = NOPOLL_CONN_SEND_WAIT - __nopoll_conn_ellapsed (&start);
+		if (remaining <= 0 || ! __nopoll_conn_wait_writable (conn, remaining))
+			break;
 	} /* end while */
 
-	/* record pending write bytes */
-	conn->pending_write_bytes = length + header_size - desp;
-
-	/* record the header to be accurate when reporting the amount
-	   of bytes written: we have to avoid confusing two things:
-
-	   - Bytes written by the protocol (length + headers)
-	   - Bytes requested by the upper level application to be written (just length)
-	   
-	   By recording the following value, we try to make
-	   nopoll_conn_complete_pending_write to report amount of
-	   upper level bytes written (without headers, which is
-	   something created by noPoll and not requested by the upper
-	   level application).
-	*/
-	conn->pending_write_added_header = header_size;
+	if (failed) {
+		nopoll_mutex_unlock (conn->write_mutex);
+		nopoll_log (conn->ctx, NOPOLL_LEVEL_WARNING, "Failed to send frame, result=%d, errno=%d (%s), conn-id=%d", 
+			    bytes_written, errno, strerror (errno), conn->id);
+		nopoll_free (send_buffer);
+		return -1;
+	} /* end if */
 
 	/* record and report useful userland payload's bytes sent  */
 	bytes_sent = 0;
-	if ((desp - header_size) > 0) {
+	if ((desp - header_size) > 0) 
 	        bytes_sent = (desp - header_size);
-
-		/* make conn->pending_write_added_header 0 because it
-		   have written enought bytes including the header */
-		conn->pending_write_added_header = 0;
-	} /* end if */
 	
 #if defined(SHOW_DEBUG_LOG)
 	level = NOPOLL_LEVEL_DEBUG;
-	if (desp != (length + header_size))
+	if (desp != total && ! watched)
 		level = NOPOLL_LEVEL_CRITICAL;
-	else if (errno == NOPOLL_EWOULDBLOCK && conn->pending_write_bytes > 0)
+	else if (desp != total)
 		level = NOPOLL_LEVEL_WARNING;
 
 	nopoll_log (conn->ctx, level, 
-		    "Write operation finished with last result=%d (bytes_written), bytes-sent=%d, desp=%d, header_size=%d, requested=%d (length), remaining=%d (conn->pending_write_bytes), errno=%d (conn-id=%d)",
+		    "Write operation finished with last result=%d (bytes_written), bytes-sent=%d, desp=%d, header_size=%d, requested=%d (length), remaining=%d (queued), errno=%d (conn-id=%d)",
 		    /* report want we are going to report: result */
 		    bytes_written,
 		    /* bytes sent */
 		    bytes_sent, desp, header_size,
-		    length, conn->pending_write_bytes, errno, conn->id);
+		    length, total - desp, errno, conn->id);
 #endif
 
-	/* check pending bytes for the next operation */
-	if (conn->pending_write_bytes > 0) {
-		conn->pending_write = send_buffer;
-		conn->pending_write_desp = desp;
-		nopoll_log (conn->ctx, NOPOLL_LEVEL_DEBUG, "Stored %d bytes starting from %d out of %d bytes (header size: %d)", 
-			    conn->pending_write_bytes, desp, length + header_size, header_size);
+	/* queue pending bytes for the next operation */
+	if (desp < total) {
+		if (send_buffer) {
+			frame = __nopoll_frame_new_adopt (send_buffer, total, header_size);
+			if (frame == NULL)
+				nopoll_free (send_buffer);
+		} else if (desp < header_size) {
+			/* vectored write: copy only what is pending */
+			frame = __nopoll_frame_new_encoded (header + desp, header_size - desp, content, length, NULL);
+			desp  = 0;
+		} else {
+			frame = __nopoll_frame_new_encoded (header, 0, ((char *) content) + desp - header_size, total - desp, NULL);
+			desp  = 0;
+		} /* end if */
+
+		if (frame == NULL || ! __nopoll_conn_queue_frame (conn, frame, desp)) {
+			nopoll_mutex_unlock (conn->write_mutex);
+			nopoll_log (conn->ctx, NOPOLL_LEVEL_CRITICAL, "Unable to allocate memory to store %d pending bytes", total - desp);
+			nopoll_frame_unref (frame);
+			return -1;
+		} /* end if */
+		nopoll_frame_unref (frame);
 	} else {
 		/* release memory */
 		nopoll_free (send_buffer);
 	} /* end if */
+	state = __nopoll_conn_write_state (conn);
+	nopoll_mutex_unlock (conn->write_mutex);
+	__nopoll_conn_write_notify (conn, state);
 
 	/* if no byte was sent and errno is set to non-blocking error
 	   operation that indicates a retry, report -2 */
@@ -4718,6 +7446,361 @@ noPollConn * nopoll_conn_accept_socket (noPollCtx * ctx, noPollConn * listener,
 	return conn;
 }
 
+/**
+ * @internal SSL_CTX ex data index where session ticket keys are
+ * stored (see __nopoll_conn_ssl_ctx_set_tickets).
+ */
+int __nopoll_conn_ticket_keys_index = -1;
+
+/**
+ * @internal Releases the session ticket keys when the SSL context is
+ * released.
+ */
+void __nopoll_conn_ticket_keys_free (void * parent, void * ptr, CRYPTO_EX_DATA * ad, int idx, long argl, void * argp)
+{
+	noPollTicketKeys * keys = ptr;
+
+	if (keys == NULL)
+		return;
+	nopoll_mutex_destroy (keys->mutex);
+	/* clear key material */
+	OPENSSL_cleanse (keys, sizeof (noPollTicketKeys));
+	nopoll_free (keys);
+	return;
+}
+
+/**
+ * @internal Generates a new session ticket key.
+ */
+nopoll_bool __nopoll_conn_ticket_key_new (noPollTicketKey * key)
+{
+	if (RAND_bytes (key->name, sizeof (key->name)) != 1 ||
+	    RAND_bytes (key->aes_key, sizeof (key->aes_key)) != 1 ||
+	    RAND_bytes (key->hmac_key, sizeof (key->hmac_key)) != 1)
+		return nopoll_false;
+	key->created = (long) time (NULL);
+	return nopoll_true;
+}
+
+/**
+ * @internal Finds the key to encrypt (name == NULL) or decrypt a
+ * ticket, rotating keys when required. Copies the key found and
+ * returns 1 for the current key, 2 for the previous one (ticket to be
+ * renewed) or 0 if not found.
+ */
+int __nopoll_conn_ticket_key_find (SSL * ssl, const unsigned char * name, noPollTicketKey * key)
+{
+	noPollTicketKeys * keys;
+	noPollTicketKey    rotated;
+	int                result = 0;
+
+	keys = SSL_CTX_get_ex_data (SSL_get_SSL_CTX (ssl), __nopoll_conn_ticket_keys_index);
+	if (keys == NULL)
+		return 0;
+
+	nopoll_mutex_lock (keys->mutex);
+
+	/* rotate keys */
+	if ((long) time (NULL) - keys->current.created >= keys->rotation && __nopoll_conn_ticket_key_new (&rotated)) {
+		keys->previous     = keys->current;
+		keys->has_previous = nopoll_true;
+		keys->current      = rotated;
+		OPENSSL_cleanse (&rotated, sizeof (rotated));
+	} /* end if */
+
+	if (name == NULL || memcmp (name, keys->current.name, sizeof (keys->current.name)) == 0) {
+		(*key) = keys->current;
+		result = 1;
+	} else if (keys->has_previous && memcmp (name, keys->previous.name, sizeof (keys->previous.name)) == 0) {
+		(*key) = keys->previous;
+		result = 2;
+	} /* end if */
+
+	nopoll_mutex_unlock (keys->mutex);
+	return result;
+}
+
+/**
+ * @internal Session ticket keys callback (see
+ * SSL_CTX_set_tlsext_ticket_key_cb).
+ */
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+int __nopoll_conn_ticket_key_cb (SSL * ssl, unsigned char * name, unsigned char * iv, EVP_CIPHER_CTX * cipher_ctx, EVP_MAC_CTX * hmac_ctx, int enc)
+#else
+int __nopoll_conn_ticket_key_cb (SSL * ssl, unsigned char * name, unsigned char * iv, EVP_CIPHER_CTX * cipher_ctx, HMAC_CTX * hmac_ctx, int enc)
+#endif
+{
+	noPollTicketKey   key;
+	int               result;
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	OSSL_PARAM        params[3];
+#endif
+
+	if (enc) {
+		/* issue a ticket with the current key */
+		result = __nopoll_conn_ticket_key_find (ssl, NULL, &key);
+		if (result == 0 || RAND_bytes (iv, EVP_MAX_IV_LENGTH) != 1)
+			return -1;
+		memcpy (name, key.name, sizeof (key.name));
+		if (EVP_EncryptInit_ex (cipher_ctx, EVP_aes_256_cbc (), NULL, key.aes_key, iv) != 1)
+			result = -1;
+	} else {
+		/* unknown keys just cause a full handshake */
+		result = __nopoll_conn_ticket_key_find (ssl, name, &key);
+		if (result == 0)
+			return 0;
+		if (EVP_DecryptInit_ex (cipher_ctx, EVP_aes_256_cbc (), NULL, key.aes_key, iv) != 1)
+			result = -1;
+#if defined(TLS1_3_VERSION)
+		/* TLSv1.3 clients use tickets once: always renew them */
+		else if (SSL_version (ssl) >= TLS1_3_VERSION)
+			result = 2;
+#endif
+	} /* end if */
+
+	if (result > 0) {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+		params[0] = OSSL_PARAM_construct_octet_string (OSSL_MAC_PARAM_KEY, key.hmac_key, sizeof (key.hmac_key));
+		params[1] = OSSL_PARAM_construct_utf8_string (OSSL_MAC_PARAM_DIGEST, (char *) "SHA256", 0);
+		params[2] = OSSL_PARAM_construct_end ();
+		if (EVP_MAC_CTX_set_params (hmac_ctx, params) != 1)
+			result = -1;
+#else
+		if (HMAC_Init_ex (hmac_ctx, key.hmac_key, sizeof (key.hmac_key), EVP_sha256 (), NULL) != 1)
+			result = -1;
+#endif
+	} /* end if */
+
+	OPENSSL_cleanse (&key, sizeof (key));
+	return result;
+}
+
+/**
+ * @internal Configures the session cache and session tickets of a
+ * server SSL context according to the listener options.
+ */
+nopoll_bool __nopoll_conn_ssl_ctx_set_sessions (noPollCtx * ctx, SSL_CTX * ssl_ctx, noPollConnOpts * opts)
+{
+	noPollTicketKeys * keys;
+	int                cache_size = opts ? opts->ssl_session_cache_size : NOPOLL_SSL_SESSION_CACHE_SIZE;
+	int                timeout    = opts ? opts->ssl_session_timeout    : NOPOLL_SSL_SESSION_TIMEOUT;
+	nopoll_bool        tickets    = opts ? opts->ssl_session_tickets    : nopoll_true;
+	int                rotation   = opts ? opts->ssl_ticket_rotation    : NOPOLL_SSL_TICKET_ROTATION;
+
+	/* sessions can only be resumed under the same context */
+	SSL_CTX_set_session_id_context (ssl_ctx, (const unsigned char *) "nopoll", 6);
+	SSL_CTX_set_timeout (ssl_ctx, timeout);
+
+	/* stateful session cache */
+	if (cache_size > 0) {
+		SSL_CTX_set_session_cache_mode (ssl_ctx, SSL_SESS_CACHE_SERVER);
+		SSL_CTX_sess_set_cache_size (ssl_ctx, cache_size);
+	} else
+		SSL_CTX_set_session_cache_mode (ssl_ctx, SSL_SESS_CACHE_OFF);
+
+	if (! tickets) {
+		SSL_CTX_set_options (ssl_ctx, SSL_OP_NO_TICKET);
+		return nopoll_true;
+	} /* end if */
+
+	/* session tickets with keys rotated */
+	if (__nopoll_conn_ticket_keys_index < 0)
+		__nopoll_conn_ticket_keys_index = SSL_CTX_get_ex_new_index (0, NULL, NULL, NULL, __nopoll_conn_ticket_keys_free);
+	if (__nopoll_conn_ticket_keys_index < 0)
+		return nopoll_false;
+
+	keys = nopoll_new (noPollTicketKeys, 1);
+	if (keys == NULL)
+		return nopoll_false;
+	keys->rotation = rotation;
+	keys->mutex    = nopoll_mutex_create ();
+	if (! __nopoll_conn_ticket_key_new (&keys->current) || SSL_CTX_set_ex_data (ssl_ctx, __nopoll_conn_ticket_keys_index, keys) != 1) {
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to create session ticket keys");
+		__nopoll_conn_ticket_keys_free (NULL, keys, NULL, 0, 0, NULL);
+		return nopoll_false;
+	} /* end if */
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	SSL_CTX_set_tlsext_ticket_key_evp_cb (ssl_ctx, __nopoll_conn_ticket_key_cb);
+#else
+	SSL_CTX_set_tlsext_ticket_key_cb (ssl_ctx, __nopoll_conn_ticket_key_cb);
+#endif
+	return nopoll_true;
+}
+
+/**
+ * @internal Creates and configures a server SSL context with the
+ * provided certificates and options (certificates and keys are loaded
+ * from disk).
+ */
+SSL_CTX * __nopoll_conn_new_server_ssl_context (noPollCtx      * ctx,
+						noPollConn     * conn,
+						noPollConn     * listener,
+						noPollConnOpts * options,
+						const char     * certificateFile,
+						const char     * privateKey,
+						const char     * chainCertificate)
+{
+	SSL_CTX * ssl_ctx;
+
+	/* create ssl context */
+	ssl_ctx  = __nopoll_conn_get_ssl_context (ctx, conn, listener->opts, nopoll_false);
+	if (ssl_ctx == NULL) {
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to accept incoming connection, failed to create SSL context (__nopoll_conn_get_ssl_context returned NULL)");
+		return NULL;
+	} /* end if */
+
+	/* Configure ca certificate in the case it is defined */
+	if (options && options->ca_certificate) {
+		nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Setting up CA certificate: %s", options->ca_certificate);
+		if (SSL_CTX_load_verify_locations (ssl_ctx, options->ca_certificate, NULL) != 1) {
+			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Failed to configure CA certificate (%s), SSL_CTX_load_verify_locations () failed", options->ca_certificate);
+			SSL_CTX_free (ssl_ctx);
+			return NULL;
+		} /* end if */
+	} /* end if */
+
+	/* enable default verification paths */
+	if (SSL_CTX_set_default_verify_paths (ssl_ctx) != 1) {
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to configure default verification paths, SSL_CTX_set_default_verify_paths () failed");
+		SSL_CTX_free (ssl_ctx);
+		return NULL;
+	} /* end if */
+
+	/* configure chain certificate */
+	if (chainCertificate) {
+		nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Setting up chain certificate: %s", chainCertificate);
+		if (SSL_CTX_use_certificate_chain_file (ssl_ctx, chainCertificate) != 1) {
+			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Failed to configure chain certificate (%s), SSL_CTX_use_certificate_chain_file () failed", chainCertificate);
+			SSL_CTX_free (ssl_ctx);
+			return NULL;
+		} /* end if */
+	} /* end if */
+
+	nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Using certificate file: %s (with ssl context ref: %p)", certificateFile, ssl_ctx);
+	if (SSL_CTX_use_certificate_chain_file (ssl_ctx, certificateFile) != 1) {
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "there was an error while setting certificate file into the SSl context, unable to start TLS profile. Failure found at SSL_CTX_use_certificate_file function. Tried certificate file: %s",
+			    certificateFile);
+		SSL_CTX_free (ssl_ctx);
+		return NULL;
+	} /* end if */
+
+	nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Using certificate key: %s", privateKey);
+	if (SSL_CTX_use_PrivateKey_file (ssl_ctx, privateKey, SSL_FILETYPE_PEM) != 1) {
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL,
+			    "there was an error while setting private file into the SSl context, unable to start TLS profile. Failure found at SSL_CTX_use_PrivateKey_file function. Tried private file: %s",
+			    privateKey);
+		SSL_CTX_free (ssl_ctx);
+		return NULL;
+	} /* end if */
+
+	/* check for private key and certificate file to match. */
+	if (! SSL_CTX_check_private_key (ssl_ctx)) {
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL,
+			    "seems that certificate file and private key doesn't match!, unable to start TLS profile. Failure found at SSL_CTX_check_private_key function. Used certificate %s, and key: %s",
+			    certificateFile, privateKey);
+		SSL_CTX_free (ssl_ctx);
+		return NULL;
+	} /* end if */
+
+	if (options != NULL && ! options->disable_ssl_verify) {
+		nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Enabling certificate client peer verification from server");
+		/** really, really ugly hack to let
+		 * __nopoll_conn_ssl_verify_callback to be able to get
+		 * access to the context required to drop some logs */
+		__nopoll_conn_ssl_ctx_debug = ctx;
+		SSL_CTX_set_verify (ssl_ctx, SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT, __nopoll_conn_ssl_verify_callback);
+		SSL_CTX_set_verify_depth (ssl_ctx, 5);
+	} /* end if */
+
+	/* session resumption */
+	if (! __nopoll_conn_ssl_ctx_set_sessions (ctx, ssl_ctx, listener->opts)) {
+		SSL_CTX_free (ssl_ctx);
+		return NULL;
+	} /* end if */
+
+	return ssl_ctx;
+}
+
+/**
+ * @internal Returns a reference to the server SSL context to be used
+ * by the provided connection. Contexts are configured once per
+ * listener (listeners sharing its port included), certificate and
+ * protocol and then shared by all connections accepted with the same
+ * configuration (unless a context creator is defined, see
+ * nopoll_ctx_set_ssl_context_creator).
+ */
+SSL_CTX * __nopoll_conn_get_server_ssl_context (noPollCtx      * ctx,
+						noPollConn     * conn,
+						noPollConn     * listener,
+						noPollConnOpts * options,
+						const char     * certificateFile,
+						const char     * privateKey,
+						const char     * chainCertificate)
+{
+	noPollSslCtxEntry * entry;
+	SSL_CTX           * ssl_ctx;
+	int                 listener_id   = listener->listener_origin ? listener->listener_origin : listener->id;
+	int                 ssl_protocol  = listener->opts ? (int) listener->opts->ssl_protocol : -1;
+	const char        * caCertificate = options ? options->ca_certificate : NULL;
+	nopoll_bool         verify        = options != NULL && ! options->disable_ssl_verify;
+
+	/* user defined contexts are created for each connection */
+	if (ctx->context_creator)
+		return __nopoll_conn_new_server_ssl_context (ctx, conn, listener, options, certificateFile, privateKey, chainCertificate);
+
+	/* check cached context */
+	nopoll_mutex_lock (ctx->ref_mutex);
+	entry = __nopoll_conn_find_ssl_context (ctx, listener_id, ssl_protocol, certificateFile, privateKey, chainCertificate, caCertificate, verify);
+	if (entry) {
+		ssl_ctx = entry->ssl_ctx;
+		__nopoll_conn_ssl_ctx_ref (ssl_ctx);
+		nopoll_mutex_unlock (ctx->ref_mutex);
+
+		nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Using cached ssl context %p (certificate %s) for conn id %d", ssl_ctx, certificateFile, conn->id);
+		return ssl_ctx;
+	} /* end if */
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	/* configure a new one (without locking, it loads files) */
+	ssl_ctx = __nopoll_conn_new_server_ssl_context (ctx, conn, listener, options, certificateFile, privateKey, chainCertificate);
+	if (ssl_ctx == NULL)
+		return NULL;
+
+	nopoll_mutex_lock (ctx->ref_mutex);
+	entry = __nopoll_conn_find_ssl_context (ctx, listener_id, ssl_protocol, certificateFile, privateKey, chainCertificate, caCertificate, verify);
+	if (entry) {
+		/* configured by another thread in the meantime */
+		SSL_CTX_free (ssl_ctx);
+		ssl_ctx = entry->ssl_ctx;
+	} else {
+		entry                    = nopoll_new (noPollSslCtxEntry, 1);
+		if (entry == NULL) {
+			nopoll_mutex_unlock (ctx->ref_mutex);
+			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to allocate memory to cache server SSL context");
+			SSL_CTX_free (ssl_ctx);
+			return NULL;
+		} /* end if */
+		entry->listener_id       = listener_id;
+		entry->ssl_protocol      = ssl_protocol;
+		entry->certificate       = nopoll_strdup (certificateFile);
+		entry->private_key       = nopoll_strdup (privateKey);
+		entry->chain_certificate = chainCertificate ? nopoll_strdup (chainCertificate) : NULL;
+		entry->ca_certificate    = caCertificate ? nopoll_strdup (caCertificate) : NULL;
+		entry->verify            = verify;
+		entry->ssl_ctx           = ssl_ctx;
+
+		entry->next              = ctx->ssl_ctx_cache;
+		ctx->ssl_ctx_cache       = entry;
+	} /* end if */
+
+	/* reference for the connection */
+	__nopoll_conn_ssl_ctx_ref (ssl_ctx);
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	return ssl_ctx;
+}
+
 /**
  * @internal Function to support accept listener operations.
  */
@@ -4741,6 +7824,13 @@ nopoll_bool __nopoll_conn_accept_complete_common (noPollCtx * ctx, noPollConnOpt
 
 	/* configure non blocking mode */
 	nopoll_conn_set_sock_block (session, nopoll_true);
+
+	/* default write watermarks and limit */
+	__nopoll_conn_set_write_opts (conn, options);
+
+	/* serve the connection from the loop worker that accepted it
+	 * (if nopoll_loop_run_threads is running) */
+	nopoll_io_assign_conn (ctx, conn, listener->worker);
 	
 	/* now check for accept handler */
 	if (ctx->on_accept) {
@@ -4816,63 +7906,10 @@ nopoll_bool __nopoll_conn_accept_complete_common (noPollCtx * ctx, noPollConnOpt
 		else if (options && options->chain_certificate)
 			chainCertificate = options->chain_certificate;
 
-		/* create ssl context */
-		conn->ssl_ctx  = __nopoll_conn_get_ssl_context (ctx, conn, listener->opts, nopoll_false);
+		/* get ssl context (shared by all connections accepted
+		 * with the same configuration) */
+		conn->ssl_ctx  = __nopoll_conn_get_server_ssl_context (ctx, conn, listener, options, certificateFile, privateKey, chainCertificate);
 		if (conn->ssl_ctx == NULL) {
-		        nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Failed to get Ssl Context (conn->ssl_ctx = __nopoll_conn_get_ssl_context), function returned NULL");
-			return nopoll_false;
-		} /* end if */
-
-		/* Configure ca certificate in the case it is defined */
-		if (options && options->ca_certificate) {
-			nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Setting up CA certificate: %s", options->ca_certificate);
-			if (SSL_CTX_load_verify_locations (conn->ssl_ctx, options->ca_certificate, NULL) != 1) {
-				nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Failed to configure CA certificate (%s), SSL_CTX_load_verify_locations () failed", options->ca_certificate);
-				return nopoll_false;
-			} /* end if */
-
-		} /* end if */
-
-		/* enable default verification paths */
-		if (SSL_CTX_set_default_verify_paths (conn->ssl_ctx) != 1) {
-			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to configure default verification paths, SSL_CTX_set_default_verify_paths () failed");
-			return nopoll_false;
-		} /* end if */
-
-		/* configure chain certificate */
-		if (chainCertificate) {
-			nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Setting up chain certificate: %s", chainCertificate);
-			if (SSL_CTX_use_certificate_chain_file (conn->ssl_ctx, chainCertificate) != 1) {
-				nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Failed to configure chain certificate (%s), SSL_CTX_use_certificate_chain_file () failed", chainCertificate);
-				return nopoll_false;
-			} /* end if */
-		} /* end if */
-
-		nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Using certificate file: %s (with ssl context ref: %p)", certificateFile, conn->ssl_ctx);
-		if (conn->ssl_ctx == NULL || SSL_CTX_use_certificate_chain_file (conn->ssl_ctx, certificateFile) != 1) {
-			/* drop an error log */
-			if (conn->ssl_ctx == NULL)
-				nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to accept incoming connection, failed to create SSL context. Context creator returned NULL pointer");
-			else 
-				nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "there was an error while setting certificate file into the SSl context, unable to start TLS profile. Failure found at SSL_CTX_use_certificate_file function. Tried certificate file: %s", 
-					    certificateFile);
-
-			/* dump error stack */
-			nopoll_conn_shutdown (conn);
-			nopoll_ctx_unregister_conn (ctx, conn);
-
-			/* release connection options */
-			__nopoll_conn_opts_release_if_needed (options);
-
-			return nopoll_false;
-		} /* end if */
-
-		nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Using certificate key: %s", privateKey);
-		if (SSL_CTX_use_PrivateKey_file (conn->ssl_ctx, privateKey, SSL_FILETYPE_PEM) != 1) {
-			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, 
-				    "there was an error while setting private file into the SSl context, unable to start TLS profile. Failure found at SSL_CTX_use_PrivateKey_file function. Tried private file: %s", 
-				    privateKey);
-			/* dump error stack */
 			nopoll_conn_shutdown (conn);
 			nopoll_ctx_unregister_conn (ctx, conn);
 
@@ -4880,33 +7917,8 @@ nopoll_bool __nopoll_conn_accept_complete_common (noPollCtx * ctx, noPollConnOpt
 			__nopoll_conn_opts_release_if_needed (options);
 
 			return nopoll_false;
-		}
-
-		/* check for private key and certificate file to match. */
-		if (! SSL_CTX_check_private_key (conn->ssl_ctx)) {
-			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, 
-				    "seems that certificate file and private key doesn't match!, unable to start TLS profile. Failure found at SSL_CTX_check_private_key function. Used certificate %s, and key: %s",
-				    certificateFile, privateKey);
-			/* dump error stack */
-			nopoll_conn_shutdown (conn);
-
-			/* release connection options */
-			__nopoll_conn_opts_release_if_needed (options);
-
-			return nopoll_false;
-		} /* end if */
-
-		if (options != NULL && ! options->disable_ssl_verify) {
-			nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Enabling certificate client peer verification from server");
-			/** really, really ugly hack to let
-			 * __nopoll_conn_ssl_verify_callback to be able to get
-			 * access to the context required to drop some logs */
-			__nopoll_conn_ssl_ctx_debug = ctx;
-			SSL_CTX_set_verify (conn->ssl_ctx, SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT, __nopoll_conn_ssl_verify_callback); 
-			SSL_CTX_set_verify_depth (conn->ssl_ctx, 5);
 		} /* end if */
 
-
 		/* create SSL context */
 		conn->ssl = SSL_new (conn->ssl_ctx);       
 		if (conn->ssl == NULL) {
@@ -4923,6 +7935,12 @@ nopoll_bool __nopoll_conn_accept_complete_common (noPollCtx * ctx, noPollConnOpt
 		/* set the file descriptor */
 		SSL_set_fd (conn->ssl, conn->session);
 
+		/* writes never block (see __nopoll_conn_tls_set_modes) */
+		__nopoll_conn_tls_set_modes (conn);
+
+		/* request kernel TLS offload (if enabled) */
+		__nopoll_conn_ktls_enable (ctx, conn, options);
+
 		/* don't complete here the operation but flag it as
 		 * pending */
 		conn->pending_ssl_accept = nopoll_true;
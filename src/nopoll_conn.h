@@ -128,6 +128,8 @@ nopoll_bool    nopoll_conn_is_ready (noPollConn * conn);
 
 nopoll_bool    nopoll_conn_is_tls_on (noPollConn * conn);
 
+nopoll_bool    nopoll_conn_is_ktls_on (noPollConn * conn, nopoll_bool * send, nopoll_bool * recv);
+
 NOPOLL_SOCKET nopoll_conn_socket (noPollConn * conn);
 
 void           nopoll_conn_set_socket (noPollConn * conn, NOPOLL_SOCKET _socket);
@@ -183,6 +185,8 @@ int           nopoll_conn_send_binary (noPollConn * conn, const char * content,
 
 int           nopoll_conn_send_binary_fragment (noPollConn * conn, const char * content, long length);
 
+int           nopoll_conn_send_prepared (noPollConn * conn, noPollFrame * frame);
+
 int           nopoll_conn_complete_pending_write (noPollConn * conn);
 
 int           nopoll_conn_pending_write_bytes    (noPollConn * conn);
@@ -211,6 +215,20 @@ void          nopoll_conn_set_on_close (noPollConn            * conn,
 					noPollOnCloseHandler    on_close,
 					noPollPtr               user_data);
 
+void          nopoll_conn_set_write_watermarks (noPollConn * conn, int high, int low);
+
+nopoll_bool   nopoll_conn_is_write_blocked (noPollConn * conn);
+
+void          nopoll_conn_set_write_limit (noPollConn * conn, int limit, noPollWriteLimit policy);
+
+void          nopoll_conn_set_on_write_blocked (noPollConn            * conn,
+						noPollOnWriteHandler    on_write_blocked,
+						noPollPtr               user_data);
+
+void          nopoll_conn_set_on_write_drained (noPollConn            * conn,
+						noPollOnWriteHandler    on_write_drained,
+						noPollPtr               user_data);
+
 int nopoll_conn_send_frame (noPollConn * conn, nopoll_bool fin, nopoll_bool masked,
 			    noPollOpCode op_code, long length, noPollPtr content,
 			    long sleep_in_header);
@@ -236,10 +254,47 @@ const char *       nopoll_conn_get_x_real_ip_header (noPollConn * conn);
 /** internal api **/
 void nopoll_conn_complete_handshake (noPollConn * conn);
 
+nopoll_bool nopoll_conn_has_pending_input (noPollConn * conn);
+
+nopoll_bool nopoll_conn_has_buffered_input (noPollConn * conn);
+
+nopoll_bool __nopoll_conn_wire_pending (noPollConn * conn);
+
+int         __nopoll_conn_header_size (const char * header, int available);
+
 int nopoll_conn_default_receive (noPollConn * conn, char * buffer, int buffer_size);
 
 int nopoll_conn_default_send (noPollConn * conn, char * buffer, int buffer_size);
 
+int __nopoll_conn_default_sendv (noPollConn * conn, const char * header, int header_size,
+				 const char * payload, int payload_size, int desp);
+
+int __nopoll_conn_build_header (char * header, nopoll_bool fin, noPollOpCode op_code, long length, const char * mask);
+
+nopoll_bool __nopoll_conn_queue_frame (noPollConn * conn, noPollFrame * frame, int desp);
+
+void __nopoll_conn_queue_free (noPollConn * conn);
+
+int __nopoll_conn_complete_write_queue (noPollConn * conn);
+
+int __nopoll_conn_write_state (noPollConn * conn);
+
+void __nopoll_conn_write_notify (noPollConn * conn, int state);
+
+void __nopoll_conn_set_write_opts (noPollConn * conn, noPollConnOpts * opts);
+
+void __nopoll_conn_connect_continue (noPollConn * conn);
+
+void __nopoll_conn_connect_check_timeout (noPollConn * conn);
+
+void __nopoll_conn_close_defer (noPollConn * conn);
+
+void __nopoll_conn_close_finish (noPollConn * conn);
+
+nopoll_bool __nopoll_conn_close_check (noPollConn * conn, nopoll_bool failed);
+
+void __nopoll_conn_resolver_stop (noPollCtx * ctx);
+
 void nopoll_conn_mask_content (noPollCtx * ctx, char * payload, int payload_size, char * mask, int desp);
 
 END_C_DECLS
@@ -72,7 +72,9 @@ noPollConnOpts * nopoll_conn_opts_new (void)
 	result->ssl_protocol = NOPOLL_METHOD_TLSV1;
 #endif	  
 
+#if !defined(NOPOLL_HAVE_ATOMIC_REFS)
 	result->mutex        = nopoll_mutex_create ();
+#endif
 	result->refs         = 1;
 
 	/* by default, disable ssl peer verification */
@@ -80,6 +82,12 @@ noPollConnOpts * nopoll_conn_opts_new (void)
 	/* by default, add origin header */
 	result->add_origin_header  = nopoll_true;
 
+	/* default server TLS session resumption */
+	result->ssl_session_cache_size = NOPOLL_SSL_SESSION_CACHE_SIZE;
+	result->ssl_session_timeout    = NOPOLL_SSL_SESSION_TIMEOUT;
+	result->ssl_session_tickets    = nopoll_true;
+	result->ssl_ticket_rotation    = NOPOLL_SSL_TICKET_ROTATION;
+
 	return result;
 }
 
@@ -291,6 +299,196 @@ void        nopoll_conn_opts_add_origin_header (noPollConnOpts * opts, nopoll_bo
 	return;
 }
 
+/** 
+ * @brief Allows to configure default write watermarks for
+ * connections created with these options (see \ref
+ * nopoll_conn_set_write_watermarks).
+ *
+ * When used on listener options, connections accepted get them.
+ *
+ * @param opts The connection options to configure.
+ *
+ * @param high High watermark in bytes (0 disables watermarks).
+ *
+ * @param low Low watermark in bytes. It must be lower than high,
+ * otherwise high / 2 is used.
+ */
+void        nopoll_conn_opts_set_write_watermarks (noPollConnOpts * opts, int high, int low)
+{
+	if (opts == NULL)
+		return;
+
+	if (high < 0)
+		high = 0;
+	if (low < 0 || low >= high)
+		low = high / 2;
+	opts->write_high = high;
+	opts->write_low  = low;
+	return;
+}
+
+/** 
+ * @brief Allows to configure the default write hard limit (and the
+ * policy applied above it) for connections created with these options
+ * (see \ref nopoll_conn_set_write_limit).
+ *
+ * When used on listener options, connections accepted get them.
+ *
+ * @param opts The connection options to configure.
+ *
+ * @param limit Max bytes queued (0 disables the limit).
+ *
+ * @param policy What to do with new messages above the limit.
+ */
+void        nopoll_conn_opts_set_write_limit (noPollConnOpts * opts, int limit, noPollWriteLimit policy)
+{
+	if (opts == NULL)
+		return;
+
+	opts->write_limit        = limit > 0 ? limit : 0;
+	opts->write_limit_policy = policy;
+	return;
+}
+
+/** 
+ * @brief Allows to configure the TLS session cache used by listeners
+ * created with these options, so clients reconnecting can resume
+ * their previous session (abbreviated handshake) instead of doing a
+ * full handshake.
+ *
+ * Sessions are cached in memory by the SSL context shared by all
+ * connections accepted by the listener (see \ref
+ * nopoll_ctx_invalidate_ssl_contexts). By default, up to
+ * NOPOLL_SSL_SESSION_CACHE_SIZE sessions are cached for
+ * NOPOLL_SSL_SESSION_TIMEOUT seconds.
+ *
+ * @param opts The connection options to configure.
+ *
+ * @param cache_size Max number of sessions cached (0 disables the
+ * cache, so sessions are only resumed through session tickets).
+ *
+ * @param timeout Session lifetime in seconds (also used for session
+ * tickets). Values <= 0 keep the current value.
+ */
+void        nopoll_conn_opts_set_ssl_session_cache (noPollConnOpts * opts, int cache_size, int timeout)
+{
+	if (opts == NULL)
+		return;
+
+	opts->ssl_session_cache_size = cache_size > 0 ? cache_size : 0;
+	if (timeout > 0)
+		opts->ssl_session_timeout = timeout;
+	return;
+}
+
+/** 
+ * @brief Allows to configure session tickets (stateless session
+ * resumption) on listeners created with these options.
+ *
+ * Tickets are encrypted with keys generated by each listener SSL
+ * context, rotated every rotation seconds. Tickets issued with the
+ * previous key are still accepted (and renewed) until the next
+ * rotation, so a ticket is valid for up to two rotation periods
+ * (limited by the session lifetime, see \ref
+ * nopoll_conn_opts_set_ssl_session_cache).
+ *
+ * @param opts The connection options to configure.
+ *
+ * @param enabled nopoll_true to issue session tickets (default),
+ * nopoll_false to disable them.
+ *
+ * @param rotation Ticket keys rotation period in seconds (by default
+ * NOPOLL_SSL_TICKET_ROTATION). Values <= 0 keep the current value.
+ */
+void        nopoll_conn_opts_set_ssl_session_tickets (noPollConnOpts * opts, nopoll_bool enabled, int rotation)
+{
+	if (opts == NULL)
+		return;
+
+	opts->ssl_session_tickets = enabled;
+	if (rotation > 0)
+		opts->ssl_ticket_rotation = rotation;
+	return;
+}
+
+/** 
+ * @brief Allows to request kernel TLS offload (kTLS) for connections
+ * created with these options (client connections or connections
+ * accepted by listeners).
+ *
+ * Once the handshake is finished, if the kernel supports the
+ * negotiated cipher, TLS records are encrypted and decrypted by the
+ * kernel and frames are written straight to the socket, like on
+ * plain connections. Otherwise, the connection silently keeps using
+ * OpenSSL. Use \ref nopoll_conn_is_ktls_on to check if offload is
+ * active for a connection.
+ *
+ * Only available on Linux with OpenSSL built with kTLS support (and
+ * the tls kernel module loaded).
+ *
+ * @param opts The connection options to configure.
+ *
+ * @param enabled nopoll_true to request kernel TLS offload,
+ * nopoll_false to disable it (default).
+ */
+void        nopoll_conn_opts_set_ktls (noPollConnOpts * opts, nopoll_bool enabled)
+{
+	if (opts == NULL)
+		return;
+
+	opts->ktls = enabled;
+	return;
+}
+
+/** 
+ * @brief Allows to create client connections without blocking the
+ * caller until the connection is established.
+ *
+ * By default, client connections (for example \ref nopoll_conn_new_opts
+ * or \ref nopoll_conn_tls_new) wait for the TCP connect and the TLS
+ * handshake (retrying every 10ms) and for the client init to be sent.
+ * With this option, the connection is returned as soon as the TCP
+ * connect is started and the loop running the context (\ref
+ * nopoll_loop_wait or \ref nopoll_loop_run_threads) completes the TCP
+ * connect, the TLS handshake and the WebSocket upgrade as the socket
+ * becomes ready, so many connections can be opened in parallel from
+ * a single thread.
+ *
+ * The on ready handler (\ref nopoll_conn_set_on_ready or \ref
+ * nopoll_ctx_set_on_ready) is called once the connection is ready. If
+ * the connection fails or isn't ready within the connect timeout
+ * (\ref nopoll_conn_connect_timeout), it is closed and the on close
+ * handler (\ref nopoll_conn_set_on_close) is called.
+ *
+ * Connections created with this option must be served by a loop
+ * (until it is running, the connection just waits).
+ *
+ * Host names are resolved by resolver threads (\ref
+ * nopoll_ctx_set_resolver_threads) so the caller isn't blocked by DNS
+ * either (addresses defined, cached or numeric don't use them). The
+ * loop then connects to the addresses found: when a host has IPv4 and
+ * IPv6 addresses, they are tried alternating families, starting a new
+ * attempt each 250ms (or as soon as the previous one fails) and
+ * keeping the first one connected (Happy Eyeballs, RFC 8305). Connections created with the IPv6
+ * variants (for example \ref nopoll_conn_tls_new6) only use IPv6
+ * addresses. Addresses found are cached (\ref nopoll_ctx_set_dns_cache)
+ * and can be defined for a host name (\ref
+ * nopoll_ctx_set_host_addresses).
+ *
+ * @param opts The connection options to configure.
+ *
+ * @param enabled nopoll_true to connect without blocking,
+ * nopoll_false to wait for the connect (default).
+ */
+void        nopoll_conn_opts_set_async_connect (noPollConnOpts * opts, nopoll_bool enabled)
+{
+	if (opts == NULL)
+		return;
+
+	opts->async_connect = enabled;
+	return;
+}
+
 
 /** 
  * @brief Allows to increase a reference to the connection options
@@ -307,18 +505,11 @@ nopoll_bool nopoll_conn_opts_ref (noPollConnOpts * opts)
 	if (opts == NULL)
 		return nopoll_false;
 
-	/* lock the mutex */
-	nopoll_mutex_lock (opts->mutex);
-	if (opts->refs <= 0) {
-		/* unlock the mutex */
-		nopoll_mutex_unlock (opts->mutex);
+	/* object already released */
+	if (nopoll_ref_get (&opts->refs, opts->mutex) <= 0)
 		return nopoll_false;
-	}
-	
-	opts->refs++;
 
-	/* release here the mutex */
-	nopoll_mutex_unlock (opts->mutex);
+	nopoll_ref_inc (&opts->refs, opts->mutex);
 
 	return nopoll_true;
 }
@@ -388,17 +579,8 @@ void __nopoll_conn_opts_free_common  (noPollConnOpts * opts)
 	if (opts == NULL)
 		return;
 
-	/* acquire here the mutex */
-	nopoll_mutex_lock (opts->mutex);
-
-	opts->refs--;
-	if (opts->refs != 0) {
-		/* release here the mutex */
-		nopoll_mutex_unlock (opts->mutex);
+	if (nopoll_ref_dec (&opts->refs, opts->mutex) != 0)
 		return;
-	}
-	/* release here the mutex */
-	nopoll_mutex_unlock (opts->mutex);
 
 	nopoll_free (opts->certificate);
 	nopoll_free (opts->private_key);
@@ -415,7 +597,9 @@ void __nopoll_conn_opts_free_common  (noPollConnOpts * opts)
 		nopoll_free (opts->extra_headers);
 
 	/* release mutex */
+#if !defined(NOPOLL_HAVE_ATOMIC_REFS)
 	nopoll_mutex_destroy (opts->mutex);
+#endif
 	nopoll_free (opts);
 	return;
 }
@@ -60,6 +60,18 @@ void        nopoll_conn_opts_skip_origin_check (noPollConnOpts * opts, nopoll_bo
 
 void        nopoll_conn_opts_add_origin_header (noPollConnOpts * opts, nopoll_bool add);
 
+void        nopoll_conn_opts_set_write_watermarks (noPollConnOpts * opts, int high, int low);
+
+void        nopoll_conn_opts_set_write_limit (noPollConnOpts * opts, int limit, noPollWriteLimit policy);
+
+void        nopoll_conn_opts_set_ssl_session_cache (noPollConnOpts * opts, int cache_size, int timeout);
+
+void        nopoll_conn_opts_set_ssl_session_tickets (noPollConnOpts * opts, nopoll_bool enabled, int rotation);
+
+void        nopoll_conn_opts_set_ktls (noPollConnOpts * opts, nopoll_bool enabled);
+
+void        nopoll_conn_opts_set_async_connect (noPollConnOpts * opts, nopoll_bool enabled);
+
 nopoll_bool nopoll_conn_opts_ref (noPollConnOpts * opts);
 
 void        nopoll_conn_opts_unref (noPollConnOpts * opts);
@@ -90,6 +90,11 @@ noPollCtx * nopoll_ctx_new (void) {
 	/* default log initialization */
 	result->not_executed  = nopoll_true;
 	result->debug_enabled = nopoll_false;
+	result->log_level     = NOPOLL_LEVEL_DEBUG;
+	result->log_threshold = NOPOLL_LEVEL_CRITICAL + 1;
+
+	/* select masking kernel before connections use it */
+	__nopoll_conn_mask_init ();
 	
 	/* colored log */
 	result->not_executed_color  = nopoll_true;
@@ -98,6 +103,24 @@ noPollCtx * nopoll_ctx_new (void) {
 	/* default back log */
 	result->backlog = 5;
 
+	/* drain messages received on each loop readiness event */
+	result->loop_drain        = nopoll_true;
+	result->loop_drain_budget = NOPOLL_LOOP_DRAIN_BUDGET;
+
+	/* read buffer created by connections */
+	result->read_buffer_size  = NOPOLL_READ_BUFFER_SIZE;
+
+	/* messages cached for reuse */
+	result->msg_pool_size     = NOPOLL_MSG_POOL_SIZE;
+	result->msg_inline_size   = NOPOLL_MSG_INLINE_SIZE;
+
+	/* client TLS sessions cached for reuse */
+	result->ssl_sessions_size = NOPOLL_SSL_CLIENT_SESSIONS;
+
+	/* host names resolved for asynchronous connects */
+	result->resolver_size     = NOPOLL_RESOLVER_THREADS;
+	result->dns_cache_ttl     = NOPOLL_DNS_CACHE_TTL;
+
 	/* current list length */
 	result->conn_length = 0;
 
@@ -106,6 +129,10 @@ noPollCtx * nopoll_ctx_new (void) {
 
 	/* create mutexes */
 	result->ref_mutex = nopoll_mutex_create ();
+	result->msg_pool_mutex = nopoll_mutex_create ();
+
+	/* resolver threads wait on it for requests */
+	result->resolver_cond = nopoll_cond_create ();
 
 #if !defined(NOPOLL_OS_WIN32)
 	/* install sigpipe handler */
@@ -129,17 +156,156 @@ nopoll_bool    nopoll_ctx_ref (noPollCtx * ctx)
 	/* return false value */
 	nopoll_return_val_if_fail (ctx, ctx, nopoll_false);
 
-	/* acquire mutex here */
-	nopoll_mutex_lock (ctx->ref_mutex);
+	nopoll_ref_inc (&ctx->refs, ctx->ref_mutex);
+
+	return nopoll_true;
+}
 
-	ctx->refs++;
 
-	/* release mutex here */
+/** 
+ * @internal Releases a reference to the provided snapshot, releasing
+ * connection references it holds when it reaches 0 (must be called
+ * without ctx->ref_mutex acquired).
+ */
+void __nopoll_ctx_snapshot_unref (noPollCtx * ctx, noPollConnSnapshot * snapshot)
+{
+	int iterator;
+
+	if (snapshot == NULL)
+		return;
+
+	nopoll_mutex_lock (ctx->ref_mutex);
+	snapshot->refs--;
+	if (snapshot->refs > 0) {
+		nopoll_mutex_unlock (ctx->ref_mutex);
+		return;
+	} /* end if */
+	iterator = 0;
+	while (iterator < snapshot->length) {
+		snapshot->conns[iterator]->snapshot_refs--;
+		iterator++;
+	} /* end while */
 	nopoll_mutex_unlock (ctx->ref_mutex);
 
+	iterator = 0;
+	while (iterator < snapshot->length) {
+		nopoll_conn_unref (snapshot->conns[iterator]);
+		iterator++;
+	} /* end while */
+	nopoll_free (snapshot);
+	return;
+}
+
+/** 
+ * @internal Detaches the current snapshot (must be called with
+ * ctx->ref_mutex acquired), returning it to be released once the
+ * mutex is unlocked.
+ */
+noPollConnSnapshot * __nopoll_ctx_snapshot_detach (noPollCtx * ctx)
+{
+	noPollConnSnapshot * snapshot = ctx->conn_snapshot;
+
+	ctx->conn_snapshot = NULL;
+	return snapshot;
+}
+
+/** 
+ * @internal Adds the connection registered to the current snapshot
+ * (must be called with ctx->ref_mutex acquired). The snapshot is
+ * updated in place unless a foreach operation is using it, in which
+ * case it is detached (returned to be released once the mutex is
+ * unlocked) to be created again by the next foreach operation.
+ */
+noPollConnSnapshot * __nopoll_ctx_snapshot_add (noPollCtx * ctx, noPollConn * conn)
+{
+	noPollConnSnapshot * snapshot = ctx->conn_snapshot;
+
+	if (snapshot == NULL)
+		return NULL;
+
+	if (snapshot->refs > 1)
+		return __nopoll_ctx_snapshot_detach (ctx);
+
+	if (snapshot->length == snapshot->size) {
+		snapshot = nopoll_realloc (snapshot, sizeof (noPollConnSnapshot) + sizeof (noPollConn *) * snapshot->size * 2);
+		if (snapshot == NULL)
+			return __nopoll_ctx_snapshot_detach (ctx);
+		snapshot->size     = snapshot->size * 2 + 1;
+		ctx->conn_snapshot = snapshot;
+	} /* end if */
+
+	nopoll_conn_ref (conn);
+	conn->snapshot_refs++;
+	snapshot->conns[snapshot->length++] = conn;
+	conn->snapshot_pos                  = snapshot->length;
+	return NULL;
+}
+
+/** 
+ * @internal Removes the connection unregistered from the current
+ * snapshot (must be called with ctx->ref_mutex acquired). The
+ * snapshot is updated in place (nopoll_true is returned and the
+ * reference it held to the connection must be released once the
+ * mutex is unlocked) unless a foreach operation is using it, in which
+ * case it is detached (see __nopoll_ctx_snapshot_add).
+ */
+nopoll_bool __nopoll_ctx_snapshot_remove (noPollCtx * ctx, noPollConn * conn, noPollConnSnapshot ** detached)
+{
+	noPollConnSnapshot * snapshot = ctx->conn_snapshot;
+	int                  pos      = conn->snapshot_pos - 1;
+
+	(*detached) = NULL;
+	if (snapshot == NULL)
+		return nopoll_false;
+
+	if (snapshot->refs > 1 || pos < 0 || pos >= snapshot->length || snapshot->conns[pos] != conn) {
+		(*detached) = __nopoll_ctx_snapshot_detach (ctx);
+		return nopoll_false;
+	} /* end if */
+
+	/* move last connection to the position released */
+	snapshot->length--;
+	snapshot->conns[pos]                    = snapshot->conns[snapshot->length];
+	snapshot->conns[pos]->snapshot_pos      = pos + 1;
+	conn->snapshot_pos                      = 0;
+	conn->snapshot_refs--;
 	return nopoll_true;
 }
 
+/** 
+ * @internal Returns a reference to the snapshot of connections
+ * currently registered, creating it if it was detached (must be
+ * called with ctx->ref_mutex acquired).
+ */
+noPollConnSnapshot * __nopoll_ctx_snapshot_get (noPollCtx * ctx)
+{
+	noPollConnSnapshot * snapshot = ctx->conn_snapshot;
+	int                  iterator;
+
+	if (snapshot == NULL) {
+		snapshot = nopoll_calloc (1, sizeof (noPollConnSnapshot) + sizeof (noPollConn *) * ctx->conn_num);
+		if (snapshot == NULL)
+			return NULL;
+
+		/* the context keeps a reference */
+		snapshot->refs = 1;
+		snapshot->size = ctx->conn_num + 1;
+		iterator = 0;
+		while (iterator < ctx->conn_length) {
+			if (ctx->conn_list[iterator]) {
+				nopoll_conn_ref (ctx->conn_list[iterator]);
+				ctx->conn_list[iterator]->snapshot_refs++;
+				snapshot->conns[snapshot->length++] = ctx->conn_list[iterator];
+				ctx->conn_list[iterator]->snapshot_pos = snapshot->length;
+			} /* end if */
+			iterator++;
+		} /* end while */
+		ctx->conn_snapshot = snapshot;
+	} /* end if */
+
+	snapshot->refs++;
+	return snapshot;
+}
 
 /** 
  * @brief allows to release a reference acquired to the provided
@@ -154,17 +320,8 @@ void           nopoll_ctx_unref (noPollCtx * ctx)
 
 	nopoll_return_if_fail (ctx, ctx);
 
-	/* acquire mutex here */
-	nopoll_mutex_lock (ctx->ref_mutex);
-
-	ctx->refs--;
-	if (ctx->refs != 0) {
-		/* release mutex here */
-		nopoll_mutex_unlock (ctx->ref_mutex);
+	if (nopoll_ref_dec (&ctx->refs, ctx->ref_mutex) != 0)
 		return;
-	}
-	/* release mutex here */
-	nopoll_mutex_unlock (ctx->ref_mutex);
 
 	nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Releasing no poll context %p (%d, conns: %d)", ctx, ctx->refs, ctx->conn_length);
 
@@ -183,14 +340,34 @@ void           nopoll_ctx_unref (noPollCtx * ctx)
 		iterator++;
 	} /* end while */
 
+	/* stop asynchronous log writer (if any) */
+	__nopoll_log_async_stop (ctx);
+
+	/* stop resolver threads (if any) */
+	__nopoll_conn_resolver_stop (ctx);
+
+	/* release ssl contexts and sessions cached */
+	nopoll_ctx_invalidate_ssl_contexts (ctx, NULL);
+	nopoll_ctx_set_ssl_client_sessions (ctx, 0);
+
+	/* release messages cached */
+	__nopoll_msg_pool_release (ctx, 0);
+
+	/* release connections snapshot */
+	__nopoll_ctx_snapshot_unref (ctx, __nopoll_ctx_snapshot_detach (ctx));
+
 	/* release mutex */
 	nopoll_mutex_destroy (ctx->ref_mutex);
+	nopoll_mutex_destroy (ctx->msg_pool_mutex);
+	nopoll_cond_destroy (ctx->resolver_cond);
 
 	/* release all certificates buckets */
 	nopoll_free (ctx->certificates);
 
 	/* release connection */
 	nopoll_free (ctx->conn_list);
+	nopoll_free (ctx->conn_free);
+	nopoll_free (ctx->conn_index);
 	ctx->conn_length = 0;
 	nopoll_free (ctx);
 	return;
@@ -206,19 +383,108 @@ void           nopoll_ctx_unref (noPollCtx * ctx)
  */
 int            nopoll_ctx_ref_count (noPollCtx * ctx)
 {
-	int result;
 	if (! ctx)
 		return -1;
 
-	/* lock */
-	nopoll_mutex_lock (ctx->ref_mutex);
+	return nopoll_ref_get (&ctx->refs, ctx->ref_mutex);
+}
 
-	result = ctx->refs;
+/* hash used to find connection ids in the context index */
+#define __NOPOLL_CTX_INDEX_HASH(id, size) ((int) (((unsigned int) (id) * 2654435761u) & (unsigned int) ((size) - 1)))
 
-	/* unlock */
-	nopoll_mutex_unlock (ctx->ref_mutex);
+/** 
+ * @internal Finds the index entry for the provided connection id or
+ * the empty entry where it should be placed (must be called with
+ * ctx->ref_mutex acquired).
+ */
+int __nopoll_ctx_index_find (noPollCtx * ctx, int id)
+{
+	int position = __NOPOLL_CTX_INDEX_HASH (id, ctx->conn_index_size);
 
-	return result;
+	while (ctx->conn_index[position] && ctx->conn_list[ctx->conn_index[position] - 1]->id != id)
+		position = (position + 1) & (ctx->conn_index_size - 1);
+	return position;
+}
+
+/** 
+ * @internal Removes the index entry at the provided position, moving
+ * back entries placed after it so lookups don't require tombstones
+ * (must be called with ctx->ref_mutex acquired).
+ */
+void __nopoll_ctx_index_remove (noPollCtx * ctx, int position)
+{
+	int mask = ctx->conn_index_size - 1;
+	int next = position;
+	int home;
+
+	ctx->conn_index[position] = 0;
+	while (nopoll_true) {
+		next = (next + 1) & mask;
+		if (ctx->conn_index[next] == 0)
+			break;
+
+		/* move the entry if its home position isn't placed
+		 * (cyclically) between the hole and the entry */
+		home = __NOPOLL_CTX_INDEX_HASH (ctx->conn_list[ctx->conn_index[next] - 1]->id, ctx->conn_index_size);
+		if (position <= next ? (home > position && home <= next) : (home > position || home <= next))
+			continue;
+
+		ctx->conn_index[position] = ctx->conn_index[next];
+		ctx->conn_index[next]     = 0;
+		position                  = next;
+	} /* end while */
+
+	return;
+}
+
+/** 
+ * @internal Grows the connection list and its index, doubling their
+ * size (must be called with ctx->ref_mutex acquired).
+ */
+nopoll_bool __nopoll_ctx_conns_grow (noPollCtx * ctx)
+{
+	noPollConn ** list;
+	int         * free_slots;
+	int         * index;
+	int           length = ctx->conn_length > 0 ? ctx->conn_length * 2 : 16;
+	int           iterator;
+
+	list       = (noPollConn **) nopoll_realloc (ctx->conn_list, sizeof (noPollConn *) * length);
+	if (list == NULL)
+		return nopoll_false;
+	ctx->conn_list = list;
+	free_slots = (int *) nopoll_realloc (ctx->conn_free, sizeof (int) * length);
+	if (free_slots == NULL)
+		return nopoll_false;
+	ctx->conn_free = free_slots;
+
+	/* index is kept at most half full */
+	index      = nopoll_new (int, length * 2);
+	if (index == NULL)
+		return nopoll_false;
+
+	/* clear new positions, pushing them as free slots (lower
+	 * slots first) */
+	iterator = length - 1;
+	while (iterator >= ctx->conn_length) {
+		ctx->conn_list[iterator] = NULL;
+		ctx->conn_free[ctx->conn_free_length++] = iterator;
+		iterator--;
+	} /* end while */
+	ctx->conn_length = length;
+
+	/* rebuild index */
+	nopoll_free (ctx->conn_index);
+	ctx->conn_index      = index;
+	ctx->conn_index_size = length * 2;
+	iterator = 0;
+	while (iterator < ctx->conn_length) {
+		if (ctx->conn_list[iterator])
+			ctx->conn_index[__nopoll_ctx_index_find (ctx, ctx->conn_list[iterator]->id)] = iterator + 1;
+		iterator++;
+	} /* end while */
+
+	return nopoll_true;
 }
 
 /** 
@@ -235,71 +501,53 @@ int            nopoll_ctx_ref_count (noPollCtx * ctx)
 nopoll_bool           nopoll_ctx_register_conn (noPollCtx  * ctx, 
 						noPollConn * conn)
 {
-	int iterator;
+	noPollConnSnapshot * snapshot;
+	int                  slot;
 
 	nopoll_return_val_if_fail (ctx, ctx && conn, nopoll_false);
 
 	/* acquire mutex here */
 	nopoll_mutex_lock (ctx->ref_mutex);
 
+	/* if no more slots are available, acquire more memory */
+	if (ctx->conn_free_length == 0 && ! __nopoll_ctx_conns_grow (ctx)) {
+		/* release mutex */
+		nopoll_mutex_unlock (ctx->ref_mutex);
+
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "General connection registration error, memory acquisition failed..");
+		return nopoll_false;
+	} /* end if */
+
 	/* get connection */
 	conn->id = ctx->conn_id;
 	ctx->conn_id ++;
 
-	/* register connection */
-	iterator = 0;
-	while (iterator < ctx->conn_length) {
+	/* register connection on a free slot */
+	slot                     = ctx->conn_free[--ctx->conn_free_length];
+	ctx->conn_list[slot]     = conn;
+	conn->ctx_slot           = slot + 1;
+	ctx->conn_index[__nopoll_ctx_index_find (ctx, conn->id)] = slot + 1;
 
-		/* register reference */
-		if (ctx->conn_list[iterator] == 0) {
-			ctx->conn_list[iterator] = conn;
+	/* update connection list number */
+	ctx->conn_num++;
+	snapshot = __nopoll_ctx_snapshot_add (ctx, conn);
 
-			/* update connection list number */
-			ctx->conn_num++;
+	nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "registered connection id %d, role: %d", conn->id, conn->role);
 
-			nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "registered connection id %d, role: %d", conn->id, conn->role);
+	/* release */
+	nopoll_mutex_unlock (ctx->ref_mutex);
+	__nopoll_ctx_snapshot_unref (ctx, snapshot);
 
-			/* release */
-			nopoll_mutex_unlock (ctx->ref_mutex);
+	/* acquire reference */
+	nopoll_ctx_ref (ctx);
 
-			/* acquire reference */
-			nopoll_ctx_ref (ctx);
-			
-			/* acquire a reference to the conection */
-			nopoll_conn_ref (conn);
+	/* acquire a reference to the conection */
+	nopoll_conn_ref (conn);
 
-			/* release mutex here */
-			return nopoll_true;
-		}
-		
-		iterator++;
-	} /* end while */
+	/* add it to the io engine if it is running */
+	nopoll_io_add_conn (ctx, conn);
 
-	/* if reached this place it means no more buckets are
-	 * available, acquire more memory (increase 10 by 10) */
-	ctx->conn_length += 10;
-	ctx->conn_list = (noPollConn**) nopoll_realloc (ctx->conn_list, sizeof (noPollConn *) * (ctx->conn_length));
-	if (ctx->conn_list == NULL) {
-		/* release mutex */
-		nopoll_mutex_unlock (ctx->ref_mutex);
-
-		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "General connection registration error, memory acquisition failed..");
-		return nopoll_false;
-	} /* end if */
-	
-	/* clear new positions */
-	iterator = (ctx->conn_length - 10);
-	while (iterator < ctx->conn_length) {
-		ctx->conn_list[iterator] = 0;
-		/* next position */
-		iterator++;
-	} /* end while */
-
-	/* release mutex here */
-	nopoll_mutex_unlock (ctx->ref_mutex);
-
-	/* ok, now register connection because we have memory */
-	return nopoll_ctx_register_conn (ctx, conn);
+	return nopoll_true;
 }
 
 /** 
@@ -313,41 +561,82 @@ nopoll_bool           nopoll_ctx_register_conn (noPollCtx  * ctx,
 void           nopoll_ctx_unregister_conn (noPollCtx  * ctx, 
 					   noPollConn * conn)
 {
-	int iterator;
+	noPollConnSnapshot * snapshot;
+	nopoll_bool          snapshot_ref;
+	int                  slot;
 
 	nopoll_return_if_fail (ctx, ctx && conn);
 
 	/* acquire mutex here */
 	nopoll_mutex_lock (ctx->ref_mutex);
 
-	/* find the connection and remove it from the array */
-	iterator = 0;
-	while (iterator < ctx->conn_length) {
+	/* check the connection is registered */
+	slot = conn->ctx_slot - 1;
+	if (slot < 0 || slot >= ctx->conn_length || ctx->conn_list[slot] != conn) {
+		/* release mutex here */
+		nopoll_mutex_unlock (ctx->ref_mutex);
+		return;
+	} /* end if */
 
-		/* check the connection reference */
-		if (ctx->conn_list && ctx->conn_list[iterator] && ctx->conn_list[iterator]->id == conn->id) {
-			/* remove reference */
-			ctx->conn_list[iterator] = NULL;
+	/* remove reference, releasing its slot */
+	__nopoll_ctx_index_remove (ctx, __nopoll_ctx_index_find (ctx, conn->id));
+	ctx->conn_list[slot] = NULL;
+	ctx->conn_free[ctx->conn_free_length++] = slot;
+	conn->ctx_slot       = 0;
 
-			/* update connection list number */
-			ctx->conn_num--;
+	/* update connection list number */
+	ctx->conn_num--;
+	snapshot_ref = __nopoll_ctx_snapshot_remove (ctx, conn, &snapshot);
 
-			/* release */
-			nopoll_mutex_unlock (ctx->ref_mutex);
+	/* release */
+	nopoll_mutex_unlock (ctx->ref_mutex);
+	__nopoll_ctx_snapshot_unref (ctx, snapshot);
+	if (snapshot_ref)
+		nopoll_conn_unref (conn);
 
-			/* acquire a reference to the conection */
-			nopoll_conn_unref (conn);
+	/* stop watching it on the io engine */
+	nopoll_io_remove_conn (ctx, conn);
 
-			return; 
-		} /* end if */
-		
-		iterator++;
-	} /* end while */
+	/* acquire a reference to the conection */
+	nopoll_conn_unref (conn);
+
+	return;
+}
+
+/** 
+ * @brief Allows to find a connection registered on the provided
+ * context by its id (see \ref nopoll_conn_get_id).
+ *
+ * A reference is acquired on the connection returned (while it is
+ * still registered) so it remains valid even if other threads close
+ * it. The caller must release it with \ref nopoll_conn_unref once
+ * finished.
+ *
+ * @param ctx The context where the connection is registered.
+ *
+ * @param conn_id The connection id to find.
+ *
+ * @return A new reference to the connection found or NULL if it
+ * fails.
+ */
+noPollConn   * nopoll_ctx_find_conn_by_id (noPollCtx * ctx, int conn_id)
+{
+	noPollConn * result = NULL;
+	int          position;
+
+	nopoll_return_val_if_fail (ctx, ctx, NULL);
 
-	/* release mutex here */
+	nopoll_mutex_lock (ctx->ref_mutex);
+	if (ctx->conn_index_size > 0) {
+		position = __nopoll_ctx_index_find (ctx, conn_id);
+		if (ctx->conn_index[position]) {
+			result = ctx->conn_list[ctx->conn_index[position] - 1];
+			nopoll_conn_ref (result);
+		} /* end if */
+	} /* end if */
 	nopoll_mutex_unlock (ctx->ref_mutex);
 
-	return;
+	return result;
 }
 
 /** 
@@ -514,6 +803,74 @@ nopoll_bool           nopoll_ctx_set_certificate (noPollCtx  * ctx,
 	return nopoll_true;
 }
 
+/** 
+ * @brief Releases the server SSL contexts cached for the provided
+ * listener (or for all listeners), so certificates and keys are
+ * loaded again from disk for the next TLS connections accepted.
+ *
+ * Server SSL contexts are configured once for each listener,
+ * certificate and protocol, and then shared by all TLS connections
+ * accepted with the same configuration (also by the listeners
+ * created to share the listener port, see \ref
+ * nopoll_listener_new_reuse_port, whose contexts are released too). Use this function after
+ * updating certificate files to make new connections use them
+ * (connections already accepted keep using the previous context).
+ *
+ * Client SSL contexts are also shared by client connections created
+ * with the same protocol, certificates and verification mode: they
+ * are only released when NULL is provided.
+ *
+ * @param ctx The context where the operation takes place.
+ *
+ * @param listener The listener whose SSL contexts are released or
+ * NULL to release all SSL contexts cached (server and client ones).
+ */
+void                  nopoll_ctx_invalidate_ssl_contexts (noPollCtx  * ctx,
+							  noPollConn * listener)
+{
+	noPollSslCtxEntry  * entry;
+	noPollSslCtxEntry ** prev;
+	noPollSslCtxEntry  * released    = NULL;
+	int                  listener_id = 0;
+
+	nopoll_return_if_fail (ctx, ctx);
+
+	/* contexts are shared by listeners sharing a port (cached
+	 * under the first listener) */
+	if (listener)
+		listener_id = listener->listener_origin ? listener->listener_origin : listener->id;
+
+	/* unlink entries */
+	nopoll_mutex_lock (ctx->ref_mutex);
+	prev = &ctx->ssl_ctx_cache;
+	while (*prev) {
+		entry = *prev;
+		if (listener == NULL || entry->listener_id == listener_id) {
+			(*prev)     = entry->next;
+			entry->next = released;
+			released    = entry;
+			continue;
+		} /* end if */
+		prev = &entry->next;
+	} /* end while */
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	/* and release them */
+	while (released) {
+		entry    = released;
+		released = entry->next;
+
+		SSL_CTX_free (entry->ssl_ctx);
+		nopoll_free (entry->certificate);
+		nopoll_free (entry->private_key);
+		nopoll_free (entry->chain_certificate);
+		nopoll_free (entry->ca_certificate);
+		nopoll_free (entry);
+	} /* end while */
+
+	return;
+}
+
 /** 
  * @brief Allows to configure the on open handler, the handler that is
  * called when it is received an incoming websocket connection and all
@@ -653,6 +1010,58 @@ void           nopoll_ctx_set_on_msg    (noPollCtx              * ctx,
 	return;
 }
 
+/** 
+ * @brief Allows to set a general handler called when content queued
+ * to be written on any connection of the context reaches its high
+ * watermark (see \ref nopoll_conn_set_write_watermarks).
+ *
+ * @param ctx The context where the notification will happen
+ *
+ * @param on_write_blocked The handler to be called.
+ *
+ * @param user_data User defined pointer that is passed in into the
+ * handler when called.
+ *
+ * Note that the handler configured here will be overriden by the handler configured by \ref nopoll_conn_set_on_write_blocked
+ */
+void           nopoll_ctx_set_on_write_blocked (noPollCtx              * ctx,
+						noPollOnWriteHandler     on_write_blocked,
+						noPollPtr                user_data)
+{
+	nopoll_return_if_fail (ctx, ctx);
+
+	ctx->on_write_blocked      = on_write_blocked;
+	ctx->on_write_blocked_data = user_data;
+
+	return;
+}
+
+/** 
+ * @brief Allows to set a general handler called when content queued
+ * to be written on any connection of the context drops to its low
+ * watermark (see \ref nopoll_conn_set_write_watermarks).
+ *
+ * @param ctx The context where the notification will happen
+ *
+ * @param on_write_drained The handler to be called.
+ *
+ * @param user_data User defined pointer that is passed in into the
+ * handler when called.
+ *
+ * Note that the handler configured here will be overriden by the handler configured by \ref nopoll_conn_set_on_write_drained
+ */
+void           nopoll_ctx_set_on_write_drained (noPollCtx              * ctx,
+						noPollOnWriteHandler     on_write_drained,
+						noPollPtr                user_data)
+{
+	nopoll_return_if_fail (ctx, ctx);
+
+	ctx->on_write_drained      = on_write_drained;
+	ctx->on_write_drained_data = user_data;
+
+	return;
+}
+
 /** 
  * @brief Allows to configure the handler that will be used to let
  * user land code to define OpenSSL SSL_CTX object.
@@ -729,51 +1138,106 @@ void           nopoll_ctx_set_post_ssl_check (noPollCtx          * ctx,
  * executions returned nopoll_true. Keep in mind the function also
  * returns NULL if ctx or foreach parameter is NULL.
  *
+ * Connections are iterated over a snapshot of the registry (kept
+ * updated as connections are registered or unregistered), so
+ * no lock is acquired for each connection: connections registered
+ * during the foreach aren't notified, and connections closed during
+ * the foreach remain valid until it finishes.
+ *
  * See \ref noPollForeachConn for a signature example.
  */
 noPollConn   * nopoll_ctx_foreach_conn (noPollCtx          * ctx, 
 					noPollForeachConn    foreach, 
 					noPollPtr            user_data)
 {
-	noPollConn * result;
-	int          iterator;
+	noPollConnSnapshot * snapshot;
+	noPollConn         * result = NULL;
+	int                  iterator;
 	nopoll_return_val_if_fail (ctx, ctx && foreach, NULL);
 
-	/* acquire here the mutex to protect connection list */
+	/* get connections registered (without locking the context
+	 * for each one) */
 	nopoll_mutex_lock (ctx->ref_mutex);
+	snapshot = __nopoll_ctx_snapshot_get (ctx);
+	nopoll_mutex_unlock (ctx->ref_mutex);
+	if (snapshot == NULL) {
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to acquire memory to iterate over registered connections");
+		return NULL;
+	} /* end if */
 
-	/* nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Doing foreach over conn_length array (%p): %d", ctx, ctx->conn_length); */
-	
-	/* find the connection and remove it from the array */
 	iterator = 0;
-	while (iterator < ctx->conn_length) {
-
-		/* check the connection reference */
-		if (ctx->conn_list[iterator]) {
-
-			result = ctx->conn_list[iterator];
-			
-			nopoll_mutex_unlock (ctx->ref_mutex);
-			
-			/* call to notify connection */
-			if (foreach (ctx, result, user_data)) {
-				
-				/* release here the mutex to protect connection list */
-				return result;
-			} /* end if */
-
-			/* realloc again */
-			nopoll_mutex_lock (ctx->ref_mutex);
-
+	while (iterator < snapshot->length) {
+		/* call to notify connection */
+		if (foreach (ctx, snapshot->conns[iterator], user_data)) {
+			result = snapshot->conns[iterator];
+			break;
 		} /* end if */
-		
 		iterator++;
 	} /* end while */
 
-	/* release here the mutex to protect connection list */
-	nopoll_mutex_unlock (ctx->ref_mutex);
+	/* release snapshot (and connections closed meanwhile) */
+	__nopoll_ctx_snapshot_unref (ctx, snapshot);
 
-	return NULL;
+	return result;
+}
+
+typedef struct _noPollBroadcast {
+	noPollFrame * frame;
+	int           sent;
+} noPollBroadcast;
+
+nopoll_bool __nopoll_ctx_broadcast_conn (noPollCtx * ctx, noPollConn * conn, noPollPtr user_data)
+{
+	noPollBroadcast * broadcast = user_data;
+
+	/* only established listener side connections */
+	if (conn->role != NOPOLL_ROLE_LISTENER || ! conn->handshake_ok || conn->session == NOPOLL_INVALID_SOCKET)
+		return nopoll_false;
+
+	if (__nopoll_conn_send_prepared (conn, broadcast->frame, nopoll_false) >= 0)
+		broadcast->sent++;
+	return nopoll_false;
+}
+
+/** 
+ * @brief Sends the provided frame (see \ref nopoll_frame_new) to all
+ * listener side connections (\ref NOPOLL_ROLE_LISTENER) registered
+ * on the context that have completed the handshake.
+ *
+ * The frame is encoded only once and shared by all connections: those
+ * that cannot write it right now (because they have content pending
+ * to be written or the socket is full) keep a reference to it until
+ * it is written (see \ref nopoll_conn_send_prepared).
+ *
+ * Connections watched by a loop (\ref nopoll_loop_wait) write the
+ * frame right away or have it written by the loop. On connections
+ * not watched by a loop, the frame is only queued so a slow
+ * connection can't stall the broadcast: complete their writes with
+ * \ref nopoll_conn_complete_pending_write or \ref
+ * nopoll_conn_flush_writes.
+ *
+ * The function can run at the same time than other write operations
+ * over the same connections (they are serialized per connection).
+ *
+ * @param ctx The context where the broadcast will take place.
+ *
+ * @param frame The frame to send.
+ *
+ * @return Number of connections where the frame was written or
+ * queued, or -1 if it fails.
+ */
+int            nopoll_ctx_broadcast (noPollCtx * ctx, noPollFrame * frame)
+{
+	noPollBroadcast broadcast;
+
+	if (ctx == NULL || frame == NULL)
+		return -1;
+
+	broadcast.frame = frame;
+	broadcast.sent  = 0;
+	nopoll_ctx_foreach_conn (ctx, __nopoll_ctx_broadcast_conn, &broadcast);
+
+	return broadcast.sent;
 }
 
 
@@ -805,4 +1269,514 @@ void           nopoll_ctx_set_protocol_version (noPollCtx * ctx, int version)
 	return;
 }
 
+/** 
+ * @brief Allows to configure the IO wait engine used by \ref
+ * nopoll_loop_wait on the provided context.
+ *
+ * By default, \ref NOPOLL_IO_ENGINE_DEFAULT is used, which selects
+ * the best mechanism available (epoll(2) on Linux). The change
+ * takes effect the next time the loop creates its engine (that is,
+ * on the next call to \ref nopoll_loop_wait).
+ *
+ * @param ctx The context to configure.
+ *
+ * @param engine_type The IO wait engine to use.
+ */
+void           nopoll_ctx_set_io_engine (noPollCtx * ctx, noPollIoEngineType engine_type)
+{
+	nopoll_return_if_fail (ctx, ctx);
+
+	/* setup the engine type */
+	ctx->io_engine_type = engine_type;
+	return;
+}
+
+/** 
+ * @brief Allows to configure how long the IO wait engine used by
+ * \ref nopoll_loop_wait may block without activity before checking
+ * loop status again.
+ *
+ * By default there is no limit (0): the engine is interrupted when
+ * the loop is requested to stop (\ref nopoll_loop_stop) or when
+ * connections are registered from other threads, so there is no need
+ * to wakeup regularly. Use a value if your application relies on the
+ * loop to do something on a regular basis. On platforms where the
+ * engine can't be interrupted (windows), a limit of 500 ms is applied.
+ *
+ * @param ctx The context to configure.
+ *
+ * @param microseconds Max time to wait without activity or 0 to wait
+ * without limit.
+ */
+void           nopoll_ctx_set_io_wait_timeout (noPollCtx * ctx, long microseconds)
+{
+	nopoll_return_if_fail (ctx, ctx && microseconds >= 0);
+
+	ctx->io_wait_timeout = microseconds;
+	return;
+}
+
+/** 
+ * @brief Returns current IO wait timeout configured (see \ref
+ * nopoll_ctx_set_io_wait_timeout).
+ *
+ * @param ctx The context to check.
+ *
+ * @return Timeout in microseconds (0: no limit) or -1 if ctx is NULL.
+ */
+long           nopoll_ctx_get_io_wait_timeout (noPollCtx * ctx)
+{
+	if (ctx == NULL)
+		return -1;
+	return ctx->io_wait_timeout;
+}
+
+/** 
+ * @brief Allows to configure how the loop (\ref nopoll_loop_wait,
+ * \ref nopoll_loop_run_threads) reads messages from a connection
+ * reported with data available.
+ *
+ * With drain mode enabled (default), the loop keeps notifying
+ * messages already received by the connection until no more input
+ * is available without blocking, up to budget messages, so other
+ * connections are not starved. A burst of small messages is then
+ * notified on a single readiness event instead of one wait
+ * operation per message. With drain mode disabled, only one message
+ * is notified on each readiness event.
+ *
+ * @param ctx The context to configure.
+ *
+ * @param drain nopoll_true to enable drain mode, otherwise
+ * nopoll_false.
+ *
+ * @param budget Max messages notified per connection on each
+ * readiness event or 0 to use the default value
+ * (NOPOLL_LOOP_DRAIN_BUDGET: 64).
+ */
+void           nopoll_ctx_set_loop_drain (noPollCtx * ctx, nopoll_bool drain, int budget)
+{
+	nopoll_return_if_fail (ctx, ctx && budget >= 0);
+
+	ctx->loop_drain        = drain;
+	ctx->loop_drain_budget = budget > 0 ? budget : NOPOLL_LOOP_DRAIN_BUDGET;
+	return;
+}
+
+/** 
+ * @brief Returns drain mode configuration (see \ref
+ * nopoll_ctx_set_loop_drain).
+ *
+ * @param ctx The context to check.
+ *
+ * @param budget Optional reference to get the budget configured.
+ *
+ * @return nopoll_true if drain mode is enabled, otherwise
+ * nopoll_false (also when ctx is NULL).
+ */
+nopoll_bool    nopoll_ctx_get_loop_drain (noPollCtx * ctx, int * budget)
+{
+	if (ctx == NULL)
+		return nopoll_false;
+	if (budget)
+		(*budget) = ctx->loop_drain_budget;
+	return ctx->loop_drain;
+}
+
+/** 
+ * @brief Allows to configure the size of the read buffer used by
+ * connections to read incoming frames.
+ *
+ * Each connection reads from the wire as many bytes as available (up
+ * to the buffer size) with a single read operation and then parses
+ * frames from the buffer, so several small frames cost a single read
+ * operation. Payloads bigger than the buffer are read directly into
+ * the message. The buffer is created by the connection when the
+ * first frame is read, using the size configured at that moment.
+ *
+ * @param ctx The context to configure.
+ *
+ * @param size The read buffer size in bytes (at least 16 bytes,
+ * default value NOPOLL_READ_BUFFER_SIZE: 8192).
+ */
+void           nopoll_ctx_set_read_buffer_size (noPollCtx * ctx, int size)
+{
+	/* at least, a complete frame header must fit (14 bytes) */
+	nopoll_return_if_fail (ctx, ctx && size >= 16);
+
+	ctx->read_buffer_size = size;
+	return;
+}
+
+/** 
+ * @brief Returns read buffer size configured (see \ref
+ * nopoll_ctx_set_read_buffer_size).
+ *
+ * @param ctx The context to check.
+ *
+ * @return The read buffer size or -1 if ctx is NULL.
+ */
+int            nopoll_ctx_get_read_buffer_size (noPollCtx * ctx)
+{
+	if (ctx == NULL)
+		return -1;
+	return ctx->read_buffer_size;
+}
+
+/** 
+ * @brief Allows to configure how messages received are cached by the
+ * context for reuse.
+ *
+ * Messages released (see \ref nopoll_msg_unref) are kept by the
+ * context (up to pool_size) so the next frame received reuses them,
+ * and payloads up to inline_size bytes are stored inside the message
+ * itself. This way, receiving small messages doesn't allocate memory
+ * once the pool is populated.
+ *
+ * Changing inline_size releases messages already cached.
+ *
+ * @param ctx The context to configure.
+ *
+ * @param pool_size Max number of released messages cached (0 to
+ * disable caching, default value NOPOLL_MSG_POOL_SIZE: 128).
+ *
+ * @param inline_size Max payload size stored inside the message (0
+ * to always allocate payloads, default value NOPOLL_MSG_INLINE_SIZE:
+ * 256).
+ */
+void           nopoll_ctx_set_msg_pool (noPollCtx * ctx, int pool_size, int inline_size)
+{
+	nopoll_return_if_fail (ctx, ctx && pool_size >= 0 && inline_size >= 0);
+
+	nopoll_mutex_lock (ctx->msg_pool_mutex);
+	ctx->msg_pool_size = pool_size;
+	if (ctx->msg_inline_size != inline_size) {
+		ctx->msg_inline_size = inline_size;
+		pool_size = 0;
+	} /* end if */
+	nopoll_mutex_unlock (ctx->msg_pool_mutex);
+
+	/* release messages not fitting new configuration */
+	__nopoll_msg_pool_release (ctx, pool_size);
+	return;
+}
+
+/** 
+ * @brief Returns current message pool configuration (see \ref
+ * nopoll_ctx_set_msg_pool).
+ *
+ * @param ctx The context to check.
+ *
+ * @param inline_size Optional reference to get the inline payload
+ * size configured.
+ *
+ * @return Max number of messages cached or -1 if ctx is NULL.
+ */
+int            nopoll_ctx_get_msg_pool (noPollCtx * ctx, int * inline_size)
+{
+	if (ctx == NULL)
+		return -1;
+	if (inline_size)
+		(*inline_size) = ctx->msg_inline_size;
+	return ctx->msg_pool_size;
+}
+
+/** 
+ * @brief Allows to configure how many client TLS sessions are cached
+ * by the context, so TLS connections created again to the same
+ * host:port (and server name) resume the previous session
+ * (abbreviated handshake) instead of doing a full handshake.
+ *
+ * Sessions are stored when received from the server (after the
+ * handshake) and offered by the next \ref nopoll_conn_tls_new call to
+ * the same destination (with the same client certificate). When more
+ * sessions are received, the least recently used ones are released.
+ *
+ * Sessions aren't cached for SSL contexts created by a context
+ * creator (see \ref nopoll_ctx_set_ssl_context_creator).
+ *
+ * @param ctx The context to configure.
+ *
+ * @param size Max number of sessions cached (0 disables the cache
+ * releasing sessions cached, default value
+ * NOPOLL_SSL_CLIENT_SESSIONS: 64).
+ */
+void           nopoll_ctx_set_ssl_client_sessions (noPollCtx * ctx, int size)
+{
+	noPollSslSession * entry;
+	noPollSslSession * released = NULL;
+	noPollSslSession * next;
+	int                iterator = 0;
+
+	nopoll_return_if_fail (ctx, ctx && size >= 0);
+
+	nopoll_mutex_lock (ctx->ref_mutex);
+	ctx->ssl_sessions_size = size;
+
+	/* unlink sessions above the new size */
+	entry = ctx->ssl_sessions;
+	if (size == 0) {
+		released          = ctx->ssl_sessions;
+		ctx->ssl_sessions = NULL;
+	} else {
+		while (entry && entry->next) {
+			if (++iterator == size) {
+				released    = entry->next;
+				entry->next = NULL;
+				break;
+			} /* end if */
+			entry = entry->next;
+		} /* end while */
+	} /* end if */
+	if (size < ctx->ssl_sessions_length)
+		ctx->ssl_sessions_length = size;
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	/* and release them */
+	while (released) {
+		next = released->next;
+		SSL_SESSION_free (released->session);
+		nopoll_free (released->key);
+		nopoll_free (released);
+		released = next;
+	} /* end while */
+
+	return;
+}
+
+/** 
+ * @brief Returns how many client TLS connections resumed a cached
+ * session (hits) and how many did a full handshake (misses), see
+ * \ref nopoll_ctx_set_ssl_client_sessions.
+ *
+ * @param ctx The context to check.
+ *
+ * @param hits Optional reference to get the number of sessions resumed.
+ *
+ * @param misses Optional reference to get the number of full
+ * handshakes.
+ */
+void           nopoll_ctx_get_ssl_client_session_stats (noPollCtx * ctx, int * hits, int * misses)
+{
+	if (ctx == NULL)
+		return;
+
+	nopoll_mutex_lock (ctx->ref_mutex);
+	if (hits)
+		(*hits)   = ctx->ssl_session_hits;
+	if (misses)
+		(*misses) = ctx->ssl_session_misses;
+	nopoll_mutex_unlock (ctx->ref_mutex);
+	return;
+}
+
+/** 
+ * @brief Allows to configure how many threads resolve host names of
+ * asynchronous connections (see \ref
+ * nopoll_conn_opts_set_async_connect). Threads only resolve host
+ * names: connection attempts are run by the loop.
+ *
+ * Threads are created when required (up to the provided number) and
+ * stay waiting for new requests. When no thread can be created (for
+ * example, no thread handlers are configured, see \ref
+ * nopoll_thread_handlers), host names are resolved by the caller.
+ *
+ * @param ctx The context to configure.
+ *
+ * @param threads Max number of resolver threads (0 resolves host
+ * names on the caller, default value NOPOLL_RESOLVER_THREADS: 4). It
+ * doesn't stop threads already created.
+ */
+void           nopoll_ctx_set_resolver_threads (noPollCtx * ctx, int threads)
+{
+	nopoll_return_if_fail (ctx, ctx && threads >= 0);
+
+	nopoll_mutex_lock (ctx->ref_mutex);
+	ctx->resolver_size = threads;
+	nopoll_mutex_unlock (ctx->ref_mutex);
+	return;
+}
+
+/** 
+ * @brief Allows to configure how long addresses resolved for
+ * asynchronous connections are cached, so connections created again
+ * to the same host:port skip the resolution.
+ *
+ * getaddrinfo doesn't report the TTL of the records found, so the
+ * provided time is used for all of them. Up to NOPOLL_DNS_CACHE_SIZE
+ * (256) hosts are cached, releasing the oldest ones when more are
+ * resolved.
+ *
+ * @param ctx The context to configure.
+ *
+ * @param ttl Seconds addresses are cached (0 disables the cache
+ * releasing addresses cached, default value NOPOLL_DNS_CACHE_TTL:
+ * 60). Addresses defined with \ref nopoll_ctx_set_host_addresses are
+ * kept.
+ */
+void           nopoll_ctx_set_dns_cache (noPollCtx * ctx, int ttl)
+{
+	noPollDnsEntry  * entry;
+	noPollDnsEntry ** prev;
+	noPollDnsEntry  * released = NULL;
+
+	nopoll_return_if_fail (ctx, ctx && ttl >= 0);
+
+	nopoll_mutex_lock (ctx->ref_mutex);
+	ctx->dns_cache_ttl = ttl;
+
+	/* unlink addresses resolved */
+	if (ttl == 0) {
+		prev = &ctx->dns_cache;
+		while (*prev) {
+			entry = (*prev);
+			if (entry->port == NULL) {
+				prev = &entry->next;
+				continue;
+			} /* end if */
+			(*prev)     = entry->next;
+			entry->next = released;
+			released    = entry;
+		} /* end while */
+		ctx->dns_cache_length = 0;
+	} /* end if */
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	/* and release them */
+	while (released) {
+		entry    = released;
+		released = entry->next;
+		__nopoll_conn_dns_entry_free (entry);
+	} /* end while */
+
+	return;
+}
+
+/** 
+ * @brief Allows to define the addresses used by asynchronous
+ * connections to the provided host name (on any port) instead of
+ * resolving it (see \ref nopoll_conn_opts_set_async_connect).
+ *
+ * Addresses are tried alternating families, starting with the family
+ * of the first one. Addresses defined aren't released by \ref
+ * nopoll_ctx_set_dns_cache.
+ *
+ * @param ctx The context to configure.
+ *
+ * @param host The host name.
+ *
+ * @param addresses Comma separated list of numeric IPv4/IPv6
+ * addresses (for example "::1,127.0.0.1"). NULL removes the
+ * addresses defined for the host name.
+ *
+ * @return nopoll_true if the addresses were defined (or removed),
+ * otherwise nopoll_false is returned (for example, one of the
+ * addresses isn't valid).
+ */
+nopoll_bool    nopoll_ctx_set_host_addresses (noPollCtx * ctx, const char * host, const char * addresses)
+{
+	noPollDnsEntry  * entry;
+	noPollDnsEntry ** prev;
+	noPollDnsEntry  * released = NULL;
+	struct addrinfo   hints, * res;
+	char            * list     = NULL;
+	char            * address;
+	char            * next;
+
+	nopoll_return_val_if_fail (ctx, ctx && host, nopoll_false);
+
+	if (addresses) {
+		entry = nopoll_new (noPollDnsEntry, 1);
+		if (entry == NULL)
+			return nopoll_false;
+
+		/* parse addresses */
+		memset (&hints, 0, sizeof (struct addrinfo));
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_flags    = AI_NUMERICHOST;
+		list    = nopoll_strdup (addresses);
+		address = list;
+		while (address) {
+			next = strchr (address, ',');
+			if (next)
+				(*next++) = 0;
+			nopoll_trim (address, NULL);
+
+			res = NULL;
+			if (entry->addresses.length == NOPOLL_DNS_CACHE_ADDRESSES || getaddrinfo (address, NULL, &hints, &res) != 0 ||
+			    res->ai_addrlen > sizeof (struct sockaddr_storage)) {
+				nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to define address '%s' for host name %s", address, host);
+				if (res)
+					freeaddrinfo (res);
+				nopoll_free (list);
+				nopoll_free (entry);
+				return nopoll_false;
+			} /* end if */
+
+			memcpy (&(entry->addresses.items[entry->addresses.length]), res->ai_addr, res->ai_addrlen);
+			entry->addresses.lengths[entry->addresses.length] = res->ai_addrlen;
+			entry->addresses.length++;
+			freeaddrinfo (res);
+
+			/* next address */
+			address = next;
+		} /* end while */
+		nopoll_free (list);
+
+		__nopoll_conn_addresses_sort (&entry->addresses);
+		entry->host   = nopoll_strdup (host);
+		entry->family = AF_UNSPEC;
+	} else
+		entry = NULL;
+
+	nopoll_mutex_lock (ctx->ref_mutex);
+
+	/* unlink addresses previously defined */
+	prev = &ctx->dns_cache;
+	while (*prev) {
+		if ((*prev)->port == NULL && nopoll_cmp ((*prev)->host, host)) {
+			released = (*prev);
+			(*prev)  = released->next;
+			break;
+		} /* end if */
+		prev = &(*prev)->next;
+	} /* end while */
+
+	/* place new ones first */
+	if (entry) {
+		entry->next    = ctx->dns_cache;
+		ctx->dns_cache = entry;
+	} /* end if */
+
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	if (released)
+		__nopoll_conn_dns_entry_free (released);
+	return nopoll_true;
+}
+
+/** 
+ * @brief Returns how many asynchronous connections found the
+ * addresses of the host cached or defined (hits) and how many had to
+ * resolve it (misses), see \ref nopoll_ctx_set_dns_cache.
+ *
+ * @param ctx The context to check.
+ *
+ * @param hits Optional reference to get the number of addresses found.
+ *
+ * @param misses Optional reference to get the number of resolutions.
+ */
+void           nopoll_ctx_get_dns_cache_stats (noPollCtx * ctx, int * hits, int * misses)
+{
+	if (ctx == NULL)
+		return;
+
+	nopoll_mutex_lock (ctx->ref_mutex);
+	if (hits)
+		(*hits)   = ctx->dns_cache_hits;
+	if (misses)
+		(*misses) = ctx->dns_cache_misses;
+	nopoll_mutex_unlock (ctx->ref_mutex);
+	return;
+}
+
 /* @} */
@@ -58,6 +58,8 @@ void           nopoll_ctx_unregister_conn (noPollCtx  * ctx,
 
 int            nopoll_ctx_conns (noPollCtx * ctx);
 
+noPollConn   * nopoll_ctx_find_conn_by_id (noPollCtx * ctx, int conn_id);
+
 nopoll_bool    nopoll_ctx_set_certificate (noPollCtx  * ctx, 
 					   const char * serverName, 
 					   const char * certificateFile, 
@@ -70,6 +72,9 @@ nopoll_bool    nopoll_ctx_find_certificate (noPollCtx   * ctx,
 					    const char ** privateKey, 
 					    const char ** optionalChainFile);
 
+void           nopoll_ctx_invalidate_ssl_contexts (noPollCtx  * ctx,
+						   noPollConn * listener);
+
 void           nopoll_ctx_set_on_accept (noPollCtx           * ctx,
 					 noPollActionHandler   on_accept,
 					 noPollPtr             user_data);
@@ -86,6 +91,14 @@ void           nopoll_ctx_set_on_msg    (noPollCtx              * ctx,
 					 noPollOnMessageHandler   on_msg,
 					 noPollPtr                user_data);
 
+void           nopoll_ctx_set_on_write_blocked (noPollCtx              * ctx,
+						noPollOnWriteHandler     on_write_blocked,
+						noPollPtr                user_data);
+
+void           nopoll_ctx_set_on_write_drained (noPollCtx              * ctx,
+						noPollOnWriteHandler     on_write_drained,
+						noPollPtr                user_data);
+
 void           nopoll_ctx_set_ssl_context_creator (noPollCtx                * ctx,
 						   noPollSslContextCreator    context_creator,
 						   noPollPtr                  user_data);
@@ -96,8 +109,40 @@ void           nopoll_ctx_set_post_ssl_check (noPollCtx          * ctx,
 
 noPollConn   * nopoll_ctx_foreach_conn (noPollCtx * ctx, noPollForeachConn foreach, noPollPtr user_data);
 
+int            nopoll_ctx_broadcast (noPollCtx * ctx, noPollFrame * frame);
+
 void           nopoll_ctx_set_protocol_version (noPollCtx * ctx, int version);
 
+void           nopoll_ctx_set_io_engine (noPollCtx * ctx, noPollIoEngineType engine_type);
+
+void           nopoll_ctx_set_io_wait_timeout (noPollCtx * ctx, long microseconds);
+
+long           nopoll_ctx_get_io_wait_timeout (noPollCtx * ctx);
+
+void           nopoll_ctx_set_loop_drain (noPollCtx * ctx, nopoll_bool drain, int budget);
+
+nopoll_bool    nopoll_ctx_get_loop_drain (noPollCtx * ctx, int * budget);
+
+void           nopoll_ctx_set_read_buffer_size (noPollCtx * ctx, int size);
+
+int            nopoll_ctx_get_read_buffer_size (noPollCtx * ctx);
+
+void           nopoll_ctx_set_msg_pool (noPollCtx * ctx, int pool_size, int inline_size);
+
+int            nopoll_ctx_get_msg_pool (noPollCtx * ctx, int * inline_size);
+
+void           nopoll_ctx_set_ssl_client_sessions (noPollCtx * ctx, int size);
+
+void           nopoll_ctx_get_ssl_client_session_stats (noPollCtx * ctx, int * hits, int * misses);
+
+void           nopoll_ctx_set_resolver_threads (noPollCtx * ctx, int threads);
+
+void           nopoll_ctx_set_dns_cache (noPollCtx * ctx, int ttl);
+
+nopoll_bool    nopoll_ctx_set_host_addresses (noPollCtx * ctx, const char * host, const char * addresses);
+
+void           nopoll_ctx_get_dns_cache_stats (noPollCtx * ctx, int * hits, int * misses);
+
 void           nopoll_ctx_free (noPollCtx * ctx);
 
 END_C_DECLS
@@ -101,6 +101,60 @@
 /* max buffer size to process incoming handshake */
 #define NOPOLL_HANDSHAKE_BUFFER_SIZE 8192
 
+/* default max messages notified by the loop per connection on each
+ * readiness event (see nopoll_ctx_set_loop_drain) */
+#define NOPOLL_LOOP_DRAIN_BUDGET 64
+
+/* size of the stack buffer used to format logs delivered to the log
+ * handler (longer logs are allocated) */
+#define NOPOLL_LOG_BUFFER_SIZE 1024
+
+/* max microseconds library threads wait before checking for work
+ * again when no condition variable handlers are installed (see
+ * nopoll_thread_cond_handlers) */
+#define NOPOLL_THREAD_COND_WAIT 5000
+
+/* default size of the buffer used by each connection to read
+ * incoming frames (see nopoll_ctx_set_read_buffer_size) */
+#define NOPOLL_READ_BUFFER_SIZE 8192
+
+/* default number of released messages cached by each context for
+ * reuse and payload size stored inside the message itself (see
+ * nopoll_ctx_set_msg_pool) */
+#define NOPOLL_MSG_POOL_SIZE   128
+#define NOPOLL_MSG_INLINE_SIZE 256
+
+/* default server TLS session cache size, session lifetime and session
+ * ticket keys rotation period, in seconds (see
+ * nopoll_conn_opts_set_ssl_session_cache) */
+#define NOPOLL_SSL_SESSION_CACHE_SIZE 1024
+#define NOPOLL_SSL_SESSION_TIMEOUT    300
+#define NOPOLL_SSL_TICKET_ROTATION    3600
+
+/* default number of client TLS sessions cached by each context (see
+ * nopoll_ctx_set_ssl_client_sessions) */
+#define NOPOLL_SSL_CLIENT_SESSIONS    64
+
+/* how often (microseconds) the loop checks the timeout of
+ * asynchronous connects in progress (see
+ * nopoll_conn_opts_set_async_connect) */
+#define NOPOLL_CONNECT_CHECK_PERIOD   250000
+
+/* default number of resolver threads (see
+ * nopoll_ctx_set_resolver_threads) */
+#define NOPOLL_RESOLVER_THREADS       4
+
+/* default TTL (seconds) of host names cached, max host names cached
+ * and max addresses kept for each one (see nopoll_ctx_set_dns_cache) */
+#define NOPOLL_DNS_CACHE_TTL          60
+#define NOPOLL_DNS_CACHE_SIZE         256
+#define NOPOLL_DNS_CACHE_ADDRESSES    16
+
+/* delay (microseconds) before starting a connection attempt to the
+ * next address while the previous one is in progress (Happy
+ * Eyeballs, RFC 8305) */
+#define NOPOLL_CONNECT_ATTEMPT_DELAY  250000
+
 /* include this at this place to load GNU extensions */
 #if defined(__GNUC__)
 #  ifndef _GNU_SOURCE
@@ -148,6 +202,7 @@
 #define NOPOLL_EINPROGRESS     EINPROGRESS
 #define NOPOLL_ENOTCONN        ENOTCONN
 #define NOPOLL_EAGAIN          EAGAIN
+#define NOPOLL_ENOBUFS         ENOBUFS
 #define NOPOLL_SOCKET          int
 #define NOPOLL_INVALID_SOCKET  -1
 #define NOPOLL_SOCKET_ERROR    -1
@@ -192,6 +247,7 @@
 #define NOPOLL_EINPROGRESS     WSAEINPROGRESS
 #define NOPOLL_ENOTCONN        WSAENOTCONN
 #define NOPOLL_EAGAIN          WSAEWOULDBLOCK
+#define NOPOLL_ENOBUFS         WSAENOBUFS
 #define SHUT_RDWR              SD_BOTH
 #define SHUT_WR                SD_SEND
 #define NOPOLL_SOCKET          SOCKET
@@ -292,12 +348,25 @@ typedef struct _noPollConnOpts noPollConnOpts;
  */
 typedef struct _noPollIoEngine noPollIoEngine;
 
+/** 
+ * @brief Abstraction that represents a loop worker created by \ref
+ * nopoll_loop_run_threads.
+ */
+typedef struct _noPollLoopWorker noPollLoopWorker;
+
 /** 
  * @brief Abstraction that represents a single websocket message
  * received.
  */
 typedef struct _noPollMsg noPollMsg;
 
+/** 
+ * @brief Abstraction that represents a websocket frame already
+ * encoded (header and payload) that can be sent to several
+ * connections. See \ref nopoll_frame_new and \ref nopoll_ctx_broadcast.
+ */
+typedef struct _noPollFrame noPollFrame;
+
 /** 
  * @brief Abstraction that represents the status and data exchanged
  * during the handshake.
@@ -380,6 +449,43 @@ typedef enum {
 	NOPOLL_IO_ENGINE_EPOLL
 } noPollIoEngineType;
 
+/** 
+ * @brief Socket is readable (or closed/failed): reported by IO
+ * mechanisms for a connection (see \ref noPollIoMechIsSet and \ref
+ * noPollIoMechEvents).
+ */
+#define NOPOLL_IO_READ  (1)
+
+/** 
+ * @brief Socket is writable: reported by IO mechanisms for
+ * connections with content queued to be written.
+ */
+#define NOPOLL_IO_WRITE (2)
+
+/** 
+ * @brief What to do with new messages sent over a connection that
+ * has more content queued to be written than its hard limit (see
+ * \ref nopoll_conn_set_write_limit).
+ *
+ * Only complete (unfragmented) text and binary messages are dropped
+ * or coalesced: control frames and fragments are always queued to
+ * keep the stream valid.
+ */
+typedef enum {
+	/** 
+	 * @brief New messages are dropped: the send operation
+	 * returns -1 with errno set to NOPOLL_ENOBUFS.
+	 */
+	NOPOLL_WRITE_LIMIT_DROP     = 1,
+	/** 
+	 * @brief Messages queued that weren't started yet are
+	 * dropped and replaced by the new one (only the last message
+	 * is kept, useful for state updates where only the latest
+	 * value matters).
+	 */
+	NOPOLL_WRITE_LIMIT_COALESCE = 2
+} noPollWriteLimit;
+
 /** 
  * @brief Support macro to allocate memory using nopoll_calloc function,
  * making a casting and using the sizeof keyword.
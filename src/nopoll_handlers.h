@@ -71,8 +71,11 @@ typedef nopoll_bool (*noPollActionHandler) (noPollCtx * ctx, noPollConn * conn,
  * @brief Handler used to define the create function for an IO mechanism.
  *
  * @param ctx The context where the io mechanism will be created.
+ *
+ * @param engine The engine that will own the object created (kept by
+ * the io object to reach the engine lock and wait limit).
  */
-typedef noPollPtr (*noPollIoMechCreate)  (noPollCtx * ctx);
+typedef noPollPtr (*noPollIoMechCreate)  (noPollCtx * ctx, noPollIoEngine * engine);
 
 /** 
  * @brief Handler used to define the IO wait set destroy function for
@@ -113,6 +116,10 @@ typedef int (*noPollIoMechWait)  (noPollCtx * ctx, noPollPtr io_object);
  * @brief Handler used to define the IO add to set function for an IO
  * mechanism.
  *
+ * Besides watching the socket to be readable, connections with
+ * content queued to be written (see \ref
+ * nopoll_conn_pending_write_bytes) must be watched to be writable.
+ *
  * @param ctx The context where the io mechanism was created.
  *
  * @param conn The noPollConn to be added to the working set.
@@ -136,10 +143,129 @@ typedef nopoll_bool (*noPollIoMechAddTo)  (int               fds,
  *
  * @param io_object The io object to be created as created by \ref
  * noPollIoMechCreate handler where the wait will be implemented.
+ *
+ * @return Events reported for the socket (\ref NOPOLL_IO_READ and/or
+ * \ref NOPOLL_IO_WRITE) or 0 if it is not set.
  */
-typedef nopoll_bool (*noPollIoMechIsSet)  (noPollCtx       * ctx,
-					   int               fds, 
-					   noPollPtr         io_object);
+typedef int (*noPollIoMechIsSet)  (noPollCtx       * ctx,
+				   int               fds, 
+				   noPollPtr         io_object);
+
+/** 
+ * @brief Handler used to define the IO add function for IO mechanisms
+ * that keep a persistent interest registration (for example epoll).
+ *
+ * The handler is called once when the connection is registered on
+ * the context (or when the loop starts), instead of being called on
+ * every loop iteration like \ref noPollIoMechAddTo.
+ *
+ * @param ctx The context where the io mechanism was created.
+ *
+ * @param conn The noPollConn to be added to the watched set.
+ *
+ * @param io_object The io object as created by \ref
+ * noPollIoMechCreate handler.
+ *
+ * @return nopoll_true if the connection was added, otherwise
+ * nopoll_false.
+ */
+typedef nopoll_bool (*noPollIoMechAdd)  (noPollCtx       * ctx,
+					 noPollConn      * conn,
+					 noPollPtr         io_object);
+
+/** 
+ * @brief Handler used to define the IO modify function for IO
+ * mechanisms with persistent interest registration. It is called
+ * when the events the connection is interested in have changed.
+ *
+ * @param ctx The context where the io mechanism was created.
+ *
+ * @param conn The noPollConn to be updated.
+ *
+ * @param io_object The io object as created by \ref
+ * noPollIoMechCreate handler.
+ *
+ * @return nopoll_true if the connection was updated, otherwise
+ * nopoll_false.
+ */
+typedef nopoll_bool (*noPollIoMechModify)  (noPollCtx       * ctx,
+					    noPollConn      * conn,
+					    noPollPtr         io_object);
+
+/** 
+ * @brief Handler used to define the IO remove function for IO
+ * mechanisms with persistent interest registration.
+ *
+ * @param ctx The context where the io mechanism was created.
+ *
+ * @param conn The noPollConn to be removed from the watched set.
+ *
+ * @param io_object The io object as created by \ref
+ * noPollIoMechCreate handler.
+ *
+ * @return nopoll_true if the connection was found and removed,
+ * otherwise nopoll_false.
+ */
+typedef nopoll_bool (*noPollIoMechRemove)  (noPollCtx       * ctx,
+					    noPollConn      * conn,
+					    noPollPtr         io_object);
+
+/** 
+ * @brief Handler used to get connections reported by the last wait
+ * operation on IO mechanisms with persistent interest registration.
+ *
+ * @param ctx The context where the io mechanism was created.
+ *
+ * @param position The position to get, from 0 up to the value
+ * returned by the last \ref noPollIoMechWait call.
+ *
+ * @param io_object The io object as created by \ref
+ * noPollIoMechCreate handler.
+ *
+ * @return The connection reported or NULL if it is no longer
+ * registered (for example, it was closed while notifying connections
+ * reported before).
+ */
+typedef noPollConn * (*noPollIoMechReady)  (noPollCtx       * ctx,
+					    int               position,
+					    noPollPtr         io_object);
+
+/** 
+ * @brief Handler used to get events reported for a connection by the
+ * last wait operation on IO mechanisms with persistent interest
+ * registration (optional: if not defined, connections reported are
+ * only notified as readable).
+ *
+ * @param ctx The context where the io mechanism was created.
+ *
+ * @param position The position to get, from 0 up to the value
+ * returned by the last \ref noPollIoMechWait call.
+ *
+ * @param io_object The io object as created by \ref
+ * noPollIoMechCreate handler.
+ *
+ * @return Events reported (\ref NOPOLL_IO_READ and/or \ref
+ * NOPOLL_IO_WRITE).
+ */
+typedef int (*noPollIoMechEvents)  (noPollCtx       * ctx,
+				    int               position,
+				    noPollPtr         io_object);
+
+/** 
+ * @brief Handler used to interrupt a wait operation in progress (for
+ * example, because the loop was requested to stop or because a
+ * connection was registered from a different thread).
+ *
+ * The wait operation must return as soon as possible after this
+ * handler is called, even if it was called before the wait started.
+ *
+ * @param ctx The context where the io mechanism was created.
+ *
+ * @param io_object The io object as created by \ref
+ * noPollIoMechCreate handler.
+ */
+typedef void (*noPollIoMechWakeup)  (noPollCtx       * ctx,
+				     noPollPtr         io_object);
 
 /** 
  * @brief Handler used to define the foreach function that is used by
@@ -214,6 +340,27 @@ typedef void (*noPollOnCloseHandler)    (noPollCtx  * ctx,
 					 noPollConn * conn, 
 					 noPollPtr    user_data);
 
+/** 
+ * @brief Handler definition used by \ref
+ * nopoll_conn_set_on_write_blocked and \ref
+ * nopoll_conn_set_on_write_drained.
+ *
+ * Called when content queued to be written on the connection reaches
+ * its high watermark (the producer should stop sending) or drops to
+ * its low watermark (the producer can resume). See \ref
+ * nopoll_conn_set_write_watermarks.
+ *
+ * @param ctx The context where the operation will take place.
+ *
+ * @param conn The connection where the operation will take place.
+ *
+ * @param user_data The reference that was configured to be passed in
+ * into the handler.
+ */
+typedef void (*noPollOnWriteHandler)    (noPollCtx  * ctx,
+					 noPollConn * conn, 
+					 noPollPtr    user_data);
+
 /** 
  * @brief Mutex creation handler used by the library.
  *
@@ -242,6 +389,80 @@ typedef void (*noPollMutexLock) (noPollPtr mutex);
  */
 typedef void (*noPollMutexUnlock) (noPollPtr mutex);
 
+/** 
+ * @brief Condition variable creation handler used by the library.
+ *
+ * @return A reference to the condition variable created (already
+ * initialized).
+ */
+typedef noPollPtr (*noPollCondCreate) (void);
+
+/** 
+ * @brief Condition variable destroy handler used by the library.
+ *
+ * @param cond The condition variable to destroy.
+ */
+typedef void (*noPollCondDestroy) (noPollPtr cond);
+
+/** 
+ * @brief Condition variable wait handler used by the library: waits
+ * until the condition is signaled, releasing the provided mutex
+ * (created by \ref noPollMutexCreate and locked by the caller) while
+ * waiting and acquiring it again before returning.
+ *
+ * @param cond The condition variable to wait on.
+ *
+ * @param mutex The mutex locked by the caller.
+ */
+typedef void (*noPollCondWait) (noPollPtr cond, noPollPtr mutex);
+
+/** 
+ * @brief Condition variable signal handler used by the library:
+ * wakes up one thread waiting on the condition (if any).
+ *
+ * @param cond The condition variable to signal.
+ */
+typedef void (*noPollCondSignal) (noPollPtr cond);
+
+/** 
+ * @brief Condition variable broadcast handler used by the library:
+ * wakes up all threads waiting on the condition.
+ *
+ * @param cond The condition variable to signal.
+ */
+typedef void (*noPollCondBroadcast) (noPollPtr cond);
+
+/** 
+ * @brief Function executed by a thread created through \ref
+ * noPollThreadCreate.
+ *
+ * @param user_data User defined pointer passed to the thread.
+ *
+ * @return Value returned by the thread (ignored by the library).
+ */
+typedef noPollPtr (*noPollThreadFunc) (noPollPtr user_data);
+
+/** 
+ * @brief Thread creation handler used by the library (for example
+ * by \ref nopoll_loop_run_threads).
+ *
+ * @param func The function to be executed by the new thread.
+ *
+ * @param user_data User defined pointer to be passed to func.
+ *
+ * @return A reference to the thread created or NULL if it fails.
+ */
+typedef noPollPtr (*noPollThreadCreate) (noPollThreadFunc func, noPollPtr user_data);
+
+/** 
+ * @brief Thread join handler used by the library: waits for the
+ * thread to finish and releases it.
+ *
+ * @param thread The thread reference as returned by \ref
+ * noPollThreadCreate.
+ */
+typedef void (*noPollThreadJoin) (noPollPtr thread);
+
 /** 
  * @brief Handler used by nopoll_log_set_handler to receive all log
  * notifications produced by the library on this function.
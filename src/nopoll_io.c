@@ -38,11 +38,167 @@
 #include <nopoll_io.h>
 #include <nopoll_private.h>
 
+#if defined(NOPOLL_HAVE_EPOLL)
+#include <sys/eventfd.h>
+#endif
+
+/* descriptors used to interrupt a wait operation (eventfd(2) on
+ * Linux, a self-pipe on other platforms and none on windows, where
+ * engines fall back to check regularly) */
+typedef struct _noPollIoWakeup {
+	int                  read_fd;
+	int                  write_fd;
+} noPollIoWakeup;
+
+/** 
+ * @internal Creates wakeup descriptors. On failure, descriptors are
+ * set to -1 and the engine falls back to regular checks.
+ */
+void    __nopoll_io_wakeup_init (noPollCtx * ctx, noPollIoWakeup * wakeup)
+{
+#if defined(NOPOLL_OS_WIN32)
+	wakeup->read_fd  = -1;
+	wakeup->write_fd = -1;
+#elif defined(NOPOLL_HAVE_EPOLL)
+	wakeup->read_fd  = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+	wakeup->write_fd = wakeup->read_fd;
+#else
+	int fds[2];
+
+	wakeup->read_fd  = -1;
+	wakeup->write_fd = -1;
+	if (pipe (fds) == 0) {
+		fcntl (fds[0], F_SETFL, fcntl (fds[0], F_GETFL) | O_NONBLOCK);
+		fcntl (fds[1], F_SETFL, fcntl (fds[1], F_GETFL) | O_NONBLOCK);
+		fcntl (fds[0], F_SETFD, FD_CLOEXEC);
+		fcntl (fds[1], F_SETFD, FD_CLOEXEC);
+		wakeup->read_fd  = fds[0];
+		wakeup->write_fd = fds[1];
+	} /* end if */
+#endif
+
+#if !defined(NOPOLL_OS_WIN32)
+	if (wakeup->read_fd < 0)
+		nopoll_log (ctx, NOPOLL_LEVEL_WARNING, "Unable to create wakeup descriptors (errno=%d), checking loop status every 500 ms", errno);
+#endif
+	return;
+}
+
+/** 
+ * @internal Closes wakeup descriptors.
+ */
+void    __nopoll_io_wakeup_close (noPollIoWakeup * wakeup)
+{
+#if !defined(NOPOLL_OS_WIN32)
+	if (wakeup->read_fd >= 0)
+		close (wakeup->read_fd);
+	if (wakeup->write_fd >= 0 && wakeup->write_fd != wakeup->read_fd)
+		close (wakeup->write_fd);
+#endif
+	wakeup->read_fd  = -1;
+	wakeup->write_fd = -1;
+	return;
+}
+
+/** 
+ * @internal Makes the wakeup descriptor readable (it stays readable
+ * until drained, so a wakeup signaled before the wait starts isn't
+ * lost).
+ */
+void    __nopoll_io_wakeup_signal (noPollIoWakeup * wakeup)
+{
+#if defined(NOPOLL_HAVE_EPOLL)
+	if (wakeup->write_fd >= 0)
+		eventfd_write (wakeup->write_fd, 1);
+#elif !defined(NOPOLL_OS_WIN32)
+	char value = 0;
+
+	/* a full pipe is already readable */
+	if (wakeup->write_fd >= 0 && write (wakeup->write_fd, &value, 1) < 0)
+		return;
+#endif
+	return;
+}
+
+/** 
+ * @internal Drains the wakeup descriptor after it was reported
+ * readable.
+ */
+void    __nopoll_io_wakeup_drain (noPollIoWakeup * wakeup)
+{
+#if defined(NOPOLL_HAVE_EPOLL)
+	eventfd_t value;
+
+	if (wakeup->read_fd >= 0)
+		eventfd_read (wakeup->read_fd, &value);
+#elif !defined(NOPOLL_OS_WIN32)
+	char buffer[64];
+
+	while (wakeup->read_fd >= 0 && read (wakeup->read_fd, buffer, sizeof (buffer)) > 0)
+		;
+#endif
+	return;
+}
+
+/** 
+ * @internal Returns how long (microseconds) the engine may block
+ * waiting for activity or -1 to wait without limit.
+ */
+long    __nopoll_io_wait_timeout (noPollCtx * ctx, noPollIoEngine * engine, noPollIoWakeup * wakeup)
+{
+	long timeout = ctx->io_wait_timeout > 0 ? ctx->io_wait_timeout : -1;
+
+	/* do not wait beyond the limit requested by the loop */
+	if (engine->wait_limit > 0 && (timeout < 0 || engine->wait_limit < timeout))
+		timeout = engine->wait_limit;
+
+	/* without wakeup support, check loop status regularly */
+	if (wakeup->read_fd < 0 && (timeout < 0 || timeout > 500000))
+		timeout = 500000;
+
+	return timeout;
+}
+
+/** 
+ * @internal Same as __nopoll_io_wait_timeout but in milliseconds
+ * (rounded up) as used by poll(2) and epoll_wait(2).
+ */
+int     __nopoll_io_wait_timeout_ms (noPollCtx * ctx, noPollIoEngine * engine, noPollIoWakeup * wakeup)
+{
+	long timeout = __nopoll_io_wait_timeout (ctx, engine, wakeup);
+
+	if (timeout < 0)
+		return -1;
+	return (int) ((timeout + 999) / 1000);
+}
+
+/** 
+ * @internal Translates the events an asynchronous connect waits for
+ * (NOPOLL_IO_READ, NOPOLL_IO_WRITE) into the provided engine flags.
+ */
+int     __nopoll_io_connect_events (noPollConn * conn, int read_flag, int write_flag)
+{
+	int events = 0;
+
+	if (conn->connect_events & NOPOLL_IO_READ)
+		events |= read_flag;
+	if (conn->connect_events & NOPOLL_IO_WRITE)
+		events |= write_flag;
+	return events;
+}
+
+/* all engine objects keep a reference to the engine owning them
+ * (received by their create function), used to reach its lock and
+ * wait limit */
 typedef struct _noPollSelect {
+	noPollIoEngine     * engine;
 	noPollCtx          * ctx;
 	fd_set               set;
+	/* sockets with content queued to be written */
+	fd_set               wset;
 	int                  length;
 	int                  max_fds;
+	noPollIoWakeup       wakeup;
 } noPollSelect;
 
 /** 
@@ -51,15 +207,25 @@ typedef struct _noPollSelect {
  *
  * @return A newly allocated fd_set reference.
  */
-noPollPtr nopoll_io_wait_select_create (noPollCtx * ctx) 
+noPollPtr nopoll_io_wait_select_create (noPollCtx * ctx, noPollIoEngine * engine) 
 {
 	noPollSelect * select = nopoll_new (noPollSelect, 1);
 
+	if (select == NULL)
+		return NULL;
+
 	/* set default behaviour expected for the set */
+	select->engine        = engine;
 	select->ctx           = ctx;
 	
 	/* clear the set */
 	FD_ZERO (&(select->set));
+	FD_ZERO (&(select->wset));
+
+	/* wakeup descriptor must fit into the set */
+	__nopoll_io_wakeup_init (ctx, &(select->wakeup));
+	if (select->wakeup.read_fd >= FD_SETSIZE)
+		__nopoll_io_wakeup_close (&(select->wakeup));
 
 	return select;
 }
@@ -72,10 +238,11 @@ noPollPtr nopoll_io_wait_select_create (noPollCtx * ctx)
  */
 void    nopoll_io_wait_select_destroy (noPollCtx * ctx, noPollPtr fd_group)
 {
-	fd_set * __fd_set = (fd_set *) fd_group;
+	noPollSelect * select = (noPollSelect *) fd_group;
 
 	/* release memory allocated */
-	nopoll_free (__fd_set);
+	__nopoll_io_wakeup_close (&(select->wakeup));
+	nopoll_free (select);
 	
 	/* nothing more to do */
 	return;
@@ -94,6 +261,14 @@ void    nopoll_io_wait_select_clear (noPollCtx * ctx, noPollPtr __fd_group)
 	/* clear the fd set */
 	select->length = 0;
 	FD_ZERO (&(select->set));
+	FD_ZERO (&(select->wset));
+
+	/* always watch wakeup descriptor */
+	if (select->wakeup.read_fd >= 0) {
+		FD_SET (select->wakeup.read_fd, &(select->set));
+		if (select->wakeup.read_fd > select->max_fds)
+			select->max_fds = select->wakeup.read_fd;
+	} /* end if */
 
 	/* nothing more to do */
 	return;
@@ -113,16 +288,25 @@ int nopoll_io_wait_select_wait (noPollCtx * ctx, noPollPtr __fd_group)
 {
 	int                 result = -1;
 	struct timeval      tv;
+	long                timeout;
 	noPollSelect     * _select = (noPollSelect *) __fd_group;
 
 	/* init wait */
-	tv.tv_sec    = 0;
-	tv.tv_usec   = 500000;
-	result       = select (_select->max_fds + 1, &(_select->set), NULL,   NULL, &tv);
+	timeout      = __nopoll_io_wait_timeout (ctx, _select->engine, &(_select->wakeup));
+	tv.tv_sec    = timeout / 1000000;
+	tv.tv_usec   = timeout % 1000000;
+	result       = select (_select->max_fds + 1, &(_select->set), &(_select->wset), NULL, timeout < 0 ? NULL : &tv);
 
 	/* check result */
 	if ((result == NOPOLL_SOCKET_ERROR) && (errno == NOPOLL_EINTR))
 		return -1;
+
+	/* do not report wakeup descriptor as a connection */
+	if (result > 0 && _select->wakeup.read_fd >= 0 && FD_ISSET (_select->wakeup.read_fd, &(_select->set))) {
+		__nopoll_io_wakeup_drain (&(_select->wakeup));
+		FD_CLR (_select->wakeup.read_fd, &(_select->set));
+		result--;
+	} /* end if */
 	
 	return result;
 }
@@ -153,8 +337,21 @@ nopoll_bool  nopoll_io_wait_select_add_to (int               fds,
 		return nopoll_false;
 	} /* end if */	
 
-	/* set the value */
-	FD_SET (fds, &(select->set));
+	/* set the value (and watch it to be writable if content is
+	 * queued or an asynchronous connect waits for it) */
+	if (conn && conn->connect_stage) {
+		if (conn->connect_events & NOPOLL_IO_READ)
+			FD_SET (fds, &(select->set));
+		if (conn->connect_events & NOPOLL_IO_WRITE)
+			FD_SET (fds, &(select->wset));
+	} else if (conn && conn->close_pending) {
+		/* closing: only write content queued */
+		FD_SET (fds, &(select->wset));
+	} else {
+		FD_SET (fds, &(select->set));
+		if (conn && conn->write_queue)
+			FD_SET (fds, &(select->wset));
+	} /* end if */
 
 	/* update length */
 	select->length++;
@@ -176,22 +373,736 @@ nopoll_bool  nopoll_io_wait_select_add_to (int               fds,
  * given fd group.
  *
  * @param fd_set The fd set where the socket descriptor will be checked.
+ *
+ * @return Events reported (NOPOLL_IO_READ, NOPOLL_IO_WRITE) or 0.
  */
-nopoll_bool      nopoll_io_wait_select_is_set (noPollCtx   * ctx,
+int              nopoll_io_wait_select_is_set (noPollCtx   * ctx,
 					       int           fds, 
 					       noPollPtr      __fd_set)
 {
 	noPollSelect * select = (noPollSelect *) __fd_set;
+	int            events = 0;
 	
 	if (fds < 0 || fds >= FD_SETSIZE) {
 		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL,
 			    "received a non valid socket (%d), unable to test in the set", fds);
-		return nopoll_false;
+		return 0;
 	}
 
-	return FD_ISSET (fds, &(select->set));
+	if (FD_ISSET (fds, &(select->set)))
+		events |= NOPOLL_IO_READ;
+	if (FD_ISSET (fds, &(select->wset)))
+		events |= NOPOLL_IO_WRITE;
+	return events;
 }
 
+/** 
+ * @internal noPoll select implementation for the "wakeup" operation.
+ */
+void         nopoll_io_wait_select_wakeup (noPollCtx * ctx, noPollPtr __fd_set)
+{
+	noPollSelect * select = (noPollSelect *) __fd_set;
+
+	__nopoll_io_wakeup_signal (&(select->wakeup));
+	return;
+}
+
+
+#if defined(NOPOLL_HAVE_EPOLL)
+typedef struct _noPollEpoll {
+	noPollIoEngine     * engine;
+	noPollCtx          * ctx;
+	int                  epoll_fd;
+	/* events reported by epoll_wait */
+	struct epoll_event * events;
+	int                  events_length;
+	/* connections registered, indexed by socket */
+	noPollConn        ** conns;
+	int                  conns_length;
+	/* number of connections registered */
+	int                  length;
+	/* connections reported by the last wait, same size as
+	 * events */
+	noPollConn        ** ready;
+	noPollIoWakeup       wakeup;
+} noPollEpoll;
+
+/** 
+ * @internal nopoll implementation to create a "epoll" IO call
+ * object.
+ *
+ * @return A newly allocated epoll reference or NULL if it fails.
+ */
+noPollPtr nopoll_io_wait_epoll_create (noPollCtx * ctx, noPollIoEngine * engine) 
+{
+	noPollEpoll        * epoll = nopoll_new (noPollEpoll, 1);
+	struct epoll_event   event;
+
+	if (epoll == NULL)
+		return NULL;
+
+	/* create kernel set */
+	epoll->engine        = engine;
+	epoll->ctx           = ctx;
+	epoll->epoll_fd      = epoll_create (1024);
+	epoll->events_length = 64;
+	epoll->events        = nopoll_new (struct epoll_event, epoll->events_length);
+	epoll->ready         = nopoll_new (noPollConn *, epoll->events_length);
+	if (epoll->epoll_fd < 0 || epoll->events == NULL || epoll->ready == NULL) {
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to create epoll(2) descriptor, errno=%d", errno);
+		if (epoll->epoll_fd >= 0)
+			close (epoll->epoll_fd);
+		nopoll_free (epoll->events);
+		nopoll_free (epoll->ready);
+		nopoll_free (epoll);
+		return NULL;
+	} /* end if */
+
+	/* watch wakeup descriptor */
+	__nopoll_io_wakeup_init (ctx, &(epoll->wakeup));
+	if (epoll->wakeup.read_fd >= 0) {
+		memset (&event, 0, sizeof (struct epoll_event));
+		event.events  = EPOLLIN;
+		event.data.fd = epoll->wakeup.read_fd;
+		if (epoll_ctl (epoll->epoll_fd, EPOLL_CTL_ADD, epoll->wakeup.read_fd, &event) != 0)
+			__nopoll_io_wakeup_close (&(epoll->wakeup));
+	} /* end if */
+
+	return epoll;
+}
+
+/** 
+ * @internal noPoll implementation to destroy the "epoll" IO call
+ * created by the epoll create.
+ */
+void    nopoll_io_wait_epoll_destroy (noPollCtx * ctx, noPollPtr fd_group)
+{
+	noPollEpoll * epoll = (noPollEpoll *) fd_group;
+
+	if (epoll == NULL)
+		return;
+
+	/* close kernel set and release memory (connections aren't
+	 * owned by the engine) */
+	close (epoll->epoll_fd);
+	__nopoll_io_wakeup_close (&(epoll->wakeup));
+	nopoll_free (epoll->events);
+	nopoll_free (epoll->ready);
+	nopoll_free (epoll->conns);
+	nopoll_free (epoll);
+
+	return;
+}
+
+/** 
+ * @internal Events the provided connection is interested in.
+ */
+int     __nopoll_io_wait_epoll_events (noPollConn * conn)
+{
+	/* do not watch sockets that are doing SSL/TLS handshake */
+	if (conn->pending_ssl_connect)
+		return 0;
+	/* asynchronous connect: watch what it waits for */
+	if (conn->connect_stage)
+		return __nopoll_io_connect_events (conn, EPOLLIN, EPOLLOUT);
+	/* closing: only write content queued */
+	if (conn->close_pending)
+		return EPOLLOUT;
+	/* watch it to be writable while content is queued */
+	if (conn->write_queue)
+		return EPOLLIN | EPOLLOUT;
+	return EPOLLIN;
+}
+
+/** 
+ * @internal epoll(2) implementation for the wait operation.
+ *
+ * @return Number of connections that changed (available through
+ * nopoll_io_wait_epoll_ready) or -1 if something failed.
+ */
+int nopoll_io_wait_epoll_wait (noPollCtx * ctx, noPollPtr __fd_group)
+{
+	noPollEpoll        * epoll = (noPollEpoll *) __fd_group;
+	noPollConn         * conn;
+	struct epoll_event * events;
+	noPollConn        ** ready;
+	int                  length;
+	int                  result;
+	int                  iterator;
+	int                  fds;
+	int                  changed = 0;
+
+	/* grow events reported (up to 4096 per wait, the rest are
+	 * reported on next wait): done here because the loop thread
+	 * is the only one using these arrays, connections may be
+	 * added by other threads while it waits */
+	nopoll_mutex_lock (epoll->engine->mutex);
+	if (epoll->length >= epoll->events_length && epoll->events_length < 4096) {
+		length = epoll->events_length * 2;
+		events = (struct epoll_event *) nopoll_realloc (epoll->events, sizeof (struct epoll_event) * length);
+		if (events != NULL)
+			epoll->events = events;
+		ready  = (noPollConn **) nopoll_realloc (epoll->ready, sizeof (noPollConn *) * length);
+		if (ready != NULL)
+			epoll->ready = ready;
+		if (events != NULL && ready != NULL)
+			epoll->events_length = length;
+	} /* end if */
+	nopoll_mutex_unlock (epoll->engine->mutex);
+
+	result = epoll_wait (epoll->epoll_fd, epoll->events, epoll->events_length,
+			     __nopoll_io_wait_timeout_ms (ctx, epoll->engine, &(epoll->wakeup)));
+
+	/* check result */
+	if (result == NOPOLL_SOCKET_ERROR) 
+		return -1;
+
+	/* translate sockets into connections */
+	nopoll_mutex_lock (epoll->engine->mutex);
+	for (iterator = 0; iterator < result; iterator++) {
+		fds  = epoll->events[iterator].data.fd;
+		if (fds == epoll->wakeup.read_fd) {
+			__nopoll_io_wakeup_drain (&(epoll->wakeup));
+			continue;
+		} /* end if */
+		conn = fds < epoll->conns_length ? epoll->conns[fds] : NULL;
+		if (conn == NULL)
+			continue;
+
+		/* keep events and connections at the same position */
+		epoll->events[changed] = epoll->events[iterator];
+		epoll->ready[changed]  = conn;
+		changed++;
+	} /* end for */
+	nopoll_mutex_unlock (epoll->engine->mutex);
+
+	return changed;
+}
+
+/** 
+ * @internal noPoll epoll implementation for the "ready" operation.
+ */
+noPollConn * nopoll_io_wait_epoll_ready (noPollCtx * ctx, int position, noPollPtr __fd_group)
+{
+	noPollEpoll * epoll = (noPollEpoll *) __fd_group;
+	noPollConn  * conn  = NULL;
+	int           fds;
+
+	if (position < 0 || position >= epoll->events_length)
+		return NULL;
+
+	/* check the connection is still registered (it may have
+	 * been removed while notifying previous ones) */
+	nopoll_mutex_lock (epoll->engine->mutex);
+	fds = epoll->events[position].data.fd;
+	if (fds < epoll->conns_length && epoll->conns[fds] == epoll->ready[position])
+		conn = epoll->ready[position];
+	nopoll_mutex_unlock (epoll->engine->mutex);
+
+	return conn;
+}
+
+/** 
+ * @internal noPoll epoll implementation for the "events" operation.
+ */
+int          nopoll_io_wait_epoll_ready_events (noPollCtx * ctx, int position, noPollPtr __fd_group)
+{
+	noPollEpoll * epoll  = (noPollEpoll *) __fd_group;
+	int           events = 0;
+
+	if (position < 0 || position >= epoll->events_length)
+		return 0;
+
+	if (epoll->events[position].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+		events |= NOPOLL_IO_READ;
+	if (epoll->events[position].events & EPOLLOUT)
+		events |= NOPOLL_IO_WRITE;
+	return events;
+}
+
+/** 
+ * @internal noPoll epoll implementation for the "modify" operation.
+ */
+nopoll_bool  nopoll_io_wait_epoll_modify (noPollCtx       * ctx,
+					  noPollConn      * conn,
+					  noPollPtr         __fd_set)
+{
+	noPollEpoll        * epoll = (noPollEpoll *) __fd_set;
+	struct epoll_event   event;
+	int                  fds   = conn->session;
+
+	if (fds < 0 || fds >= epoll->conns_length || epoll->conns[fds] != conn)
+		return nopoll_false;
+
+	memset (&event, 0, sizeof (struct epoll_event));
+	event.events  = __nopoll_io_wait_epoll_events (conn);
+	event.data.fd = fds;
+	if (epoll_ctl (epoll->epoll_fd, EPOLL_CTL_MOD, fds, &event) != 0) {
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL,
+			    "Unable to modify socket (%d) on the epoll set, errno=%d", fds, errno);
+		return nopoll_false;
+	} /* end if */
+
+	return nopoll_true;
+}
+
+/** 
+ * @internal noPoll epoll implementation for the "add" operation.
+ */
+nopoll_bool  nopoll_io_wait_epoll_add (noPollCtx       * ctx,
+				       noPollConn      * conn,
+				       noPollPtr         __fd_set)
+{
+	noPollEpoll        * epoll = (noPollEpoll *) __fd_set;
+	noPollConn        ** conns;
+	struct epoll_event   event;
+	int                  length;
+	int                  fds   = conn->session;
+
+	if (fds < 0) {
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL,
+			    "received a non valid socket (%d), unable to add to the set", fds);
+		return nopoll_false;
+	} /* end if */
+
+	/* already registered: just update */
+	if (fds < epoll->conns_length && epoll->conns[fds] == conn)
+		return nopoll_io_wait_epoll_modify (ctx, conn, __fd_set);
+
+	/* grow socket indexed table */
+	if (fds >= epoll->conns_length) {
+		length = epoll->conns_length > 0 ? epoll->conns_length : 64;
+		while (length <= fds)
+			length *= 2;
+		conns = (noPollConn **) nopoll_realloc (epoll->conns, sizeof (noPollConn *) * length);
+		if (conns == NULL) {
+			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to grow epoll connection table to %d items", length);
+			return nopoll_false;
+		} /* end if */
+		memset (conns + epoll->conns_length, 0, sizeof (noPollConn *) * (length - epoll->conns_length));
+		epoll->conns        = conns;
+		epoll->conns_length = length;
+	} /* end if */
+
+	/* register into the kernel set */
+	memset (&event, 0, sizeof (struct epoll_event));
+	event.events  = __nopoll_io_wait_epoll_events (conn);
+	event.data.fd = fds;
+	if (epoll_ctl (epoll->epoll_fd, EPOLL_CTL_ADD, fds, &event) != 0) {
+		/* socket reused without being removed */
+		if (errno != EEXIST || epoll_ctl (epoll->epoll_fd, EPOLL_CTL_MOD, fds, &event) != 0) {
+			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL,
+				    "Unable to add socket (%d) to the epoll set, errno=%d", fds, errno);
+			return nopoll_false;
+		} /* end if */
+	} /* end if */
+
+	if (epoll->conns[fds] == NULL)
+		epoll->length++;
+	epoll->conns[fds] = conn;
+
+	return nopoll_true;
+}
+
+/** 
+ * @internal noPoll epoll implementation for the "remove" operation.
+ */
+nopoll_bool  nopoll_io_wait_epoll_remove (noPollCtx       * ctx,
+					  noPollConn      * conn,
+					  noPollPtr         __fd_set)
+{
+	noPollEpoll        * epoll = (noPollEpoll *) __fd_set;
+	struct epoll_event   event;
+	int                  fds   = conn->session;
+
+	if (fds < 0 || fds >= epoll->conns_length || epoll->conns[fds] != conn)
+		return nopoll_false;
+
+	/* kernels before 2.6.9 require a non NULL event */
+	memset (&event, 0, sizeof (struct epoll_event));
+	epoll_ctl (epoll->epoll_fd, EPOLL_CTL_DEL, fds, &event);
+
+	epoll->conns[fds] = NULL;
+	epoll->length--;
+
+	return nopoll_true;
+}
+
+/** 
+ * @internal noPoll epoll implementation for the "wakeup" operation.
+ */
+void         nopoll_io_wait_epoll_wakeup (noPollCtx * ctx, noPollPtr __fd_set)
+{
+	noPollEpoll * epoll = (noPollEpoll *) __fd_set;
+
+	__nopoll_io_wakeup_signal (&(epoll->wakeup));
+	return;
+}
+#endif
+
+#if defined(NOPOLL_HAVE_POLL)
+typedef struct _noPollPoll {
+	noPollIoEngine     * engine;
+	noPollCtx          * ctx;
+	/* compact array of sockets watched and their connections
+	 * (same position) */
+	struct pollfd      * fds;
+	noPollConn        ** conns;
+	int                  length;
+	int                  size;
+	/* socket indexed position into fds array (position + 1, 0
+	 * = not registered) */
+	int                * index;
+	int                  index_length;
+	/* copy of fds array used by wait (so the set can be updated
+	 * from other threads while waiting) */
+	struct pollfd      * wait_fds;
+	int                  wait_size;
+	/* connections reported by the last wait (their sockets are
+	 * kept at the same position in wait_fds) */
+	noPollConn        ** ready;
+	int                  ready_size;
+	noPollIoWakeup       wakeup;
+} noPollPoll;
+
+/** 
+ * @internal nopoll implementation to create a "poll" IO call
+ * object.
+ *
+ * @return A newly allocated poll reference or NULL if it fails.
+ */
+noPollPtr nopoll_io_wait_poll_create (noPollCtx * ctx, noPollIoEngine * engine) 
+{
+	noPollPoll * group = nopoll_new (noPollPoll, 1);
+
+	if (group == NULL)
+		return NULL;
+	group->engine = engine;
+	group->ctx    = ctx;
+	__nopoll_io_wakeup_init (ctx, &(group->wakeup));
+
+	return group;
+}
+
+/** 
+ * @internal noPoll implementation to destroy the "poll" IO call
+ * created by the poll create.
+ */
+void    nopoll_io_wait_poll_destroy (noPollCtx * ctx, noPollPtr fd_group)
+{
+	noPollPoll * group = (noPollPoll *) fd_group;
+
+	if (group == NULL)
+		return;
+
+	/* connections aren't owned by the engine */
+	__nopoll_io_wakeup_close (&(group->wakeup));
+	nopoll_free (group->fds);
+	nopoll_free (group->conns);
+	nopoll_free (group->index);
+	nopoll_free (group->wait_fds);
+	nopoll_free (group->ready);
+	nopoll_free (group);
+
+	return;
+}
+
+/** 
+ * @internal Events the provided connection is interested in.
+ */
+short   __nopoll_io_wait_poll_events (noPollConn * conn)
+{
+	/* do not watch sockets that are doing SSL/TLS handshake */
+	if (conn->pending_ssl_connect)
+		return 0;
+	/* asynchronous connect: watch what it waits for */
+	if (conn->connect_stage)
+		return (short) __nopoll_io_connect_events (conn, POLLIN, POLLOUT);
+	/* closing: only write content queued */
+	if (conn->close_pending)
+		return POLLOUT;
+	/* watch it to be writable while content is queued */
+	if (conn->write_queue)
+		return POLLIN | POLLOUT;
+	return POLLIN;
+}
+
+/** 
+ * @internal poll(2) implementation for the wait operation.
+ *
+ * @return Number of connections that changed (available through
+ * nopoll_io_wait_poll_ready) or -1 if something failed.
+ */
+int nopoll_io_wait_poll_wait (noPollCtx * ctx, noPollPtr __fd_group)
+{
+	noPollPoll    * group = (noPollPoll *) __fd_group;
+	struct pollfd * fds;
+	noPollConn   ** ready;
+	int             length;
+	int             result;
+	int             iterator;
+	int             position;
+	int             changed = 0;
+
+	/* get a copy of the current set (plus the wakeup
+	 * descriptor) */
+	nopoll_mutex_lock (group->engine->mutex);
+	if (group->wait_size < group->size + 1) {
+		fds = (struct pollfd *) nopoll_realloc (group->wait_fds, sizeof (struct pollfd) * (group->size + 1));
+		if (fds == NULL) {
+			nopoll_mutex_unlock (group->engine->mutex);
+			return -1;
+		} /* end if */
+		group->wait_fds  = fds;
+		group->wait_size = group->size + 1;
+	} /* end if */
+	length = group->length;
+	if (length > 0)
+		memcpy (group->wait_fds, group->fds, sizeof (struct pollfd) * length);
+	if (group->wakeup.read_fd >= 0) {
+		group->wait_fds[length].fd      = group->wakeup.read_fd;
+		group->wait_fds[length].events  = POLLIN;
+		group->wait_fds[length].revents = 0;
+		length++;
+	} /* end if */
+	nopoll_mutex_unlock (group->engine->mutex);
+
+	result = poll (group->wait_fds, length, __nopoll_io_wait_timeout_ms (ctx, group->engine, &(group->wakeup)));
+
+	/* check result */
+	if (result == NOPOLL_SOCKET_ERROR) 
+		return -1;
+	if (result == 0)
+		return 0;
+
+	/* translate sockets into connections still registered */
+	nopoll_mutex_lock (group->engine->mutex);
+	if (group->ready_size < result) {
+		ready = (noPollConn **) nopoll_realloc (group->ready, sizeof (noPollConn *) * result);
+		if (ready == NULL) {
+			nopoll_mutex_unlock (group->engine->mutex);
+			return -1;
+		} /* end if */
+		group->ready      = ready;
+		group->ready_size = result;
+	} /* end if */
+
+	for (iterator = 0; iterator < length && changed < result; iterator++) {
+		if (group->wait_fds[iterator].revents == 0)
+			continue;
+
+		if (group->wait_fds[iterator].fd == group->wakeup.read_fd) {
+			__nopoll_io_wakeup_drain (&(group->wakeup));
+			continue;
+		} /* end if */
+
+		/* find current position for this socket */
+		position = group->wait_fds[iterator].fd;
+		position = position < group->index_length ? group->index[position] - 1 : -1;
+		if (position < 0)
+			continue;
+
+		group->wait_fds[changed] = group->wait_fds[iterator];
+		group->ready[changed]    = group->conns[position];
+		changed++;
+	} /* end for */
+	nopoll_mutex_unlock (group->engine->mutex);
+
+	return changed;
+}
+
+/** 
+ * @internal noPoll poll implementation for the "ready" operation.
+ */
+noPollConn * nopoll_io_wait_poll_ready (noPollCtx * ctx, int position, noPollPtr __fd_group)
+{
+	noPollPoll * group = (noPollPoll *) __fd_group;
+	noPollConn * conn = NULL;
+	int          fds;
+
+	if (position < 0 || position >= group->ready_size)
+		return NULL;
+
+	/* check the connection is still registered (it may have
+	 * been removed while notifying previous ones) */
+	nopoll_mutex_lock (group->engine->mutex);
+	fds = group->wait_fds[position].fd;
+	if (fds < group->index_length && group->index[fds] > 0 && group->conns[group->index[fds] - 1] == group->ready[position])
+		conn = group->ready[position];
+	nopoll_mutex_unlock (group->engine->mutex);
+
+	return conn;
+}
+
+/** 
+ * @internal noPoll poll implementation for the "events" operation.
+ */
+int          nopoll_io_wait_poll_ready_events (noPollCtx * ctx, int position, noPollPtr __fd_group)
+{
+	noPollPoll * group  = (noPollPoll *) __fd_group;
+	int          events = 0;
+
+	if (position < 0 || position >= group->ready_size)
+		return 0;
+
+	if (group->wait_fds[position].revents & (POLLIN | POLLERR | POLLHUP | POLLNVAL))
+		events |= NOPOLL_IO_READ;
+	if (group->wait_fds[position].revents & POLLOUT)
+		events |= NOPOLL_IO_WRITE;
+	return events;
+}
+
+/** 
+ * @internal Returns current position for the provided connection or
+ * -1 if it is not registered.
+ */
+int     __nopoll_io_wait_poll_find (noPollPoll * group, noPollConn * conn)
+{
+	int fds      = conn->session;
+	int position;
+
+	if (fds < 0 || fds >= group->index_length)
+		return -1;
+	position = group->index[fds] - 1;
+	if (position < 0 || group->conns[position] != conn)
+		return -1;
+	return position;
+}
+
+/** 
+ * @internal noPoll poll implementation for the "modify" operation.
+ */
+nopoll_bool  nopoll_io_wait_poll_modify (noPollCtx       * ctx,
+					 noPollConn      * conn,
+					 noPollPtr         __fd_set)
+{
+	noPollPoll * group    = (noPollPoll *) __fd_set;
+	int          position = __nopoll_io_wait_poll_find (group, conn);
+
+	if (position < 0)
+		return nopoll_false;
+
+	group->fds[position].events = __nopoll_io_wait_poll_events (conn);
+	return nopoll_true;
+}
+
+/** 
+ * @internal noPoll poll implementation for the "add" operation.
+ */
+nopoll_bool  nopoll_io_wait_poll_add (noPollCtx       * ctx,
+				      noPollConn      * conn,
+				      noPollPtr         __fd_set)
+{
+	noPollPoll     * group = (noPollPoll *) __fd_set;
+	struct pollfd  * fds;
+	noPollConn    ** conns;
+	int            * index;
+	int              length;
+	int              position;
+
+	if (conn->session < 0) {
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL,
+			    "received a non valid socket (%d), unable to add to the set", conn->session);
+		return nopoll_false;
+	} /* end if */
+
+	/* already registered: just update */
+	if (__nopoll_io_wait_poll_find (group, conn) >= 0)
+		return nopoll_io_wait_poll_modify (ctx, conn, __fd_set);
+
+	/* grow socket indexed table */
+	if (conn->session >= group->index_length) {
+		length = group->index_length > 0 ? group->index_length : 64;
+		while (length <= conn->session)
+			length *= 2;
+		index = (int *) nopoll_realloc (group->index, sizeof (int) * length);
+		if (index == NULL) {
+			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to grow poll index to %d items", length);
+			return nopoll_false;
+		} /* end if */
+		memset (index + group->index_length, 0, sizeof (int) * (length - group->index_length));
+		group->index        = index;
+		group->index_length = length;
+	} /* end if */
+
+	/* socket reused by a connection that wasn't removed: replace
+	 * it */
+	position = group->index[conn->session] - 1;
+	if (position >= 0) {
+		group->conns[position]      = conn;
+		group->fds[position].events = __nopoll_io_wait_poll_events (conn);
+		return nopoll_true;
+	} /* end if */
+
+	/* grow compact arrays */
+	if (group->length == group->size) {
+		length = group->size > 0 ? group->size * 2 : 64;
+		fds    = (struct pollfd *) nopoll_realloc (group->fds, sizeof (struct pollfd) * length);
+		if (fds == NULL) {
+			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to grow poll set to %d items", length);
+			return nopoll_false;
+		} /* end if */
+		group->fds = fds;
+		conns  = (noPollConn **) nopoll_realloc (group->conns, sizeof (noPollConn *) * length);
+		if (conns == NULL) {
+			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to grow poll set to %d items", length);
+			return nopoll_false;
+		} /* end if */
+		group->conns = conns;
+		group->size  = length;
+	} /* end if */
+
+	/* add at the end */
+	position                    = group->length;
+	group->fds[position].fd      = conn->session;
+	group->fds[position].events  = __nopoll_io_wait_poll_events (conn);
+	group->fds[position].revents = 0;
+	group->conns[position]       = conn;
+	group->index[conn->session]  = position + 1;
+	group->length++;
+
+	return nopoll_true;
+}
+
+/** 
+ * @internal noPoll poll implementation for the "remove" operation.
+ */
+nopoll_bool  nopoll_io_wait_poll_remove (noPollCtx       * ctx,
+					 noPollConn      * conn,
+					 noPollPtr         __fd_set)
+{
+	noPollPoll * group    = (noPollPoll *) __fd_set;
+	int          position = __nopoll_io_wait_poll_find (group, conn);
+	int          last;
+
+	if (position < 0)
+		return nopoll_false;
+
+	/* move last item into the removed position to keep the
+	 * array compact */
+	last = group->length - 1;
+	group->index[conn->session] = 0;
+	if (position != last) {
+		group->fds[position]   = group->fds[last];
+		group->conns[position] = group->conns[last];
+		group->index[group->fds[position].fd] = position + 1;
+	} /* end if */
+	group->length--;
+
+	return nopoll_true;
+}
+
+/** 
+ * @internal noPoll poll implementation for the "wakeup" operation.
+ */
+void         nopoll_io_wait_poll_wakeup (noPollCtx * ctx, noPollPtr __fd_set)
+{
+	noPollPoll * group = (noPollPoll *) __fd_set;
+
+	__nopoll_io_wakeup_signal (&(group->wakeup));
+	return;
+}
+#endif
 
 /** 
  * @brief Creates an object that represents the best IO wait mechanism
@@ -199,29 +1110,90 @@ nopoll_bool      nopoll_io_wait_select_is_set (noPollCtx   * ctx,
  *
  * @param ctx The context where the engine will be created/associated.
  *
- * @param engine Use \ref NOPOLL_IO_ENGINE_DEFAULT or the engine you
- * want to use.
+ * @param engine_type Use \ref NOPOLL_IO_ENGINE_DEFAULT or the engine
+ * you want to use. \ref NOPOLL_IO_ENGINE_DEFAULT selects epoll(2)
+ * when available (Linux), then poll(2), falling back to select(2)
+ * otherwise.
  *
- * @return The selected IO wait mechanism or NULL if it fails.
+ * @return The selected IO wait mechanism or NULL if it fails (for
+ * example, because the requested engine is not supported on this
+ * platform).
  */ 
 noPollIoEngine * nopoll_io_get_engine (noPollCtx * ctx, noPollIoEngineType engine_type)
 {
-	noPollIoEngine * engine = nopoll_new (noPollIoEngine, 1);
+	noPollIoEngine * engine;
+
+	/* resolve default engine */
+	if (engine_type == NOPOLL_IO_ENGINE_DEFAULT) {
+#if defined(NOPOLL_HAVE_EPOLL)
+		engine_type = NOPOLL_IO_ENGINE_EPOLL;
+#elif defined(NOPOLL_HAVE_POLL)
+		engine_type = NOPOLL_IO_ENGINE_POLL;
+#else
+		engine_type = NOPOLL_IO_ENGINE_SELECT;
+#endif
+	} /* end if */
+
+	engine = nopoll_new (noPollIoEngine, 1);
 	if (engine == NULL)
 		return NULL;
 
-	/* configure default implementation */
-	engine->create  = nopoll_io_wait_select_create;
-	engine->destroy = nopoll_io_wait_select_destroy;
-	engine->clear   = nopoll_io_wait_select_clear;
-	engine->wait    = nopoll_io_wait_select_wait;
-	engine->add_to  = nopoll_io_wait_select_add_to;
-	engine->is_set  = nopoll_io_wait_select_is_set;
+	switch (engine_type) {
+	case NOPOLL_IO_ENGINE_SELECT:
+		/* configure default implementation */
+		engine->create  = nopoll_io_wait_select_create;
+		engine->destroy = nopoll_io_wait_select_destroy;
+		engine->clear   = nopoll_io_wait_select_clear;
+		engine->wait    = nopoll_io_wait_select_wait;
+		engine->add_to  = nopoll_io_wait_select_add_to;
+		engine->is_set  = nopoll_io_wait_select_is_set;
+		engine->wakeup  = nopoll_io_wait_select_wakeup;
+		break;
+#if defined(NOPOLL_HAVE_EPOLL)
+	case NOPOLL_IO_ENGINE_EPOLL:
+		/* persistent registration */
+		engine->create  = nopoll_io_wait_epoll_create;
+		engine->destroy = nopoll_io_wait_epoll_destroy;
+		engine->wait    = nopoll_io_wait_epoll_wait;
+		engine->add     = nopoll_io_wait_epoll_add;
+		engine->modify  = nopoll_io_wait_epoll_modify;
+		engine->remove  = nopoll_io_wait_epoll_remove;
+		engine->ready   = nopoll_io_wait_epoll_ready;
+		engine->events  = nopoll_io_wait_epoll_ready_events;
+		engine->wakeup  = nopoll_io_wait_epoll_wakeup;
+		break;
+#endif
+#if defined(NOPOLL_HAVE_POLL)
+	case NOPOLL_IO_ENGINE_POLL:
+		/* persistent registration */
+		engine->create  = nopoll_io_wait_poll_create;
+		engine->destroy = nopoll_io_wait_poll_destroy;
+		engine->wait    = nopoll_io_wait_poll_wait;
+		engine->add     = nopoll_io_wait_poll_add;
+		engine->modify  = nopoll_io_wait_poll_modify;
+		engine->remove  = nopoll_io_wait_poll_remove;
+		engine->ready   = nopoll_io_wait_poll_ready;
+		engine->events  = nopoll_io_wait_poll_ready_events;
+		engine->wakeup  = nopoll_io_wait_poll_wakeup;
+		break;
+#endif
+	default:
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Requested IO engine (%d) is not supported on this platform", engine_type);
+		nopoll_free (engine);
+		return NULL;
+	} /* end switch */
 
 	/* call to create the object */
 	engine->ctx       = ctx;
-	engine->io_object = engine->create (ctx);
-	
+	engine->mutex     = nopoll_mutex_create ();
+	engine->io_object = engine->create (ctx, engine);
+	if (engine->io_object == NULL) {
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Failed to create IO engine (%d)", engine_type);
+		nopoll_mutex_destroy (engine->mutex);
+		nopoll_free (engine);
+		return NULL;
+	} /* end if */
+
 	/* return the engine that was created */
 	return engine;
 }
@@ -233,11 +1205,433 @@ noPollIoEngine * nopoll_io_get_engine (noPollCtx * ctx, noPollIoEngineType engin
  */
 void             nopoll_io_release_engine (noPollIoEngine * engine)
 {
+	int iterator;
+
 	if (engine == NULL)
 		return;
+
+	/* wait for operations started before the engine was
+	 * unpublished */
+	nopoll_mutex_lock (engine->mutex);
+	nopoll_mutex_unlock (engine->mutex);
+
+	/* release connections left with input pending to be
+	 * notified */
+	for (iterator = 0; iterator < engine->pending_length; iterator++) {
+		engine->pending[iterator]->input_queued = nopoll_false;
+		nopoll_conn_unref (engine->pending[iterator]);
+	} /* end for */
+	nopoll_free (engine->pending);
+	nopoll_free (engine->conns);
+
 	engine->destroy (engine->ctx, engine->io_object);
+	nopoll_mutex_destroy (engine->mutex);
 	nopoll_free (engine);
 	return;
 }
 
+/** 
+ * @internal Returns the io engine watching the provided connection:
+ * the engine of its loop worker when nopoll_loop_run_threads is
+ * running or the one created by nopoll_loop_wait otherwise (must be
+ * called with ctx->ref_mutex acquired).
+ */
+noPollIoEngine * __nopoll_io_conn_engine (noPollCtx * ctx, noPollConn * conn)
+{
+	if (ctx->workers_length > 0) {
+		if (conn->worker < 1 || conn->worker > ctx->workers_length)
+			return NULL;
+		return ctx->workers[conn->worker - 1]->io_engine;
+	} /* end if */
+
+	return ctx->io_engine;
+}
+
+/** 
+ * @internal Returns the io engine watching the provided connection
+ * with its mutex acquired (or NULL if there is none). Must be called
+ * with ctx->ref_mutex acquired, which can be released once the
+ * engine is returned: the engine is not released until its mutex is
+ * unlocked.
+ */
+noPollIoEngine * __nopoll_io_lock_conn_engine (noPollCtx * ctx, noPollConn * conn)
+{
+	noPollIoEngine * engine = __nopoll_io_conn_engine (ctx, conn);
+
+	if (engine)
+		nopoll_mutex_lock (engine->mutex);
+	return engine;
+}
+
+/** 
+ * @internal Wakes up the provided engine if the loop is waiting on it
+ * (must be called with engine->mutex acquired).
+ */
+void             __nopoll_io_wakeup_engine (noPollIoEngine * engine)
+{
+	if (engine && engine->waiting && engine->wakeup)
+		engine->wakeup (engine->ctx, engine->io_object);
+	return;
+}
+
+/** 
+ * @internal Adds the provided connection to the list of connections
+ * assigned to the engine (must be called with engine->mutex
+ * acquired). Nothing is done if it is already on the list.
+ */
+nopoll_bool      __nopoll_io_engine_join (noPollIoEngine * engine, noPollConn * conn)
+{
+	noPollConn ** conns;
+
+	if (__nopoll_io_engine_member (engine, conn))
+		return nopoll_true;
+
+	if (engine->conns_length == engine->conns_size) {
+		conns = nopoll_realloc (engine->conns, sizeof (noPollConn *) * (engine->conns_size + 32));
+		if (conns == NULL) {
+			nopoll_log (engine->ctx, NOPOLL_LEVEL_CRITICAL, "Failed to allocate memory to assign conn-id=%d to the io engine", conn->id);
+			return nopoll_false;
+		} /* end if */
+		engine->conns       = conns;
+		engine->conns_size += 32;
+	} /* end if */
+
+	engine->conns[engine->conns_length++] = conn;
+	conn->engine_pos                      = engine->conns_length;
+	return nopoll_true;
+}
+
+/** 
+ * @internal Removes the provided connection from the list of
+ * connections assigned to the engine (must be called with
+ * engine->mutex acquired).
+ */
+void             __nopoll_io_engine_leave (noPollIoEngine * engine, noPollConn * conn)
+{
+	int pos = conn->engine_pos - 1;
+
+	if (! __nopoll_io_engine_member (engine, conn))
+		return;
+
+	/* move last connection to the position released */
+	engine->conns_length--;
+	engine->conns[pos]               = engine->conns[engine->conns_length];
+	engine->conns[pos]->engine_pos   = pos + 1;
+	conn->engine_pos                 = 0;
+	return;
+}
+
+/** 
+ * @internal Checks if the provided connection is on the list of
+ * connections assigned to the engine (must be called with
+ * engine->mutex acquired). Positions recorded by engines already
+ * released are not trusted.
+ */
+nopoll_bool      __nopoll_io_engine_member (noPollIoEngine * engine, noPollConn * conn)
+{
+	int pos = conn->engine_pos - 1;
+
+	return pos >= 0 && pos < engine->conns_length && engine->conns[pos] == conn;
+}
+
+/** 
+ * @internal Calls the provided handler for each connection assigned
+ * to the engine (only used by the loop running it). The engine mutex
+ * is not held while the handler runs, so it can register or
+ * unregister connections: connections assigned meanwhile may not be
+ * visited and connections may be visited twice.
+ */
+void             __nopoll_io_foreach_conn (noPollIoEngine * engine, noPollForeachConn foreach, noPollPtr user_data)
+{
+	noPollConn * conn;
+	int          iterator;
+
+	nopoll_mutex_lock (engine->mutex);
+	/* iterate backwards: connections removed meanwhile are
+	 * replaced by the last one, which was already visited */
+	iterator = engine->conns_length - 1;
+	while (iterator >= 0) {
+		if (iterator >= engine->conns_length) {
+			iterator = engine->conns_length - 1;
+			continue;
+		} /* end if */
+
+		/* keep the connection while the handler runs */
+		conn = engine->conns[iterator];
+		nopoll_conn_ref (conn);
+		nopoll_mutex_unlock (engine->mutex);
+
+		foreach (engine->ctx, conn, user_data);
+		nopoll_conn_unref (conn);
+
+		nopoll_mutex_lock (engine->mutex);
+		iterator--;
+	} /* end while */
+	nopoll_mutex_unlock (engine->mutex);
+
+	return;
+}
+
+/** 
+ * @internal Adds the provided connection to the io engine currently
+ * running on the context (if any and if it keeps a persistent
+ * registration). Called when the connection is registered.
+ *
+ * When loop workers are running, the connection is assigned to one
+ * of them (round robin) unless it is a connection accepted, which is
+ * assigned to the worker of its listener (see nopoll_io_assign_conn).
+ *
+ * @param ctx The context where the connection is registered.
+ *
+ * @param conn The connection to add.
+ *
+ * @return nopoll_true if the connection was added or there is
+ * nothing to do, otherwise nopoll_false.
+ */
+nopoll_bool      nopoll_io_add_conn (noPollCtx * ctx, noPollConn * conn)
+{
+	noPollIoEngine * engine;
 
+	if (ctx == NULL || conn == NULL)
+		return nopoll_false;
+
+	nopoll_mutex_lock (ctx->ref_mutex);
+	engine = __nopoll_io_add_conn_lock (ctx, conn);
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	return __nopoll_io_add_conn_locked (ctx, conn, engine);
+}
+
+/** 
+ * @internal First step of nopoll_io_add_conn (called with
+ * ctx->ref_mutex acquired): assigns a loop worker to the provided
+ * connection (if workers are running) and returns the engine that
+ * watches it already locked (NULL if no loop is running). Callers
+ * then release ctx->ref_mutex and call __nopoll_io_add_conn_locked,
+ * so a shutdown started meanwhile waits for the connection to be
+ * added before removing it.
+ */
+noPollIoEngine * __nopoll_io_add_conn_lock (noPollCtx * ctx, noPollConn * conn)
+{
+	if (ctx->workers_length > 0 && (conn->worker < 1 || conn->worker > ctx->workers_length) && conn->role != NOPOLL_ROLE_LISTENER) {
+		conn->worker = (ctx->workers_next % ctx->workers_length) + 1;
+		ctx->workers_next++;
+	} /* end if */
+
+	return __nopoll_io_lock_conn_engine (ctx, conn);
+}
+
+/** 
+ * @internal Second step of nopoll_io_add_conn: adds the provided
+ * connection to the engine returned by __nopoll_io_add_conn_lock (if
+ * any), releasing it.
+ */
+nopoll_bool      __nopoll_io_add_conn_locked (noPollCtx * ctx, noPollConn * conn, noPollIoEngine * engine)
+{
+	nopoll_bool      result = nopoll_true;
+
+	if (engine == NULL)
+		return result;
+
+	/* engines with persistent registration keep the list of
+	 * connections assigned (also the ones without socket yet) */
+	if (engine->add)
+		result = __nopoll_io_engine_join (engine, conn);
+	if (result && engine->add && conn->session != NOPOLL_INVALID_SOCKET) {
+		result           = engine->add (ctx, conn, engine->io_object);
+		conn->io_watched = result;
+	} /* end if */
+	__nopoll_io_wakeup_engine (engine);
+	nopoll_mutex_unlock (engine->mutex);
+
+	return result;
+}
+
+/** 
+ * @internal Assigns the provided connection to a loop worker, moving
+ * it from the engine of its previous worker (if any). Used to serve
+ * connections accepted by the same worker that accepted them.
+ *
+ * @param ctx The context where the connection is registered.
+ *
+ * @param conn The connection to assign.
+ *
+ * @param worker The worker id or 0 to assign one (round robin).
+ */
+void             nopoll_io_assign_conn (noPollCtx * ctx, noPollConn * conn, int worker)
+{
+	noPollIoEngine * engine;
+
+	if (ctx == NULL || conn == NULL)
+		return;
+
+	nopoll_mutex_lock (ctx->ref_mutex);
+	if (ctx->workers_length == 0 || (worker > 0 && conn->worker == worker)) {
+		nopoll_mutex_unlock (ctx->ref_mutex);
+		return;
+	} /* end if */
+
+	/* remove from previous engine */
+	engine = __nopoll_io_lock_conn_engine (ctx, conn);
+	if (engine) {
+		if (engine->remove && conn->session != NOPOLL_INVALID_SOCKET)
+			engine->remove (ctx, conn, engine->io_object);
+		__nopoll_io_engine_leave (engine, conn);
+		conn->io_watched = nopoll_false;
+		nopoll_mutex_unlock (engine->mutex);
+	} /* end if */
+
+	if (worker < 1 || worker > ctx->workers_length) {
+		worker = (ctx->workers_next % ctx->workers_length) + 1;
+		ctx->workers_next++;
+	} /* end if */
+	conn->worker = worker;
+
+	/* add to the new one */
+	engine = __nopoll_io_lock_conn_engine (ctx, conn);
+	nopoll_mutex_unlock (ctx->ref_mutex);
+	if (engine == NULL)
+		return;
+
+	if (engine->add && __nopoll_io_engine_join (engine, conn) && conn->session != NOPOLL_INVALID_SOCKET)
+		conn->io_watched = engine->add (ctx, conn, engine->io_object);
+	__nopoll_io_wakeup_engine (engine);
+	nopoll_mutex_unlock (engine->mutex);
+
+	return;
+}
+
+/** 
+ * @internal Updates events watched for the provided connection on the
+ * io engine currently running on the context (if any).
+ *
+ * @param ctx The context where the connection is registered.
+ *
+ * @param conn The connection to update.
+ */
+void             nopoll_io_update_conn (noPollCtx * ctx, noPollConn * conn)
+{
+	noPollIoEngine * engine;
+
+	if (ctx == NULL || conn == NULL)
+		return;
+
+	nopoll_mutex_lock (ctx->ref_mutex);
+	engine = __nopoll_io_lock_conn_engine (ctx, conn);
+	nopoll_mutex_unlock (ctx->ref_mutex);
+	if (engine == NULL)
+		return;
+
+	if (engine->modify && conn->session != NOPOLL_INVALID_SOCKET)
+		engine->modify (ctx, conn, engine->io_object);
+	__nopoll_io_wakeup_engine (engine);
+	nopoll_mutex_unlock (engine->mutex);
+
+	return;
+}
+
+/** 
+ * @internal Removes the provided connection from the io engine
+ * currently running on the context (if any). It must be called before
+ * the connection socket is closed.
+ *
+ * @param ctx The context where the connection is registered.
+ *
+ * @param conn The connection to remove.
+ *
+ * @return nopoll_true if the connection was found and removed.
+ */
+nopoll_bool      nopoll_io_remove_conn (noPollCtx * ctx, noPollConn * conn)
+{
+	noPollIoEngine * engine;
+	nopoll_bool      result = nopoll_false;
+	nopoll_bool      unregistered;
+
+	if (ctx == NULL || conn == NULL)
+		return nopoll_false;
+
+	nopoll_mutex_lock (ctx->ref_mutex);
+	engine       = __nopoll_io_lock_conn_engine (ctx, conn);
+	unregistered = conn->ctx_slot == 0;
+	nopoll_mutex_unlock (ctx->ref_mutex);
+	if (engine == NULL)
+		return nopoll_false;
+
+	if (engine->remove && conn->session != NOPOLL_INVALID_SOCKET)
+		result = engine->remove (ctx, conn, engine->io_object);
+	if (result)
+		conn->io_watched = nopoll_false;
+
+	/* connections unregistered are no longer assigned to the
+	 * engine (the rest are added again, see
+	 * nopoll_conn_set_socket) */
+	if (unregistered)
+		__nopoll_io_engine_leave (engine, conn);
+	nopoll_mutex_unlock (engine->mutex);
+
+	return result;
+}
+
+/** 
+ * @internal Removes the provided connection from the io engine
+ * watching it because it is being shutdown, signaling the loop
+ * running the engine to unregister it. It must be called before the
+ * connection socket is closed.
+ *
+ * @param ctx The context where the connection is registered.
+ *
+ * @param conn The connection being shutdown.
+ */
+void             nopoll_io_shutdown_conn (noPollCtx * ctx, noPollConn * conn)
+{
+	noPollIoEngine * engine;
+
+	if (ctx == NULL || conn == NULL)
+		return;
+
+	nopoll_mutex_lock (ctx->ref_mutex);
+	engine = __nopoll_io_lock_conn_engine (ctx, conn);
+	nopoll_mutex_unlock (ctx->ref_mutex);
+	if (engine == NULL)
+		return;
+
+	if (engine->remove && conn->session != NOPOLL_INVALID_SOCKET &&
+	    engine->remove (ctx, conn, engine->io_object)) {
+		conn->io_watched              = nopoll_false;
+		engine->conn_shutdown_pending = nopoll_true;
+		__nopoll_io_wakeup_engine (engine);
+	} /* end if */
+	nopoll_mutex_unlock (engine->mutex);
+
+	return;
+}
+
+/** 
+ * @internal Wakes up the io engines running on the context (the one
+ * used by nopoll_loop_wait or the ones used by loop workers) if they
+ * are waiting, so changes done from other threads (loop stop, new
+ * connections) are noticed without delay.
+ *
+ * @param ctx The context where the loop is running.
+ */
+void             nopoll_io_wakeup (noPollCtx * ctx)
+{
+	noPollIoEngine * engine;
+	int              iterator;
+
+	if (ctx == NULL)
+		return;
+
+	nopoll_mutex_lock (ctx->ref_mutex);
+	for (iterator = -1; iterator < ctx->workers_length; iterator++) {
+		engine = iterator < 0 ? ctx->io_engine : ctx->workers[iterator]->io_engine;
+		if (engine == NULL)
+			continue;
+		nopoll_mutex_lock (engine->mutex);
+		__nopoll_io_wakeup_engine (engine);
+		nopoll_mutex_unlock (engine->mutex);
+	} /* end for */
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	return;
+}
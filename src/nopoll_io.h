@@ -46,6 +46,31 @@ noPollIoEngine * nopoll_io_get_engine (noPollCtx * ctx, noPollIoEngineType engin
 
 void             nopoll_io_release_engine (noPollIoEngine * engine);
 
+/** internal api **/
+nopoll_bool      nopoll_io_add_conn (noPollCtx * ctx, noPollConn * conn);
+
+noPollIoEngine * __nopoll_io_add_conn_lock (noPollCtx * ctx, noPollConn * conn);
+
+nopoll_bool      __nopoll_io_add_conn_locked (noPollCtx * ctx, noPollConn * conn, noPollIoEngine * engine);
+
+nopoll_bool      __nopoll_io_engine_join (noPollIoEngine * engine, noPollConn * conn);
+
+void             __nopoll_io_engine_leave (noPollIoEngine * engine, noPollConn * conn);
+
+nopoll_bool      __nopoll_io_engine_member (noPollIoEngine * engine, noPollConn * conn);
+
+void             __nopoll_io_foreach_conn (noPollIoEngine * engine, noPollForeachConn foreach, noPollPtr user_data);
+
+void             nopoll_io_assign_conn (noPollCtx * ctx, noPollConn * conn, int worker);
+
+void             nopoll_io_update_conn (noPollCtx * ctx, noPollConn * conn);
+
+nopoll_bool      nopoll_io_remove_conn (noPollCtx * ctx, noPollConn * conn);
+
+void             nopoll_io_shutdown_conn (noPollCtx * ctx, noPollConn * conn);
+
+void             nopoll_io_wakeup (noPollCtx * ctx);
+
 END_C_DECLS
 
 #endif 
@@ -215,8 +215,11 @@ noPollConn      * __nopoll_listener_new_opts_internal (noPollCtx      * ctx,
 	listener           = nopoll_new (noPollConn, 1);
 	listener->refs     = 1;
 	/* create mutex */
+#if !defined(NOPOLL_HAVE_ATOMIC_REFS)
 	listener->ref_mutex = nopoll_mutex_create ();
+#endif
 	listener->handshake_mutex = nopoll_mutex_create ();
+	listener->write_mutex = nopoll_mutex_create ();
 	listener->session   = session;
 	listener->ctx       = ctx;
 	listener->role      = NOPOLL_ROLE_MAIN_LISTENER;
@@ -460,11 +463,31 @@ noPollConn      * nopoll_listener_tls_new_opts6 (noPollCtx      * ctx,
 	return __nopoll_listener_tls_new_opts_internal (ctx, NOPOLL_TRANSPORT_IPV6, opts, host, port);
 }
 
+/** 
+ * @internal Copies the certificates of the listener provided
+ * (user_data) to the listeners created to share its port.
+ */
+nopoll_bool __nopoll_listener_set_certificate_shared (noPollCtx * ctx, noPollConn * conn, noPollPtr user_data)
+{
+	noPollConn * listener = user_data;
+
+	if (conn->role != NOPOLL_ROLE_MAIN_LISTENER || conn->listener_origin != listener->id)
+		return nopoll_false;
+
+	conn->certificate   = nopoll_strdup (listener->certificate);
+	conn->private_key   = nopoll_strdup (listener->private_key);
+	if (listener->chain_certificate)
+		conn->chain_certificate = nopoll_strdup (listener->chain_certificate);
+	return nopoll_false; /* keep foreach, don't stop */
+}
+
 /** 
  * @brief Allows to configure the TLS certificate and key to be used
  * on the provided connection.
  *
  * @param listener The listener that is going to be configured with the providing certificate and key.
+ * Listeners created to share its port (see \ref
+ * nopoll_listener_new_reuse_port) are configured too.
  *
  * @param certificate The path to the public certificate file (PEM
  * format) to be used for every TLS connection received under the
@@ -520,6 +543,13 @@ nopoll_bool           nopoll_listener_set_certificate (noPollConn * listener,
 	listener->private_key   = nopoll_strdup (private_key);
 	if (chain_file)
 		listener->chain_certificate = nopoll_strdup (chain_file);
+
+	/* and to the listeners sharing its port */
+	nopoll_ctx_foreach_conn (listener->ctx, __nopoll_listener_set_certificate_shared, listener);
+
+	/* release ssl contexts configured with previous
+	 * certificates (shared by those listeners) */
+	nopoll_ctx_invalidate_ssl_contexts (listener->ctx, listener);
 	    
 	nopoll_log (listener->ctx, NOPOLL_LEVEL_DEBUG, "Configured certificate: %s, key: %s, for conn id: %d",
 		    listener->certificate, listener->private_key, listener->id);
@@ -557,8 +587,11 @@ noPollConn   * nopoll_listener_from_socket (noPollCtx      * ctx,
 	listener            = nopoll_new (noPollConn, 1);
 	listener->refs      = 1;
 	/* create mutex */
+#if !defined(NOPOLL_HAVE_ATOMIC_REFS)
 	listener->ref_mutex = nopoll_mutex_create ();
+#endif
 	listener->handshake_mutex = nopoll_mutex_create ();
+	listener->write_mutex = nopoll_mutex_create ();
 	listener->session   = session;
 	listener->ctx       = ctx;
 	listener->role      = NOPOLL_ROLE_LISTENER;
@@ -596,6 +629,121 @@ noPollConn   * nopoll_listener_from_socket (noPollCtx      * ctx,
 	return listener;
 }
 
+/** 
+ * @brief Creates a new listener bound to the same address and port of
+ * the listener provided, sharing it through SO_REUSEPORT so the
+ * kernel balances incoming connections among both listeners. The new
+ * listener copies the configuration of the provided one (TLS,
+ * certificates, options and handlers) and shares its server SSL
+ * contexts, so TLS sessions issued by any of them can be resumed by
+ * the others.
+ *
+ * The function is used by \ref nopoll_loop_run_threads to create one
+ * listener per loop worker.
+ *
+ * @param ctx The context where the listener will be associated.
+ *
+ * @param listener The listener (\ref NOPOLL_ROLE_MAIN_LISTENER) whose
+ * port is shared.
+ *
+ * @return A reference to a listener connection object or NULL if it
+ * fails or SO_REUSEPORT is not supported by the platform.
+ */
+noPollConn   * nopoll_listener_new_reuse_port (noPollCtx      * ctx,
+					       noPollConn     * listener)
+{
+#if defined(SO_REUSEPORT) && ! defined(NOPOLL_OS_WIN32)
+	struct sockaddr_storage   sin;
+	socklen_t                 sin_size = sizeof (sin);
+	NOPOLL_SOCKET             session;
+	noPollConn              * conn;
+	int                       unit     = 1; 
+
+	nopoll_return_val_if_fail (ctx, ctx && listener, NULL);
+	nopoll_return_val_if_fail (ctx, listener->role == NOPOLL_ROLE_MAIN_LISTENER, NULL);
+
+	/* enable port sharing on the listener and get its address */
+	if (setsockopt (listener->session, SOL_SOCKET, SO_REUSEPORT, &unit, sizeof (unit)) != 0 ||
+	    getsockname (listener->session, (struct sockaddr *) &sin, &sin_size) != 0) {
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "unable to enable SO_REUSEPORT on listener socket %d (errno=%d)", listener->session, errno);
+		return NULL;
+	} /* end if */
+
+	/* create socket */
+	session = socket (sin.ss_family, SOCK_STREAM, 0);
+	if (session <= 2) {
+		/* do not allow creating sockets reusing stdin (0),
+		   stdout (1), stderr (2) */
+		nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "failed to create listener socket: %d (errno=%d)", session, errno);
+		return NULL;
+	} /* end if */
+
+	setsockopt (session, SOL_SOCKET, SO_REUSEADDR, &unit, sizeof (unit));
+	setsockopt (session, SOL_SOCKET, SO_REUSEPORT, &unit, sizeof (unit));
+	if (bind (session, (struct sockaddr *) &sin, sin_size) == NOPOLL_SOCKET_ERROR ||
+	    listen (session, ctx->backlog) == NOPOLL_SOCKET_ERROR) {
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "unable to share listener port %s (errno=%d : %s)", listener->port, errno, strerror (errno));
+		nopoll_close_socket (session);
+		return NULL;
+	} /* end if */
+
+	/* create noPollConn ection object */
+	conn            = nopoll_new (noPollConn, 1);
+	conn->refs      = 1;
+	/* create mutex */
+#if !defined(NOPOLL_HAVE_ATOMIC_REFS)
+	conn->ref_mutex = nopoll_mutex_create ();
+#endif
+	conn->handshake_mutex = nopoll_mutex_create ();
+	conn->write_mutex = nopoll_mutex_create ();
+	conn->session   = session;
+	conn->ctx       = ctx;
+	conn->role      = NOPOLL_ROLE_MAIN_LISTENER;
+
+	/* share the SSL contexts (session cache and ticket keys) of
+	 * the first listener */
+	conn->listener_origin = listener->listener_origin ? listener->listener_origin : listener->id;
+
+	/* record host and port */
+	conn->host      = nopoll_strdup (listener->host);
+	conn->port      = nopoll_strdup (listener->port);
+
+	/* register connection into context */
+	nopoll_ctx_register_conn (ctx, conn);
+
+	/* configure default handlers */
+	conn->receive   = nopoll_conn_default_receive;
+	conn->send      = nopoll_conn_default_send;
+
+	/* copy listener configuration (options are released with
+	 * the connection unless reuse flag is set) */
+	conn->opts      = listener->opts;
+	if (conn->opts && ! conn->opts->reuse)
+		nopoll_conn_opts_ref (conn->opts);
+	conn->tls_on    = listener->tls_on;
+	if (listener->certificate)
+		conn->certificate       = nopoll_strdup (listener->certificate);
+	if (listener->private_key)
+		conn->private_key       = nopoll_strdup (listener->private_key);
+	if (listener->chain_certificate)
+		conn->chain_certificate = nopoll_strdup (listener->chain_certificate);
+	conn->on_msg         = listener->on_msg;
+	conn->on_msg_data    = listener->on_msg_data;
+	conn->on_ready       = listener->on_ready;
+	conn->on_ready_data  = listener->on_ready_data;
+	conn->on_close       = listener->on_close;
+	conn->on_close_data  = listener->on_close_data;
+
+	nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Listener created sharing port with listener id=%d: %s:%s (socket: %d)",
+		    listener->id, conn->host, conn->port, conn->session);
+
+	return conn;
+#else
+	nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to share listener port, SO_REUSEPORT is not supported by this platform");
+	return NULL;
+#endif
+}
+
 /** 
  * @internal Public function that performs a TCP listener accept.
  *
@@ -90,6 +90,9 @@ nopoll_bool       nopoll_listener_set_certificate (noPollConn * listener,
 noPollConn      * nopoll_listener_from_socket (noPollCtx      * ctx,
 					       NOPOLL_SOCKET    session);
 
+noPollConn      * nopoll_listener_new_reuse_port (noPollCtx      * ctx,
+						  noPollConn     * listener);
+
 NOPOLL_SOCKET     nopoll_listener_accept (NOPOLL_SOCKET server_socket);
 
 END_C_DECLS
@@ -78,6 +78,19 @@ nopoll_bool    nopoll_log_color_is_enabled (noPollCtx * ctx)
 	return ctx->debug_color_enabled;
 }
 
+/** 
+ * @internal Updates the minimum level delivered by the context
+ * according to its configuration.
+ */
+void __nopoll_log_update_threshold (noPollCtx * ctx)
+{
+	if (ctx->log_handler || ctx->debug_enabled)
+		ctx->log_threshold = ctx->log_level;
+	else
+		ctx->log_threshold = NOPOLL_LEVEL_CRITICAL + 1;
+	return;
+}
+
 /** 
  * @brief Allows to control how to activate the log reporting to the
  * console from the nopoll core library.
@@ -94,6 +107,7 @@ void     nopoll_log_enable (noPollCtx * ctx, nopoll_bool value)
 
 	/* activate debuging according to the variable */
 	ctx->debug_enabled = value;
+	__nopoll_log_update_threshold (ctx);
 	return;
 }
 
@@ -135,61 +149,102 @@ void            nopoll_log_set_handler (noPollCtx * ctx, noPollLogHandler handle
 
 	ctx->log_handler   = handler;
 	ctx->log_user_data = user_data;
+	__nopoll_log_update_threshold (ctx);
 
 	return;
 }
 
 /** 
- * @internal Allows to drop a log to the console.
+ * @brief Allows to configure the minimum level reported by the
+ * provided context (to the console or to the handler configured with
+ * \ref nopoll_log_set_handler).
  *
- * This function allow to drop a log to the console using the given
- * domain, as an identification of which subsystem have reported the
- * information, and report level. This report level is used to notify
- * the consideration of the log reported.
- * 
- * The function allows to provide a printf like interface to report
- * messages. Here are some examples:
- * 
- * \code
- * // drop a log about current library initialization
- * nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "library properly initialized status=%d", status);
- * \endcode
+ * Logs below the level are discarded before evaluating their
+ * arguments. By default, all levels are reported (\ref
+ * NOPOLL_LEVEL_DEBUG). Levels can also be removed at compile time by
+ * defining NOPOLL_LOG_MIN_LEVEL.
  *
+ * @param ctx The context that is going to be configured.
  *
- * @param ctx The context where the operation will take place.
+ * @param level The minimum level to report.
+ */
+void            nopoll_log_set_level (noPollCtx * ctx, noPollDebugLevel level)
+{
+	nopoll_return_if_fail (ctx, ctx);
+
+	ctx->log_level = level;
+	__nopoll_log_update_threshold (ctx);
+
+	return;
+}
+
+/** 
+ * @brief Returns the minimum level reported by the provided context
+ * (see \ref nopoll_log_set_level).
  *
- * @param level The level that this message is classificed. 
- * 
- * @param message The message to report. The message to report must be
- * not NULL.
+ * @param ctx The context to check.
+ *
+ * @return The level configured (\ref NOPOLL_LEVEL_DEBUG if ctx is
+ * NULL).
  */
-void __nopoll_log (noPollCtx * ctx, const char * function_name, const char * file, int line, noPollDebugLevel level, const char * message, ...)
+noPollDebugLevel nopoll_log_get_level (noPollCtx * ctx)
 {
+	if (ctx == NULL)
+		return NOPOLL_LEVEL_DEBUG;
+	return ctx->log_level;
+}
 
-#ifdef SHOW_DEBUG_LOG
-	va_list      args;
-	char       * log_msg;
-	char       * log_msg2;
+/** 
+ * @brief Allows to check if a log with the provided level would be
+ * reported by the context (log is enabled or a handler is defined,
+ * and the level isn't below the level configured).
+ *
+ * @param ctx The context to check.
+ *
+ * @param level The level to check.
+ *
+ * @return nopoll_true if the level is reported, otherwise
+ * nopoll_false is returned.
+ */
+nopoll_bool     nopoll_log_is_level_enabled (noPollCtx * ctx, noPollDebugLevel level)
+{
+	return __NOPOLL_LOG_ENABLED (ctx, level);
+}
 
-	if (ctx && ctx->log_handler) {
-		/* print the message */
-		va_start (args, message);
-		log_msg = nopoll_strdup_printfv (message, args);
-		va_end (args);
+/** 
+ * @internal printf like function writing into the provided buffer,
+ * returning the length required (or -1 if it fails).
+ */
+int __nopoll_log_vsnprintf (char * buffer, int size, const char * format, va_list args)
+{
+#if defined(NOPOLL_OS_WIN32) && ! defined (__GNUC__)
+	return _vsnprintf_s (buffer, size, _TRUNCATE, format, args);
+#else
+	return vsnprintf (buffer, size, format, args);
+#endif
+}
 
-		log_msg2 = log_msg;
-		log_msg = nopoll_strdup_printf ("%s:%d %s ", file, line, log_msg);
-		nopoll_free (log_msg2);
+/** 
+ * @internal See __nopoll_log_vsnprintf.
+ */
+int __nopoll_log_snprintf (char * buffer, int size, const char * format, ...)
+{
+	va_list args;
+	int     result;
 
-		ctx->log_handler (ctx, level, log_msg, ctx->log_user_data);
-		nopoll_free (log_msg);
-		return;
-	}
+	va_start (args, format);
+	result = __nopoll_log_vsnprintf (buffer, size, format, args);
+	va_end (args);
 
-	/* check if the log is enabled */
-	if (! nopoll_log_is_enabled (ctx))
-		return;
+	return result;
+}
 
+/** 
+ * @internal Prints to the console the process and level prefix of a
+ * log.
+ */
+void __nopoll_log_console_prefix (noPollCtx * ctx, noPollDebugLevel level)
+{
 	/* printout the process pid */
 	if (nopoll_log_color_is_enabled (ctx)) 
 		printf ("\e[1;36m(proc %d)\e[0m: ", getpid ());
@@ -222,6 +277,442 @@ void __nopoll_log (noPollCtx * ctx, const char * function_name, const char * fil
 			break;
 		}
 	}
+	return;
+}
+/** 
+ * @internal Log record stored in the asynchronous ring.
+ */
+typedef struct _noPollLogRecord {
+	/* record state: equal to the ring position when the record
+	 * is free, position + 1 once it is ready to be delivered */
+	unsigned int       sequence;
+	noPollDebugLevel   level;
+	char               message[NOPOLL_LOG_BUFFER_SIZE];
+} noPollLogRecord;
+
+/** 
+ * @internal Bounded ring of log records written by any thread
+ * (without locking) and delivered by a single writer thread.
+ */
+typedef struct _noPollLogRing {
+	noPollCtx        * ctx;
+	noPollLogRecord  * records;
+	unsigned int       mask;
+
+	/* next position to be written (shared by all threads) and
+	 * next position to be delivered (writer thread) */
+	unsigned int       write_pos;
+	unsigned int       read_pos;
+
+	/* records dropped because the ring was full */
+	int                dropped;
+
+	/* the writer waits on cond (protected by mutex) while no
+	 * record is ready, flagging it with sleeping */
+	noPollPtr          mutex;
+	noPollPtr          cond;
+	int                sleeping;
+
+	int                stop;
+	noPollPtr          thread;
+} noPollLogRing;
+
+#if defined(NOPOLL_HAVE_ATOMIC_REFS)
+/** 
+ * @internal Delivers a log record from the writer thread.
+ */
+void __nopoll_log_async_deliver (noPollCtx * ctx, noPollDebugLevel level, const char * message)
+{
+	if (ctx->log_handler) {
+		ctx->log_handler (ctx, level, message, ctx->log_user_data);
+		return;
+	} /* end if */
+
+	if (! nopoll_log_is_enabled (ctx))
+		return;
+
+	__nopoll_log_console_prefix (ctx, level);
+	printf ("%s\n", message);
+	return;
+}
+
+/** 
+ * @internal Delivers all records ready in the ring, returning how many
+ * were delivered.
+ */
+int __nopoll_log_async_drain (noPollLogRing * ring)
+{
+	noPollLogRecord * record;
+	int               delivered = 0;
+
+	while (nopoll_true) {
+		record = &ring->records[ring->read_pos & ring->mask];
+		if (nopoll_atomic_get (&record->sequence) != ring->read_pos + 1)
+			break;
+
+		__nopoll_log_async_deliver (ring->ctx, record->level, record->message);
+
+		/* release the record for the next round */
+		nopoll_atomic_set (&record->sequence, ring->read_pos + ring->mask + 1);
+		ring->read_pos++;
+		delivered++;
+	} /* end while */
+
+	if (delivered > 0 && ! ring->ctx->log_handler)
+		fflush (stdout);
+	return delivered;
+}
+
+/** 
+ * @internal Writer thread delivering records until requested to stop.
+ */
+noPollPtr __nopoll_log_async_run (noPollPtr user_data)
+{
+	noPollLogRing   * ring = user_data;
+	noPollLogRecord * record;
+
+	while (! nopoll_atomic_get (&ring->stop)) {
+		if (__nopoll_log_async_drain (ring) > 0)
+			continue;
+
+		/* wait for new records: flag it first and check
+		 * again, so records published meanwhile are not
+		 * missed (writers signal once they see the flag) */
+		nopoll_mutex_lock (ring->mutex);
+		nopoll_atomic_cas (&ring->sleeping, 0, 1);
+		record = &ring->records[ring->read_pos & ring->mask];
+		if (nopoll_atomic_get (&record->sequence) != ring->read_pos + 1 && ! nopoll_atomic_get (&ring->stop))
+			nopoll_cond_wait (ring->cond, ring->mutex);
+		nopoll_atomic_set (&ring->sleeping, 0);
+		nopoll_mutex_unlock (ring->mutex);
+	} /* end while */
+
+	/* deliver pending records */
+	__nopoll_log_async_drain (ring);
+	return NULL;
+}
+
+/** 
+ * @internal Stores a log record into the ring (dropping it if the ring
+ * is full).
+ */
+void __nopoll_log_async_push (noPollLogRing * ring, noPollDebugLevel level, const char * file, int line, const char * message, va_list args)
+{
+	noPollLogRecord * record;
+	unsigned int      position;
+	int               size;
+	int               length;
+
+	/* claim a free record */
+	position = nopoll_atomic_get (&ring->write_pos);
+	while (nopoll_true) {
+		record = &ring->records[position & ring->mask];
+		size   = (int) (nopoll_atomic_get (&record->sequence) - position);
+		if (size == 0) {
+			if (nopoll_atomic_cas (&ring->write_pos, position, position + 1))
+				break;
+		} else if (size < 0) {
+			/* record not delivered yet: ring is full */
+			nopoll_atomic_inc (&ring->dropped);
+			return;
+		} /* end if */
+
+		/* another thread claimed the position */
+		position = nopoll_atomic_get (&ring->write_pos);
+	} /* end while */
+
+	/* write the record (truncated to the record size) */
+	record->level = level;
+	size   = __nopoll_log_snprintf (record->message, NOPOLL_LOG_BUFFER_SIZE, "%s:%d ", file, line);
+	if (size < 0 || size >= NOPOLL_LOG_BUFFER_SIZE - 1)
+		size = 0;
+	length = __nopoll_log_vsnprintf (record->message + size, NOPOLL_LOG_BUFFER_SIZE - size, message, args);
+	if (length < 0 || size + length + 1 >= NOPOLL_LOG_BUFFER_SIZE)
+		length = NOPOLL_LOG_BUFFER_SIZE - size - 2;
+	record->message[size + length]     = ' ';
+	record->message[size + length + 1] = 0;
+
+	/* publish it and wake up the writer if it is waiting */
+	nopoll_atomic_set (&record->sequence, position + 1);
+	if (nopoll_atomic_cas (&ring->sleeping, 1, 1)) {
+		nopoll_mutex_lock (ring->mutex);
+		nopoll_cond_signal (ring->cond);
+		nopoll_mutex_unlock (ring->mutex);
+	} /* end if */
+	return;
+}
+
+/** 
+ * @internal Returns the ring currently configured on the provided
+ * context (if any) flagging the caller is using it: it won't be
+ * released until __nopoll_log_async_unuse is called.
+ */
+noPollLogRing * __nopoll_log_async_use (noPollCtx * ctx)
+{
+	noPollLogRing * ring;
+
+	if (nopoll_atomic_get_ptr (&ctx->log_ring) == NULL)
+		return NULL;
+
+	nopoll_atomic_inc (&ctx->log_users);
+	ring = nopoll_atomic_get_ptr (&ctx->log_ring);
+	if (ring == NULL)
+		nopoll_atomic_dec (&ctx->log_users);
+	return ring;
+}
+
+/** 
+ * @internal Flags the caller finished using the ring returned by
+ * __nopoll_log_async_use.
+ */
+void __nopoll_log_async_unuse (noPollCtx * ctx)
+{
+	nopoll_atomic_dec (&ctx->log_users);
+	return;
+}
+
+/** 
+ * @internal Stops the writer of the provided ring (already detached
+ * from its context), delivering pending records, and releases it once
+ * no thread is using it.
+ */
+void __nopoll_log_async_release (noPollCtx * ctx, noPollLogRing * ring)
+{
+	if (ring == NULL)
+		return;
+
+	/* wait for threads still pushing records (they got the ring
+	 * before it was detached) */
+	while (! nopoll_atomic_cas (&ctx->log_users, 0, 0))
+		nopoll_sleep (100);
+
+	/* stop the writer and wait for it */
+	nopoll_mutex_lock (ring->mutex);
+	nopoll_atomic_set (&ring->stop, 1);
+	nopoll_cond_signal (ring->cond);
+	nopoll_mutex_unlock (ring->mutex);
+	nopoll_thread_join (ring->thread);
+
+	nopoll_cond_destroy (ring->cond);
+	nopoll_mutex_destroy (ring->mutex);
+	nopoll_free (ring->records);
+	nopoll_free (ring);
+	return;
+}
+#endif
+
+/** 
+ * @internal Stops the asynchronous log writer (if any), delivering
+ * pending records.
+ */
+void __nopoll_log_async_stop (noPollCtx * ctx)
+{
+#if defined(NOPOLL_HAVE_ATOMIC_REFS)
+	/* detach it so no new record is pushed */
+	__nopoll_log_async_release (ctx, nopoll_atomic_xchg_ptr (&ctx->log_ring, NULL));
+#endif
+	return;
+}
+
+/** 
+ * @brief Allows to deliver logs from a background thread, so threads
+ * logging (for example, the one running the loop) don't wait for the
+ * console or the handler configured with \ref nopoll_log_set_handler.
+ *
+ * Logs are stored (without locking) into a ring with the provided
+ * number of records, and delivered by a writer thread created with
+ * the handlers configured by \ref nopoll_thread_create_handlers.
+ * When the ring is full, new logs are dropped and counted (see \ref
+ * nopoll_log_get_dropped). Logs longer than NOPOLL_LOG_BUFFER_SIZE
+ * are truncated.
+ *
+ * The log handler is called from the writer thread, which sleeps
+ * while no log is stored when condition variable handlers are
+ * configured (see \ref nopoll_thread_cond_handlers). Pending records
+ * are delivered when the asynchronous mode is disabled or the context
+ * is released. Disable the asynchronous mode before changing the log
+ * handler.
+ *
+ * The function can be called while other threads are logging: the
+ * previous ring is released once no thread is storing into it.
+ *
+ * @param ctx The context to configure.
+ *
+ * @param records Number of records in the ring (rounded up to a power
+ * of 2) or 0 to disable asynchronous delivery.
+ *
+ * @return nopoll_true if the configuration was applied, otherwise
+ * nopoll_false is returned (for example, when no thread handlers are
+ * defined or atomic operations aren't supported).
+ */
+nopoll_bool     nopoll_log_set_async (noPollCtx * ctx, int records)
+{
+#if defined(NOPOLL_HAVE_ATOMIC_REFS)
+	noPollLogRing * ring;
+	unsigned int    size;
+	unsigned int    iterator;
+#endif
+
+	nopoll_return_val_if_fail (ctx, ctx && records >= 0, nopoll_false);
+
+	/* stop current writer */
+	__nopoll_log_async_stop (ctx);
+	if (records == 0)
+		return nopoll_true;
+
+#if defined(NOPOLL_HAVE_ATOMIC_REFS)
+	size = 1;
+	while (size < (unsigned int) records)
+		size <<= 1;
+
+	ring = nopoll_new (noPollLogRing, 1);
+	if (ring == NULL)
+		return nopoll_false;
+	ring->ctx     = ctx;
+	ring->mask    = size - 1;
+	ring->records = nopoll_new (noPollLogRecord, size);
+	if (ring->records == NULL) {
+		nopoll_free (ring);
+		return nopoll_false;
+	} /* end if */
+	for (iterator = 0; iterator < size; iterator++)
+		ring->records[iterator].sequence = iterator;
+	ring->mutex = nopoll_mutex_create ();
+	ring->cond  = nopoll_cond_create ();
+
+	ring->thread = nopoll_thread_create (__nopoll_log_async_run, ring);
+	if (ring->thread == NULL) {
+		nopoll_cond_destroy (ring->cond);
+		nopoll_mutex_destroy (ring->mutex);
+		nopoll_free (ring->records);
+		nopoll_free (ring);
+		return nopoll_false;
+	} /* end if */
+
+	/* publish it (releasing the one configured meanwhile by
+	 * another thread, if any) */
+	__nopoll_log_async_release (ctx, nopoll_atomic_xchg_ptr (&ctx->log_ring, ring));
+	return nopoll_true;
+#else
+	return nopoll_false;
+#endif
+}
+
+/** 
+ * @brief Returns the number of logs dropped because the asynchronous
+ * ring was full (see \ref nopoll_log_set_async).
+ *
+ * @param ctx The context to check.
+ *
+ * @return Number of logs dropped since asynchronous delivery was
+ * enabled (0 when disabled, -1 if ctx is NULL).
+ */
+int             nopoll_log_get_dropped (noPollCtx * ctx)
+{
+#if defined(NOPOLL_HAVE_ATOMIC_REFS)
+	noPollLogRing * ring;
+	int             dropped;
+#endif
+
+	if (ctx == NULL)
+		return -1;
+#if defined(NOPOLL_HAVE_ATOMIC_REFS)
+	ring = __nopoll_log_async_use (ctx);
+	if (ring) {
+		dropped = nopoll_atomic_get (&ring->dropped);
+		__nopoll_log_async_unuse (ctx);
+		return dropped;
+	} /* end if */
+#endif
+	return 0;
+}
+
+/** 
+ * @internal Allows to drop a log to the console.
+ *
+ * This function allow to drop a log to the console using the given
+ * domain, as an identification of which subsystem have reported the
+ * information, and report level. This report level is used to notify
+ * the consideration of the log reported.
+ * 
+ * The function allows to provide a printf like interface to report
+ * messages. Here are some examples:
+ * 
+ * \code
+ * // drop a log about current library initialization
+ * nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "library properly initialized status=%d", status);
+ * \endcode
+ *
+ *
+ * @param ctx The context where the operation will take place.
+ *
+ * @param level The level that this message is classificed. 
+ * 
+ * @param message The message to report. The message to report must be
+ * not NULL.
+ */
+void __nopoll_log (noPollCtx * ctx, const char * function_name, const char * file, int line, noPollDebugLevel level, const char * message, ...)
+{
+
+#ifdef SHOW_DEBUG_LOG
+	va_list      args;
+	char         buffer[NOPOLL_LOG_BUFFER_SIZE];
+	int          size;
+	int          length;
+	char       * log_msg;
+	char       * log_msg2;
+#if defined(NOPOLL_HAVE_ATOMIC_REFS)
+	noPollLogRing * ring;
+#endif
+
+	/* check level (and if the log is enabled) */
+	if (! __NOPOLL_LOG_ENABLED (ctx, level))
+		return;
+
+#if defined(NOPOLL_HAVE_ATOMIC_REFS)
+	/* deliver from the writer thread */
+	ring = __nopoll_log_async_use (ctx);
+	if (ring) {
+		va_start (args, message);
+		__nopoll_log_async_push (ring, level, file, line, message, args);
+		va_end (args);
+		__nopoll_log_async_unuse (ctx);
+		return;
+	} /* end if */
+#endif
+
+	if (ctx->log_handler) {
+		/* print the message into the stack buffer */
+		size = __nopoll_log_snprintf (buffer, NOPOLL_LOG_BUFFER_SIZE, "%s:%d ", file, line);
+		if (size > 0 && size < NOPOLL_LOG_BUFFER_SIZE) {
+			va_start (args, message);
+			length = __nopoll_log_vsnprintf (buffer + size, NOPOLL_LOG_BUFFER_SIZE - size, message, args);
+			va_end (args);
+
+			if (length >= 0 && size + length + 1 < NOPOLL_LOG_BUFFER_SIZE) {
+				buffer[size + length]     = ' ';
+				buffer[size + length + 1] = 0;
+				ctx->log_handler (ctx, level, buffer, ctx->log_user_data);
+				return;
+			} /* end if */
+		} /* end if */
+
+		/* message doesn't fit: allocate it */
+		va_start (args, message);
+		log_msg = nopoll_strdup_printfv (message, args);
+		va_end (args);
+
+		log_msg2 = log_msg;
+		log_msg = nopoll_strdup_printf ("%s:%d %s ", file, line, log_msg);
+		nopoll_free (log_msg2);
+
+		ctx->log_handler (ctx, level, log_msg, ctx->log_user_data);
+		nopoll_free (log_msg);
+		return;
+	}
+
+	/* printout the process pid and level */
+	__nopoll_log_console_prefix (ctx, level);
 
 	/* drop a log according to the domain */
 	printf ("%s:%d ", file, line);
@@ -58,6 +58,16 @@ void            nopoll_log_color_enable (noPollCtx * ctx, nopoll_bool value);
 
 void            nopoll_log_set_handler (noPollCtx * ctx, noPollLogHandler handler, noPollPtr user_data);
 
+void            nopoll_log_set_level (noPollCtx * ctx, noPollDebugLevel level);
+
+noPollDebugLevel nopoll_log_get_level (noPollCtx * ctx);
+
+nopoll_bool     nopoll_log_is_level_enabled (noPollCtx * ctx, noPollDebugLevel level);
+
+nopoll_bool     nopoll_log_set_async (noPollCtx * ctx, int records);
+
+int             nopoll_log_get_dropped (noPollCtx * ctx);
+
 /* include this at this place to load GNU extensions */
 #if defined(__GNUC__)
 #  ifndef _GNU_SOURCE
@@ -78,9 +88,23 @@ void            nopoll_log_set_handler (noPollCtx * ctx, noPollLogHandler handle
 #endif
 
 
+/** 
+ * @internal Log levels below this value are never reported, and
+ * their nopoll_log calls are removed at compile time (0: debug, 1:
+ * warning, 2: critical). Define it at nopoll_config.h or CFLAGS to
+ * build with a different floor.
+ */
+#if !defined(NOPOLL_LOG_MIN_LEVEL)
+# define NOPOLL_LOG_MIN_LEVEL 0
+#endif
+
 #if defined(SHOW_DEBUG_LOG)
-# define nopoll_log(ctx,level,message, ...) do{__nopoll_log(ctx, __function_name__, __file__, __line__, level, message, ##__VA_ARGS__);}while(0)
+# define nopoll_log(ctx,level,message, ...) do{if ((int) (level) >= NOPOLL_LOG_MIN_LEVEL && __NOPOLL_LOG_ENABLED (ctx, level)) __nopoll_log(ctx, __function_name__, __file__, __line__, level, message, ##__VA_ARGS__);}while(0)
+/* debug dump of a byte (see nopoll_show_byte), skipped like
+ * nopoll_log when debug isn't reported */
+# define nopoll_log_byte(ctx,byte,label) do{if (NOPOLL_LEVEL_DEBUG >= NOPOLL_LOG_MIN_LEVEL && __NOPOLL_LOG_ENABLED (ctx, NOPOLL_LEVEL_DEBUG)) nopoll_show_byte (ctx, byte, label);}while(0)
 #else
+# define nopoll_log_byte(ctx,byte,label) /* nothing */
 # if defined(NOPOLL_OS_WIN32) && !( defined (__GNUC__) || _MSC_VER >= 1400)
 /* default case where '...' is not supported but log is still
  * disabled */
@@ -104,9 +128,26 @@ void            nopoll_log_set_handler (noPollCtx * ctx, noPollLogHandler handle
 
 void __nopoll_log (noPollCtx * ctx, const char * function_name, const char * file, int line, noPollDebugLevel level, const char * message, ...);
 
+void __nopoll_log_update_threshold (noPollCtx * ctx);
+
+void __nopoll_log_async_stop (noPollCtx * ctx);
+
 /* @} */
 
 END_C_DECLS
 
 #endif
 
+/** 
+ * @internal Checks if the context reports the provided level (see
+ * nopoll_log_set_level) before arguments are evaluated. Kept out of
+ * the include guard: nopoll_private.h includes this header again so
+ * the library checks the context directly.
+ */
+#undef __NOPOLL_LOG_ENABLED
+#if defined(__NOPOLL_PRIVATE_H__)
+# define __NOPOLL_LOG_ENABLED(ctx, level) ((ctx) != NULL && (int) (level) >= (ctx)->log_threshold)
+#else
+# define __NOPOLL_LOG_ENABLED(ctx, level) nopoll_log_is_level_enabled (ctx, level)
+#endif
+
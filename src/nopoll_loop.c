@@ -53,8 +53,11 @@
  */
 nopoll_bool nopoll_loop_register (noPollCtx * ctx, noPollConn * conn, noPollPtr user_data)
 {
-	/* do not add connections that aren't working */
+	/* do not add connections that aren't working (finishing
+	 * closes left to the loop) */
 	if (! nopoll_conn_is_ok (conn)) {
+		if (__nopoll_conn_close_check (conn, nopoll_true))
+			return nopoll_false; /* keep foreach, don't stop */
 		
 		/* remove this connection from registry */
 		nopoll_ctx_unregister_conn (ctx, conn);
@@ -62,10 +65,27 @@ nopoll_bool nopoll_loop_register (noPollCtx * ctx, noPollConn * conn, noPollPtr
 		return nopoll_false; /* keep foreach, don't stop */
 	}
 
+	/* engines with persistent registration: add it once (the
+	 * engine is kept updated by register/unregister
+	 * operations) */
+	if (ctx->io_engine->add) {
+		if (! nopoll_io_add_conn (ctx, conn)) {
+			/* remove this connection from registry */
+			nopoll_ctx_unregister_conn (ctx, conn);
+			nopoll_log (ctx, NOPOLL_LEVEL_WARNING, "Failed to add socket %d to the watching set", conn->session);
+		} /* end if */
+		return nopoll_false; /* keep foreach, don't stop */
+	} /* end if */
+
         /* Do not listen on sockets that are doing SSL/TLS handshake */
         if (conn->pending_ssl_connect)
                 return nopoll_false;
 
+	/* do not listen on sockets still being created (asynchronous
+	 * connect) */
+	if (conn->connect_stage && ! conn->connect_events)
+		return nopoll_false;
+
 	/* register the connection socket */
 	/* nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Adding socket id: %d", conn->session);*/
 	if (! ctx->io_engine->add_to (conn->session, ctx, conn, ctx->io_engine->io_object)) {
@@ -74,32 +94,167 @@ nopoll_bool nopoll_loop_register (noPollCtx * ctx, noPollConn * conn, noPollPtr
 		nopoll_ctx_unregister_conn (ctx, conn);
 		nopoll_log (ctx, NOPOLL_LEVEL_WARNING, "Failed to add socket %d to the watching set", conn->session);
 
-	}
+	} else
+		conn->io_watched = nopoll_true;
+
+	return nopoll_false; /* keep foreach, don't stop */
+}
+
+/** 
+ * @internal Function used by the loop to unregister connections
+ * assigned to its engine that were closed (used with engines that
+ * have persistent registration).
+ */
+nopoll_bool nopoll_loop_unregister_closed (noPollCtx * ctx, noPollConn * conn, noPollPtr user_data)
+{
+	if (! nopoll_conn_is_ok (conn) && ! __nopoll_conn_close_check (conn, nopoll_true))
+		nopoll_ctx_unregister_conn (ctx, conn);
 
 	return nopoll_false; /* keep foreach, don't stop */
 }
 
+/** 
+ * @internal Function used to queue the provided connection on the
+ * engine list of connections with input already received (read
+ * buffer, TLS layer) pending to be notified. The list holds a
+ * reference to each connection and it is only used by the loop
+ * running the engine.
+ */
+void __nopoll_loop_pending_add (noPollIoEngine * engine, noPollConn * conn)
+{
+	noPollConn ** pending;
+
+	/* already queued */
+	if (conn->input_queued)
+		return;
+
+	if (engine->pending_length == engine->pending_size) {
+		pending = nopoll_realloc (engine->pending, sizeof (noPollConn *) * (engine->pending_size + 16));
+		if (pending == NULL) {
+			nopoll_log (engine->ctx, NOPOLL_LEVEL_CRITICAL, "Failed to allocate memory to queue input pending on conn-id=%d, it will be notified once more input is received",
+				    conn->id);
+			return;
+		} /* end if */
+		engine->pending       = pending;
+		engine->pending_size += 16;
+	} /* end if */
+
+	if (! nopoll_conn_ref (conn))
+		return;
+	conn->input_queued                        = nopoll_true;
+	engine->pending[engine->pending_length++] = conn;
+	return;
+}
+
 /** 
  * @internal Function used to handle incoming data from from the
  * connection and to notify this data on the connection.
+ *
+ * In the case input already received (read buffer, TLS layer) is
+ * left to be notified, the connection is queued on the engine so the
+ * loop notifies it without waiting for the socket to be readable.
  */
-void nopoll_loop_process_data (noPollCtx * ctx, noPollConn * conn)
+void nopoll_loop_process_data (noPollCtx * ctx, noPollIoEngine * engine, noPollConn * conn)
 {
 	noPollMsg * msg;
+	int         budget = ctx->loop_drain ? ctx->loop_drain_budget : 1;
 
-	/* call to get messages from the connection */
-	msg = nopoll_conn_get_msg (conn);
-	if (msg == NULL)
+	/* keep the connection while handlers are notified (they may
+	 * close it) */
+	if (! nopoll_conn_ref (conn))
 		return;
 
-	/* found message, notify it */
-	if (conn->on_msg) 
-		conn->on_msg (ctx, conn, msg, conn->on_msg_data);
-	else if (ctx->on_msg)
-		ctx->on_msg (ctx, conn, msg, ctx->on_msg_data);
+	while (nopoll_true) {
+		/* call to get messages from the connection */
+		msg = nopoll_conn_get_msg (conn);
+		if (msg == NULL) {
+			if (nopoll_conn_has_buffered_input (conn))
+				__nopoll_loop_pending_add (engine, conn);
+			break;
+		} /* end if */
+
+		/* found message, notify it */
+		if (conn->on_msg) 
+			conn->on_msg (ctx, conn, msg, conn->on_msg_data);
+		else if (ctx->on_msg)
+			ctx->on_msg (ctx, conn, msg, ctx->on_msg_data);
 
-	/* release message */
-	nopoll_msg_unref (msg);
+		/* release message */
+		nopoll_msg_unref (msg);
+
+		/* drain mode: keep notifying messages already
+		 * received (up to the budget to not starve other
+		 * connections) unless the handler closed the
+		 * connection */
+		if (! nopoll_conn_is_ok (conn))
+			break;
+		budget--;
+		if (budget <= 0) {
+			if (nopoll_conn_has_buffered_input (conn))
+				__nopoll_loop_pending_add (engine, conn);
+			break;
+		} /* end if */
+		if (! nopoll_conn_has_pending_input (conn))
+			break;
+	} /* end while */
+
+	nopoll_conn_unref (conn);
+	return;
+}
+
+/** 
+ * @internal Function used to notify something interesting was
+ * detected on the provided connection, according to its role and the
+ * events reported (NOPOLL_IO_READ, NOPOLL_IO_WRITE).
+ */
+void nopoll_loop_notify (noPollCtx * ctx, noPollIoEngine * engine, noPollConn * conn, int events)
+{
+	nopoll_bool failed;
+
+	/* socket readable: next reads must check it again (see
+	 * __nopoll_conn_wire_pending) */
+	if (events & NOPOLL_IO_READ)
+		conn->wire_drained = nopoll_false;
+
+	/* closing (see nopoll_conn_close_ext): only write content
+	 * queued, then finish the close */
+	if (conn->close_pending) {
+		failed = nopoll_conn_complete_pending_write (conn) < 0 && errno != NOPOLL_EWOULDBLOCK && errno != NOPOLL_EINTR;
+		__nopoll_conn_close_check (conn, failed);
+		return;
+	} /* end if */
+
+	/* asynchronous connect in progress: advance it (unless the
+	 * connection is still being created) */
+	if (conn->connect_stage) {
+		if (conn->connect_events)
+			__nopoll_conn_connect_continue (conn);
+		return;
+	} /* end if */
+
+	/* socket writable: write content queued (the connection
+	 * stops being watched to be writable once it is written) */
+	if (events & NOPOLL_IO_WRITE)
+		nopoll_conn_complete_pending_write (conn);
+	if (! (events & NOPOLL_IO_READ))
+		return;
+
+	/* call to notify action according to role */
+	switch (conn->role) {
+	case NOPOLL_ROLE_CLIENT:
+	case NOPOLL_ROLE_LISTENER:
+		/* received data, notify */
+		nopoll_loop_process_data (ctx, engine, conn);
+		break;
+	case NOPOLL_ROLE_MAIN_LISTENER:
+		/* call to handle */
+		nopoll_conn_accept (ctx, conn);
+		break;
+	default:
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Found connection with unknown role, closing and dropping");
+		nopoll_conn_shutdown (conn);
+		break;
+	}
 	return;
 }
 
@@ -111,32 +266,99 @@ void nopoll_loop_process_data (noPollCtx * ctx, noPollConn * conn)
 nopoll_bool nopoll_loop_process (noPollCtx * ctx, noPollConn * conn, noPollPtr user_data)
 {
 	int        * conn_changed = (int *) user_data;
+	int          events;
 
 	/* check if the connection have something to notify */
-	if (ctx->io_engine->is_set (ctx, conn->session, ctx->io_engine->io_object)) {
+	events = ctx->io_engine->is_set (ctx, conn->session, ctx->io_engine->io_object);
+	if (events) {
 
 		/* call to notify action according to role */
-		switch (conn->role) {
-		case NOPOLL_ROLE_CLIENT:
-		case NOPOLL_ROLE_LISTENER:
-			/* received data, notify */
-			nopoll_loop_process_data (ctx, conn);
-			break;
-		case NOPOLL_ROLE_MAIN_LISTENER:
-			/* call to handle */
-			nopoll_conn_accept (ctx, conn);
-			break;
-		default:
-			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Found connection with unknown role, closing and dropping");
-			nopoll_conn_shutdown (conn);
-			break;
-		}
+		nopoll_loop_notify (ctx, ctx->io_engine, conn, events);
 		
-		/* reduce connection changed */
+		/* reduce connection changed (select reports each
+		 * set where the socket was found) */
 		(*conn_changed)--;
+		if (events == (NOPOLL_IO_READ | NOPOLL_IO_WRITE))
+			(*conn_changed)--;
 	} /* end if */
 	
-	return (*conn_changed) == 0;
+	return (*conn_changed) <= 0;
+}
+
+/** 
+ * @internal Function used to notify connections reported by engines
+ * with persistent registration (only ready connections are visited).
+ */
+void nopoll_loop_process_ready (noPollCtx * ctx, noPollIoEngine * engine, int conn_changed)
+{
+	noPollConn * conn;
+	int          iterator;
+	int          events;
+
+	for (iterator = 0; iterator < conn_changed; iterator++) {
+		conn = engine->ready (ctx, iterator, engine->io_object);
+		if (conn == NULL)
+			continue;
+
+		/* engines not reporting events only report readable
+		 * connections */
+		events = engine->events ? engine->events (ctx, iterator, engine->io_object) : NOPOLL_IO_READ;
+
+		/* notify (connections closed as a consequence are
+		 * unregistered on next iteration) */
+		nopoll_loop_notify (ctx, engine, conn, events);
+	} /* end for */
+
+	return;
+}
+
+/** 
+ * @internal Function used to notify input already received by
+ * connections (read buffer, TLS layer) that is not reported by the
+ * engine because the socket is not readable. Only connections queued
+ * on the engine are visited (connections queued again while
+ * notifying are left for the next iteration).
+ */
+void nopoll_loop_process_pending (noPollCtx * ctx, noPollIoEngine * engine)
+{
+	noPollConn * conn;
+	int          length = engine->pending_length;
+	int          iterator;
+
+	for (iterator = 0; iterator < length; iterator++) {
+		/* the list may be moved by connections queued again */
+		conn               = engine->pending[iterator];
+		conn->input_queued = nopoll_false;
+
+		if ((conn->role == NOPOLL_ROLE_CLIENT || conn->role == NOPOLL_ROLE_LISTENER) &&
+		    nopoll_conn_is_ok (conn) && nopoll_conn_has_buffered_input (conn))
+			nopoll_loop_process_data (ctx, engine, conn);
+
+		/* release reference acquired when queued */
+		nopoll_conn_unref (conn);
+	} /* end for */
+
+	/* keep connections queued again */
+	engine->pending_length -= length;
+	if (engine->pending_length > 0)
+		memmove (engine->pending, engine->pending + length, sizeof (noPollConn *) * engine->pending_length);
+
+	return;
+}
+
+/** 
+ * @internal Function used to close connections whose asynchronous
+ * connect didn't finish in time and to finish closes left to the
+ * loop that didn't finish in time.
+ */
+nopoll_bool nopoll_loop_check_connect (noPollCtx * ctx, noPollConn * conn, noPollPtr user_data)
+{
+	if (conn->connect_stage)
+		__nopoll_conn_connect_check_timeout (conn);
+	else if (conn->close_pending)
+		__nopoll_conn_close_check (conn, nopoll_false);
+
+	return nopoll_false; /* keep foreach, don't stop */
 }
 
 /** 
@@ -156,16 +378,32 @@ nopoll_bool nopoll_loop_process (noPollCtx * ctx, noPollConn * conn, noPollPtr u
  */
 void nopoll_loop_init (noPollCtx * ctx) 
 {
+	noPollIoEngine * engine;
+
 	if (ctx == NULL)
 		return;
 
+	/* loop workers are running (nopoll_loop_run_threads) */
+	if (ctx->workers_length > 0)
+		return;
+
 	/* grab the mutex for the following check */
 	if (ctx->io_engine == NULL) {
-		ctx->io_engine = nopoll_io_get_engine (ctx, NOPOLL_IO_ENGINE_DEFAULT);
-		if (ctx->io_engine == NULL) {
+		engine = nopoll_io_get_engine (ctx, ctx->io_engine_type);
+		if (engine == NULL) {
 			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Failed to create IO wait engine, unable to implement wait call");
 			return;
 		} 
+
+		/* publish engine so connections registered from now
+		 * on are added to it */
+		nopoll_mutex_lock (ctx->ref_mutex);
+		ctx->io_engine = engine;
+		nopoll_mutex_unlock (ctx->ref_mutex);
+
+		/* add all connections already registered */
+		if (engine->add)
+			nopoll_ctx_foreach_conn (ctx, nopoll_loop_register, NULL);
 	} /* end if */
 	/* release the mutex */
 
@@ -178,15 +416,180 @@ void nopoll_loop_init (noPollCtx * ctx)
  * @param ctx The context where the loop is being done, and wanted to
  * be stopped.
  *
+ * The function can be called from any thread: a wait in progress is
+ * interrupted so the loop finishes without delay.
  */
 void nopoll_loop_stop (noPollCtx * ctx)
 {
 	if (! ctx)
 		return;
 	ctx->keep_looping = nopoll_false;
+
+	/* interrupt the wait in progress (if any) */
+	nopoll_io_wakeup (ctx);
 	return;
 } /* end if */
 
+/** 
+ * @internal Returns microseconds ellapsed since the provided start
+ * time.
+ */
+long __nopoll_loop_ellapsed (struct timeval * start)
+{
+	struct timeval   stop;
+	struct timeval   diff;
+
+#if defined(NOPOLL_OS_WIN32)
+	nopoll_win32_gettimeofday (&stop, NULL);
+#else
+	gettimeofday (&stop, NULL);
+#endif
+	nopoll_timeval_substract (&stop, start, &diff);
+	return (diff.tv_sec * 1000000) + diff.tv_usec;
+}
+
+/** 
+ * @internal Implements the loop over the provided engine until it is
+ * stopped, the timeout is reached or the engine fails. Used by
+ * nopoll_loop_wait and by each loop worker created by
+ * nopoll_loop_run_threads (only watching the connections assigned to
+ * its engine).
+ *
+ * @return 0, -3 (timeout reached) or -4 (io wait failure).
+ */
+int __nopoll_loop_run (noPollCtx * ctx, noPollIoEngine * engine, long timeout)
+{
+	struct timeval   start;
+	struct timeval   connect_check;
+	int              wait_status;
+	nopoll_bool      shutdown_pending;
+
+	/* get as reference current time */
+#if defined(NOPOLL_OS_WIN32)
+	nopoll_win32_gettimeofday (&start, NULL);
+#else
+	gettimeofday (&start, NULL);
+#endif
+	connect_check = start;
+
+	while (ctx->keep_looping) {
+		/* flag the loop is about to wait so other threads
+		 * wakeup the engine (checking again the stop flag to
+		 * not miss a stop signaled before) */
+		nopoll_mutex_lock (engine->mutex);
+		engine->waiting               = nopoll_true;
+		shutdown_pending              = engine->conn_shutdown_pending;
+		engine->conn_shutdown_pending = nopoll_false;
+		nopoll_mutex_unlock (engine->mutex);
+		if (! ctx->keep_looping)
+			break;
+
+		if (engine->add) {
+			/* persistent registration: only unregister
+			 * connections closed outside the loop */
+			if (shutdown_pending) 
+				__nopoll_io_foreach_conn (engine, nopoll_loop_unregister_closed, NULL);
+		} else {
+			/* ok, now implement wait operation */
+			engine->clear (ctx, engine->io_object);
+		
+			/* add all connections */
+			/* nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Adding connections to watch: %d", ctx->conn_num);  */
+			nopoll_ctx_foreach_conn (ctx, nopoll_loop_register, NULL);
+		} /* end if */
+
+		/* if (errno == EBADF) { */
+			/* detected some descriptor not properly
+			 * working, try to check them */
+			/* nopoll_ctx_foreach_conn (ctx, nopoll_loop_clean_descriptors, NULL); */
+		/* nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Found some descriptor is not valid (errno==%d)", errno);
+		   continue; */ 
+		/* } */ /* end if */
+		
+		/* do not wait beyond the timeout requested (or the
+		 * next check of asynchronous connects or closes in
+		 * progress) */
+		if (timeout > 0) {
+			engine->wait_limit = timeout - __nopoll_loop_ellapsed (&start);
+			if (engine->wait_limit <= 0)
+				engine->wait_limit = 1;
+		} else
+			engine->wait_limit = 0;
+		if ((ctx->conn_connecting > 0 || ctx->conn_closing > 0) && (engine->wait_limit == 0 || engine->wait_limit > NOPOLL_CONNECT_CHECK_PERIOD))
+			engine->wait_limit = NOPOLL_CONNECT_CHECK_PERIOD;
+
+		/* input already received pending to be notified: do
+		 * not block (just check other connections) */
+		if (engine->pending_length > 0 && engine->wakeup)
+			engine->wakeup (ctx, engine->io_object);
+
+		/* implement wait operation */
+		/* nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Waiting for changes into %d connections", ctx->conn_num); */
+		wait_status = engine->wait (ctx, engine->io_object);
+
+		/* changes are now noticed by the loop itself */
+		nopoll_mutex_lock (engine->mutex);
+		engine->waiting = nopoll_false;
+		nopoll_mutex_unlock (engine->mutex);
+		/* nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Waiting finished with result %d", wait_status);  */
+		if (wait_status == -1) {
+			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Received error from wait operation, error code was: %d", errno);
+			return -4; /* io wait failure */
+		} /* end if */
+
+		/* check how many connections changed and restart */
+		if (wait_status > 0) {
+			/* check and call for connections with something
+			 * interesting */
+			if (engine->ready)
+				nopoll_loop_process_ready (ctx, engine, wait_status);
+			else
+				nopoll_ctx_foreach_conn (ctx, nopoll_loop_process, &wait_status);
+		}
+
+		/* notify input already received */
+		if (engine->pending_length > 0)
+			nopoll_loop_process_pending (ctx, engine);
+
+		/* close asynchronous connects not finished in time
+		 * (or failed before being handed to the loop), start
+		 * their next connection attempts and close the ones
+		 * whose queue wasn't written in time */
+		if ((ctx->conn_connecting > 0 || ctx->conn_closing > 0) &&
+		    (ctx->conn_connect_failed > 0 || __nopoll_loop_ellapsed (&connect_check) >= NOPOLL_CONNECT_CHECK_PERIOD)) {
+			if (engine->add)
+				__nopoll_io_foreach_conn (engine, nopoll_loop_check_connect, NULL);
+			else
+				nopoll_ctx_foreach_conn (ctx, nopoll_loop_check_connect, NULL);
+#if defined(NOPOLL_OS_WIN32)
+			nopoll_win32_gettimeofday (&connect_check, NULL);
+#else
+			gettimeofday (&connect_check, NULL);
+#endif
+		} /* end if */
+
+		/* check to stop wait operation */
+		if (timeout > 0) {
+			if (__nopoll_loop_ellapsed (&start) > timeout) 
+				return -3; /* timeout reached */
+		} /* end if */
+	} /* end while */
+
+	return 0;
+}
+
+/** 
+ * @internal Function used once a loop finishes to flag connections
+ * are no longer watched (writes block again) and to finish closes
+ * left to it.
+ */
+nopoll_bool __nopoll_loop_unwatch (noPollCtx * ctx, noPollConn * conn, noPollPtr user_data)
+{
+	conn->io_watched = nopoll_false;
+	__nopoll_conn_close_check (conn, nopoll_false);
+	return nopoll_false; /* keep foreach, don't stop */
+}
+
 /** 
  * @brief Allows to implement a wait over all connections registered
  * under the provided context during the provided timeout until
@@ -201,7 +604,8 @@ void nopoll_loop_stop (noPollCtx * ctx)
  * passed is 0.
  *
  * @return The function returns 0 when finished without error or -2 in
- * the case ctx is NULL or timeout is negative. Function returns -3 if
+ * the case ctx is NULL, timeout is negative or loop workers are running
+(see \ref nopoll_loop_run_threads). Function returns -3 if
  * timeout was reached. Function returns -4 in the case
  * ctx->io_engine->wait failed to implement wait or it reported error.
  *
@@ -231,84 +635,293 @@ void nopoll_loop_stop (noPollCtx * ctx)
  */
 int nopoll_loop_wait (noPollCtx * ctx, long timeout)
 {
-	struct timeval start;
-	struct timeval stop;
-	struct timeval diff;
-	long           ellapsed;
-	int            wait_status;
-	int            result = 0;
+	int              result;
+	noPollIoEngine * engine;
 
 	nopoll_return_val_if_fail (ctx, ctx, -2);
 	nopoll_return_val_if_fail (ctx, timeout >= 0, -2);
+
+	if (ctx->workers_length > 0) {
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to implement wait, loop workers are running on this context (nopoll_loop_run_threads)");
+		return -2;
+	} /* end if */
 	
 	/* call to init io engine */
 	nopoll_loop_init (ctx);
-
-	/* get as reference current time */
-	if (timeout > 0)
-#if defined(NOPOLL_OS_WIN32)
-		nopoll_win32_gettimeofday (&start, NULL);
-#else
-		gettimeofday (&start, NULL);
-#endif
+	if (ctx->io_engine == NULL)
+		return -4;
 	
 	/* set to keep looping everything this function is called */
-	ctx->keep_looping = nopoll_true;
+	ctx->keep_looping  = nopoll_true;
 
-	while (ctx->keep_looping) {
-		/* ok, now implement wait operation */
-		ctx->io_engine->clear (ctx, ctx->io_engine->io_object);
-		
-		/* add all connections */
-		/* nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Adding connections to watch: %d", ctx->conn_num);  */
-		nopoll_ctx_foreach_conn (ctx, nopoll_loop_register, NULL);
+	result = __nopoll_loop_run (ctx, ctx->io_engine, timeout);
 
-		/* if (errno == EBADF) { */
-			/* detected some descriptor not properly
-			 * working, try to check them */
-			/* nopoll_ctx_foreach_conn (ctx, nopoll_loop_clean_descriptors, NULL); */
-		/* nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Found some descriptor is not valid (errno==%d)", errno);
-		   continue; */ 
-		/* } */ /* end if */
-		
-		/* implement wait operation */
-		/* nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Waiting for changes into %d connections", ctx->conn_num); */
-		wait_status = ctx->io_engine->wait (ctx, ctx->io_engine->io_object);
-		/* nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "Waiting finished with result %d", wait_status);  */
-		if (wait_status == -1) {
-			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Received error from wait operation, error code was: %d", errno);
-			result = -4; /* io wait failure */
-			break;
+	/* release engine (once unpublished, no other thread can
+	 * reach it) */
+	nopoll_mutex_lock (ctx->ref_mutex);
+	engine         = ctx->io_engine;
+	ctx->io_engine = NULL;
+	nopoll_mutex_unlock (ctx->ref_mutex);
+	nopoll_io_release_engine (engine);
+	nopoll_ctx_foreach_conn (ctx, __nopoll_loop_unwatch, NULL);
+
+	/* return result so far */
+	return result;
+}
+
+/** 
+ * @internal Function used by nopoll_loop_run_threads to reset the
+ * worker assigned to connections once workers finished.
+ */
+nopoll_bool __nopoll_loop_reset_worker (noPollCtx * ctx, noPollConn * conn, noPollPtr user_data)
+{
+	conn->worker = 0;
+	return __nopoll_loop_unwatch (ctx, conn, user_data);
+}
+
+/** 
+ * @internal Function used by nopoll_loop_run_threads to assign all
+ * connections already registered to the loop workers.
+ */
+nopoll_bool __nopoll_loop_register_worker (noPollCtx * ctx, noPollConn * conn, noPollPtr user_data)
+{
+	/* do not add connections that aren't working */
+	if (! nopoll_conn_is_ok (conn)) {
+		/* remove this connection from registry */
+		nopoll_ctx_unregister_conn (ctx, conn);
+		return nopoll_false; /* keep foreach, don't stop */
+	} /* end if */
+
+	/* main listeners are assigned later (one per worker) */
+	if (conn->role == NOPOLL_ROLE_MAIN_LISTENER)
+		return nopoll_false; /* keep foreach, don't stop */
+
+	if (conn->role == NOPOLL_ROLE_LISTENER) {
+		/* accepted connections are not assigned on
+		 * registration, assign one worker */
+		nopoll_io_assign_conn (ctx, conn, 0);
+	} else if (! nopoll_io_add_conn (ctx, conn)) {
+		/* remove this connection from registry */
+		nopoll_ctx_unregister_conn (ctx, conn);
+		nopoll_log (ctx, NOPOLL_LEVEL_WARNING, "Failed to add socket %d to the watching set", conn->session);
+	} /* end if */
+
+	return nopoll_false; /* keep foreach, don't stop */
+}
+
+/** 
+ * @internal Function used by nopoll_loop_run_threads to collect main
+ * listeners registered on the context.
+ */
+nopoll_bool __nopoll_loop_collect_listener (noPollCtx * ctx, noPollConn * conn, noPollPtr user_data)
+{
+	noPollLoopWorker * worker = (noPollLoopWorker *) user_data;
+
+	if (conn->role != NOPOLL_ROLE_MAIN_LISTENER || conn->worker != 0)
+		return nopoll_false; /* keep foreach, don't stop */
+
+	worker->listeners = nopoll_realloc (worker->listeners, sizeof (noPollConn *) * (worker->listeners_length + 1));
+	if (worker->listeners == NULL) {
+		worker->listeners_length = 0;
+		return nopoll_true; /* stop */
+	} /* end if */
+	worker->listeners[worker->listeners_length] = conn;
+	worker->listeners_length++;
+
+	return nopoll_false; /* keep foreach, don't stop */
+}
+
+/** 
+ * @internal Thread function that runs a loop worker.
+ */
+noPollPtr __nopoll_loop_worker_run (noPollPtr _worker)
+{
+	noPollLoopWorker * worker = (noPollLoopWorker *) _worker;
+
+	worker->result = __nopoll_loop_run (worker->ctx, worker->io_engine, 0);
+	if (worker->result != 0) {
+		/* stop the rest of workers */
+		nopoll_loop_stop (worker->ctx);
+	} /* end if */
+
+	return NULL;
+}
+
+/** 
+ * @internal Releases loop workers created by nopoll_loop_run_threads.
+ */
+void __nopoll_loop_workers_free (noPollLoopWorker ** workers, int threads)
+{
+	int iterator;
+	int iterator2;
+
+	for (iterator = 0; iterator < threads; iterator++) {
+		if (workers[iterator] == NULL)
+			continue;
+		/* close listeners created for this worker (the
+		 * first worker uses the ones created by the user) */
+		if (iterator > 0) {
+			for (iterator2 = 0; iterator2 < workers[iterator]->listeners_length; iterator2++)
+				nopoll_conn_close (workers[iterator]->listeners[iterator2]);
 		} /* end if */
+		nopoll_free (workers[iterator]->listeners);
+		nopoll_io_release_engine (workers[iterator]->io_engine);
+		nopoll_free (workers[iterator]);
+	} /* end for */
+	nopoll_free (workers);
+	return;
+}
 
-		/* check how many connections changed and restart */
-		if (wait_status > 0) {
-			/* check and call for connections with something
-			 * interesting */
-			nopoll_ctx_foreach_conn (ctx, nopoll_loop_process, &wait_status);
-		}
+/** 
+ * @brief Implements a wait over all connections registered under the
+ * provided context using several threads (loop workers), each one
+ * with its own I/O wait engine, until \ref nopoll_loop_stop is called.
+ *
+ * Connections are distributed among workers: each connection is
+ * watched and notified (on_msg, on_ready, on_close handlers) by only
+ * one worker, so handlers for a given connection are never called
+ * concurrently, but handlers for different connections are. Make sure
+ * your handlers are thread safe.
+ *
+ * Each listener registered on the context is served by the first
+ * worker and, for the rest of workers, a new listener sharing the
+ * same port is created (SO_REUSEPORT) so the kernel balances incoming
+ * connections among workers. Connections accepted are served by the
+ * worker that accepted them. Connections registered while the workers
+ * are running (for example, client connections) are assigned to
+ * workers in a round robin manner. On platforms without SO_REUSEPORT
+ * support, listeners are only served by the first worker.
+ *
+ * The function blocks the caller, which runs the first worker, until
+ * all workers finish. Threads are created through the handlers
+ * configured with \ref nopoll_thread_create_handlers and mutex
+ * handlers must be installed too (\ref nopoll_thread_handlers).
+ *
+ * The I/O engine configured (\ref nopoll_ctx_set_io_engine) must
+ * keep persistent registration (epoll or poll): the
+ * select(2) engine is not supported.
+ *
+ * @param ctx The context object where the wait will be implemented.
+ *
+ * @param threads Number of loop workers to run (1 or more).
+ *
+ * @return 0 when finished without error, -2 in the case ctx is NULL,
+ * threads is not valid, a loop is already running on the context,
+ * thread handlers are not configured or the I/O engine is not
+ * supported. Function returns -4 in the case a worker I/O wait
+ * failed.
+ */
+int nopoll_loop_run_threads (noPollCtx * ctx, int threads)
+{
+	noPollLoopWorker ** workers;
+	noPollLoopWorker  * worker;
+	noPollConn        * listener;
+	int                 iterator;
+	int                 iterator2;
+	int                 result = 0;
 
-		/* check to stop wait operation */
-		if (timeout > 0) {
-#if defined(NOPOLL_OS_WIN32)
-			nopoll_win32_gettimeofday (&stop, NULL);
-#else
-			gettimeofday (&stop, NULL);
-#endif
-			nopoll_timeval_substract (&stop, &start, &diff);
-			ellapsed = (diff.tv_sec * 1000000) + diff.tv_usec;
-			if (ellapsed > timeout) {
-				result = -3; /* timeout reached */
+	nopoll_return_val_if_fail (ctx, ctx, -2);
+	nopoll_return_val_if_fail (ctx, threads > 0, -2);
+
+	/* create workers */
+	workers = nopoll_new (noPollLoopWorker *, threads);
+	if (workers == NULL)
+		return -2;
+	for (iterator = 0; iterator < threads; iterator++) {
+		workers[iterator] = nopoll_new (noPollLoopWorker, 1);
+		if (workers[iterator] == NULL) {
+			__nopoll_loop_workers_free (workers, threads);
+			return -2;
+		} /* end if */
+		workers[iterator]->ctx       = ctx;
+		workers[iterator]->id        = iterator + 1;
+		workers[iterator]->io_engine = nopoll_io_get_engine (ctx, ctx->io_engine_type);
+		if (workers[iterator]->io_engine == NULL || workers[iterator]->io_engine->add == NULL) {
+			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Failed to create IO wait engine for loop worker (engine must keep persistent registration)");
+			__nopoll_loop_workers_free (workers, threads);
+			return -2;
+		} /* end if */
+	} /* end for */
+
+	/* publish workers */
+	nopoll_mutex_lock (ctx->ref_mutex);
+	if (ctx->io_engine || ctx->workers_length > 0) {
+		nopoll_mutex_unlock (ctx->ref_mutex);
+		nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Unable to run loop workers, a loop is already running on this context");
+		__nopoll_loop_workers_free (workers, threads);
+		return -2;
+	} /* end if */
+	ctx->workers        = workers;
+	ctx->workers_length = threads;
+	ctx->workers_next   = 0;
+	ctx->keep_looping   = nopoll_true;
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	/* assign connections already registered */
+	nopoll_ctx_foreach_conn (ctx, __nopoll_loop_register_worker, NULL);
+
+	/* main listeners are served by the first worker and cloned
+	 * for the rest (sharing the port) */
+	nopoll_ctx_foreach_conn (ctx, __nopoll_loop_collect_listener, workers[0]);
+	for (iterator = 0; iterator < workers[0]->listeners_length; iterator++) {
+		listener = workers[0]->listeners[iterator];
+		nopoll_io_assign_conn (ctx, listener, 1);
+
+		for (iterator2 = 1; iterator2 < threads; iterator2++) {
+			worker   = workers[iterator2];
+			listener = nopoll_listener_new_reuse_port (ctx, workers[0]->listeners[iterator]);
+			if (listener == NULL) {
+				nopoll_log (ctx, NOPOLL_LEVEL_WARNING, "Unable to share listener port with loop worker %d, it will be served by the first worker",
+					    worker->id);
+				break;
+			} /* end if */
+
+			worker->listeners = nopoll_realloc (worker->listeners, sizeof (noPollConn *) * (worker->listeners_length + 1));
+			if (worker->listeners == NULL) {
+				worker->listeners_length = 0;
+				nopoll_conn_close (listener);
 				break;
-			}
+			} /* end if */
+			worker->listeners[worker->listeners_length] = listener;
+			worker->listeners_length++;
+			nopoll_io_assign_conn (ctx, listener, worker->id);
+		} /* end for */
+	} /* end for */
+
+	/* start workers (the first one is run by the caller) */
+	for (iterator = 1; iterator < threads; iterator++) {
+		workers[iterator]->thread = nopoll_thread_create (__nopoll_loop_worker_run, workers[iterator]);
+		if (workers[iterator]->thread == NULL) {
+			nopoll_log (ctx, NOPOLL_LEVEL_CRITICAL, "Failed to create thread for loop worker %d (thread handlers not configured?)", iterator + 1);
+			nopoll_loop_stop (ctx);
+			result = -2;
+			break;
 		} /* end if */
-	} /* end while */
+	} /* end for */
 
-	/* release engine */
-	nopoll_io_release_engine (ctx->io_engine);
-	ctx->io_engine = NULL;
+	if (result == 0)
+		__nopoll_loop_worker_run (workers[0]);
+
+	/* wait for the rest of workers */
+	for (iterator = 1; iterator < threads; iterator++) {
+		if (workers[iterator]->thread)
+			nopoll_thread_join (workers[iterator]->thread);
+	} /* end for */
+
+	for (iterator = 0; iterator < threads && result == 0; iterator++)
+		result = workers[iterator]->result;
+
+	/* unpublish workers: connections are no longer watched */
+	nopoll_mutex_lock (ctx->ref_mutex);
+	ctx->workers        = NULL;
+	ctx->workers_length = 0;
+	nopoll_mutex_unlock (ctx->ref_mutex);
+
+	/* forget worker assigned so a new loop assigns them again */
+	nopoll_ctx_foreach_conn (ctx, __nopoll_loop_reset_worker, NULL);
+
+	__nopoll_loop_workers_free (workers, threads);
 
-	/* return result so far */
 	return result;
 }
 
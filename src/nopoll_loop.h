@@ -46,6 +46,8 @@ int  nopoll_loop_wait (noPollCtx * ctx, long timeout);
  
 void nopoll_loop_stop (noPollCtx * ctx);
 
+int  nopoll_loop_run_threads (noPollCtx * ctx, int threads);
+
 END_C_DECLS
 
 #endif
@@ -47,22 +47,124 @@
  * @{
  */
 
+/* payload storage placed right after the message */
+#define __NOPOLL_MSG_INLINE(msg) ((noPollPtr) ((msg) + 1))
+
 /** 
  * @internal function that creates an empty message holder.
  * @return A newly created reference or NULL if it fails. 
  */
 noPollMsg  * nopoll_msg_new (void)
 {
-	noPollMsg * msg = nopoll_new (noPollMsg, 1);
+	return __nopoll_msg_new (NULL);
+}
+
+/** 
+ * @internal Creates an empty message holder, reusing a message cached
+ * by the provided context if available (see \ref
+ * nopoll_ctx_set_msg_pool). Messages created for a context hold a
+ * reference to it and are returned to its pool once released.
+ *
+ * @param ctx Optional context to get the message from.
+ *
+ * @return A newly created reference or NULL if it fails.
+ */
+noPollMsg  * __nopoll_msg_new (noPollCtx * ctx)
+{
+	noPollMsg * msg         = NULL;
+	int         inline_size = 0;
+
+	if (ctx) {
+		/* get a cached message */
+		nopoll_mutex_lock (ctx->msg_pool_mutex);
+		msg = ctx->msg_pool;
+		if (msg) {
+			ctx->msg_pool = msg->next;
+			ctx->msg_pool_length--;
+		} /* end if */
+		inline_size = ctx->msg_inline_size;
+		nopoll_mutex_unlock (ctx->msg_pool_mutex);
+
+		if (msg) {
+			msg->next = NULL;
+			msg->refs = 1;
+			nopoll_ctx_ref (ctx);
+			return msg;
+		} /* end if */
+	} /* end if */
+
+	/* allow extra byte for string terminator */
+	msg = nopoll_calloc (1, sizeof (noPollMsg) + (inline_size > 0 ? inline_size + 1 : 0));
 	if (msg == NULL)
 		return NULL;
 
-	msg->refs = 1;
-	msg->ref_mutex = nopoll_mutex_create ();
+	msg->refs        = 1;
+#if !defined(NOPOLL_HAVE_ATOMIC_REFS)
+	msg->ref_mutex   = nopoll_mutex_create ();
+#endif
+	msg->inline_size = inline_size;
+	if (ctx) {
+		msg->ctx = ctx;
+		nopoll_ctx_ref (ctx);
+	} /* end if */
 
 	return msg;
 }
 
+/** 
+ * @internal Sets up payload storage for the provided size (plus an
+ * extra byte for string terminator), using message inline storage
+ * when it fits.
+ */
+nopoll_bool  __nopoll_msg_alloc_payload (noPollMsg * msg, long size)
+{
+	if (size <= msg->inline_size)
+		msg->payload = __NOPOLL_MSG_INLINE (msg);
+	else
+		msg->payload = nopoll_new (char, size + 1);
+	return msg->payload != NULL;
+}
+
+/** 
+ * @internal Releases payload storage (if it was allocated).
+ */
+void         __nopoll_msg_free_payload (noPollMsg * msg)
+{
+	if (msg->payload != __NOPOLL_MSG_INLINE (msg))
+		nopoll_free (msg->payload);
+	msg->payload = NULL;
+	return;
+}
+
+/** 
+ * @internal Releases messages cached by the context until keep
+ * messages remain.
+ */
+void         __nopoll_msg_pool_release (noPollCtx * ctx, int keep)
+{
+	noPollMsg * msg;
+
+	while (nopoll_true) {
+		nopoll_mutex_lock (ctx->msg_pool_mutex);
+		msg = NULL;
+		if (ctx->msg_pool_length > keep) {
+			msg           = ctx->msg_pool;
+			ctx->msg_pool = msg->next;
+			ctx->msg_pool_length--;
+		} /* end if */
+		nopoll_mutex_unlock (ctx->msg_pool_mutex);
+
+		if (msg == NULL)
+			break;
+#if !defined(NOPOLL_HAVE_ATOMIC_REFS)
+		nopoll_mutex_destroy (msg->ref_mutex);
+#endif
+		nopoll_free (msg);
+	} /* end while */
+
+	return;
+}
+
 /** 
  * @brief Allows to get a reference to the payload content inside the
  * provided websocket message.
@@ -109,13 +211,7 @@ nopoll_bool  nopoll_msg_ref (noPollMsg * msg)
 	if (msg == NULL)
 		return nopoll_false;
 
-	/* acquire mutex here */
-	nopoll_mutex_lock (msg->ref_mutex);
-
-	msg->refs++;
-
-	/* release mutex here */
-	nopoll_mutex_unlock (msg->ref_mutex);
+	nopoll_ref_inc (&msg->refs, msg->ref_mutex);
 
 	return nopoll_true;
 }
@@ -132,21 +228,11 @@ nopoll_bool  nopoll_msg_ref (noPollMsg * msg)
  */
 int          nopoll_msg_ref_count (noPollMsg * msg)
 {
-	int result;
-
 	/* check recieved reference */
 	if (msg == NULL)
 		return -1;
 
-	/* acquire mutex here */
-	nopoll_mutex_lock (msg->ref_mutex);
-
-	result = msg->refs;
-
-	/* release mutex here */
-	nopoll_mutex_unlock (msg->ref_mutex);
-
-	return result;
+	return nopoll_ref_get (&msg->refs, msg->ref_mutex);
 }
 
 /** 
@@ -262,7 +348,9 @@ noPollMsg  * nopoll_msg_join (noPollMsg * msg, noPollMsg * msg2)
 	} /* end if */
 	
 	/* now, join content */
-	result            = nopoll_msg_new ();
+	result            = __nopoll_msg_new (msg->ctx);
+	if (result == NULL)
+		return NULL;
 	result->has_fin   = msg->has_fin;
 	result->op_code   = msg->op_code;
 	result->is_masked = msg->is_masked;
@@ -271,13 +359,17 @@ noPollMsg  * nopoll_msg_join (noPollMsg * msg, noPollMsg * msg2)
 
 	/* copy payload size and content */
 	result->payload_size = msg->payload_size + msg2->payload_size;
-	result->payload = nopoll_new (char, result->payload_size + 1);
+	if (! __nopoll_msg_alloc_payload (result, result->payload_size)) {
+		nopoll_msg_unref (result);
+		return NULL;
+	} /* end if */
 
 	/* copy content from first message */
 	memcpy (result->payload, msg->payload, msg->payload_size);
 
 	/* copy content from second message */
 	memcpy (((unsigned char *) result->payload) + msg->payload_size , msg2->payload, msg2->payload_size);
+	((char *) result->payload)[result->payload_size] = 0;
 
 	/* return joined message */
 	return result;
@@ -291,27 +383,220 @@ noPollMsg  * nopoll_msg_join (noPollMsg * msg, noPollMsg * msg2)
  */
 void         nopoll_msg_unref (noPollMsg * msg)
 {
+	noPollCtx * ctx;
+#if !defined(NOPOLL_HAVE_ATOMIC_REFS)
+	noPollPtr   ref_mutex;
+#endif
+	int         inline_size;
+
 	if (msg == NULL)
 		return;
-	
-	/* acquire mutex here */
-	nopoll_mutex_lock (msg->ref_mutex);
 
-	msg->refs--;
-	if (msg->refs != 0) {
-		/* release mutex here */
-		nopoll_mutex_unlock (msg->ref_mutex);
+	if (nopoll_ref_dec (&msg->refs, msg->ref_mutex) != 0)
 		return;
-	}
-	/* release mutex */
-	nopoll_mutex_unlock (msg->ref_mutex);
-	nopoll_mutex_destroy (msg->ref_mutex);
 
-	/* free websocket message */
-	nopoll_free (msg->payload);
-	nopoll_free (msg);
+	/* free websocket message payload */
+	__nopoll_msg_free_payload (msg);
+
+	ctx = msg->ctx;
+	if (ctx) {
+		/* reset message keeping its storage */
+		inline_size = msg->inline_size;
+#if !defined(NOPOLL_HAVE_ATOMIC_REFS)
+		ref_mutex   = msg->ref_mutex;
+		memset (msg, 0, sizeof (noPollMsg));
+		msg->ref_mutex   = ref_mutex;
+#else
+		memset (msg, 0, sizeof (noPollMsg));
+#endif
+		msg->inline_size = inline_size;
+		msg->ctx         = ctx;
+
+		/* return it to the context pool if it fits */
+		nopoll_mutex_lock (ctx->msg_pool_mutex);
+		if (ctx->msg_pool_length < ctx->msg_pool_size && inline_size == ctx->msg_inline_size) {
+			msg->next     = ctx->msg_pool;
+			ctx->msg_pool = msg;
+			ctx->msg_pool_length++;
+			msg           = NULL;
+		} /* end if */
+		nopoll_mutex_unlock (ctx->msg_pool_mutex);
+	} /* end if */
+
+	if (msg) {
+#if !defined(NOPOLL_HAVE_ATOMIC_REFS)
+		nopoll_mutex_destroy (msg->ref_mutex);
+#endif
+		nopoll_free (msg);
+	} /* end if */
+
+	/* release reference to the context */
+	if (ctx)
+		nopoll_ctx_unref (ctx);
+	return;
+}
+
+/** 
+ * @internal Creates a frame holding the provided header followed by
+ * the payload, masked with the provided mask (if defined).
+ */
+noPollFrame * __nopoll_frame_new_encoded (const char * header, int header_size, const char * payload, long length, const char * mask)
+{
+	noPollFrame * frame;
+
+	frame = nopoll_new (noPollFrame, 1);
+	if (frame == NULL)
+		return NULL;
+
+	frame->size = header_size + length;
+	frame->data = nopoll_new (char, frame->size);
+	if (frame->data == NULL) {
+		nopoll_free (frame);
+		return NULL;
+	} /* end if */
+
+	frame->header_size = header_size;
+	memcpy (frame->data, header, header_size);
+	if (length > 0) {
+		memcpy (frame->data + header_size, payload, length);
+		if (mask)
+			nopoll_conn_mask_content (NULL, frame->data + header_size, length, (char *) mask, 0);
+	} /* end if */
+
+	frame->refs      = 1;
+#if !defined(NOPOLL_HAVE_ATOMIC_REFS)
+	frame->ref_mutex = nopoll_mutex_create ();
+#endif
+
+	return frame;
+}
+
+/** 
+ * @internal Creates a frame taking ownership of the provided buffer
+ * (already encoded: header followed by the payload).
+ */
+noPollFrame * __nopoll_frame_new_adopt (char * data, int size, int header_size)
+{
+	noPollFrame * frame;
+
+	frame = nopoll_new (noPollFrame, 1);
+	if (frame == NULL)
+		return NULL;
+
+	frame->data        = data;
+	frame->size        = size;
+	frame->header_size = header_size;
+	frame->refs        = 1;
+#if !defined(NOPOLL_HAVE_ATOMIC_REFS)
+	frame->ref_mutex   = nopoll_mutex_create ();
+#endif
+
+	return frame;
+}
+
+/** 
+ * @brief Creates a frame encoded once (header + payload) that can be
+ * sent to many listener side connections with \ref
+ * nopoll_conn_send_prepared or \ref nopoll_ctx_broadcast without
+ * encoding or copying the content again for each connection.
+ *
+ * Frames created are not masked (as required for frames sent by
+ * servers), so they can't be sent by client connections.
+ *
+ * @param op_code The frame type (for example \ref NOPOLL_TEXT_FRAME
+ * or \ref NOPOLL_BINARY_FRAME).
+ *
+ * @param fin nopoll_true to flag the frame as final.
+ *
+ * @param content The frame payload.
+ *
+ * @param length Payload length.
+ *
+ * @return A newly created frame (release it with \ref
+ * nopoll_frame_unref) or NULL if it fails.
+ */
+noPollFrame * nopoll_frame_new (noPollOpCode op_code, nopoll_bool fin, const char * content, long length)
+{
+	char header[14];
+	int  header_size;
+
+	if (length < 0 || (length > 0 && content == NULL))
+		return NULL;
+
+	header_size = __nopoll_conn_build_header (header, fin, op_code, length, NULL);
+	if (header_size < 0)
+		return NULL;
+
+	return __nopoll_frame_new_encoded (header, header_size, content, length, NULL);
+}
+
+/** 
+ * @brief Allows to acquire a reference to the provided frame.
+ *
+ * @param frame The frame to acquire a reference.
+ *
+ * @return nopoll_true if the reference was acquired, otherwise
+ * nopoll_false is returned.
+ */
+nopoll_bool  nopoll_frame_ref (noPollFrame * frame)
+{
+	if (frame == NULL)
+		return nopoll_false;
+
+	nopoll_ref_inc (&frame->refs, frame->ref_mutex);
+
+	return nopoll_true;
+}
+
+/** 
+ * @brief Allows to get current reference counting for the provided
+ * frame (connections that still have it queued hold a reference).
+ *
+ * @param frame The frame to check.
+ *
+ * @return Reference counting or -1 if it fails.
+ */
+int          nopoll_frame_ref_count (noPollFrame * frame)
+{
+	if (frame == NULL)
+		return -1;
+
+	return nopoll_ref_get (&frame->refs, frame->ref_mutex);
+}
+
+/** 
+ * @brief Returns the size of the encoded frame (header and payload).
+ *
+ * @param frame The frame to check.
+ *
+ * @return The frame size or -1 if it fails.
+ */
+int          nopoll_frame_get_size (noPollFrame * frame)
+{
+	if (frame == NULL)
+		return -1;
+	return frame->size;
+}
+
+/** 
+ * @brief Releases a reference to the provided frame, releasing it
+ * when it reaches 0.
+ *
+ * @param frame The frame to release.
+ */
+void         nopoll_frame_unref (noPollFrame * frame)
+{
+	if (frame == NULL)
+		return;
+
+	if (nopoll_ref_dec (&frame->refs, frame->ref_mutex) != 0)
+		return;
+#if !defined(NOPOLL_HAVE_ATOMIC_REFS)
+	nopoll_mutex_destroy (frame->ref_mutex);
+#endif
 
-	/* release mutex here */
+	nopoll_free (frame->data);
+	nopoll_free (frame);
 	return;
 }
 
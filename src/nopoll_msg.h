@@ -62,6 +62,29 @@ noPollMsg  * nopoll_msg_join (noPollMsg * msg, noPollMsg * msg2);
 
 void         nopoll_msg_unref (noPollMsg * msg);
 
+noPollFrame * nopoll_frame_new (noPollOpCode op_code, nopoll_bool fin, const char * content, long length);
+
+nopoll_bool  nopoll_frame_ref (noPollFrame * frame);
+
+int          nopoll_frame_ref_count (noPollFrame * frame);
+
+int          nopoll_frame_get_size (noPollFrame * frame);
+
+void         nopoll_frame_unref (noPollFrame * frame);
+
+/** internal api **/
+noPollMsg   * __nopoll_msg_new (noPollCtx * ctx);
+
+nopoll_bool   __nopoll_msg_alloc_payload (noPollMsg * msg, long size);
+
+void          __nopoll_msg_free_payload (noPollMsg * msg);
+
+void          __nopoll_msg_pool_release (noPollCtx * ctx, int keep);
+
+noPollFrame * __nopoll_frame_new_encoded (const char * header, int header_size, const char * payload, long length, const char * mask);
+
+noPollFrame * __nopoll_frame_new_adopt   (char * data, int size, int header_size);
+
 END_C_DECLS
 
 #endif
@@ -44,10 +44,55 @@
 #include <openssl/x509v3.h>
 #include <openssl/ssl.h>
 #include <openssl/err.h>
+#include <openssl/rand.h>
 #include <openssl/opensslv.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#else
+#include <openssl/hmac.h>
+#endif
 
 #include <nopoll_handlers.h>
 
+/* reference counting: atomic operations are used when supported by
+ * the compiler, otherwise reference counters are protected by a
+ * mutex (see nopoll_thread_handlers) */
+#if !defined(NOPOLL_DISABLE_ATOMIC_REFS)
+#if defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7)))
+#define NOPOLL_HAVE_ATOMIC_REFS 1
+#define nopoll_atomic_inc(ref) __atomic_add_fetch ((ref), 1, __ATOMIC_ACQ_REL)
+#define nopoll_atomic_dec(ref) __atomic_sub_fetch ((ref), 1, __ATOMIC_ACQ_REL)
+#define nopoll_atomic_get(ref) __atomic_load_n ((ref), __ATOMIC_ACQUIRE)
+#define nopoll_atomic_set(ref, value) __atomic_store_n ((ref), (value), __ATOMIC_RELEASE)
+#define nopoll_atomic_cas(ref, old_value, new_value) __sync_bool_compare_and_swap ((ref), (old_value), (new_value))
+#define nopoll_atomic_get_ptr(ref) __atomic_load_n ((ref), __ATOMIC_SEQ_CST)
+#define nopoll_atomic_xchg_ptr(ref, value) __atomic_exchange_n ((ref), (value), __ATOMIC_SEQ_CST)
+#elif defined(_MSC_VER)
+#define NOPOLL_HAVE_ATOMIC_REFS 1
+#define nopoll_atomic_inc(ref) InterlockedIncrement ((volatile LONG *) (ref))
+#define nopoll_atomic_dec(ref) InterlockedDecrement ((volatile LONG *) (ref))
+#define nopoll_atomic_get(ref) InterlockedCompareExchange ((volatile LONG *) (ref), 0, 0)
+#define nopoll_atomic_set(ref, value) InterlockedExchange ((volatile LONG *) (ref), (LONG) (value))
+#define nopoll_atomic_cas(ref, old_value, new_value) (InterlockedCompareExchange ((volatile LONG *) (ref), (LONG) (new_value), (LONG) (old_value)) == (LONG) (old_value))
+#define nopoll_atomic_get_ptr(ref) InterlockedCompareExchangePointer ((PVOID volatile *) (ref), NULL, NULL)
+#define nopoll_atomic_xchg_ptr(ref, value) InterlockedExchangePointer ((PVOID volatile *) (ref), (value))
+#endif
+#endif
+
+/* update the reference counter returning its new value (the mutex
+ * argument is not evaluated when atomics are available) */
+#if defined(NOPOLL_HAVE_ATOMIC_REFS)
+#define nopoll_ref_inc(ref, mutex) nopoll_atomic_inc (ref)
+#define nopoll_ref_dec(ref, mutex) nopoll_atomic_dec (ref)
+#define nopoll_ref_get(ref, mutex) nopoll_atomic_get (ref)
+#else
+#define nopoll_ref_inc(ref, mutex) __nopoll_ref_update ((ref), (mutex), 1)
+#define nopoll_ref_dec(ref, mutex) __nopoll_ref_update ((ref), (mutex), -1)
+#define nopoll_ref_get(ref, mutex) __nopoll_ref_update ((ref), (mutex), 0)
+#endif
+
+int __nopoll_ref_update (int * ref, noPollPtr mutex, int value);
+
 typedef struct _noPollCertificate {
 
 	char * serverName;
@@ -57,6 +102,153 @@ typedef struct _noPollCertificate {
 
 } noPollCertificate;
 
+/** 
+ * @internal Server SSL_CTX configured for a listener, certificate and
+ * protocol, shared by all TLS connections accepted with the same
+ * configuration, or client SSL_CTX (listener_id 0) shared by client
+ * connections with the same configuration (see
+ * nopoll_ctx_invalidate_ssl_contexts).
+ */
+typedef struct _noPollSslCtxEntry {
+	int            listener_id;
+	int            ssl_protocol;
+	char         * certificate;
+	char         * private_key;
+	char         * chain_certificate;
+	char         * ca_certificate;
+	nopoll_bool    verify;
+
+	/* reference owned by the cache */
+	SSL_CTX      * ssl_ctx;
+
+	struct _noPollSslCtxEntry * next;
+} noPollSslCtxEntry;
+
+/** 
+ * @internal Client TLS session cached for a host:port:SNI (see
+ * nopoll_ctx_set_ssl_client_sessions).
+ */
+typedef struct _noPollSslSession {
+	char         * key;
+	SSL_SESSION  * session;
+
+	struct _noPollSslSession * next;
+} noPollSslSession;
+
+/** 
+ * @internal Addresses found for a host name (sorted to be tried as
+ * defined by RFC 8305).
+ */
+typedef struct _noPollAddresses {
+	struct sockaddr_storage  items[NOPOLL_DNS_CACHE_ADDRESSES];
+	socklen_t                lengths[NOPOLL_DNS_CACHE_ADDRESSES];
+	int                      length;
+} noPollAddresses;
+
+/** 
+ * @internal Host name resolved cached (see nopoll_ctx_set_dns_cache)
+ * or addresses defined for a host name (port is NULL, see
+ * nopoll_ctx_set_host_addresses).
+ */
+typedef struct _noPollDnsEntry {
+	char               * host;
+	char               * port;
+	int                  family;
+	noPollAddresses      addresses;
+	/* time when the entry expires (0: never) */
+	long                 expires;
+
+	struct _noPollDnsEntry * next;
+} noPollDnsEntry;
+
+/** 
+ * @internal Asynchronous connect pending to be resolved by a
+ * resolver thread (see nopoll_ctx_set_resolver_threads). It holds a
+ * reference to the connection.
+ */
+typedef struct _noPollResolveRequest {
+	noPollConn   * conn;
+	int            family;
+	char         * _interface;
+
+	struct _noPollResolveRequest * next;
+} noPollResolveRequest;
+
+/** 
+ * @internal Connection attempts of an asynchronous connect to the
+ * addresses of the host (Happy Eyeballs, RFC 8305), run by the loop
+ * serving the connection once the host name is resolved. The attempt
+ * watched by the loop is the connection socket, the rest of attempts
+ * in progress are kept on sockets (protected by ctx->ref_mutex).
+ */
+typedef struct _noPollConnectAttempts {
+	noPollAddresses  addresses;
+	/* next address to try */
+	int              next;
+	NOPOLL_SOCKET    sockets[NOPOLL_DNS_CACHE_ADDRESSES];
+	int              length;
+	/* when the last attempt was started */
+	struct timeval   last;
+	char           * _interface;
+} noPollConnectAttempts;
+
+void __nopoll_conn_addresses_sort (noPollAddresses * addresses);
+
+void __nopoll_conn_dns_entry_free (noPollDnsEntry * entry);
+
+void __nopoll_conn_connect_attempts_close_locked (noPollConn * conn);
+
+void __nopoll_conn_connect_attempts_free (noPollConnectAttempts * attempts);
+
+int  __nopoll_conn_send_prepared (noPollConn * conn, noPollFrame * frame, nopoll_bool write_unwatched);
+
+/* masking kernel selection (__nopoll_conn_mask_set_kernel and
+ * __nopoll_conn_mask_get_kernel are regression test and benchmark
+ * hooks) */
+void          __nopoll_conn_mask_init (void);
+
+nopoll_bool   __nopoll_conn_mask_set_kernel (const char * name);
+
+const char  * __nopoll_conn_mask_get_kernel (void);
+
+/** 
+ * @internal Session ticket key (name, encryption and HMAC keys).
+ */
+typedef struct _noPollTicketKey {
+	unsigned char  name[16];
+	unsigned char  aes_key[32];
+	unsigned char  hmac_key[32];
+	long           created;
+} noPollTicketKey;
+
+/** 
+ * @internal Session ticket keys of a server SSL context: tickets are
+ * issued with the current key, and the previous one is still accepted
+ * (renewing the ticket) until the next rotation.
+ */
+typedef struct _noPollTicketKeys {
+	noPollPtr        mutex;
+	int              rotation;
+	noPollTicketKey  current;
+	noPollTicketKey  previous;
+	nopoll_bool      has_previous;
+} noPollTicketKeys;
+
+/** 
+ * @internal Copy of the connections registered on a context, shared
+ * by foreach operations (see nopoll_ctx_foreach_conn). It is updated
+ * in place as the registry changes while no foreach operation is
+ * using it (otherwise it is replaced). It holds a reference to each
+ * connection, and refs is protected by ctx->ref_mutex.
+ */
+typedef struct _noPollConnSnapshot {
+	int            refs;
+	int            length;
+	/* connections that fit on conns */
+	int            size;
+	noPollConn   * conns[1];
+} noPollConnSnapshot;
+
 struct _noPollCtx {
 	/**
 	 * @internal Controls logs output..
@@ -90,15 +282,92 @@ struct _noPollCtx {
 	noPollIoEngine * io_engine;
 
 	/** 
-	 * @internal Connection array list and its length.
+	 * @internal IO engine type to be created by the loop (\ref
+	 * NOPOLL_IO_ENGINE_DEFAULT unless configured).
+	 */
+	noPollIoEngineType io_engine_type;
+
+	/** 
+	 * @internal Max time (microseconds) the io engine waits
+	 * without activity (0: no limit).
+	 */
+	long               io_wait_timeout;
+
+	/** 
+	 * @internal Loop workers created by nopoll_loop_run_threads
+	 * (each one with its own io engine) and next worker to
+	 * assign connections (round robin).
+	 */
+	noPollLoopWorker ** workers;
+	int                 workers_length;
+	int                 workers_next;
+
+	/** 
+	 * @internal Drain mode: the loop notifies all messages
+	 * already received by a connection (up to the budget) on
+	 * each readiness event (see nopoll_ctx_set_loop_drain).
+	 */
+	nopoll_bool         loop_drain;
+	int                 loop_drain_budget;
+
+	/** 
+	 * @internal Size of the read buffer created by each
+	 * connection to read incoming frames.
+	 */
+	int                 read_buffer_size;
+
+	/** 
+	 * @internal Released messages cached for reuse (see
+	 * nopoll_ctx_set_msg_pool).
+	 */
+	noPollMsg         * msg_pool;
+	int                 msg_pool_length;
+	int                 msg_pool_size;
+	int                 msg_inline_size;
+	noPollPtr           msg_pool_mutex;
+
+	/** 
+	 * @internal Connection array list (slots) and its length.
 	 */
         int               conn_id;
 	noPollConn     ** conn_list;
 	int               conn_length;
+	/** 
+	 * @internal Stack of free slots in conn_list and its length.
+	 */
+	int             * conn_free;
+	int               conn_free_length;
+	/** 
+	 * @internal Connection id to slot index (open addressing,
+	 * storing slot + 1, 0 for empty entries) and its size (power
+	 * of 2).
+	 */
+	int             * conn_index;
+	int               conn_index_size;
+	/** 
+	 * @internal Connections snapshot for the current registry
+	 * state (NULL when it has to be created again).
+	 */
+	noPollConnSnapshot * conn_snapshot;
 	/** 
 	 * @internal Number of connections registered on this context.
 	 */
 	int               conn_num;
+	/** 
+	 * @internal Number of client connections with an
+	 * asynchronous connect in progress.
+	 */
+	int               conn_connecting;
+	/** 
+	 * @internal Number of asynchronous connects that failed to
+	 * resolve or connect, pending to be closed by the loop.
+	 */
+	int               conn_connect_failed;
+	/** 
+	 * @internal Number of connections closing in the background
+	 * (close frame queued, flushed by the loop).
+	 */
+	int               conn_closing;
 
 	/** 
 	 * @internal Reference to defined on accept handling.
@@ -124,6 +393,15 @@ struct _noPollCtx {
 	noPollOnMessageHandler on_msg;
 	noPollPtr              on_msg_data;
 
+	/** 
+	 * @internal Default write watermark handlers (see
+	 * nopoll_ctx_set_on_write_blocked).
+	 */
+	noPollOnWriteHandler   on_write_blocked;
+	noPollPtr              on_write_blocked_data;
+	noPollOnWriteHandler   on_write_drained;
+	noPollPtr              on_write_drained_data;
+
 	/** 
 	 * @internal Basic fake support for protocol version, by
 	 * default: 13, due to RFC6455 standard
@@ -136,6 +414,51 @@ struct _noPollCtx {
 	noPollCertificate *  certificates;
 	int                  certificates_length;
 
+	/** 
+	 * @internal Server SSL contexts cached (protected by
+	 * ref_mutex).
+	 */
+	noPollSslCtxEntry  * ssl_ctx_cache;
+
+	/** 
+	 * @internal Client TLS sessions cached (most recently used
+	 * first, protected by ref_mutex), max sessions cached and
+	 * connections resuming / not resuming their session.
+	 */
+	noPollSslSession   * ssl_sessions;
+	int                  ssl_sessions_length;
+	int                  ssl_sessions_size;
+	int                  ssl_session_hits;
+	int                  ssl_session_misses;
+
+	/** 
+	 * @internal Asynchronous connects pending to be resolved
+	 * (protected by ref_mutex), condition idle resolver threads
+	 * wait on, resolver threads running (and how many are idle),
+	 * max threads and stop flag (see
+	 * nopoll_ctx_set_resolver_threads).
+	 */
+	noPollResolveRequest * resolver_queue;
+	noPollResolveRequest * resolver_last;
+	noPollPtr              resolver_cond;
+	noPollPtr            * resolver_threads;
+	int                    resolver_threads_length;
+	int                    resolver_idle;
+	int                    resolver_size;
+	nopoll_bool            resolver_stop;
+
+	/** 
+	 * @internal Host names resolved cached (most recently
+	 * resolved first, protected by ref_mutex), TTL applied and
+	 * lookups found / not found on the cache (see
+	 * nopoll_ctx_set_dns_cache).
+	 */
+	noPollDnsEntry       * dns_cache;
+	int                    dns_cache_length;
+	int                    dns_cache_ttl;
+	int                    dns_cache_hits;
+	int                    dns_cache_misses;
+
 	/* mutex */
 	noPollPtr            ref_mutex;
 
@@ -143,6 +466,18 @@ struct _noPollCtx {
 	noPollLogHandler     log_handler;
 	noPollPtr            log_user_data;
 
+	/* minimum level reported (see nopoll_log_set_level) and
+	 * minimum level actually delivered: above all levels when
+	 * neither console log nor a handler are enabled */
+	noPollDebugLevel     log_level;
+	int                  log_threshold;
+
+	/* asynchronous log delivery (see nopoll_log_set_async) and
+	 * threads pushing records into it right now (the ring is
+	 * released once none is left) */
+	struct _noPollLogRing * log_ring;
+	int                     log_users;
+
 	/* context creator */
 	noPollSslContextCreator context_creator;
 	noPollPtr               context_creator_data;
@@ -152,12 +487,44 @@ struct _noPollCtx {
 	noPollPtr               post_ssl_check_data;
 };
 
+/* check context log level directly inside the library (see
+ * nopoll_log) */
+#include <nopoll_log.h>
+
+/* frame queued to be written on a connection */
+typedef struct _noPollWriteItem {
+	noPollFrame             * frame;
+	int                       desp;
+	struct _noPollWriteItem * next;
+} noPollWriteItem;
+
+/* stages of an asynchronous client connect (see
+ * nopoll_conn_opts_set_async_connect) */
+typedef enum {
+	NOPOLL_CONNECT_DONE = 0,
+	/* resolving the host name (resolver thread) */
+	NOPOLL_CONNECT_RESOLVE,
+	/* waiting the TCP connect to finish (trying the addresses
+	 * resolved on the loop, see noPollConnectAttempts) */
+	NOPOLL_CONNECT_TCP,
+	/* doing the TLS handshake */
+	NOPOLL_CONNECT_TLS,
+	/* sending the WebSocket client init */
+	NOPOLL_CONNECT_INIT
+} noPollConnectStage;
+
 struct _noPollConn {
 	/** 
 	 * @internal Connection id.
 	 */
 	int              id;
 
+	/** 
+	 * @internal Slot (position + 1) used in the context connection
+	 * list, 0 when not registered.
+	 */
+	int              ctx_slot;
+
 	/** 
 	 * @internal The context associated to this connection.
 	 */
@@ -281,18 +648,53 @@ struct _noPollConn {
          */
         nopoll_bool   pending_ssl_connect;
 
+	/**
+	 * @internal Asynchronous connect in progress (see
+	 * nopoll_conn_opts_set_async_connect): current stage, events
+	 * the loop has to wait for (0 while the connection is being
+	 * created), if resolving or connecting it failed before
+	 * handing it to the loop, client init pending to be sent,
+	 * connect start time and connection attempts in progress.
+	 */
+	noPollConnectStage  connect_stage;
+	int                 connect_events;
+	nopoll_bool         connect_failed;
+	char              * connect_content;
+	int                 connect_size;
+	int                 connect_desp;
+	struct timeval      connect_start;
+	noPollConnectAttempts * connect_attempts;
+
 	/* SSL support */
 	SSL_CTX        * ssl_ctx;
 	SSL            * ssl;
 
+	/* client TLS session cache key (see
+	 * nopoll_ctx_set_ssl_client_sessions) */
+	char           * ssl_session_key;
+
+	/* kernel TLS offload active for sending and receiving (see
+	 * nopoll_conn_opts_set_ktls) */
+	nopoll_bool      ktls_send;
+	nopoll_bool      ktls_recv;
+
 	/* certificates */
 	char           * certificate;
 	char           * private_key;
 	char           * chain_certificate;
 
-	/* pending buffer */
-	char             pending_buf[100];
-	int              pending_buf_bytes;
+	/* read buffer: bytes received pending to be consumed are
+	 * read_buf[read_buf_start..read_buf_end) */
+	char           * read_buf;
+	int              read_buf_size;
+	int              read_buf_start;
+	int              read_buf_end;
+	/* last read from the wire got less than requested (or
+	 * nothing), so the socket was left without input */
+	nopoll_bool      wire_drained;
+	/* queued on the engine list of connections with input
+	 * pending to be notified (see nopoll_loop_process_pending) */
+	nopoll_bool      input_queued;
 
 	/** 
 	 * @internal Support for an user defined pointer.
@@ -302,7 +704,9 @@ struct _noPollConn {
 	/** 
 	 * @internal Mutexes
 	 */
+#if !defined(NOPOLL_HAVE_ATOMIC_REFS)
 	noPollPtr             ref_mutex;
+#endif
 	noPollPtr             handshake_mutex;
 
 	/** 
@@ -314,10 +718,33 @@ struct _noPollConn {
 	 * next message, even having FIN enabled as a fragment. */
 	nopoll_bool           previous_was_fragment;
 
-	char                * pending_write;
-	int                   pending_write_bytes;
-	int                   pending_write_desp;
-        int                   pending_write_added_header;
+	/** 
+	 * @internal Frames (or the part of them) that couldn't be
+	 * written yet and the amount of bytes they still have to
+	 * write. The queue is written by the loop when the socket
+	 * is writable or by nopoll_conn_complete_pending_write.
+	 */
+	noPollWriteItem     * write_queue;
+	noPollWriteItem     * write_queue_last;
+	int                   write_queue_bytes;
+	/* serializes writes done by the loop and by senders */
+	noPollPtr             write_mutex;
+
+	/** 
+	 * @internal Write watermarks (0: disabled), hard limit and
+	 * policy applied above it (see nopoll_conn_set_write_limit)
+	 * and handlers notified when the queue reaches the high
+	 * watermark (write_blocked is set) or drops to the low one.
+	 */
+	int                   write_high;
+	int                   write_low;
+	int                   write_limit;
+	noPollWriteLimit      write_limit_policy;
+	nopoll_bool           write_blocked;
+	noPollOnWriteHandler  on_write_blocked;
+	noPollPtr             on_write_blocked_data;
+	noPollOnWriteHandler  on_write_drained;
+	noPollPtr             on_write_drained_data;
 
 	/** 
 	 * @internal Internal reference to the connection options.
@@ -330,10 +757,54 @@ struct _noPollConn {
 	 */
 	noPollConn          * listener;
 
+
+	/** 
+	 * @internal Loop worker (id) watching this connection when
+	 * nopoll_loop_run_threads is running (0: not assigned).
+	 */
+	int                   worker;
+	/** 
+	 * @internal Id of the listener whose port is shared by this
+	 * one (see nopoll_listener_new_reuse_port), 0 otherwise.
+	 * Listeners sharing a port share their server SSL contexts.
+	 */
+	int                   listener_origin;
+	/** 
+	 * @internal References held by registry snapshots (see
+	 * nopoll_ctx_foreach_conn), which nopoll_conn_close_ext
+	 * doesn't count as owners.
+	 */
+	int                   snapshot_refs;
 	/** 
-	 * @internal Flag to track internal header pending 
+	 * @internal Position (+1) on the context snapshot, 0 when
+	 * the connection is not on it.
 	 */
-	nopoll_bool           read_pending_header;
+	int                   snapshot_pos;
+	/** 
+	 * @internal The connection is registered on an io engine
+	 * (so a loop is reporting its events).
+	 */
+	nopoll_bool           io_watched;
+	/** 
+	 * @internal Position (+1) on the list of connections assigned
+	 * to the io engine watching it, 0 when it is not assigned.
+	 */
+	int                   engine_pos;
+	/** 
+	 * @internal nopoll_conn_shutdown is closing the socket
+	 * (claimed under ctx->ref_mutex, so concurrent shutdowns, for
+	 * example by the loop failing an asynchronous connect, do
+	 * not close it twice).
+	 */
+	nopoll_bool           shutdown_started;
+	/** 
+	 * @internal nopoll_conn_close_ext queued the close frame
+	 * and left the loop writing it: the close finishes once the
+	 * queue is written, fails or NOPOLL_CONN_SEND_WAIT elapses
+	 * from close_start.
+	 */
+	nopoll_bool           close_pending;
+	struct timeval        close_start;
 
 	
 	/**** debug values ****/
@@ -358,6 +829,55 @@ struct _noPollIoEngine {
 	noPollIoMechWait       wait;
 	noPollIoMechAddTo      add_to;
 	noPollIoMechIsSet      is_set;
+	/* persistent interest registration (optional): when add is
+	 * defined, clear/add_to/is_set are not used */
+	noPollIoMechAdd        add;
+	noPollIoMechModify     modify;
+	noPollIoMechRemove     remove;
+	noPollIoMechReady      ready;
+	/* events reported for ready connections (optional) */
+	noPollIoMechEvents     events;
+	/* interrupt a wait in progress (optional) */
+	noPollIoMechWakeup     wakeup;
+	/* protects the connections registered on this engine and
+	 * the flags below (held by add, modify and remove and briefly
+	 * by wait and ready) */
+	noPollPtr              mutex;
+	/* limit (microseconds) requested by the loop running this
+	 * engine for the current wait (0: no limit) */
+	long                   wait_limit;
+	/* loop is waiting (or about to) so changes done from other
+	 * threads must wakeup the engine */
+	nopoll_bool            waiting;
+	/* connections removed because they were shutdown, pending to
+	 * be unregistered by the loop */
+	nopoll_bool            conn_shutdown_pending;
+	/* connections (one reference each) that left input already
+	 * received (read buffer, TLS layer) pending to be notified
+	 * (only used by the loop running this engine) */
+	noPollConn          ** pending;
+	int                    pending_length;
+	int                    pending_size;
+	/* connections assigned to this engine (watched or not yet,
+	 * for example while resolving), visited by the loop instead of
+	 * the context registry (only used by engines with persistent
+	 * registration, protected by the mutex) */
+	noPollConn          ** conns;
+	int                    conns_length;
+	int                    conns_size;
+};
+
+struct _noPollLoopWorker {
+	noPollCtx            * ctx;
+	/* worker id (position + 1) as recorded on connections */
+	int                    id;
+	noPollIoEngine       * io_engine;
+	noPollPtr              thread;
+	/* listeners created for this worker (sharing the port with
+	 * the main listener through SO_REUSEPORT) */
+	noPollConn          ** listeners;
+	int                    listeners_length;
+	int                    result;
 };
 
 struct _noPollMsg {
@@ -369,13 +889,34 @@ struct _noPollMsg {
 	long int       payload_size;
 
 	int            refs;
+#if !defined(NOPOLL_HAVE_ATOMIC_REFS)
 	noPollPtr      ref_mutex;
+#endif
 
 	char           mask[4];
 	int            remain_bytes;
 
 	nopoll_bool    is_fragment;
 	int            unmask_desp;
+
+	/* context pool the message is returned to (if any), size of
+	 * the payload storage placed after the message and next
+	 * message in the pool */
+	noPollCtx    * ctx;
+	int            inline_size;
+	noPollMsg    * next;
+};
+
+struct _noPollFrame {
+	/* encoded frame: header followed by payload */
+	char         * data;
+	int            size;
+	int            header_size;
+
+	int            refs;
+#if !defined(NOPOLL_HAVE_ATOMIC_REFS)
+	noPollPtr      ref_mutex;
+#endif
 };
 
 struct _noPollHandshake {
@@ -400,7 +941,9 @@ struct _noPollConnOpts {
 	nopoll_bool          reuse;
 
 	/* mutex */
+#if !defined(NOPOLL_HAVE_ATOMIC_REFS)
 	noPollPtr            mutex;
+#endif
 	int                  refs;
 
 	/* What ssl protocol should be used */
@@ -429,6 +972,28 @@ struct _noPollConnOpts {
 	/* control whether origin header is added or not (see
 	 * nopoll_conn_opts_add_origin_header) */
 	nopoll_bool add_origin_header;
+
+	/* default write watermarks and hard limit for connections
+	 * created with these options */
+	int               write_high;
+	int               write_low;
+	int               write_limit;
+	noPollWriteLimit  write_limit_policy;
+
+	/* server TLS session cache size (0 disables it), session
+	 * lifetime (seconds), session tickets and ticket keys
+	 * rotation period (seconds) */
+	int               ssl_session_cache_size;
+	int               ssl_session_timeout;
+	nopoll_bool       ssl_session_tickets;
+	int               ssl_ticket_rotation;
+
+	/* request kernel TLS offload (see nopoll_conn_opts_set_ktls) */
+	nopoll_bool       ktls;
+
+	/* connect without blocking the caller (see
+	 * nopoll_conn_opts_set_async_connect) */
+	nopoll_bool       async_connect;
 };
 
 #endif
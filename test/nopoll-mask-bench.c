@@ -0,0 +1,153 @@
+/*
+ *  LibNoPoll: A websocket library
+ *  Copyright (C) 2025 Advanced Software Production Line, S.L.
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public License
+ *  as published by the Free Software Foundation; either version 2.1
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program; if not, write to the Free
+ *  Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307 USA
+ *  
+ *  You may find a copy of the license under this software is released
+ *  at COPYING file. This is LGPL software: you are welcome to develop
+ *  proprietary applications using this library without any royalty or
+ *  fee but returning back any change, improvement or addition in the
+ *  form of source code, project image, documentation patches, etc.
+ *
+ *  For commercial support on build Websocket enabled solutions
+ *  contact us:
+ *          
+ *      Postal address:
+ *         Advanced Software Production Line, S.L.
+ *         Av. Juan Carlos I, Nº13, 2ºC
+ *         Alcalá de Henares 28806 Madrid
+ *         Spain
+ *
+ *      Email address:
+ *         info@aspl.es - http://www.aspl.es/nopoll
+ */
+#include <nopoll.h>
+
+/* kernel selection hooks (__nopoll_conn_mask_set_kernel) */
+#include <nopoll_private.h>
+
+/* masking loop as implemented before word/vector kernels, used as
+ * reference for throughput and for checking results */
+void mask_reference (char * payload, int payload_size, char * mask, int desp)
+{
+	int iter       = 0;
+	int mask_index = 0;
+
+	while (iter < payload_size) {
+		/* rotate mask and apply it */
+		mask_index = (iter + desp) % 4;
+		payload[iter] ^= mask[mask_index];
+		iter++;
+	} /* end while */
+
+	return;
+}
+
+double elapsed (struct timeval * start)
+{
+	struct timeval stop;
+	struct timeval diff;
+
+	gettimeofday (&stop, NULL);
+	nopoll_timeval_substract (&stop, start, &diff);
+	return diff.tv_sec + (diff.tv_usec / 1000000.0);
+}
+
+/* runs the selected kernel (or the reference loop when kernel is
+ * NULL) over the buffer and reports GB/s */
+double run (noPollCtx * ctx, const char * kernel, char * buffer, int size, int rounds, char * mask)
+{
+	struct timeval start;
+	double         secs;
+	int            iterator;
+
+	if (kernel && ! __nopoll_conn_mask_set_kernel (kernel))
+		return -1;
+
+	gettimeofday (&start, NULL);
+	for (iterator = 0; iterator < rounds; iterator++) {
+		if (kernel)
+			nopoll_conn_mask_content (ctx, buffer, size, mask, iterator);
+		else
+			mask_reference (buffer, size, mask, iterator);
+	} /* end for */
+	secs = elapsed (&start);
+
+	return ((double) size * rounds) / (secs * 1000000000.0);
+}
+
+int main (int argc, char ** argv)
+{
+	const char * kernels[] = {"bytes", "word64", "sse2", "avx2", NULL};
+	noPollCtx  * ctx;
+	char       * buffer;
+	char       * expected;
+	char         mask[4] = {0x12, 0x34, 0x56, 0x78};
+	int          size    = 4 * 1024 * 1024;
+	int          rounds  = 64;
+	int          offset;
+	int          iterator;
+	double       result;
+	double       reference;
+
+	if (argc > 1)
+		size = atoi (argv[1]);
+	if (argc > 2)
+		rounds = atoi (argv[2]);
+	if (size <= 0 || rounds <= 0) {
+		printf ("Usage: %s [payload-size] [rounds]\n", argv[0]);
+		return -1;
+	} /* end if */
+
+	ctx      = nopoll_ctx_new ();
+	buffer   = nopoll_new (char, size + 1);
+	expected = nopoll_new (char, size + 1);
+	for (iterator = 0; iterator < size + 1; iterator++)
+		buffer[iterator] = (char) iterator;
+
+	printf ("Masking %d bytes payloads, %d rounds (default kernel: %s)\n",
+		size, rounds, __nopoll_conn_mask_get_kernel ());
+
+	/* aligned and unaligned payloads */
+	for (offset = 0; offset < 2; offset++) {
+		reference = run (ctx, NULL, buffer + offset, size, rounds, mask);
+		printf ("  offset %d  %-10s %8.2f GB/s\n", offset, "reference", reference);
+
+		for (iterator = 0; kernels[iterator]; iterator++) {
+			/* check result against the reference loop */
+			memcpy (expected, buffer + offset, size);
+			mask_reference (expected, size, mask, 3);
+			if (! __nopoll_conn_mask_set_kernel (kernels[iterator])) {
+				printf ("  offset %d  %-10s (not available)\n", offset, kernels[iterator]);
+				continue;
+			} /* end if */
+			nopoll_conn_mask_content (ctx, buffer + offset, size, mask, 3);
+			if (memcmp (expected, buffer + offset, size)) {
+				printf ("ERROR: kernel %s produced wrong output\n", kernels[iterator]);
+				return -1;
+			} /* end if */
+
+			result = run (ctx, kernels[iterator], buffer + offset, size, rounds, mask);
+			printf ("  offset %d  %-10s %8.2f GB/s  (x%.1f)\n", offset, kernels[iterator], result, result / reference);
+		} /* end for */
+	} /* end for */
+
+	nopoll_free (buffer);
+	nopoll_free (expected);
+	nopoll_ctx_unref (ctx);
+	return 0;
+}
@@ -38,6 +38,12 @@
 #include <nopoll-regression-common.h>
 #include <nopoll.h>
 
+/**** DO NOT INCLUDE THIS HEADER IN PRODUCTION: this header is
+      included in this regression test just for testing purposes. Any
+      code developed using this include might failure in future
+      relases ****/
+#include <nopoll_private.h>
+
 nopoll_bool debug = nopoll_false;
 nopoll_bool show_critical_only = nopoll_false;
 
@@ -105,6 +111,28 @@ noPollCtx * create_ctx (void) {
 	return ctx;
 }
 
+/* test run with one of the io engines available */
+typedef nopoll_bool (*TestEngineFunc) (const char * label, noPollIoEngineType engine_type);
+
+/* runs the provided test with each io engine built in */
+nopoll_bool test_each_engine (TestEngineFunc test_engine)
+{
+	if (! test_engine ("select(2)", NOPOLL_IO_ENGINE_SELECT))
+		return nopoll_false;
+
+#if defined(NOPOLL_HAVE_EPOLL)
+	if (! test_engine ("epoll(2)", NOPOLL_IO_ENGINE_EPOLL))
+		return nopoll_false;
+#endif
+
+#if defined(NOPOLL_HAVE_POLL)
+	if (! test_engine ("poll(2)", NOPOLL_IO_ENGINE_POLL))
+		return nopoll_false;
+#endif
+
+	return nopoll_true;
+}
+
 nopoll_bool test_01_strings (void) {
 	/* check string compare functions */
 	if (! nopoll_ncmp ("GET ", "GET ", 4)) {
@@ -166,12 +194,50 @@ nopoll_bool test_01_base64 (void) {
 	return nopoll_true;
 }
 
+nopoll_bool test_01_masking_kernel (noPollCtx * ctx, const char * kernel, char * mask)
+{
+	char   buffer[600];
+	char   expected[600];
+	int    offset;
+	int    size;
+	int    desp;
+	int    iterator;
+
+	if (! __nopoll_conn_mask_set_kernel (kernel)) {
+		printf ("Test 01 masking: kernel %s not available, skipping..\n", kernel);
+		return nopoll_true;
+	} /* end if */
+
+	/* check against the byte by byte definition using all
+	 * alignments, sizes around vector widths and mask rotations */
+	for (offset = 0; offset < 33; offset++) {
+		for (size = 0; size < 520; size += (size < 80) ? 1 : 37) {
+			for (desp = 0; desp < 6; desp++) {
+				for (iterator = 0; iterator < size; iterator++) {
+					buffer[offset + iterator]   = (char) (iterator * 7 + size);
+					expected[offset + iterator] = (char) (iterator * 7 + size) ^ mask[(iterator + desp) % 4];
+				} /* end for */
+				nopoll_conn_mask_content (ctx, buffer + offset, size, mask, desp);
+				if (memcmp (buffer + offset, expected + offset, size)) {
+					printf ("ERROR: kernel %s failed masking (offset=%d, size=%d, desp=%d)..\n",
+						kernel, offset, size, desp);
+					return nopoll_false;
+				} /* end if */
+			} /* end for */
+		} /* end for */
+	} /* end for */
+
+	return nopoll_true;
+}
+
 nopoll_bool test_01_masking (void) {
 
 	char         mask[4];
 	int          mask_value;
 	char         buffer[1024];
 	noPollCtx  * ctx;
+	const char * kernels[] = {"bytes", "word64", "sse2", "avx2", NULL};
+	int          iterator;
 
 	/* clear buffer */
 	memset (buffer, 0, 1024);
@@ -211,6 +277,14 @@ nopoll_bool test_01_masking (void) {
 	printf ("Test 01 masking: found mask in the buffer %d == %d\n", 
 		nopoll_get_32bit (mask), mask_value);
 
+	/* check all masking kernels available */
+	printf ("Test 01 masking: default kernel is %s\n", __nopoll_conn_mask_get_kernel ());
+	for (iterator = 0; kernels[iterator]; iterator++) {
+		if (! test_01_masking_kernel (ctx, kernels[iterator], mask))
+			return nopoll_false;
+	} /* end for */
+	__nopoll_conn_mask_set_kernel (NULL);
+
 	nopoll_ctx_unref (ctx);
 	return nopoll_true;
 }
@@ -2692,12 +2766,6 @@ nopoll_bool test_29 (void) {
 	return nopoll_true;
 }
 
-/**** DO NOT INCLUDE THIS HEADER IN PRODUCTION: this header is
-      included in this regression test just for testing purposes. Any
-      code developed using this include might failure in future
-      relases ****/
-#include <nopoll_private.h>
-
 nopoll_bool test_30_common_header_stop (const char * label, int bytes_to_send_before_stop) {
 
 	noPollConn      * conn;
@@ -2887,198 +2955,3280 @@ nopoll_bool test_36 (void) {
 	return nopoll_true;
 }
 
-int main (int argc, char ** argv)
+nopoll_bool test_37_echo_received = nopoll_false;
+
+void test_37_on_msg (noPollCtx * ctx, noPollConn * conn, noPollMsg * msg, noPollPtr user_data)
 {
-	int iterator;
+	/* check echo and finish loop */
+	if (nopoll_msg_get_payload_size (msg) == 22 &&
+	    nopoll_ncmp ((const char *) nopoll_msg_get_payload (msg), "This is a test message", 22))
+		test_37_echo_received = nopoll_true;
+	nopoll_loop_stop (ctx);
+	return;
+}
 
-	printf ("** NoPoll: Websocket toolkit (regression test).\n");
-	printf ("** Copyright (C) 2025 Advanced Software Production Line, S.L.\n**\n");
-	printf ("** NoPoll regression tests: version=%s\n**\n",
-		VERSION);
-	printf ("** To gather information about time performance you can use:\n**\n");
-	printf ("**     >> time ./nopoll-regression-client [--debug,--show-critical-only]\n**\n");
-	printf ("** To gather information about memory consumed (and leaks) use:\n**\n");
-	printf ("**     >> libtool --mode=execute valgrind --leak-check=yes --error-limit=no ./nopoll-regression-client\n**\n");
-	printf ("**\n");
-	printf ("** Report bugs to:\n**\n");
-	printf ("**     <nopoll@lists.aspl.es> noPoll mailing list\n**\n");
-	printf ("**     <info@aspl.es> ASPL's contact \n**\n");
+nopoll_bool test_37_engine (const char * label, noPollIoEngineType engine_type)
+{
+	noPollCtx      * ctx;
+	noPollConn     * conn;
+	noPollIoEngine * engine;
 
-	iterator = 1;
-	while (iterator < argc) {
-		/* check for debug */
-		printf ("Checking agument: %s\n", argv[iterator]);
-		if (nopoll_cmp (argv[iterator], "--debug")) {
-			printf ("Activating debug..\n");
-			debug = nopoll_true;
-		} /* end if */
-		if (nopoll_cmp (argv[iterator], "--show-critical-only")) {
-			printf ("Activating reporting of critical messages..\n");
-			show_critical_only = nopoll_true;
-		} /* end if */
+	ctx = create_ctx ();
 
-		/* next position */
-		iterator++;
-	}
+	/* check engine is available */
+	engine = nopoll_io_get_engine (ctx, engine_type);
+	if (engine == NULL) {
+		printf ("ERROR: expected to create %s engine but NULL was found..\n", label);
+		return nopoll_false;
+	} /* end if */
+	nopoll_io_release_engine (engine);
 
-#if defined(__NOPOLL_PTHREAD_SUPPORT__)	
-	printf ("INFO: install default threading functions to check noPoll locking code..\n");
-	nopoll_thread_handlers (__nopoll_regtest_mutex_create,
-				__nopoll_regtest_mutex_destroy,
-				__nopoll_regtest_mutex_lock,
-				__nopoll_regtest_mutex_unlock);
-#endif
+	/* configure engine to be used by the loop */
+	nopoll_ctx_set_io_engine (ctx, engine_type);
+	nopoll_ctx_set_on_msg (ctx, test_37_on_msg, NULL);
 
-	printf ("INFO: starting tests with pid: %d\n", getpid ());
-	if (test_01_strings ()) {
-		printf ("Test 01-strings: Library strings support [   OK   ]\n");
-	}else {
-		printf ("Test 01-strings: Library strings support [ FAILED ]\n");
-		return -1;
-	}
+	/* call to create a connection */
+	conn = nopoll_conn_new (ctx, "localhost", "1234", NULL, NULL, NULL, NULL);
+	if (! nopoll_conn_is_ok (conn)) {
+		printf ("ERROR: Expected to find proper client connection status, but found error..\n");
+		return nopoll_false;
+	} /* end if */
 
-	if (test_01_base64 ()) {
-		printf ("Test 01-base64: Library base64 support [   OK   ]\n");
-	}else {
-		printf ("Test 01-base64: Library base64 support [ FAILED ]\n");
-		return -1;
-	}
+	if (! nopoll_conn_wait_until_connection_ready (conn, 5)) {
+		printf ("ERROR: expected connection ready using %s engine..\n", label);
+		return nopoll_false;
+	} /* end if */
 
-	if (test_01_masking ()) {
-		printf ("Test 01-masking: Library websocket content masking support [   OK   ]\n");
-	}else {
-		printf ("Test 01-masking: Library websocket content masking support [ FAILED ]\n");
-		return -1;
-	}
+	/* send content and wait for the echo */
+	test_37_echo_received = nopoll_false;
+	if (nopoll_conn_send_text (conn, "This is a test message", 22) != 22) {
+		printf ("ERROR: Expected to find proper send operation..\n");
+		return nopoll_false;
+	} /* end if */
 
-	if (test_01 ()) {	
-		printf ("Test 01: Simple connect and disconnect [   OK   ]\n");
-	}else {
-		printf ("Test 01: Simple connect and disconnect [ FAILED ]\n");
-		return -1;
-	}
+	if (nopoll_loop_wait (ctx, 5000000) != 0 || ! test_37_echo_received) {
+		printf ("ERROR: expected to receive echo using %s engine..\n", label);
+		return nopoll_false;
+	} /* end if */
 
-	if (test_02 ()) {	
-		printf ("Test 02: Simple request/reply [   OK   ]\n");
-	}else {
-		printf ("Test 02: Simple request/reply [ FAILED ]\n");
-		return -1;
-	}
+	nopoll_conn_close (conn);
+	nopoll_ctx_unref (ctx);
 
-	if (test_02a ()) {	
-		printf ("Test 02a: Simple request/reply (IPv6) [   OK   ]\n");
-	}else {
-		printf ("Test 02a: Simple request/reply (IPv6) [ FAILED ]\n");
-		return -1;
-	}
+	return nopoll_true;
+}
 
-	/* test sending ping */
-	if (test_02b ()) {	
-		printf ("Test 02b: test sending ping [   OK   ]\n");
-	}else {
-		printf ("Test 02a: test sending ping [ FAILED ]\n");
-		return -1;
-	}
+nopoll_bool test_37 (void) {
 
-	/* test sending pong (without ping) */
+	if (! test_each_engine (test_37_engine))
+		return nopoll_false;
 
-	/* test streaming api */
-	if (test_03 ()) {	
-		printf ("Test 03: test streaming api [   OK   ]\n");
-	}else {
-		printf ("Test 03: test streaming api [ FAILED ]\n");
-		return -1;
-	}
+	/* default engine */
+	if (! test_37_engine ("default", NOPOLL_IO_ENGINE_DEFAULT))
+		return nopoll_false;
 
-	if (test_04 (1024)) {	
-		printf ("Test 04: test streaming api (II) [   OK   ]\n");
-	}else {
-		printf ("Test 04: test streaming api (II) [ FAILED ]\n");
-		return -1;
-	}
+	return nopoll_true;
+}
 
-	if (test_04 (512)) {	
-		printf ("Test 04-a: test streaming api (III) [   OK   ]\n");
-	}else {
-		printf ("Test 04-a: test streaming api (III) [ FAILED ]\n");
-		return -1;
-	}
+nopoll_bool test_38_echo_received = nopoll_false;
 
-	if (test_04 (137)) {	
-		printf ("Test 04-b: test streaming api (IV) [   OK   ]\n");
-	}else {
-		printf ("Test 04-b: test streaming api (IV) [ FAILED ]\n");
-		return -1;
-	}
+void test_38_on_msg (noPollCtx * ctx, noPollConn * conn, noPollMsg * msg, noPollPtr user_data)
+{
+	/* shutdown other connection (not the one notified) */
+	test_38_echo_received = nopoll_true;
+	nopoll_conn_shutdown ((noPollConn *) user_data);
+	return;
+}
 
-	if (test_04 (17)) {	
-		printf ("Test 04-c: test streaming api (V) [   OK   ]\n");
-	}else {
-		printf ("Test 04-c: test streaming api (V) [ FAILED ]\n");
-		return -1;
-	}
+nopoll_bool test_38 (void) {
 
-	if (test_04a ()) {
-		printf ("Test 04-a: check non-blocking streaming and message based API  [   OK   ]\n");
-	} else {
-		printf ("Test 04-a: check non-blocking streaming and message based API [ FAILED ]\n");
-		return -1;
-	}
+	noPollCtx      * ctx;
+	noPollConn     * conns[5];
+	int              iterator;
 
-	if (test_04b ()) {
-		printf ("Test 04-b: try to overflow write access and recover from it  [   OK   ]\n");
-	} else {
-		printf ("Test 04-b: try to overflow write access and recover from it [ FAILED ]\n");
-		return -1;
-	}
+	ctx = create_ctx ();
+	nopoll_ctx_set_io_engine (ctx, NOPOLL_IO_ENGINE_DEFAULT);
 
-	if (test_04c ()) {
-		printf ("Test 04-c: send a file and try to overflow (but retry)  [   OK   ]\n");
-	} else {
-		printf ("Test 04-c: send a file and try to overflow (but retry) [ FAILED ]\n");
-		return -1;
-	}
+	/* create some connections */
+	iterator = 0;
+	while (iterator < 5) {
+		conns[iterator] = nopoll_conn_new (ctx, "localhost", "1234", NULL, NULL, NULL, NULL);
+		if (! nopoll_conn_wait_until_connection_ready (conns[iterator], 5)) {
+			printf ("ERROR: expected connection ready (%d)..\n", iterator);
+			return nopoll_false;
+		} /* end if */
+		iterator++;
+	} /* end while */
 
-	if (test_05 ()) {
-		printf ("Test 05: sending utf-8 content [   OK   ]\n");
-	} else {
-		printf ("Test 05: sending utf-8 content [ FAILED ]\n");
-		return -1;
-	}
+	/* send content over one connection, the handler will shutdown
+	 * the first connection while the loop is running */
+	nopoll_ctx_set_on_msg (ctx, test_38_on_msg, conns[0]);
+	if (nopoll_conn_send_text (conns[2], "This is a test message", 22) != 22) {
+		printf ("ERROR: Expected to find proper send operation..\n");
+		return nopoll_false;
+	} /* end if */
 
-	if (test_06 ()) {
-		printf ("Test 06: testing basic TLS connect [   OK   ]\n");
-	} else {
-		printf ("Test 06: testing basic TLS connect [ FAILED ]\n");
-		return -1;
-	}
+	printf ("Test 38: waiting on nopoll_loop_wait (1 second)...\n");
+	nopoll_loop_wait (ctx, 1000000);
+	if (! test_38_echo_received) {
+		printf ("ERROR: expected to receive echo..\n");
+		return nopoll_false;
+	} /* end if */
 
-	if (test_06a ()) {
-		printf ("Test 06a: testing basic TLS connect (IPv6) [   OK   ]\n");
-	} else {
-		printf ("Test 06a: testing basic TLS connect (IPv6) [ FAILED ]\n");
-		return -1;
-	}
+	/* connection shutdown must be unregistered by the loop */
+	if (nopoll_ctx_conns (ctx) != 4) {
+		printf ("ERROR: expected to find 4 connections registered but found %d..\n", nopoll_ctx_conns (ctx));
+		return nopoll_false;
+	} /* end if */
 
-	if (test_07 ()) {
-		printf ("Test 07: testing TLS request/reply [   OK   ]\n");
-	} else {
-		printf ("Test 07: testing TLS request/reply [ FAILED ]\n");
-		return -1;
-	}
+	/* release connections */
+	nopoll_conn_unref (conns[0]);
+	iterator = 1;
+	while (iterator < 5) {
+		nopoll_conn_close (conns[iterator]);
+		iterator++;
+	} /* end while */
 
-	if (test_08 ()) {
-		printf ("Test 08: test normal connect to TLS port [   OK   ]\n");
-	} else {
-		printf ("Test 08: test normal connect to TLS port [ FAILED ]\n");
-		return -1;
-	}
+	if (nopoll_ctx_conns (ctx) != 0) {
+		printf ("ERROR: expected to find 0 connections registered but found %d..\n", nopoll_ctx_conns (ctx));
+		return nopoll_false;
+	} /* end if */
 
-	if (test_09 ()) {
-		printf ("Test 09: ensure we only support Sec-WebSocket-Version: 13 [   OK   ]\n");
-	} else {
-		printf ("Test 09: ensure we only support Sec-WebSocket-Version: 13 [ FAILED ]\n");
-		return -1;
+	nopoll_ctx_unref (ctx);
+
+	return nopoll_true;
+}
+
+#if defined(NOPOLL_HAVE_POLL)
+nopoll_bool test_39 (void) {
+
+	noPollCtx      * ctx;
+	noPollConn     * conn;
+	struct rlimit    limit;
+	int              fds[1100];
+	int              count = 0;
+	nopoll_bool      result = nopoll_false;
+
+	/* ensure we can open enough sockets */
+	if (getrlimit (RLIMIT_NOFILE, &limit) != 0 || limit.rlim_cur < 1200) {
+		printf ("Test 39: skipping, not enough file descriptors available..\n");
+		return nopoll_true;
+	} /* end if */
+
+	/* consume low file descriptors so the connection is created
+	 * with a socket above FD_SETSIZE (1024) */
+	while (count < 1100) {
+		fds[count] = dup (0);
+		if (fds[count] < 0)
+			break;
+		if (fds[count++] > 1030)
+			break;
+	} /* end while */
+
+	ctx = create_ctx ();
+	nopoll_ctx_set_io_engine (ctx, NOPOLL_IO_ENGINE_POLL);
+	nopoll_ctx_set_on_msg (ctx, test_37_on_msg, NULL);
+
+	conn = nopoll_conn_new (ctx, "localhost", "1234", NULL, NULL, NULL, NULL);
+	if (! nopoll_conn_wait_until_connection_ready (conn, 5)) {
+		printf ("ERROR: expected connection ready..\n");
+		goto finish;
+	} /* end if */
+
+	printf ("Test 39: connection created with socket %d\n", nopoll_conn_socket (conn));
+	if (nopoll_conn_socket (conn) <= 1024) {
+		printf ("ERROR: expected a socket above 1024 but found %d..\n", nopoll_conn_socket (conn));
+		goto finish;
+	} /* end if */
+
+	/* send content and wait for the echo */
+	test_37_echo_received = nopoll_false;
+	if (nopoll_conn_send_text (conn, "This is a test message", 22) != 22) {
+		printf ("ERROR: Expected to find proper send operation..\n");
+		goto finish;
+	} /* end if */
+
+	if (nopoll_loop_wait (ctx, 5000000) != 0 || ! test_37_echo_received) {
+		printf ("ERROR: expected to receive echo using poll(2) engine..\n");
+		goto finish;
+	} /* end if */
+
+	result = nopoll_true;
+
+ finish:
+	nopoll_conn_close (conn);
+	nopoll_ctx_unref (ctx);
+
+	while (count > 0) {
+		count--;
+		close (fds[count]);
+	} /* end while */
+
+	return result;
+}
+#endif
+
+noPollPtr test_40_stop (noPollPtr user_data)
+{
+	/* stop loop from another thread */
+	nopoll_sleep (100000);
+	nopoll_loop_stop ((noPollCtx *) user_data);
+	return NULL;
+}
+
+nopoll_bool test_40_engine (const char * label, noPollIoEngineType engine_type)
+{
+	noPollCtx      * ctx;
+	noPollConn     * conn;
+	pthread_t        thread;
+	struct timeval   start;
+	struct timeval   stop;
+	struct timeval   diff;
+	long             ellapsed;
+
+	ctx = create_ctx ();
+	nopoll_ctx_set_io_engine (ctx, engine_type);
+
+	/* default: wait without limit */
+	if (nopoll_ctx_get_io_wait_timeout (ctx) != 0) {
+		printf ("ERROR: expected no io wait timeout by default but found %ld..\n", nopoll_ctx_get_io_wait_timeout (ctx));
+		return nopoll_false;
+	} /* end if */
+
+	/* idle connection watched by the loop */
+	conn = nopoll_conn_new (ctx, "localhost", "1234", NULL, NULL, NULL, NULL);
+	if (! nopoll_conn_wait_until_connection_ready (conn, 5)) {
+		printf ("ERROR: expected connection ready using %s engine..\n", label);
+		return nopoll_false;
+	} /* end if */
+
+	/* stop the loop from another thread while waiting */
+	gettimeofday (&start, NULL);
+	if (pthread_create (&thread, NULL, test_40_stop, ctx) != 0) {
+		printf ("ERROR: failed to create thread..\n");
+		return nopoll_false;
+	} /* end if */
+	if (nopoll_loop_wait (ctx, 0) != 0) {
+		printf ("ERROR: expected loop to finish without error using %s engine..\n", label);
+		return nopoll_false;
+	} /* end if */
+	gettimeofday (&stop, NULL);
+	pthread_join (thread, NULL);
+
+	nopoll_timeval_substract (&stop, &start, &diff);
+	ellapsed = (diff.tv_sec * 1000000) + diff.tv_usec;
+	printf ("Test 40: loop stopped after %ld microseconds using %s engine\n", ellapsed, label);
+	if (ellapsed > 400000) {
+		printf ("ERROR: expected loop stop to be noticed without delay using %s engine..\n", label);
+		return nopoll_false;
+	} /* end if */
+
+	/* configured timeout is used as limit */
+	nopoll_ctx_set_io_wait_timeout (ctx, 50000);
+	if (nopoll_ctx_get_io_wait_timeout (ctx) != 50000) {
+		printf ("ERROR: expected io wait timeout 50000 but found %ld..\n", nopoll_ctx_get_io_wait_timeout (ctx));
+		return nopoll_false;
+	} /* end if */
+	if (nopoll_loop_wait (ctx, 200000) != -3) {
+		printf ("ERROR: expected loop timeout using %s engine..\n", label);
+		return nopoll_false;
+	} /* end if */
+
+	nopoll_conn_close (conn);
+	nopoll_ctx_unref (ctx);
+
+	return nopoll_true;
+}
+
+nopoll_bool test_40 (void) {
+
+	if (! test_each_engine (test_40_engine))
+		return nopoll_false;
+
+	return nopoll_true;
+}
+
+pthread_mutex_t test_41_mutex = PTHREAD_MUTEX_INITIALIZER;
+int             test_41_served[5];
+
+void test_41_on_msg (noPollCtx * ctx, noPollConn * conn, noPollMsg * msg, noPollPtr user_data)
+{
+	/* record worker serving the connection */
+	pthread_mutex_lock (&test_41_mutex);
+	if (conn->worker >= 0 && conn->worker < 5)
+		test_41_served[conn->worker]++;
+	pthread_mutex_unlock (&test_41_mutex);
+
+	/* echo content */
+	nopoll_conn_send_text (conn, (const char *) nopoll_msg_get_payload (msg), nopoll_msg_get_payload_size (msg));
+	return;
+}
+
+noPollPtr test_41_run (noPollPtr user_data)
+{
+	noPollCtx * ctx = user_data;
+
+	/* run loop workers */
+	if (nopoll_loop_run_threads (ctx, 4) != 0)
+		return ctx;
+	return NULL;
+}
+
+nopoll_bool test_41_count_listeners (noPollCtx * ctx, noPollConn * conn, noPollPtr user_data)
+{
+	int * count = user_data;
+
+	if (conn->role == NOPOLL_ROLE_MAIN_LISTENER)
+		(*count)++;
+	return nopoll_false; /* keep foreach, don't stop */
+}
+
+nopoll_bool test_41 (void) {
+	noPollCtx      * ctx;
+	noPollCtx      * client_ctx;
+	noPollConn     * listener;
+	noPollConn     * conns[16];
+	noPollMsg      * msg;
+	pthread_t        thread;
+	noPollPtr        thread_result;
+	char             content[50];
+	int              iterator;
+	int              iter;
+	int              workers;
+	int              count;
+
+	ctx = create_ctx ();
+	nopoll_ctx_set_on_msg (ctx, test_41_on_msg, NULL);
+	listener = nopoll_listener_new (ctx, "0.0.0.0", "22352");
+	if (! nopoll_conn_is_ok (listener)) {
+		printf ("ERROR: expected proper listener creation..\n");
+		return nopoll_false;
+	} /* end if */
+
+	/* serve connections from 4 loop workers */
+	if (pthread_create (&thread, NULL, test_41_run, ctx) != 0) {
+		printf ("ERROR: failed to create thread..\n");
+		return nopoll_false;
+	} /* end if */
+
+	/* connect clients and check echo replies */
+	client_ctx = create_ctx ();
+	for (iterator = 0; iterator < 16; iterator++) {
+		conns[iterator] = nopoll_conn_new (client_ctx, "localhost", "22352", NULL, NULL, NULL, NULL);
+		if (! nopoll_conn_wait_until_connection_ready (conns[iterator], 5)) {
+			printf ("ERROR: expected connection %d ready..\n", iterator);
+			return nopoll_false;
+		} /* end if */
+	} /* end for */
+
+	for (iterator = 0; iterator < 16; iterator++) {
+		sprintf (content, "Message from client %d", iterator);
+		if (nopoll_conn_send_text (conns[iterator], content, strlen (content)) != (int) strlen (content)) {
+			printf ("ERROR: failed to send content from client %d..\n", iterator);
+			return nopoll_false;
+		} /* end if */
+	} /* end for */
+
+	for (iterator = 0; iterator < 16; iterator++) {
+		sprintf (content, "Message from client %d", iterator);
+		iter = 0;
+		while ((msg = nopoll_conn_get_msg (conns[iterator])) == NULL) {
+			if (! nopoll_conn_is_ok (conns[iterator]) || iter > 500) {
+				printf ("ERROR: expected reply for client %d..\n", iterator);
+				return nopoll_false;
+			} /* end if */
+			nopoll_sleep (10000);
+			iter++;
+		} /* end while */
+
+		if (! nopoll_cmp ((const char *) nopoll_msg_get_payload (msg), content)) {
+			printf ("ERROR: expected '%s' but found '%s'..\n", content, (const char *) nopoll_msg_get_payload (msg));
+			return nopoll_false;
+		} /* end if */
+		nopoll_msg_unref (msg);
+	} /* end for */
+
+	/* stop workers */
+	nopoll_loop_stop (ctx);
+	pthread_join (thread, &thread_result);
+	if (thread_result != NULL) {
+		printf ("ERROR: expected nopoll_loop_run_threads to finish without error..\n");
+		return nopoll_false;
+	} /* end if */
+
+	/* every message was served by a worker and the kernel
+	 * balanced connections among listeners */
+	workers = 0;
+	for (iterator = 1; iterator < 5; iterator++) {
+		if (test_41_served[iterator] > 0)
+			workers++;
+	} /* end for */
+	printf ("Test 41: messages served by worker: 1=%d 2=%d 3=%d 4=%d (not assigned: %d)\n",
+		test_41_served[1], test_41_served[2], test_41_served[3], test_41_served[4], test_41_served[0]);
+	if (test_41_served[0] != 0 || workers < 2) {
+		printf ("ERROR: expected connections to be served by several workers..\n");
+		return nopoll_false;
+	} /* end if */
+
+	/* listeners created for workers were closed */
+	count = 0;
+	nopoll_ctx_foreach_conn (ctx, test_41_count_listeners, &count);
+	if (count != 1) {
+		printf ("ERROR: expected to find 1 listener after workers finished but found %d..\n", count);
+		return nopoll_false;
+	} /* end if */
+
+	/* nopoll_loop_wait works again */
+	if (nopoll_loop_wait (ctx, 10000) != -3) {
+		printf ("ERROR: expected loop timeout after running workers..\n");
+		return nopoll_false;
+	} /* end if */
+
+	for (iterator = 0; iterator < 16; iterator++)
+		nopoll_conn_close (conns[iterator]);
+	nopoll_ctx_unref (client_ctx);
+
+	nopoll_conn_close (listener);
+	nopoll_ctx_unref (ctx);
+
+	return nopoll_true;
+}
+
+int test_42_received = 0;
+int test_42_unordered = 0;
+
+void test_42_on_msg (noPollCtx * ctx, noPollConn * conn, noPollMsg * msg, noPollPtr user_data)
+{
+	char content[50];
+
+	/* check messages are notified in order */
+	sprintf (content, "Burst message %d", test_42_received);
+	if (! nopoll_cmp ((const char *) nopoll_msg_get_payload (msg), content))
+		test_42_unordered++;
+	test_42_received++;
+	return;
+}
+
+noPollPtr test_42_run (noPollPtr user_data)
+{
+	noPollCtx * ctx = user_data;
+
+	nopoll_loop_wait (ctx, 0);
+	return NULL;
+}
+
+nopoll_bool test_42_burst (nopoll_bool drain, int budget)
+{
+	noPollCtx      * ctx;
+	noPollCtx      * client_ctx;
+	noPollConn     * listener;
+	noPollConn     * conn;
+	pthread_t        thread;
+	char             content[50];
+	int              iterator;
+
+	ctx = create_ctx ();
+	nopoll_ctx_set_on_msg (ctx, test_42_on_msg, NULL);
+	nopoll_ctx_set_loop_drain (ctx, drain, budget);
+	listener = nopoll_listener_new (ctx, "0.0.0.0", "22353");
+	if (! nopoll_conn_is_ok (listener)) {
+		printf ("ERROR: expected proper listener creation..\n");
+		return nopoll_false;
+	} /* end if */
+
+	test_42_received  = 0;
+	test_42_unordered = 0;
+	if (pthread_create (&thread, NULL, test_42_run, ctx) != 0) {
+		printf ("ERROR: failed to create thread..\n");
+		return nopoll_false;
+	} /* end if */
+
+	client_ctx = create_ctx ();
+	conn = nopoll_conn_new (client_ctx, "localhost", "22353", NULL, NULL, NULL, NULL);
+	if (! nopoll_conn_wait_until_connection_ready (conn, 5)) {
+		printf ("ERROR: expected connection ready..\n");
+		return nopoll_false;
+	} /* end if */
+
+	/* send a burst of small messages */
+	for (iterator = 0; iterator < 50; iterator++) {
+		sprintf (content, "Burst message %d", iterator);
+		if (nopoll_conn_send_text (conn, content, strlen (content)) != (int) strlen (content)) {
+			printf ("ERROR: failed to send message %d..\n", iterator);
+			return nopoll_false;
+		} /* end if */
+	} /* end for */
+
+	iterator = 0;
+	while (test_42_received < 50 && iterator < 500) {
+		nopoll_sleep (10000);
+		iterator++;
+	} /* end while */
+
+	nopoll_loop_stop (ctx);
+	pthread_join (thread, NULL);
+
+	if (test_42_received != 50 || test_42_unordered != 0) {
+		printf ("ERROR: expected 50 messages in order (drain=%d, budget=%d) but received %d (unordered: %d)..\n",
+			drain, budget, test_42_received, test_42_unordered);
+		return nopoll_false;
+	} /* end if */
+
+	nopoll_conn_close (conn);
+	nopoll_ctx_unref (client_ctx);
+
+	nopoll_conn_close (listener);
+	nopoll_ctx_unref (ctx);
+
+	return nopoll_true;
+}
+
+nopoll_bool test_42 (void) {
+	noPollCtx * ctx;
+	int         budget = 0;
+
+	/* drain mode is enabled by default */
+	ctx = create_ctx ();
+	if (! nopoll_ctx_get_loop_drain (ctx, &budget) || budget != NOPOLL_LOOP_DRAIN_BUDGET) {
+		printf ("ERROR: expected drain mode enabled by default with budget %d but found %d..\n", NOPOLL_LOOP_DRAIN_BUDGET, budget);
+		return nopoll_false;
+	} /* end if */
+	nopoll_ctx_unref (ctx);
+
+	if (! test_42_burst (nopoll_true, 0))
+		return nopoll_false;
+
+	/* small budget: several readiness events per burst */
+	if (! test_42_burst (nopoll_true, 4))
+		return nopoll_false;
+
+	/* one message per readiness event */
+	if (! test_42_burst (nopoll_false, 0))
+		return nopoll_false;
+
+	return nopoll_true;
+}
+
+int test_43_sizes[] = {5, 60, 130, 1000, 70000};
+int test_43_received = 0;
+int test_43_offset   = 0;
+int test_43_wrong    = 0;
+
+void test_43_on_msg (noPollCtx * ctx, noPollConn * conn, noPollMsg * msg, noPollPtr user_data)
+{
+	const unsigned char * payload = nopoll_msg_get_payload (msg);
+	int                   size    = test_43_sizes[test_43_received % 5];
+	int                   length  = nopoll_msg_get_payload_size (msg);
+	int                   iterator;
+
+	/* big frames may be notified in several pieces, check
+	 * content against its offset inside the message */
+	if (test_43_offset + length > size) {
+		test_43_wrong++;
+		return;
+	} /* end if */
+
+	for (iterator = 0; iterator < length; iterator++) {
+		if (payload[iterator] != (unsigned char) ((test_43_received + test_43_offset + iterator) % 251)) {
+			test_43_wrong++;
+			break;
+		} /* end if */
+	} /* end for */
+
+	test_43_offset += length;
+	if (test_43_offset == size) {
+		/* message completed */
+		test_43_offset = 0;
+		test_43_received++;
+	} /* end if */
+	return;
+}
+
+nopoll_bool test_43 (void) {
+	noPollCtx      * ctx;
+	noPollCtx      * client_ctx;
+	noPollConn     * listener;
+	noPollConn     * conn;
+	pthread_t        thread;
+	char           * content;
+	int              iterator;
+	int              iterator2;
+	int              size;
+
+	ctx = create_ctx ();
+	if (nopoll_ctx_get_read_buffer_size (ctx) != NOPOLL_READ_BUFFER_SIZE) {
+		printf ("ERROR: expected default read buffer size %d but found %d..\n", NOPOLL_READ_BUFFER_SIZE, nopoll_ctx_get_read_buffer_size (ctx));
+		return nopoll_false;
+	} /* end if */
+
+	/* small read buffer: headers split across reads and
+	 * payloads bigger than the buffer */
+	nopoll_ctx_set_read_buffer_size (ctx, 64);
+	nopoll_ctx_set_on_msg (ctx, test_43_on_msg, NULL);
+	listener = nopoll_listener_new (ctx, "0.0.0.0", "22354");
+	if (! nopoll_conn_is_ok (listener)) {
+		printf ("ERROR: expected proper listener creation..\n");
+		return nopoll_false;
+	} /* end if */
+
+	if (pthread_create (&thread, NULL, test_42_run, ctx) != 0) {
+		printf ("ERROR: failed to create thread..\n");
+		return nopoll_false;
+	} /* end if */
+
+	client_ctx = create_ctx ();
+	conn = nopoll_conn_new (client_ctx, "localhost", "22354", NULL, NULL, NULL, NULL);
+	if (! nopoll_conn_wait_until_connection_ready (conn, 5)) {
+		printf ("ERROR: expected connection ready..\n");
+		return nopoll_false;
+	} /* end if */
+
+	/* send messages of different sizes */
+	content = nopoll_new (char, 70000);
+	for (iterator = 0; iterator < 20; iterator++) {
+		size = test_43_sizes[iterator % 5];
+		for (iterator2 = 0; iterator2 < size; iterator2++)
+			content[iterator2] = (char) ((iterator + iterator2) % 251);
+		if (nopoll_conn_send_binary (conn, content, size) != size) {
+			printf ("ERROR: failed to send message %d (size %d)..\n", iterator, size);
+			return nopoll_false;
+		} /* end if */
+		nopoll_conn_flush_writes (conn, 2000000, 0);
+	} /* end for */
+	nopoll_free (content);
+
+	iterator = 0;
+	while (test_43_received < 20 && iterator < 500) {
+		nopoll_sleep (10000);
+		iterator++;
+	} /* end while */
+
+	nopoll_loop_stop (ctx);
+	pthread_join (thread, NULL);
+
+	if (test_43_received != 20 || test_43_wrong != 0) {
+		printf ("ERROR: expected 20 messages properly received but received %d (wrong: %d)..\n",
+			test_43_received, test_43_wrong);
+		return nopoll_false;
+	} /* end if */
+
+	nopoll_conn_close (conn);
+	nopoll_ctx_unref (client_ctx);
+
+	nopoll_conn_close (listener);
+	nopoll_ctx_unref (ctx);
+
+	return nopoll_true;
+}
+
+nopoll_bool test_44_read (noPollConn * conn, int * received, int * offset, int size)
+{
+	noPollMsg           * msg;
+	const unsigned char * payload;
+	int                   length;
+	int                   iterator;
+
+	while ((msg = nopoll_conn_get_msg (conn)) != NULL) {
+		payload = nopoll_msg_get_payload (msg);
+		length  = nopoll_msg_get_payload_size (msg);
+
+		/* check content against its offset (big frames may be
+		 * received in several pieces) */
+		if ((*offset) + length > size) {
+			printf ("ERROR: received more content than expected for message %d..\n", *received);
+			return nopoll_false;
+		} /* end if */
+		for (iterator = 0; iterator < length; iterator++) {
+			if (payload[iterator] != (unsigned char) ((*received + *offset + iterator) % 251)) {
+				printf ("ERROR: wrong content found at message %d, position %d..\n", *received, *offset + iterator);
+				return nopoll_false;
+			} /* end if */
+		} /* end for */
+		nopoll_msg_unref (msg);
+
+		(*offset) += length;
+		if ((*offset) == size) {
+			(*offset) = 0;
+			(*received)++;
+		} /* end if */
+	} /* end while */
+
+	return nopoll_true;
+}
+
+nopoll_bool test_44 (void) {
+	noPollCtx      * ctx;
+	noPollConn     * conn;
+	noPollConn     * listener, * master;
+	char           * content;
+	int              size     = 262144;
+	int              received = 0;
+	int              offset   = 0;
+	int              pending  = 0;
+	int              iterator;
+	int              iterator2;
+	int              result;
+
+	ctx = create_ctx ();
+
+	master = nopoll_listener_new (ctx, "0.0.0.0", "22355");
+	if (! nopoll_conn_is_ok (master)) {
+		printf ("ERROR: expected proper master listener at 0.0.0.0:22355 creation but a failure was found..\n");
+		return nopoll_false;
+	} /* end if */
+
+	conn = nopoll_conn_new (ctx, "localhost", "22355", NULL, NULL, NULL, NULL);
+	if (! nopoll_conn_is_ok (conn)) {
+		printf ("ERROR: Expected to find proper client connection status, but found error..\n");
+		return nopoll_false;
+	} /* end if */
+
+	listener = nopoll_conn_accept (ctx, master);
+	if (! nopoll_conn_is_ok (listener)) {
+		printf ("ERROR: expected to find proper listener status (connection accepted), but found failure..\n");
+		return nopoll_false;
+	} /* end if */
+
+	/* complete handshake on both sides */
+	iterator = 0;
+	while (! nopoll_conn_is_ready (listener) || ! nopoll_conn_is_ready (conn)) {
+		nopoll_conn_get_msg (listener);
+		nopoll_conn_get_msg (conn);
+		nopoll_sleep (1000);
+		if (iterator++ > 5000) {
+			printf ("ERROR: expected connection ready (listener: %d, client: %d)..\n",
+				nopoll_conn_is_ready (listener), nopoll_conn_is_ready (conn));
+			return nopoll_false;
+		} /* end if */
+	} /* end while */
+
+	/* server side frames (unmasked) are written from the caller's
+	 * payload: use non blocking writes to force partial writes
+	 * and check the rest is properly queued */
+	nopoll_conn_set_sock_block (nopoll_conn_socket (listener), nopoll_false);
+
+	content = nopoll_new (char, size);
+	for (iterator = 0; iterator < 64; iterator++) {
+		for (iterator2 = 0; iterator2 < size; iterator2++)
+			content[iterator2] = (char) ((iterator + iterator2) % 251);
+
+		result = nopoll_conn_send_binary (listener, content, size);
+		if (result < 0 && result != -2) {
+			printf ("ERROR: failed to send message %d, result=%d..\n", iterator, result);
+			return nopoll_false;
+		} /* end if */
+
+		/* caller's buffer is reused for the next frame: pending
+		 * content must be owned by the connection */
+		memset (content, 0, size);
+
+		while (nopoll_conn_pending_write_bytes (listener) > 0) {
+			pending++;
+			if (! test_44_read (conn, &received, &offset, size))
+				return nopoll_false;
+			if (nopoll_conn_complete_pending_write (listener) < 0) {
+				printf ("ERROR: failed to complete pending write..\n");
+				return nopoll_false;
+			} /* end if */
+		} /* end while */
+	} /* end for */
+	nopoll_free (content);
+
+	iterator = 0;
+	while (received < 64 && iterator < 1000) {
+		if (! test_44_read (conn, &received, &offset, size))
+			return nopoll_false;
+		nopoll_sleep (1000);
+		iterator++;
+	} /* end while */
+
+	if (received != 64) {
+		printf ("ERROR: expected to receive 64 messages but received %d..\n", received);
+		return nopoll_false;
+	} /* end if */
+
+	printf ("Test 44: all messages received (pending writes found: %d)\n", pending);
+
+	nopoll_conn_close (conn);
+	nopoll_conn_close (listener);
+	nopoll_conn_close (master);
+	nopoll_ctx_unref (ctx);
+
+	return nopoll_true;
+}
+
+nopoll_bool test_45_read (noPollConn * conn, int * sizes, int * seeds, int count, int * received, int * offset)
+{
+	noPollMsg           * msg;
+	const unsigned char * payload;
+	int                   length;
+	int                   iterator;
+
+	while ((msg = nopoll_conn_get_msg (conn)) != NULL) {
+		payload = nopoll_msg_get_payload (msg);
+		length  = nopoll_msg_get_payload_size (msg);
+
+		if ((*received) >= count || (*offset) + length > sizes[*received]) {
+			printf ("ERROR: received unexpected content (message %d, offset %d, length %d)..\n", *received, *offset, length);
+			return nopoll_false;
+		} /* end if */
+		for (iterator = 0; iterator < length; iterator++) {
+			if (payload[iterator] != (unsigned char) ((seeds[*received] + *offset + iterator) % 251)) {
+				printf ("ERROR: wrong content found at message %d, position %d..\n", *received, *offset + iterator);
+				return nopoll_false;
+			} /* end if */
+		} /* end for */
+		nopoll_msg_unref (msg);
+
+		(*offset) += length;
+		if ((*offset) == sizes[*received]) {
+			(*offset) = 0;
+			(*received)++;
+		} /* end if */
+	} /* end while */
+
+	return nopoll_true;
+}
+
+nopoll_bool test_45 (void) {
+	noPollCtx      * ctx;
+	noPollConn     * master;
+	noPollConn     * clients[4];
+	noPollConn     * listeners[4];
+	noPollFrame    * frame, * frame2;
+	char           * content;
+	int              sizes[3];
+	int              seeds[3]   = {7, 1, 3};
+	int              received[4];
+	int              offset[4];
+	int              iterator;
+	int              iterator2;
+	nopoll_bool      ready;
+
+	ctx = create_ctx ();
+
+	master = nopoll_listener_new (ctx, "0.0.0.0", "22356");
+	if (! nopoll_conn_is_ok (master)) {
+		printf ("ERROR: expected proper master listener at 0.0.0.0:22356 creation but a failure was found..\n");
+		return nopoll_false;
+	} /* end if */
+
+	for (iterator = 0; iterator < 4; iterator++) {
+		clients[iterator] = nopoll_conn_new (ctx, "localhost", "22356", NULL, NULL, NULL, NULL);
+		listeners[iterator] = nopoll_conn_accept (ctx, master);
+		if (! nopoll_conn_is_ok (clients[iterator]) || ! nopoll_conn_is_ok (listeners[iterator])) {
+			printf ("ERROR: expected proper connection %d..\n", iterator);
+			return nopoll_false;
+		} /* end if */
+		received[iterator] = 0;
+		offset[iterator]   = 0;
+	} /* end for */
+
+	/* complete handshakes */
+	iterator2 = 0;
+	ready     = nopoll_false;
+	while (! ready) {
+		ready = nopoll_true;
+		for (iterator = 0; iterator < 4; iterator++) {
+			nopoll_conn_get_msg (listeners[iterator]);
+			nopoll_conn_get_msg (clients[iterator]);
+			ready = ready && nopoll_conn_is_ready (listeners[iterator]) && nopoll_conn_is_ready (clients[iterator]);
+		} /* end for */
+		nopoll_sleep (1000);
+		if (iterator2++ > 5000) {
+			printf ("ERROR: expected connections ready..\n");
+			return nopoll_false;
+		} /* end if */
+	} /* end while */
+
+	/* flood first connection so it has content pending */
+	sizes[0] = 8 * 1024 * 1024;
+	content  = nopoll_new (char, sizes[0]);
+	for (iterator = 0; iterator < sizes[0]; iterator++)
+		content[iterator] = (char) ((seeds[0] + iterator) % 251);
+	nopoll_conn_set_sock_block (nopoll_conn_socket (listeners[0]), nopoll_false);
+	nopoll_conn_send_binary (listeners[0], content, sizes[0]);
+	if (nopoll_conn_pending_write_bytes (listeners[0]) == 0) 
+		printf ("Test 45: WARNING: expected pending bytes on first connection..\n");
+
+	/* prepared frames: not allowed on client connections */
+	sizes[1] = 65536;
+	for (iterator = 0; iterator < sizes[1]; iterator++)
+		content[iterator] = (char) ((seeds[1] + iterator) % 251);
+	frame = nopoll_frame_new (NOPOLL_BINARY_FRAME, nopoll_true, content, sizes[1]);
+	if (nopoll_frame_get_size (frame) != sizes[1] + 10) {
+		printf ("ERROR: expected frame size %d but found %d..\n", sizes[1] + 10, nopoll_frame_get_size (frame));
+		return nopoll_false;
+	} /* end if */
+	if (nopoll_conn_send_prepared (clients[0], frame) != -1) {
+		printf ("ERROR: expected failure sending prepared frame over a client connection..\n");
+		return nopoll_false;
+	} /* end if */
+
+	sizes[2] = 100;
+	for (iterator = 0; iterator < sizes[2]; iterator++)
+		content[iterator] = (char) ((seeds[2] + iterator) % 251);
+	frame2 = nopoll_frame_new (NOPOLL_BINARY_FRAME, nopoll_true, content, sizes[2]);
+	nopoll_free (content);
+
+	/* broadcast both frames to the 4 listener connections */
+	if (nopoll_ctx_broadcast (ctx, frame) != 4 || nopoll_ctx_broadcast (ctx, frame2) != 4) {
+		printf ("ERROR: expected broadcast to reach 4 connections..\n");
+		return nopoll_false;
+	} /* end if */
+	printf ("Test 45: frames broadcasted (references: %d, %d, pending bytes: %d)\n",
+		nopoll_frame_ref_count (frame), nopoll_frame_ref_count (frame2), nopoll_conn_pending_write_bytes (listeners[0]));
+
+	/* connections not watched by a loop only get frames queued
+	 * (a slow one must not stall the broadcast) */
+	if (nopoll_conn_pending_write_bytes (listeners[1]) != nopoll_frame_get_size (frame) + nopoll_frame_get_size (frame2)) {
+		printf ("ERROR: expected broadcast frames queued on unwatched connection (pending: %d)..\n",
+			nopoll_conn_pending_write_bytes (listeners[1]));
+		return nopoll_false;
+	} /* end if */
+
+	/* release our references: queued frames are kept by connections */
+	nopoll_frame_unref (frame2);
+
+	/* read everything */
+	iterator2 = 0;
+	ready     = nopoll_false;
+	while (! ready && iterator2 < 10000) {
+		ready = nopoll_true;
+		for (iterator = 0; iterator < 4; iterator++) {
+			if (! test_45_read (clients[iterator], iterator == 0 ? sizes : sizes + 1, iterator == 0 ? seeds : seeds + 1,
+					    iterator == 0 ? 3 : 2, &received[iterator], &offset[iterator]))
+				return nopoll_false;
+			nopoll_conn_complete_pending_write (listeners[iterator]);
+			ready = ready && (received[iterator] == (iterator == 0 ? 3 : 2));
+		} /* end for */
+		nopoll_sleep (1000);
+		iterator2++;
+	} /* end while */
+
+	if (! ready) {
+		printf ("ERROR: expected all content received (received: %d %d %d %d)..\n",
+			received[0], received[1], received[2], received[3]);
+		return nopoll_false;
+	} /* end if */
+
+	if (nopoll_frame_ref_count (frame) != 1 || nopoll_conn_pending_write_bytes (listeners[0]) != 0) {
+		printf ("ERROR: expected frame released by all connections (refs: %d, pending: %d)..\n",
+			nopoll_frame_ref_count (frame), nopoll_conn_pending_write_bytes (listeners[0]));
+		return nopoll_false;
+	} /* end if */
+	nopoll_frame_unref (frame);
+
+	for (iterator = 0; iterator < 4; iterator++) {
+		nopoll_conn_close (clients[iterator]);
+		nopoll_conn_close (listeners[iterator]);
+	} /* end for */
+	nopoll_conn_close (master);
+	nopoll_ctx_unref (ctx);
+
+	return nopoll_true;
+}
+
+long test_46_send_time  = -1;
+int  test_46_pending    = 0;
+long test_46_close_time = -1;
+
+void test_46_on_msg (noPollCtx * ctx, noPollConn * conn, noPollMsg * msg, noPollPtr user_data)
+{
+	struct timeval   start, stop, diff;
+	char           * content;
+	int              size = 16 * 1024 * 1024;
+	int              iterator;
+
+	if (! nopoll_cmp ((const char *) nopoll_msg_get_payload (msg), "big") &&
+	    ! nopoll_cmp ((const char *) nopoll_msg_get_payload (msg), "big-close")) {
+		/* echo */
+		nopoll_conn_send_text (conn, (const char *) nopoll_msg_get_payload (msg), nopoll_msg_get_payload_size (msg));
+		return;
+	} /* end if */
+
+	/* reply with content bigger than socket buffers to a peer
+	 * that is not reading: the send must not block the loop */
+	content = nopoll_new (char, size);
+	for (iterator = 0; iterator < size; iterator++)
+		content[iterator] = (char) ((5 + iterator) % 251);
+
+	gettimeofday (&start, NULL);
+	nopoll_conn_send_binary (conn, content, size);
+	gettimeofday (&stop, NULL);
+	nopoll_timeval_substract (&stop, &start, &diff);
+	nopoll_free (content);
+
+	if (nopoll_cmp ((const char *) nopoll_msg_get_payload (msg), "big-close")) {
+		/* close with the reply queued: the loop writes it
+		 * and finishes the close */
+		gettimeofday (&start, NULL);
+		nopoll_conn_close (conn);
+		gettimeofday (&stop, NULL);
+		nopoll_timeval_substract (&stop, &start, &diff);
+		test_46_close_time = (diff.tv_sec * 1000000) + diff.tv_usec;
+		return;
+	} /* end if */
+
+	test_46_pending   = nopoll_conn_pending_write_bytes (conn);
+	test_46_send_time = (diff.tv_sec * 1000000) + diff.tv_usec;
+	return;
+}
+
+nopoll_bool test_46_engine (const char * label, noPollIoEngineType engine_type) {
+	noPollCtx      * ctx;
+	noPollCtx      * client_ctx;
+	noPollConn     * listener;
+	noPollConn     * conn;
+	noPollConn     * conn2;
+	noPollMsg      * msg;
+	pthread_t        thread;
+	int              sizes[1] = {16 * 1024 * 1024};
+	int              seeds[1] = {5};
+	int              received = 0;
+	int              offset   = 0;
+	int              iterator;
+	int              iterator2;
+
+	test_46_send_time  = -1;
+	test_46_pending    = 0;
+	test_46_close_time = -1;
+
+	ctx = create_ctx ();
+	nopoll_ctx_set_io_engine (ctx, engine_type);
+	nopoll_ctx_set_on_msg (ctx, test_46_on_msg, NULL);
+	listener = nopoll_listener_new (ctx, "0.0.0.0", "22357");
+	if (! nopoll_conn_is_ok (listener)) {
+		printf ("ERROR: expected proper listener creation..\n");
+		return nopoll_false;
+	} /* end if */
+
+	if (pthread_create (&thread, NULL, test_42_run, ctx) != 0) {
+		printf ("ERROR: failed to create thread..\n");
+		return nopoll_false;
+	} /* end if */
+
+	client_ctx = create_ctx ();
+	conn  = nopoll_conn_new (client_ctx, "localhost", "22357", NULL, NULL, NULL, NULL);
+	conn2 = nopoll_conn_new (client_ctx, "localhost", "22357", NULL, NULL, NULL, NULL);
+	if (! nopoll_conn_wait_until_connection_ready (conn, 5) || ! nopoll_conn_wait_until_connection_ready (conn2, 5)) {
+		printf ("ERROR: expected connections ready..\n");
+		return nopoll_false;
+	} /* end if */
+
+	/* request the big reply without reading it */
+	nopoll_conn_send_text (conn, "big", 3);
+	iterator = 0;
+	while (test_46_send_time < 0 && iterator < 500) {
+		nopoll_sleep (10000);
+		iterator++;
+	} /* end while */
+	if (test_46_send_time < 0 || test_46_send_time > 1000000 || test_46_pending == 0) {
+		printf ("ERROR: expected send returning without waiting with content queued using %s engine (took %ld us, pending: %d)..\n",
+			label, test_46_send_time, test_46_pending);
+		return nopoll_false;
+	} /* end if */
+
+	/* the loop keeps serving other connections */
+	for (iterator = 0; iterator < 10; iterator++) {
+		nopoll_conn_send_text (conn2, "ping", 4);
+		msg = NULL;
+		iterator2 = 0;
+		while (msg == NULL && iterator2 < 1000) {
+			msg = nopoll_conn_get_msg (conn2);
+			if (msg == NULL)
+				nopoll_sleep (1000);
+			iterator2++;
+		} /* end while */
+		if (msg == NULL || ! nopoll_cmp ((const char *) nopoll_msg_get_payload (msg), "ping")) {
+			printf ("ERROR: expected echo %d while a reply is queued using %s engine..\n", iterator, label);
+			return nopoll_false;
+		} /* end if */
+		nopoll_msg_unref (msg);
+	} /* end for */
+
+	/* now read the reply, written by the loop as it is consumed */
+	iterator = 0;
+	while (received < 1 && iterator < 10000) {
+		if (! test_45_read (conn, sizes, seeds, 1, &received, &offset))
+			return nopoll_false;
+		nopoll_sleep (1000);
+		iterator++;
+	} /* end while */
+
+	if (received != 1) {
+		printf ("ERROR: expected big reply received using %s engine (offset %d)..\n", label, offset);
+		return nopoll_false;
+	} /* end if */
+	printf ("Test 46: send returned after %ld us with %d bytes queued, flushed by the loop using %s engine\n",
+		test_46_send_time, test_46_pending, label);
+
+	/* now the handler closes with the reply queued: the close
+	 * must not block the loop and the reply must arrive whole */
+	received = 0;
+	offset   = 0;
+	nopoll_conn_send_text (conn, "big-close", 9);
+	iterator = 0;
+	while (received < 1 && iterator < 10000) {
+		if (! test_45_read (conn, sizes, seeds, 1, &received, &offset))
+			return nopoll_false;
+		nopoll_sleep (1000);
+		iterator++;
+	} /* end while */
+	if (received != 1 || test_46_close_time < 0 || test_46_close_time > 1000000) {
+		printf ("ERROR: expected close returning without waiting and reply received using %s engine (took %ld us, offset %d)..\n",
+			label, test_46_close_time, offset);
+		return nopoll_false;
+	} /* end if */
+
+	/* and the close finished once the reply was written */
+	iterator = 0;
+	while (nopoll_conn_is_ok (conn) && iterator < 5000) {
+		nopoll_conn_get_msg (conn);
+		nopoll_sleep (1000);
+		iterator++;
+	} /* end while */
+	if (nopoll_conn_is_ok (conn)) {
+		printf ("ERROR: expected connection closed by the listener using %s engine..\n", label);
+		return nopoll_false;
+	} /* end if */
+	printf ("Test 46: close returned after %ld us with the reply queued, finished by the loop using %s engine\n",
+		test_46_close_time, label);
+
+	nopoll_loop_stop (ctx);
+	pthread_join (thread, NULL);
+
+	nopoll_conn_close (conn);
+	nopoll_conn_close (conn2);
+	nopoll_ctx_unref (client_ctx);
+
+	nopoll_conn_close (listener);
+	nopoll_ctx_unref (ctx);
+
+	return nopoll_true;
+}
+
+nopoll_bool test_46 (void) {
+
+	if (! test_each_engine (test_46_engine))
+		return nopoll_false;
+
+	return nopoll_true;
+}
+
+int test_47_blocked  = 0;
+int test_47_drained  = 0;
+int test_47_sent[200];
+int test_47_sent_length = 0;
+int test_47_dropped  = 0;
+int test_47_done     = 0;
+
+void test_47_on_write_blocked (noPollCtx * ctx, noPollConn * conn, noPollPtr user_data)
+{
+	test_47_blocked++;
+	return;
+}
+
+void test_47_on_write_drained (noPollCtx * ctx, noPollConn * conn, noPollPtr user_data)
+{
+	test_47_drained++;
+	return;
+}
+
+void test_47_on_msg (noPollCtx * ctx, noPollConn * conn, noPollMsg * msg, noPollPtr user_data)
+{
+	char * content;
+	int    iterator;
+	int    iterator2;
+
+	/* flood the connection with 200 messages of 64k (bigger
+	 * than socket buffers) */
+	if (nopoll_cmp ((const char *) nopoll_msg_get_payload (msg), "coalesce"))
+		nopoll_conn_set_write_limit (conn, 2 * 1024 * 1024, NOPOLL_WRITE_LIMIT_COALESCE);
+
+	test_47_sent_length = 0;
+	test_47_dropped     = 0;
+	content = nopoll_new (char, 65536);
+	for (iterator = 0; iterator < 200; iterator++) {
+		for (iterator2 = 0; iterator2 < 65536; iterator2++)
+			content[iterator2] = (char) ((iterator + iterator2) % 251);
+		if (nopoll_conn_send_binary (conn, content, 65536) == -1) {
+			if (errno == NOPOLL_ENOBUFS)
+				test_47_dropped++;
+			continue;
+		} /* end if */
+		test_47_sent[test_47_sent_length++] = iterator;
+	} /* end for */
+	nopoll_free (content);
+
+	test_47_done = 1;
+	return;
+}
+
+nopoll_bool test_47_read (noPollConn * conn, int * ids, int * received, int * offset)
+{
+	noPollMsg           * msg;
+	const unsigned char * payload;
+	int                   length;
+	int                   iterator;
+
+	while ((msg = nopoll_conn_get_msg (conn)) != NULL) {
+		payload = nopoll_msg_get_payload (msg);
+		length  = nopoll_msg_get_payload_size (msg);
+
+		/* message id is found at the first byte */
+		if ((*offset) == 0 && (*received) < 200)
+			ids[*received] = payload[0];
+		if ((*received) >= 200 || (*offset) + length > 65536) {
+			printf ("ERROR: received unexpected content (message %d, offset %d, length %d)..\n", *received, *offset, length);
+			return nopoll_false;
+		} /* end if */
+		for (iterator = 0; iterator < length; iterator++) {
+			if (payload[iterator] != (unsigned char) ((ids[*received] + *offset + iterator) % 251)) {
+				printf ("ERROR: wrong content found at message %d, position %d..\n", *received, *offset + iterator);
+				return nopoll_false;
+			} /* end if */
+		} /* end for */
+		nopoll_msg_unref (msg);
+
+		(*offset) += length;
+		if ((*offset) == 65536) {
+			(*offset) = 0;
+			(*received)++;
+		} /* end if */
+	} /* end while */
+
+	return nopoll_true;
+}
+
+nopoll_bool test_47_flood (noPollCtx * ctx, const char * request, nopoll_bool coalesce)
+{
+	noPollConn     * conn;
+	int              ids[200];
+	int              received = 0;
+	int              offset   = 0;
+	int              iterator;
+
+	test_47_blocked = 0;
+	test_47_drained = 0;
+	test_47_done    = 0;
+
+	conn = nopoll_conn_new (ctx, "localhost", "22358", NULL, NULL, NULL, NULL);
+	if (! nopoll_conn_wait_until_connection_ready (conn, 5)) {
+		printf ("ERROR: expected connection ready..\n");
+		return nopoll_false;
+	} /* end if */
+
+	/* request the flood without reading it */
+	nopoll_conn_send_text (conn, request, strlen (request));
+	iterator = 0;
+	while (! test_47_done && iterator < 1000) {
+		nopoll_sleep (10000);
+		iterator++;
+	} /* end while */
+	/* coalescing shrinks the queue under the low watermark, so
+	 * blocked and drained notifications may be repeated (and the
+	 * last replacement may drain it) */
+	if (! test_47_done || test_47_blocked < 1 || test_47_drained < test_47_blocked - 1 || test_47_drained > test_47_blocked ||
+	    (coalesce ? test_47_dropped != 0 : (test_47_blocked != 1 || test_47_drained != 0 || test_47_dropped == 0))) {
+		printf ("ERROR: expected write blocked and messages dropped (done: %d, blocked: %d, drained: %d, dropped: %d)..\n",
+			test_47_done, test_47_blocked, test_47_drained, test_47_dropped);
+		return nopoll_false;
+	} /* end if */
+
+	/* read everything */
+	iterator = 0;
+	while (iterator < 10000) {
+		if (! test_47_read (conn, ids, &received, &offset))
+			return nopoll_false;
+		if (test_47_drained == test_47_blocked && offset == 0 && received > 0 &&
+		    (coalesce ? ids[received - 1] == 199 : received == test_47_sent_length))
+			break;
+		nopoll_sleep (1000);
+		iterator++;
+	} /* end while */
+
+	if (test_47_drained != test_47_blocked) {
+		printf ("ERROR: expected write drained notification (blocked: %d, drained: %d)..\n", test_47_blocked, test_47_drained);
+		return nopoll_false;
+	} /* end if */
+
+	if (coalesce) {
+		/* messages replaced are reported as sent: check the
+		 * last one is received and order is kept */
+		if (received < 2 || ids[received - 1] != 199) {
+			printf ("ERROR: expected last message received after coalescing (received: %d)..\n", received);
+			return nopoll_false;
+		} /* end if */
+		for (iterator = 1; iterator < received; iterator++) {
+			if (ids[iterator] <= ids[iterator - 1]) {
+				printf ("ERROR: expected messages received in order (position %d)..\n", iterator);
+				return nopoll_false;
+			} /* end if */
+		} /* end for */
+	} else {
+		/* messages not dropped are received in order */
+		if (received != test_47_sent_length) {
+			printf ("ERROR: expected %d messages received but found %d..\n", test_47_sent_length, received);
+			return nopoll_false;
+		} /* end if */
+		for (iterator = 0; iterator < received; iterator++) {
+			if (ids[iterator] != test_47_sent[iterator]) {
+				printf ("ERROR: expected message %d at position %d but found %d..\n", test_47_sent[iterator], iterator, ids[iterator]);
+				return nopoll_false;
+			} /* end if */
+		} /* end for */
+	} /* end if */
+
+	printf ("Test 47: %s: %d messages received (dropped: %d, blocked: %d)\n", request, received, test_47_dropped, test_47_blocked);
+
+	nopoll_conn_close (conn);
+	return nopoll_true;
+}
+
+nopoll_bool test_47 (void) {
+	noPollCtx      * ctx;
+	noPollCtx      * client_ctx;
+	noPollConnOpts * opts;
+	noPollConn     * listener;
+	pthread_t        thread;
+
+	ctx = create_ctx ();
+	nopoll_ctx_set_on_msg (ctx, test_47_on_msg, NULL);
+	nopoll_ctx_set_on_write_blocked (ctx, test_47_on_write_blocked, NULL);
+	nopoll_ctx_set_on_write_drained (ctx, test_47_on_write_drained, NULL);
+
+	/* defaults for accepted connections */
+	opts = nopoll_conn_opts_new ();
+	nopoll_conn_opts_set_write_watermarks (opts, 1024 * 1024, 256 * 1024);
+	nopoll_conn_opts_set_write_limit (opts, 2 * 1024 * 1024, NOPOLL_WRITE_LIMIT_DROP);
+	listener = nopoll_listener_new_opts (ctx, opts, "0.0.0.0", "22358");
+	if (! nopoll_conn_is_ok (listener)) {
+		printf ("ERROR: expected proper listener creation..\n");
+		return nopoll_false;
+	} /* end if */
+
+	if (pthread_create (&thread, NULL, test_42_run, ctx) != 0) {
+		printf ("ERROR: failed to create thread..\n");
+		return nopoll_false;
+	} /* end if */
+
+	client_ctx = create_ctx ();
+	if (! test_47_flood (client_ctx, "drop", nopoll_false))
+		return nopoll_false;
+	if (! test_47_flood (client_ctx, "coalesce", nopoll_true))
+		return nopoll_false;
+
+	nopoll_loop_stop (ctx);
+	pthread_join (thread, NULL);
+
+	nopoll_ctx_unref (client_ctx);
+	nopoll_conn_close (listener);
+	nopoll_ctx_unref (ctx);
+
+	return nopoll_true;
+}
+
+noPollMsg * test_48_echo (noPollConn * conn, const char * content, int length)
+{
+	noPollMsg * msg;
+	int         iter;
+
+	if (nopoll_conn_send_text (conn, content, length) != length) {
+		printf ("ERROR: Expected to find proper send operation..\n");
+		return NULL;
+	} /* end if */
+
+	/* wait for the reply */
+	iter = 0;
+	while ((msg = nopoll_conn_get_msg (conn)) == NULL) {
+		if (! nopoll_conn_is_ok (conn) || iter > 500) {
+			printf ("ERROR: reply not received..\n");
+			return NULL;
+		} /* end if */
+		nopoll_sleep (10000);
+		iter++;
+	} /* end while */
+
+	/* check content received */
+	if (nopoll_msg_get_payload_size (msg) != length ||
+	    memcmp (nopoll_msg_get_payload (msg), content, length) ||
+	    nopoll_msg_get_payload (msg)[length] != 0) {
+		printf ("ERROR: expected to receive the echo of %d bytes but found %d bytes..\n", length, nopoll_msg_get_payload_size (msg));
+		nopoll_msg_unref (msg);
+		return NULL;
+	} /* end if */
+
+	return msg;
+}
+
+nopoll_bool test_48 (void) {
+	noPollCtx  * ctx;
+	noPollConn * conn;
+	noPollMsg  * msg;
+	noPollMsg  * msg2;
+	char         content[1024];
+	int          inline_size;
+	int          iterator;
+
+	ctx = create_ctx ();
+	if (nopoll_ctx_get_msg_pool (ctx, &inline_size) != NOPOLL_MSG_POOL_SIZE || inline_size != NOPOLL_MSG_INLINE_SIZE) {
+		printf ("ERROR: expected default message pool configuration..\n");
+		return nopoll_false;
+	} /* end if */
+
+	conn = nopoll_conn_new (ctx, "localhost", "1234", NULL, NULL, NULL, NULL);
+	if (! nopoll_conn_wait_until_connection_ready (conn, 5)) {
+		printf ("ERROR: expected connection ready..\n");
+		return nopoll_false;
+	} /* end if */
+
+	for (iterator = 0; iterator < (int) sizeof (content); iterator++)
+		content[iterator] = 'a' + (iterator % 26);
+
+	/* released messages are reused (inline and allocated
+	 * payloads) */
+	msg = test_48_echo (conn, content, 100);
+	if (msg == NULL)
+		return nopoll_false;
+	nopoll_msg_unref (msg);
+	for (iterator = 0; iterator < 10; iterator++) {
+		msg2 = test_48_echo (conn, content, iterator % 2 ? 1000 : 256);
+		if (msg2 != msg) {
+			printf ("ERROR: expected to reuse message released (%p != %p)..\n", msg2, msg);
+			return nopoll_false;
+		} /* end if */
+		nopoll_msg_unref (msg2);
+	} /* end for */
+
+	/* messages hold a context reference */
+	msg = test_48_echo (conn, content, 10);
+	if (msg == NULL)
+		return nopoll_false;
+	if (nopoll_ctx_ref_count (ctx) != 3) {
+		printf ("ERROR: expected 3 context references but found %d..\n", nopoll_ctx_ref_count (ctx));
+		return nopoll_false;
+	} /* end if */
+
+	/* disable pool: message held is released on unref */
+	nopoll_ctx_set_msg_pool (ctx, 0, 0);
+	msg2 = test_48_echo (conn, content, 200);
+	if (msg2 == NULL || msg2 == msg)
+		return nopoll_false;
+	nopoll_msg_unref (msg2);
+
+	/* join works with both storages */
+	msg2 = nopoll_msg_join (msg, msg);
+	if (nopoll_msg_get_payload_size (msg2) != 20 || memcmp (nopoll_msg_get_payload (msg2) + 10, content, 10)) {
+		printf ("ERROR: expected joined message..\n");
+		return nopoll_false;
+	} /* end if */
+	nopoll_msg_unref (msg2);
+
+	nopoll_conn_close (conn);
+	nopoll_ctx_unref (ctx);
+
+	/* context is released with last message */
+	if (! nopoll_cmp ((const char *) nopoll_msg_get_payload (msg), "abcdefghij")) {
+		printf ("ERROR: expected message content..\n");
+		return nopoll_false;
+	} /* end if */
+	nopoll_msg_unref (msg);
+
+	return nopoll_true;
+}
+
+noPollPtr test_49_refs (noPollPtr data)
+{
+	noPollPtr * objects = (noPollPtr *) data;
+	int         iterator;
+
+	for (iterator = 0; iterator < 100000; iterator++) {
+		nopoll_msg_ref (objects[0]);
+		nopoll_conn_ref (objects[1]);
+		nopoll_ctx_ref (objects[2]);
+		nopoll_frame_ref (objects[3]);
+		nopoll_conn_opts_ref (objects[4]);
+
+		nopoll_msg_unref (objects[0]);
+		nopoll_conn_unref (objects[1]);
+		nopoll_ctx_unref (objects[2]);
+		nopoll_frame_unref (objects[3]);
+		nopoll_conn_opts_unref (objects[4]);
+	} /* end for */
+
+	return NULL;
+}
+
+nopoll_bool test_49 (void) {
+	noPollCtx      * ctx;
+	noPollConn     * conn;
+	noPollMsg      * msg;
+	noPollFrame    * frame;
+	noPollConnOpts * opts;
+	noPollPtr        objects[5];
+	pthread_t        threads[4];
+	int              iterator;
+	int              conn_refs;
+
+	ctx   = create_ctx ();
+	conn  = nopoll_conn_new (ctx, "localhost", "1234", NULL, NULL, NULL, NULL);
+	if (! nopoll_conn_wait_until_connection_ready (conn, 5)) {
+		printf ("ERROR: expected connection ready..\n");
+		return nopoll_false;
+	} /* end if */
+	msg   = test_48_echo (conn, "This is a test", 14);
+	frame = nopoll_frame_new (NOPOLL_TEXT_FRAME, nopoll_true, "This is a test", 14);
+	opts  = nopoll_conn_opts_new ();
+	if (msg == NULL || frame == NULL || opts == NULL)
+		return nopoll_false;
+
+	/* update references concurrently */
+	conn_refs  = nopoll_conn_ref_count (conn);
+	objects[0] = msg;
+	objects[1] = conn;
+	objects[2] = ctx;
+	objects[3] = frame;
+	objects[4] = opts;
+	for (iterator = 0; iterator < 4; iterator++) {
+		if (pthread_create (&threads[iterator], NULL, test_49_refs, objects) != 0) {
+			printf ("ERROR: failed to create thread..\n");
+			return nopoll_false;
+		} /* end if */
+	} /* end for */
+	for (iterator = 0; iterator < 4; iterator++)
+		pthread_join (threads[iterator], NULL);
+
+	/* message and connection hold a context reference */
+	if (nopoll_msg_ref_count (msg) != 1 || nopoll_conn_ref_count (conn) != conn_refs ||
+	    nopoll_ctx_ref_count (ctx) != 3 || nopoll_frame_ref_count (frame) != 1) {
+		printf ("ERROR: expected references to be kept (msg: %d, conn: %d, ctx: %d, frame: %d)..\n",
+			nopoll_msg_ref_count (msg), nopoll_conn_ref_count (conn), nopoll_ctx_ref_count (ctx), nopoll_frame_ref_count (frame));
+		return nopoll_false;
+	} /* end if */
+
+	nopoll_conn_opts_free (opts);
+	nopoll_frame_unref (frame);
+	nopoll_msg_unref (msg);
+	nopoll_conn_close (conn);
+	nopoll_ctx_unref (ctx);
+
+	return nopoll_true;
+}
+
+/* finds the connection and releases the reference acquired, only
+ * the pointer is checked */
+noPollConn * test_50_find (noPollCtx * ctx, int conn_id)
+{
+	noPollConn * conn = nopoll_ctx_find_conn_by_id (ctx, conn_id);
+
+	if (conn)
+		nopoll_conn_unref (conn);
+	return conn;
+}
+
+nopoll_bool test_50 (void) {
+	noPollCtx      * ctx;
+	noPollCtx      * listener_ctx;
+	noPollConn     * listener;
+	noPollConn     * conns[500];
+	int              ids[500];
+	int              iterator;
+	int              refs;
+	pthread_t        thread;
+
+	/* listener served by the loop on a thread */
+	listener_ctx = create_ctx ();
+	listener = nopoll_listener_new (listener_ctx, "0.0.0.0", "22359");
+	if (! nopoll_conn_is_ok (listener)) {
+		printf ("ERROR: expected proper listener creation..\n");
+		return nopoll_false;
+	} /* end if */
+	if (pthread_create (&thread, NULL, test_42_run, listener_ctx) != 0) {
+		printf ("ERROR: failed to create thread..\n");
+		return nopoll_false;
+	} /* end if */
+
+	ctx = create_ctx ();
+	if (test_50_find (ctx, 1) != NULL) {
+		printf ("ERROR: expected to not find connections on an empty context..\n");
+		return nopoll_false;
+	} /* end if */
+
+	for (iterator = 0; iterator < 500; iterator++) {
+		conns[iterator] = nopoll_conn_new (ctx, "localhost", "22359", NULL, NULL, NULL, NULL);
+		if (! nopoll_conn_wait_until_connection_ready (conns[iterator], 5)) {
+			printf ("ERROR: expected proper connection creation..\n");
+			return nopoll_false;
+		} /* end if */
+		ids[iterator] = nopoll_conn_get_id (conns[iterator]);
+	} /* end for */
+
+	/* close every other connection */
+	for (iterator = 0; iterator < 500; iterator += 2)
+		nopoll_conn_close (conns[iterator]);
+	if (nopoll_ctx_conns (ctx) != 250) {
+		printf ("ERROR: expected 250 connections registered but found %d..\n", nopoll_ctx_conns (ctx));
+		return nopoll_false;
+	} /* end if */
+
+	/* closed ones aren't found, the rest are */
+	for (iterator = 0; iterator < 500; iterator++) {
+		if (test_50_find (ctx, ids[iterator]) != (iterator % 2 ? conns[iterator] : NULL)) {
+			printf ("ERROR: unexpected result finding connection id %d..\n", ids[iterator]);
+			return nopoll_false;
+		} /* end if */
+	} /* end for */
+
+	/* slots released are reused */
+	for (iterator = 0; iterator < 500; iterator += 2) {
+		conns[iterator] = nopoll_conn_new (ctx, "localhost", "22359", NULL, NULL, NULL, NULL);
+		if (! nopoll_conn_wait_until_connection_ready (conns[iterator], 5)) {
+			printf ("ERROR: expected proper connection creation..\n");
+			return nopoll_false;
+		} /* end if */
+		ids[iterator]   = nopoll_conn_get_id (conns[iterator]);
+	} /* end for */
+	for (iterator = 0; iterator < 500; iterator++) {
+		if (test_50_find (ctx, ids[iterator]) != conns[iterator]) {
+			printf ("ERROR: expected to find connection id %d..\n", ids[iterator]);
+			return nopoll_false;
+		} /* end if */
+	} /* end for */
+	/* connections are returned with a reference acquired */
+	refs = nopoll_conn_ref_count (conns[1]);
+	if (nopoll_ctx_find_conn_by_id (ctx, ids[1]) != conns[1] || nopoll_conn_ref_count (conns[1]) != refs + 1) {
+		printf ("ERROR: expected a reference acquired on the connection found..\n");
+		return nopoll_false;
+	} /* end if */
+	nopoll_conn_unref (conns[1]);
+
+	if (nopoll_ctx_conns (ctx) != 500 || test_50_find (ctx, ids[498] + 1) != NULL) {
+		printf ("ERROR: expected 500 connections registered but found %d..\n", nopoll_ctx_conns (ctx));
+		return nopoll_false;
+	} /* end if */
+
+	for (iterator = 0; iterator < 500; iterator++)
+		nopoll_conn_close (conns[iterator]);
+	if (nopoll_ctx_conns (ctx) != 0) {
+		printf ("ERROR: expected no connections registered but found %d..\n", nopoll_ctx_conns (ctx));
+		return nopoll_false;
+	} /* end if */
+
+	nopoll_ctx_unref (ctx);
+
+	nopoll_loop_stop (listener_ctx);
+	pthread_join (thread, NULL);
+	nopoll_conn_close (listener);
+	nopoll_ctx_unref (listener_ctx);
+
+	return nopoll_true;
+}
+
+nopoll_bool test_51_close (noPollCtx * ctx, noPollConn * conn, noPollPtr user_data)
+{
+	int * count = user_data;
+
+	/* connections closed during the foreach remain valid */
+	if (! nopoll_conn_is_ok (conn) || test_50_find (ctx, nopoll_conn_get_id (conn)) != conn)
+		return nopoll_true;
+	(*count)++;
+	nopoll_conn_close (conn);
+	return nopoll_false;
+}
+
+nopoll_bool test_51_count (noPollCtx * ctx, noPollConn * conn, noPollPtr user_data)
+{
+	int * count = user_data;
+
+	if (nopoll_conn_get_id (conn) <= 0)
+		return nopoll_true;
+	(*count)++;
+	return nopoll_false;
+}
+
+nopoll_bool test_51_count_registered (noPollCtx * ctx, noPollConn * conn, noPollPtr user_data)
+{
+	int * count = user_data;
+
+	/* only registered connections are iterated */
+	if (! nopoll_conn_is_ok (conn) || test_50_find (ctx, nopoll_conn_get_id (conn)) != conn)
+		return nopoll_true;
+	(*count)++;
+	return nopoll_false;
+}
+
+int test_51_done = 0;
+
+noPollPtr test_51_iterate (noPollPtr user_data)
+{
+	noPollCtx * ctx = user_data;
+	int         count;
+
+	while (! test_51_done) {
+		count = 0;
+		if (nopoll_ctx_foreach_conn (ctx, test_51_count, &count) != NULL)
+			return user_data;
+	} /* end while */
+
+	return NULL;
+}
+
+nopoll_bool test_51 (void) {
+	noPollCtx      * ctx;
+	noPollConn     * conns[20];
+	int              iterator;
+	int              count;
+	pthread_t        threads[2];
+	noPollPtr        result;
+
+	ctx = create_ctx ();
+	for (iterator = 0; iterator < 20; iterator++) {
+		conns[iterator] = nopoll_conn_new (ctx, "localhost", "1234", NULL, NULL, NULL, NULL);
+		if (! nopoll_conn_wait_until_connection_ready (conns[iterator], 5)) {
+			printf ("ERROR: expected proper connection creation..\n");
+			return nopoll_false;
+		} /* end if */
+	} /* end for */
+
+	/* iterate from other threads while connections are closed
+	 * and created */
+	for (iterator = 0; iterator < 2; iterator++) {
+		if (pthread_create (&threads[iterator], NULL, test_51_iterate, ctx) != 0) {
+			printf ("ERROR: failed to create thread..\n");
+			return nopoll_false;
+		} /* end if */
+	} /* end for */
+	for (iterator = 0; iterator < 200; iterator++) {
+		nopoll_conn_close (conns[iterator % 20]);
+		conns[iterator % 20] = nopoll_conn_new (ctx, "localhost", "1234", NULL, NULL, NULL, NULL);
+		if (! nopoll_conn_wait_until_connection_ready (conns[iterator % 20], 5)) {
+			printf ("ERROR: expected proper connection creation..\n");
+			return nopoll_false;
+		} /* end if */
+	} /* end for */
+	test_51_done = 1;
+	for (iterator = 0; iterator < 2; iterator++) {
+		pthread_join (threads[iterator], &result);
+		if (result != NULL) {
+			printf ("ERROR: found invalid connection while iterating..\n");
+			return nopoll_false;
+		} /* end if */
+	} /* end for */
+
+	count = 0;
+	nopoll_ctx_foreach_conn (ctx, test_51_count, &count);
+	if (count != 20) {
+		printf ("ERROR: expected to iterate over 20 connections but found %d..\n", count);
+		return nopoll_false;
+	} /* end if */
+
+	/* registry changes without foreach in progress (snapshot
+	 * updated in place) */
+	for (iterator = 0; iterator < 40; iterator++) {
+		nopoll_conn_close (conns[(iterator * 7) % 20]);
+		count = 0;
+		if (nopoll_ctx_foreach_conn (ctx, test_51_count_registered, &count) != NULL || count != 19) {
+			printf ("ERROR: expected to iterate over 19 connections but found %d..\n", count);
+			return nopoll_false;
+		} /* end if */
+
+		conns[(iterator * 7) % 20] = nopoll_conn_new (ctx, "localhost", "1234", NULL, NULL, NULL, NULL);
+		if (! nopoll_conn_wait_until_connection_ready (conns[(iterator * 7) % 20], 5)) {
+			printf ("ERROR: expected proper connection creation..\n");
+			return nopoll_false;
+		} /* end if */
+		count = 0;
+		if (nopoll_ctx_foreach_conn (ctx, test_51_count_registered, &count) != NULL || count != 20) {
+			printf ("ERROR: expected to iterate over 20 connections but found %d..\n", count);
+			return nopoll_false;
+		} /* end if */
+	} /* end for */
+
+	/* close all connections from the foreach */
+	count = 0;
+	nopoll_ctx_foreach_conn (ctx, test_51_close, &count);
+	if (count != 20 || nopoll_ctx_conns (ctx) != 0) {
+		printf ("ERROR: expected to close 20 connections but found %d (registered: %d)..\n", count, nopoll_ctx_conns (ctx));
+		return nopoll_false;
+	} /* end if */
+
+	nopoll_ctx_unref (ctx);
+	return nopoll_true;
+}
+
+int test_52_logs[3];
+nopoll_bool test_52_format_ok = nopoll_true;
+
+void test_52_log (noPollCtx * ctx, noPollDebugLevel level, const char * log_msg, noPollPtr user_data)
+{
+	test_52_logs[level]++;
+
+	/* file:line prefix and message */
+	if (strstr (log_msg, ".c:") == NULL || log_msg[strlen (log_msg) - 1] != ' ')
+		test_52_format_ok = nopoll_false;
+	return;
+}
+
+nopoll_bool test_52_echo (noPollCtx * ctx)
+{
+	noPollConn * conn;
+	noPollMsg  * msg;
+
+	conn = nopoll_conn_new (ctx, "localhost", "1234", NULL, NULL, NULL, NULL);
+	if (! nopoll_conn_wait_until_connection_ready (conn, 5)) {
+		printf ("ERROR: expected connection ready..\n");
+		return nopoll_false;
+	} /* end if */
+	msg = test_48_echo (conn, "This is a test", 14);
+	if (msg == NULL)
+		return nopoll_false;
+	nopoll_msg_unref (msg);
+	nopoll_conn_close (conn);
+	return nopoll_true;
+}
+
+nopoll_bool test_52 (void) {
+	noPollCtx * ctx;
+
+	ctx = nopoll_ctx_new ();
+
+	/* nothing reported without handler or console log */
+	if (nopoll_log_is_level_enabled (ctx, NOPOLL_LEVEL_CRITICAL) || nopoll_log_get_level (ctx) != NOPOLL_LEVEL_DEBUG) {
+		printf ("ERROR: expected log disabled by default..\n");
+		return nopoll_false;
+	} /* end if */
+
+	/* only warnings and critical logs */
+	nopoll_log_set_handler (ctx, test_52_log, NULL);
+	nopoll_log_set_level (ctx, NOPOLL_LEVEL_WARNING);
+	if (nopoll_log_is_level_enabled (ctx, NOPOLL_LEVEL_DEBUG) || ! nopoll_log_is_level_enabled (ctx, NOPOLL_LEVEL_WARNING)) {
+		printf ("ERROR: expected debug level disabled..\n");
+		return nopoll_false;
+	} /* end if */
+	if (! test_52_echo (ctx))
+		return nopoll_false;
+	if (test_52_logs[NOPOLL_LEVEL_DEBUG] != 0) {
+		printf ("ERROR: expected no debug log but found %d..\n", test_52_logs[NOPOLL_LEVEL_DEBUG]);
+		return nopoll_false;
+	} /* end if */
+
+	/* all levels */
+	nopoll_log_set_level (ctx, NOPOLL_LEVEL_DEBUG);
+	if (! test_52_echo (ctx))
+		return nopoll_false;
+	if (test_52_logs[NOPOLL_LEVEL_DEBUG] == 0 || ! test_52_format_ok) {
+		printf ("ERROR: expected debug logs properly formated (found %d)..\n", test_52_logs[NOPOLL_LEVEL_DEBUG]);
+		return nopoll_false;
+	} /* end if */
+
+	/* removing handler disables log again */
+	nopoll_log_set_handler (ctx, NULL, NULL);
+	if (nopoll_log_is_level_enabled (ctx, NOPOLL_LEVEL_CRITICAL)) {
+		printf ("ERROR: expected log disabled..\n");
+		return nopoll_false;
+	} /* end if */
+
+	nopoll_ctx_unref (ctx);
+	return nopoll_true;
+}
+
+int             test_53_logs = 0;
+int             test_53_foreign = 0;
+pthread_t       test_53_main;
+
+void test_53_log (noPollCtx * ctx, noPollDebugLevel level, const char * log_msg, noPollPtr user_data)
+{
+	/* slow handler, called from the writer thread */
+	if (pthread_equal (pthread_self (), test_53_main))
+		test_53_foreign = -1;
+	else if (test_53_foreign == 0)
+		test_53_foreign = 1;
+	test_53_logs++;
+	nopoll_sleep (1000);
+	return;
+}
+
+int             test_53_stop = 0;
+
+void test_53_count (noPollCtx * ctx, noPollDebugLevel level, const char * log_msg, noPollPtr user_data)
+{
+	test_53_logs++;
+	return;
+}
+
+void * test_53_flood (void * user_data)
+{
+	noPollCtx * ctx = user_data;
+
+	while (! test_53_stop)
+		nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "flood log record");
+	return NULL;
+}
+
+nopoll_bool test_53 (void) {
+	noPollCtx * ctx;
+	pthread_t   thread;
+	int         iterator;
+	int         dropped;
+
+	ctx = nopoll_ctx_new ();
+	test_53_main = pthread_self ();
+	nopoll_log_set_handler (ctx, test_53_log, NULL);
+	if (! nopoll_log_set_async (ctx, 4)) {
+		printf ("ERROR: expected to enable asynchronous log..\n");
+		return nopoll_false;
+	} /* end if */
+
+	/* flood the ring */
+	for (iterator = 0; iterator < 200; iterator++)
+		nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "async log record %d", iterator);
+	dropped = nopoll_log_get_dropped (ctx);
+	if (dropped <= 0) {
+		printf ("ERROR: expected dropped logs (found %d)..\n", dropped);
+		return nopoll_false;
+	} /* end if */
+	printf ("Test 53: %d logs dropped\n", dropped);
+
+	/* disabling delivers pending records */
+	if (! nopoll_log_set_async (ctx, 0) || nopoll_log_get_dropped (ctx) != 0) {
+		printf ("ERROR: expected to disable asynchronous log..\n");
+		return nopoll_false;
+	} /* end if */
+	if (test_53_foreign != 1 || test_53_logs + dropped != 200) {
+		printf ("ERROR: expected logs delivered from writer thread (found %d, thread %d)..\n", test_53_logs, test_53_foreign);
+		return nopoll_false;
+	} /* end if */
+
+	/* synchronous again */
+	iterator = test_53_logs;
+	test_53_foreign = 0;
+	nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "sync log record");
+	if (test_53_logs != iterator + 1 || test_53_foreign != -1) {
+		printf ("ERROR: expected synchronous log..\n");
+		return nopoll_false;
+	} /* end if */
+
+	/* enabled and disabled while another thread logs */
+	nopoll_log_set_handler (ctx, test_53_count, NULL);
+	test_53_logs = 0;
+	test_53_stop = 0;
+	if (pthread_create (&thread, NULL, test_53_flood, ctx) != 0) {
+		printf ("ERROR: failed to create thread..\n");
+		return nopoll_false;
+	} /* end if */
+	for (iterator = 0; iterator < 50; iterator++) {
+		nopoll_log_set_async (ctx, (iterator % 2) ? 0 : 64);
+		nopoll_sleep (1000);
+	} /* end for */
+	test_53_stop = 1;
+	pthread_join (thread, NULL);
+	if (test_53_logs == 0) {
+		printf ("ERROR: expected logs delivered while asynchronous log was switched..\n");
+		return nopoll_false;
+	} /* end if */
+
+	/* released with pending records */
+	nopoll_log_set_async (ctx, 16);
+	nopoll_log (ctx, NOPOLL_LEVEL_DEBUG, "pending log record");
+	nopoll_ctx_unref (ctx);
+	return nopoll_true;
+}
+
+nopoll_bool test_54_collect (noPollCtx * ctx, noPollConn * conn, noPollPtr user_data)
+{
+	SSL_CTX ** ssl_ctxs = user_data;
+	int        iterator = 0;
+
+	/* collect ssl contexts used by accepted connections */
+	if (nopoll_conn_role (conn) != NOPOLL_ROLE_LISTENER)
+		return nopoll_false;
+	while (ssl_ctxs[iterator])
+		iterator++;
+	ssl_ctxs[iterator] = conn->ssl_ctx;
+	return nopoll_false;
+}
+
+noPollConn * test_54_connect (noPollCtx * ctx)
+{
+	noPollConnOpts * opts;
+	noPollConn     * conn;
+
+	opts = nopoll_conn_opts_new ();
+	nopoll_conn_opts_ssl_peer_verify (opts, nopoll_false);
+	conn = nopoll_conn_tls_new (ctx, opts, "localhost", "22360", NULL, NULL, NULL, NULL);
+	if (! nopoll_conn_wait_until_connection_ready (conn, 5)) {
+		printf ("ERROR: expected TLS connection ready..\n");
+		return NULL;
+	} /* end if */
+	return conn;
+}
+
+nopoll_bool test_54 (void) {
+	noPollCtx      * ctx;
+	noPollCtx      * listener_ctx;
+	noPollConn     * listener;
+	noPollConn     * conns[5];
+	SSL_CTX        * ssl_ctxs[6];
+	SSL_CTX        * shared;
+	int              iterator;
+	int              renewed;
+	pthread_t        thread;
+
+	/* TLS listener served by the loop on a thread */
+	listener_ctx = create_ctx ();
+	listener = nopoll_listener_tls_new (listener_ctx, "0.0.0.0", "22360");
+	if (! nopoll_conn_is_ok (listener) || ! nopoll_listener_set_certificate (listener, "server.pem", "server.pem", NULL)) {
+		printf ("ERROR: expected proper TLS listener creation..\n");
+		return nopoll_false;
+	} /* end if */
+	if (pthread_create (&thread, NULL, test_42_run, listener_ctx) != 0) {
+		printf ("ERROR: failed to create thread..\n");
+		return nopoll_false;
+	} /* end if */
+
+	ctx = create_ctx ();
+	for (iterator = 0; iterator < 4; iterator++) {
+		conns[iterator] = test_54_connect (ctx);
+		if (conns[iterator] == NULL)
+			return nopoll_false;
+	} /* end for */
+
+	/* all connections share the same ssl context */
+	memset (ssl_ctxs, 0, sizeof (ssl_ctxs));
+	nopoll_ctx_foreach_conn (listener_ctx, test_54_collect, ssl_ctxs);
+	shared = ssl_ctxs[0];
+	for (iterator = 0; iterator < 4; iterator++) {
+		if (ssl_ctxs[iterator] == NULL || ssl_ctxs[iterator] != shared) {
+			printf ("ERROR: expected shared ssl context (found %p and %p)..\n", ssl_ctxs[iterator], shared);
+			return nopoll_false;
+		} /* end if */
+	} /* end for */
+	if (listener_ctx->ssl_ctx_cache == NULL || listener_ctx->ssl_ctx_cache->next != NULL) {
+		printf ("ERROR: expected one ssl context cached..\n");
+		return nopoll_false;
+	} /* end if */
+
+	/* certificate reload: new connections use a new context */
+	nopoll_ctx_invalidate_ssl_contexts (listener_ctx, listener);
+	if (listener_ctx->ssl_ctx_cache != NULL) {
+		printf ("ERROR: expected ssl context cache empty..\n");
+		return nopoll_false;
+	} /* end if */
+	conns[4] = test_54_connect (ctx);
+	if (conns[4] == NULL)
+		return nopoll_false;
+	memset (ssl_ctxs, 0, sizeof (ssl_ctxs));
+	nopoll_ctx_foreach_conn (listener_ctx, test_54_collect, ssl_ctxs);
+	renewed = 0;
+	for (iterator = 0; iterator < 5; iterator++) {
+		if (ssl_ctxs[iterator] != shared && ssl_ctxs[iterator] == listener_ctx->ssl_ctx_cache->ssl_ctx)
+			renewed++;
+	} /* end for */
+	if (ssl_ctxs[4] == NULL || renewed != 1) {
+		printf ("ERROR: expected new ssl context after invalidation (found %d)..\n", renewed);
+		return nopoll_false;
+	} /* end if */
+
+	/* existing connections keep working */
+	for (iterator = 0; iterator < 5; iterator++) {
+		if (nopoll_conn_send_text (conns[iterator], "This is a test", 14) != 14) {
+			printf ("ERROR: expected to send content..\n");
+			return nopoll_false;
+		} /* end if */
+		nopoll_conn_close (conns[iterator]);
+	} /* end for */
+	nopoll_ctx_unref (ctx);
+
+	nopoll_loop_stop (listener_ctx);
+	pthread_join (thread, NULL);
+	nopoll_conn_close (listener);
+	if (listener_ctx->ssl_ctx_cache != NULL) {
+		printf ("ERROR: expected ssl contexts released with the listener..\n");
+		return nopoll_false;
+	} /* end if */
+	nopoll_ctx_unref (listener_ctx);
+
+	return nopoll_true;
+}
+
+int test_55_handshake (SSL_CTX * client_ctx, const char * port, SSL_SESSION * session, SSL_SESSION ** result)
+{
+	NOPOLL_SOCKET        sock;
+	struct sockaddr_in   addr;
+	SSL                * ssl;
+	int                  reused;
+
+	/* raw TLS client offering the provided session */
+	sock = socket (AF_INET, SOCK_STREAM, 0);
+	memset (&addr, 0, sizeof (addr));
+	addr.sin_family      = AF_INET;
+	addr.sin_port        = htons (atoi (port));
+	addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+	if (connect (sock, (struct sockaddr *) &addr, sizeof (addr)) != 0) {
+		nopoll_close_socket (sock);
+		return -1;
+	} /* end if */
+
+	ssl = SSL_new (client_ctx);
+	SSL_set_fd (ssl, sock);
+	if (session)
+		SSL_set_session (ssl, session);
+	if (SSL_connect (ssl) != 1) {
+		SSL_free (ssl);
+		nopoll_close_socket (sock);
+		return -1;
+	} /* end if */
+
+	reused = SSL_session_reused (ssl);
+	if (result)
+		(*result) = SSL_get1_session (ssl);
+
+	/* close properly, otherwise the session can't be resumed */
+	SSL_shutdown (ssl);
+	SSL_free (ssl);
+	nopoll_close_socket (sock);
+	return reused;
+}
+
+nopoll_bool test_55 (void) {
+	noPollCtx      * listener_ctx;
+	noPollConn     * listener;
+	noPollConn     * listener2;
+	noPollConnOpts * opts;
+	SSL_CTX        * client_ctx;
+	SSL_SESSION    * first;
+	SSL_SESSION    * renewed;
+	SSL_SESSION    * session;
+	pthread_t        thread;
+
+	/* listener resuming sessions only through tickets, rotating
+	 * ticket keys every 2 seconds */
+	listener_ctx = create_ctx ();
+	opts = nopoll_conn_opts_new ();
+	nopoll_conn_opts_set_ssl_session_cache (opts, 0, 0);
+	nopoll_conn_opts_set_ssl_session_tickets (opts, nopoll_true, 2);
+	listener = nopoll_listener_tls_new_opts (listener_ctx, opts, "0.0.0.0", "22361");
+	if (! nopoll_conn_is_ok (listener) || ! nopoll_listener_set_certificate (listener, "server.pem", "server.pem", NULL)) {
+		printf ("ERROR: expected proper TLS listener creation..\n");
+		return nopoll_false;
+	} /* end if */
+
+	/* listener resuming sessions only through its session cache */
+	opts = nopoll_conn_opts_new ();
+	nopoll_conn_opts_set_ssl_session_cache (opts, 16, 60);
+	nopoll_conn_opts_set_ssl_session_tickets (opts, nopoll_false, 0);
+	listener2 = nopoll_listener_tls_new_opts (listener_ctx, opts, "0.0.0.0", "22362");
+	if (! nopoll_conn_is_ok (listener2) || ! nopoll_listener_set_certificate (listener2, "server.pem", "server.pem", NULL)) {
+		printf ("ERROR: expected proper TLS listener creation..\n");
+		return nopoll_false;
+	} /* end if */
+
+	if (pthread_create (&thread, NULL, test_42_run, listener_ctx) != 0) {
+		printf ("ERROR: failed to create thread..\n");
+		return nopoll_false;
+	} /* end if */
+
+	/* TLSv1.2 so tickets are received during the handshake */
+	client_ctx = SSL_CTX_new (TLS_client_method ());
+	SSL_CTX_set_max_proto_version (client_ctx, TLS1_2_VERSION);
+
+	/* full handshake and then resumed with the ticket */
+	if (test_55_handshake (client_ctx, "22361", NULL, &first) != 0 || test_55_handshake (client_ctx, "22361", first, NULL) != 1) {
+		printf ("ERROR: expected session resumed with ticket..\n");
+		return nopoll_false;
+	} /* end if */
+
+	/* after rotation, previous key is accepted (ticket renewed) */
+	nopoll_sleep (2500000);
+	if (test_55_handshake (client_ctx, "22361", first, &renewed) != 1) {
+		printf ("ERROR: expected session resumed with ticket of previous key..\n");
+		return nopoll_false;
+	} /* end if */
+
+	/* after two rotations, the first key is no longer accepted */
+	nopoll_sleep (2500000);
+	if (test_55_handshake (client_ctx, "22361", first, NULL) != 0 || test_55_handshake (client_ctx, "22361", renewed, NULL) != 1) {
+		printf ("ERROR: expected ticket expired after two rotations (and renewed ticket accepted)..\n");
+		return nopoll_false;
+	} /* end if */
+	SSL_SESSION_free (first);
+	SSL_SESSION_free (renewed);
+
+	/* session cache */
+	if (test_55_handshake (client_ctx, "22362", NULL, &session) != 0 || test_55_handshake (client_ctx, "22362", session, NULL) != 1) {
+		printf ("ERROR: expected session resumed from session cache..\n");
+		return nopoll_false;
+	} /* end if */
+
+	/* cache released with the ssl context */
+	nopoll_ctx_invalidate_ssl_contexts (listener_ctx, listener2);
+	if (test_55_handshake (client_ctx, "22362", session, NULL) != 0) {
+		printf ("ERROR: expected full handshake after invalidating ssl contexts..\n");
+		return nopoll_false;
+	} /* end if */
+	SSL_SESSION_free (session);
+	SSL_CTX_free (client_ctx);
+
+	nopoll_loop_stop (listener_ctx);
+	pthread_join (thread, NULL);
+	nopoll_conn_close (listener);
+	nopoll_conn_close (listener2);
+	nopoll_ctx_unref (listener_ctx);
+
+	return nopoll_true;
+}
+
+nopoll_bool test_56_connect (noPollCtx * ctx, const char * host, const char * ca_certificate)
+{
+	noPollConnOpts * opts;
+	noPollConn     * conn;
+	noPollMsg      * msg;
+
+	opts = nopoll_conn_opts_new ();
+	nopoll_conn_opts_ssl_peer_verify (opts, nopoll_false);
+	if (ca_certificate)
+		nopoll_conn_opts_set_ssl_certs (opts, NULL, NULL, NULL, ca_certificate);
+	conn = nopoll_conn_tls_new (ctx, opts, host, "22363", NULL, NULL, NULL, NULL);
+	if (! nopoll_conn_wait_until_connection_ready (conn, 5)) {
+		printf ("ERROR: expected TLS connection ready..\n");
+		return nopoll_false;
+	} /* end if */
+	msg = test_48_echo (conn, "This is a test", 14);
+	if (msg == NULL)
+		return nopoll_false;
+	nopoll_msg_unref (msg);
+	nopoll_conn_close (conn);
+	return nopoll_true;
+}
+
+nopoll_bool test_56_check (noPollCtx * ctx, int expected_hits, int expected_misses)
+{
+	int hits   = -1;
+	int misses = -1;
+
+	nopoll_ctx_get_ssl_client_session_stats (ctx, &hits, &misses);
+	if (hits != expected_hits || misses != expected_misses) {
+		printf ("ERROR: expected %d hits and %d misses, but found %d and %d..\n", expected_hits, expected_misses, hits, misses);
+		return nopoll_false;
+	} /* end if */
+	return nopoll_true;
+}
+
+nopoll_bool test_56 (void) {
+	noPollCtx      * ctx;
+	noPollCtx      * listener_ctx;
+	noPollConn     * listener;
+	pthread_t        thread;
+
+	/* TLS echo listener served by the loop on a thread */
+	listener_ctx = create_ctx ();
+	nopoll_ctx_set_on_msg (listener_ctx, test_46_on_msg, NULL);
+	listener = nopoll_listener_tls_new (listener_ctx, "0.0.0.0", "22363");
+	if (! nopoll_conn_is_ok (listener) || ! nopoll_listener_set_certificate (listener, "server.pem", "server.pem", NULL)) {
+		printf ("ERROR: expected proper TLS listener creation..\n");
+		return nopoll_false;
+	} /* end if */
+	if (pthread_create (&thread, NULL, test_42_run, listener_ctx) != 0) {
+		printf ("ERROR: failed to create thread..\n");
+		return nopoll_false;
+	} /* end if */
+
+	/* first connection does a full handshake, next ones resume
+	 * the session */
+	ctx = create_ctx ();
+	if (! test_56_connect (ctx, "localhost", NULL) || ! test_56_check (ctx, 0, 1))
+		return nopoll_false;
+	if (! test_56_connect (ctx, "localhost", NULL) || ! test_56_connect (ctx, "localhost", NULL) || ! test_56_check (ctx, 2, 1))
+		return nopoll_false;
+
+	/* sessions aren't shared by connections with different
+	 * verification settings */
+	if (! test_56_connect (ctx, "localhost", "root.pem") || ! test_56_check (ctx, 2, 2))
+		return nopoll_false;
+	if (! test_56_connect (ctx, "localhost", "root.pem") || ! test_56_check (ctx, 3, 2))
+		return nopoll_false;
+
+	/* sessions are cached by destination */
+	if (! test_56_connect (ctx, "127.0.0.1", NULL) || ! test_56_check (ctx, 3, 3))
+		return nopoll_false;
+	if (! test_56_connect (ctx, "127.0.0.1", NULL) || ! test_56_check (ctx, 4, 3))
+		return nopoll_false;
+
+	/* sessions used are kept first (least recently used ones
+	 * are released first) */
+	if (! test_56_connect (ctx, "localhost", NULL) || ! test_56_check (ctx, 5, 3))
+		return nopoll_false;
+	nopoll_ctx_set_ssl_client_sessions (ctx, 1);
+	if (! test_56_connect (ctx, "localhost", NULL) || ! test_56_check (ctx, 6, 3))
+		return nopoll_false;
+
+	/* only the last session is kept */
+	if (! test_56_connect (ctx, "127.0.0.1", NULL) || ! test_56_check (ctx, 6, 4))
+		return nopoll_false;
+	if (! test_56_connect (ctx, "localhost", NULL) || ! test_56_check (ctx, 6, 5))
+		return nopoll_false;
+	if (! test_56_connect (ctx, "127.0.0.1", NULL) || ! test_56_check (ctx, 6, 6))
+		return nopoll_false;
+
+	/* cache disabled */
+	nopoll_ctx_set_ssl_client_sessions (ctx, 0);
+	if (! test_56_connect (ctx, "127.0.0.1", NULL) || ! test_56_check (ctx, 6, 6))
+		return nopoll_false;
+	nopoll_ctx_unref (ctx);
+
+	nopoll_loop_stop (listener_ctx);
+	pthread_join (thread, NULL);
+	nopoll_conn_close (listener);
+	nopoll_ctx_unref (listener_ctx);
+
+	return nopoll_true;
+}
+
+nopoll_bool test_57_echo (noPollConn * conn)
+{
+	noPollMsg * msg;
+	char      * content;
+	int         iterator;
+
+	/* small frame and large frame (header and payload written
+	 * together) */
+	content = nopoll_new (char, 10000);
+	for (iterator = 0; iterator < 10000; iterator++)
+		content[iterator] = 'a' + (iterator % 26);
+	for (iterator = 0; iterator < 2; iterator++) {
+		msg = test_48_echo (conn, content, iterator ? 10000 : 100);
+		if (msg == NULL) {
+			nopoll_free (content);
+			return nopoll_false;
+		} /* end if */
+		nopoll_msg_unref (msg);
+	} /* end for */
+	nopoll_free (content);
+	return nopoll_true;
+}
+
+nopoll_bool test_57 (void) {
+	noPollCtx      * ctx;
+	noPollCtx      * listener_ctx;
+	noPollConn     * listener;
+	noPollConn     * conn;
+	noPollConnOpts * opts;
+	nopoll_bool      send;
+	nopoll_bool      recv;
+	pthread_t        thread;
+
+	/* TLS echo listener requesting kernel TLS */
+	listener_ctx = create_ctx ();
+	nopoll_ctx_set_on_msg (listener_ctx, test_46_on_msg, NULL);
+	opts = nopoll_conn_opts_new ();
+	nopoll_conn_opts_set_ktls (opts, nopoll_true);
+	listener = nopoll_listener_tls_new_opts (listener_ctx, opts, "0.0.0.0", "22364");
+	if (! nopoll_conn_is_ok (listener) || ! nopoll_listener_set_certificate (listener, "server.pem", "server.pem", NULL)) {
+		printf ("ERROR: expected proper TLS listener creation..\n");
+		return nopoll_false;
+	} /* end if */
+	if (pthread_create (&thread, NULL, test_42_run, listener_ctx) != 0) {
+		printf ("ERROR: failed to create thread..\n");
+		return nopoll_false;
+	} /* end if */
+
+	/* connection without offload */
+	ctx = create_ctx ();
+	opts = nopoll_conn_opts_new ();
+	nopoll_conn_opts_ssl_peer_verify (opts, nopoll_false);
+	conn = nopoll_conn_tls_new (ctx, opts, "localhost", "22364", NULL, NULL, NULL, NULL);
+	if (! nopoll_conn_wait_until_connection_ready (conn, 5) || ! test_57_echo (conn))
+		return nopoll_false;
+	if (nopoll_conn_is_ktls_on (conn, &send, &recv) || send || recv) {
+		printf ("ERROR: expected kernel TLS not to be active..\n");
+		return nopoll_false;
+	} /* end if */
+	nopoll_conn_close (conn);
+
+	/* connection requesting offload: it must work even when the
+	 * kernel doesn't support it */
+	opts = nopoll_conn_opts_new ();
+	nopoll_conn_opts_ssl_peer_verify (opts, nopoll_false);
+	nopoll_conn_opts_set_ktls (opts, nopoll_true);
+	conn = nopoll_conn_tls_new (ctx, opts, "localhost", "22364", NULL, NULL, NULL, NULL);
+	if (! nopoll_conn_wait_until_connection_ready (conn, 5) || ! test_57_echo (conn))
+		return nopoll_false;
+	if (nopoll_conn_is_ktls_on (conn, &send, &recv) != (send || recv)) {
+		printf ("ERROR: inconsistent kernel TLS status..\n");
+		return nopoll_false;
+	} /* end if */
+	if (nopoll_conn_is_ktls_on (NULL, &send, &recv) || send || recv) {
+		printf ("ERROR: expected kernel TLS not to be reported for NULL connections..\n");
+		return nopoll_false;
+	} /* end if */
+	nopoll_conn_is_ktls_on (conn, &send, &recv);
+	printf ("Test 57: kernel TLS offload send=%d, recv=%d\n", send, recv);
+	nopoll_conn_close (conn);
+	nopoll_ctx_unref (ctx);
+
+	nopoll_loop_stop (listener_ctx);
+	pthread_join (thread, NULL);
+	nopoll_conn_close (listener);
+	nopoll_ctx_unref (listener_ctx);
+
+	return nopoll_true;
+}
+
+pthread_mutex_t test_58_mutex = PTHREAD_MUTEX_INITIALIZER;
+int             test_58_ready;
+int             test_58_echoes;
+int             test_58_closed;
+
+nopoll_bool test_58_on_ready (noPollCtx * ctx, noPollConn * conn, noPollPtr user_data)
+{
+	pthread_mutex_lock (&test_58_mutex);
+	test_58_ready++;
+	pthread_mutex_unlock (&test_58_mutex);
+
+	/* check the connection works */
+	nopoll_conn_send_text (conn, "This is a test", 14);
+	return nopoll_true;
+}
+
+void test_58_on_msg (noPollCtx * ctx, noPollConn * conn, noPollMsg * msg, noPollPtr user_data)
+{
+	if (nopoll_msg_get_payload_size (msg) != 14 || memcmp (nopoll_msg_get_payload (msg), "This is a test", 14))
+		return;
+
+	pthread_mutex_lock (&test_58_mutex);
+	test_58_echoes++;
+	pthread_mutex_unlock (&test_58_mutex);
+	return;
+}
+
+void test_58_on_close (noPollCtx * ctx, noPollConn * conn, noPollPtr user_data)
+{
+	pthread_mutex_lock (&test_58_mutex);
+	test_58_closed++;
+	pthread_mutex_unlock (&test_58_mutex);
+	return;
+}
+
+noPollConn * test_58_connect (noPollCtx * ctx, nopoll_bool tls, const char * port)
+{
+	noPollConnOpts * opts;
+
+	opts = nopoll_conn_opts_new ();
+	nopoll_conn_opts_set_async_connect (opts, nopoll_true);
+	if (! tls)
+		return nopoll_conn_new_opts (ctx, opts, "127.0.0.1", port, NULL, NULL, NULL, NULL);
+
+	nopoll_conn_opts_ssl_peer_verify (opts, nopoll_false);
+	return nopoll_conn_tls_new (ctx, opts, "127.0.0.1", port, NULL, NULL, NULL, NULL);
+}
+
+nopoll_bool test_58_engine (const char * label, noPollIoEngineType engine_type)
+{
+	noPollCtx      * ctx;
+	noPollConn     * conns[100];
+	noPollConn     * failed;
+	struct timeval   start;
+	struct timeval   stop;
+	struct timeval   diff;
+	int              iterator;
+	int              ready;
+	int              echoes;
+	int              closed;
+	pthread_t        thread;
+
+	test_58_ready  = 0;
+	test_58_echoes = 0;
+	test_58_closed = 0;
+
+	ctx = create_ctx ();
+	nopoll_ctx_set_io_engine (ctx, engine_type);
+	nopoll_ctx_set_on_ready (ctx, test_58_on_ready, NULL);
+	nopoll_ctx_set_on_msg (ctx, test_58_on_msg, NULL);
+
+	/* connection refused: reported through on close */
+	failed = test_58_connect (ctx, nopoll_false, "22399");
+	if (failed == NULL) {
+		printf ("ERROR: expected connection to be created..\n");
+		return nopoll_false;
+	} /* end if */
+	nopoll_conn_set_on_close (failed, test_58_on_close, NULL);
+	if (nopoll_conn_is_ready (failed)) {
+		printf ("ERROR: expected connection not to be ready..\n");
+		return nopoll_false;
+	} /* end if */
+
+	if (pthread_create (&thread, NULL, test_42_run, ctx) != 0) {
+		printf ("ERROR: failed to create thread..\n");
+		return nopoll_false;
+	} /* end if */
+
+	/* open connections in parallel (TLS and plain) while the loop
+	 * is running */
+	gettimeofday (&start, NULL);
+	for (iterator = 0; iterator < 100; iterator++) {
+		conns[iterator] = test_58_connect (ctx, iterator % 2 == 0, iterator % 2 == 0 ? "22365" : "22366");
+		if (conns[iterator] == NULL) {
+			printf ("ERROR: expected connection to be created..\n");
+			return nopoll_false;
+		} /* end if */
+	} /* end for */
+	gettimeofday (&stop, NULL);
+	nopoll_timeval_substract (&stop, &start, &diff);
+
+	/* wait connections to be ready and working */
+	iterator = 0;
+	while (nopoll_true) {
+		pthread_mutex_lock (&test_58_mutex);
+		ready  = test_58_ready;
+		echoes = test_58_echoes;
+		closed = test_58_closed;
+		pthread_mutex_unlock (&test_58_mutex);
+		if (ready == 100 && echoes == 100 && closed == 1)
+			break;
+		if (iterator > 1000) {
+			printf ("ERROR: expected 100 connections ready and 1 closed but found ready=%d, echoes=%d, closed=%d (%s)..\n",
+				ready, echoes, closed, label);
+			return nopoll_false;
+		} /* end if */
+		nopoll_sleep (10000);
+		iterator++;
+	} /* end while */
+	printf ("Test 58: 100 connections created in %ld us and ready in %d ms using %s engine\n",
+		(long) (diff.tv_sec * 1000000 + diff.tv_usec), iterator * 10, label);
+
+	if (nopoll_conn_is_ok (failed)) {
+		printf ("ERROR: expected failed connection to be closed..\n");
+		return nopoll_false;
+	} /* end if */
+
+	nopoll_loop_stop (ctx);
+	pthread_join (thread, NULL);
+
+	for (iterator = 0; iterator < 100; iterator++) {
+		if (! nopoll_conn_is_ready (conns[iterator])) {
+			printf ("ERROR: expected connection %d to be ready..\n", iterator);
+			return nopoll_false;
+		} /* end if */
+		nopoll_conn_close (conns[iterator]);
+	} /* end for */
+	nopoll_conn_close (failed);
+	nopoll_ctx_unref (ctx);
+
+	return nopoll_true;
+}
+
+nopoll_bool test_58_timeout (void)
+{
+	noPollCtx      * ctx;
+	noPollConn     * conn;
+	NOPOLL_SOCKET    session;
+	int              iterator;
+	int              closed;
+	pthread_t        thread;
+
+	/* socket listening without accepting connections: TLS
+	 * handshake never finishes */
+	ctx     = create_ctx ();
+	session = nopoll_listener_sock_listen (ctx, "127.0.0.1", "22367");
+	if (session == NOPOLL_INVALID_SOCKET) {
+		printf ("ERROR: expected socket listening..\n");
+		return nopoll_false;
+	} /* end if */
+
+	test_58_closed = 0;
+	nopoll_conn_connect_timeout (ctx, 500000);
+	conn = test_58_connect (ctx, nopoll_true, "22367");
+	if (conn == NULL) {
+		printf ("ERROR: expected connection to be created..\n");
+		return nopoll_false;
+	} /* end if */
+	nopoll_conn_set_on_close (conn, test_58_on_close, NULL);
+	if (pthread_create (&thread, NULL, test_42_run, ctx) != 0) {
+		printf ("ERROR: failed to create thread..\n");
+		return nopoll_false;
+	} /* end if */
+
+	/* wait connect timeout */
+	iterator = 0;
+	while (nopoll_true) {
+		pthread_mutex_lock (&test_58_mutex);
+		closed = test_58_closed;
+		pthread_mutex_unlock (&test_58_mutex);
+		if (closed == 1)
+			break;
+		if (iterator > 300) {
+			printf ("ERROR: expected connection to be closed after connect timeout..\n");
+			return nopoll_false;
+		} /* end if */
+		nopoll_sleep (10000);
+		iterator++;
+	} /* end while */
+	if (iterator < 40) {
+		printf ("ERROR: expected connection to be closed after connect timeout, but it was closed after %d ms..\n", iterator * 10);
+		return nopoll_false;
+	} /* end if */
+
+	nopoll_loop_stop (ctx);
+	pthread_join (thread, NULL);
+	nopoll_conn_close (conn);
+	nopoll_close_socket (session);
+	nopoll_ctx_unref (ctx);
+
+	return nopoll_true;
+}
+
+nopoll_bool test_58 (void) {
+	noPollCtx      * listener_ctx;
+	noPollConn     * listener;
+	noPollConn     * listener2;
+	pthread_t        thread;
+
+	/* TLS and plain echo listeners served by the loop on a
+	 * thread (with a backlog for all connections opened at
+	 * once) */
+	listener_ctx = create_ctx ();
+	listener_ctx->backlog = 128;
+	nopoll_ctx_set_on_msg (listener_ctx, test_46_on_msg, NULL);
+	listener = nopoll_listener_tls_new (listener_ctx, "0.0.0.0", "22365");
+	if (! nopoll_conn_is_ok (listener) || ! nopoll_listener_set_certificate (listener, "server.pem", "server.pem", NULL)) {
+		printf ("ERROR: expected proper TLS listener creation..\n");
+		return nopoll_false;
+	} /* end if */
+	listener2 = nopoll_listener_new (listener_ctx, "0.0.0.0", "22366");
+	if (! nopoll_conn_is_ok (listener2)) {
+		printf ("ERROR: expected proper listener creation..\n");
+		return nopoll_false;
+	} /* end if */
+	if (pthread_create (&thread, NULL, test_42_run, listener_ctx) != 0) {
+		printf ("ERROR: failed to create thread..\n");
+		return nopoll_false;
+	} /* end if */
+
+	if (! test_each_engine (test_58_engine))
+		return nopoll_false;
+	if (! test_58_timeout ())
+		return nopoll_false;
+
+	nopoll_loop_stop (listener_ctx);
+	pthread_join (thread, NULL);
+	nopoll_conn_close (listener);
+	nopoll_conn_close (listener2);
+	nopoll_ctx_unref (listener_ctx);
+
+	return nopoll_true;
+}
+
+nopoll_bool test_59_wait (int ready, int echoes, int closed, int * elapsed)
+{
+	int iterator = 0;
+
+	while (nopoll_true) {
+		pthread_mutex_lock (&test_58_mutex);
+		if (test_58_ready == ready && test_58_echoes == echoes && test_58_closed == closed) {
+			pthread_mutex_unlock (&test_58_mutex);
+			break;
+		} /* end if */
+		pthread_mutex_unlock (&test_58_mutex);
+		if (iterator > 300) {
+			printf ("ERROR: expected ready=%d, echoes=%d, closed=%d but found ready=%d, echoes=%d, closed=%d..\n",
+				ready, echoes, closed, test_58_ready, test_58_echoes, test_58_closed);
+			return nopoll_false;
+		} /* end if */
+		nopoll_sleep (10000);
+		iterator++;
+	} /* end while */
+
+	if (elapsed)
+		(*elapsed) = iterator * 10;
+	return nopoll_true;
+}
+
+noPollConn * test_59_connect (noPollCtx * ctx, const char * host, const char * port)
+{
+	noPollConnOpts * opts;
+
+	opts = nopoll_conn_opts_new ();
+	nopoll_conn_opts_set_async_connect (opts, nopoll_true);
+	return nopoll_conn_new_opts (ctx, opts, host, port, NULL, NULL, NULL, NULL);
+}
+
+nopoll_bool test_59 (void) {
+	noPollCtx      * listener_ctx;
+	noPollConn     * listener;
+	noPollCtx      * ctx;
+	noPollConn     * conns[4];
+	noPollConn     * conn;
+	pthread_t        listener_thread;
+	pthread_t        thread;
+	int              elapsed;
+	int              hits;
+	int              misses;
+	int              iterator;
+	int              registered;
+
+	/* echo listener on IPv4 only */
+	listener_ctx = create_ctx ();
+	nopoll_ctx_set_on_msg (listener_ctx, test_46_on_msg, NULL);
+	listener = nopoll_listener_new (listener_ctx, "127.0.0.1", "22368");
+	if (! nopoll_conn_is_ok (listener)) {
+		printf ("ERROR: expected proper listener creation..\n");
+		return nopoll_false;
+	} /* end if */
+	if (pthread_create (&listener_thread, NULL, test_42_run, listener_ctx) != 0) {
+		printf ("ERROR: failed to create thread..\n");
+		return nopoll_false;
+	} /* end if */
+
+	test_58_ready  = 0;
+	test_58_echoes = 0;
+	test_58_closed = 0;
+
+	ctx = create_ctx ();
+	nopoll_ctx_set_on_ready (ctx, test_58_on_ready, NULL);
+	nopoll_ctx_set_on_msg (ctx, test_58_on_msg, NULL);
+	if (nopoll_ctx_set_host_addresses (ctx, "invalid.nopoll.test", "127.0.0.1,not-an-address")) {
+		printf ("ERROR: expected invalid address to be rejected..\n");
+		return nopoll_false;
+	} /* end if */
+	if (! nopoll_ctx_set_host_addresses (ctx, "dual.nopoll.test", "::1, 127.0.0.1") ||
+	    ! nopoll_ctx_set_host_addresses (ctx, "refused.nopoll.test", "127.0.0.1")) {
+		printf ("ERROR: expected host addresses to be defined..\n");
+		return nopoll_false;
+	} /* end if */
+	if (pthread_create (&thread, NULL, test_42_run, ctx) != 0) {
+		printf ("ERROR: failed to create thread..\n");
+		return nopoll_false;
+	} /* end if */
+
+	/* IPv6 address refused: IPv4 one is tried at once (without
+	 * waiting for the attempt delay) */
+	conns[0] = test_59_connect (ctx, "dual.nopoll.test", "22368");
+	if (! nopoll_conn_is_ok (conns[0])) {
+		printf ("ERROR: expected connection to be created..\n");
+		return nopoll_false;
+	} /* end if */
+	if (! test_59_wait (1, 1, 0, &elapsed))
+		return nopoll_false;
+	printf ("Test 59: dual stack host ready in %d ms (IPv6 refused)\n", elapsed);
+
+	/* host name resolved once and then cached */
+	conns[1] = test_59_connect (ctx, "localhost", "22368");
+	if (! nopoll_conn_is_ok (conns[1]) || ! test_59_wait (2, 2, 0, NULL))
+		return nopoll_false;
+	conns[2] = test_59_connect (ctx, "localhost", "22368");
+	if (! nopoll_conn_is_ok (conns[2]) || ! test_59_wait (3, 3, 0, NULL))
+		return nopoll_false;
+
+	/* all addresses refused: reported through on close (by the
+	 * loop, stopped until the handler is set) */
+	nopoll_loop_stop (ctx);
+	pthread_join (thread, NULL);
+	conns[3] = test_59_connect (ctx, "refused.nopoll.test", "22399");
+	if (conns[3] == NULL) {
+		printf ("ERROR: expected connection to be created..\n");
+		return nopoll_false;
+	} /* end if */
+	nopoll_conn_set_on_close (conns[3], test_58_on_close, NULL);
+	if (pthread_create (&thread, NULL, test_42_run, ctx) != 0) {
+		printf ("ERROR: failed to create thread..\n");
+		return nopoll_false;
+	} /* end if */
+	if (! test_59_wait (3, 3, 1, NULL))
+		return nopoll_false;
+	if (nopoll_conn_is_ok (conns[3])) {
+		printf ("ERROR: expected refused connection to be closed..\n");
+		return nopoll_false;
+	} /* end if */
+
+	nopoll_ctx_get_dns_cache_stats (ctx, &hits, &misses);
+	printf ("Test 59: host name cache hits=%d, misses=%d\n", hits, misses);
+	if (hits != 3 || misses != 1) {
+		printf ("ERROR: expected 3 cache hits and 1 miss..\n");
+		return nopoll_false;
+	} /* end if */
+
+	/* connections closed while being resolved (loop stopped so
+	 * only resolver threads race with the close): either handed
+	 * to the loop and removed or dropped */
+	nopoll_loop_stop (ctx);
+	pthread_join (thread, NULL);
+	registered = nopoll_ctx_conns (ctx);
+	for (iterator = 0; iterator < 100; iterator++) {
+		conn = test_59_connect (ctx, "localhost", "22368");
+		if (conn == NULL) {
+			printf ("ERROR: expected connection to be created..\n");
+			return nopoll_false;
+		} /* end if */
+		if (iterator % 10)
+			nopoll_sleep (iterator * 10);
+		nopoll_conn_close (conn);
+	} /* end for */
+	if (pthread_create (&thread, NULL, test_42_run, ctx) != 0) {
+		printf ("ERROR: failed to create thread..\n");
+		return nopoll_false;
+	} /* end if */
+
+	/* the context keeps working */
+	conn = test_59_connect (ctx, "localhost", "22368");
+	if (! nopoll_conn_is_ok (conn) || ! test_59_wait (4, 4, 1, NULL))
+		return nopoll_false;
+	iterator = 0;
+	while (nopoll_ctx_conns (ctx) != registered + 1) {
+		if (iterator > 300) {
+			printf ("ERROR: expected %d connections registered but found %d..\n", registered + 1, nopoll_ctx_conns (ctx));
+			return nopoll_false;
+		} /* end if */
+		nopoll_sleep (10000);
+		iterator++;
+	} /* end while */
+
+	nopoll_loop_stop (ctx);
+	pthread_join (thread, NULL);
+	for (iterator = 0; iterator < 4; iterator++)
+		nopoll_conn_close (conns[iterator]);
+	nopoll_conn_close (conn);
+	nopoll_ctx_unref (ctx);
+
+	nopoll_loop_stop (listener_ctx);
+	pthread_join (listener_thread, NULL);
+	nopoll_conn_close (listener);
+	nopoll_ctx_unref (listener_ctx);
+
+	return nopoll_true;
+}
+
+int test_60_updated = 0;
+
+nopoll_bool test_60_count_updated (noPollCtx * ctx, noPollConn * conn, noPollPtr user_data)
+{
+	noPollConn * listener = user_data;
+
+	if (conn->listener_origin == listener->id && nopoll_cmp (conn->certificate, "./server.pem"))
+		test_60_updated++;
+	return nopoll_false; /* keep foreach, don't stop */
+}
+
+nopoll_bool test_60 (void) {
+	noPollCtx      * listener_ctx;
+	noPollConn     * listener;
+	noPollConn     * listener2;
+	noPollConnOpts * opts;
+	SSL_CTX        * client_ctx;
+	SSL_SESSION    * ticket;
+	SSL_SESSION    * session;
+	pthread_t        thread;
+	noPollPtr        thread_result;
+	int              iterator;
+
+	/* listener resuming sessions only through tickets and
+	 * listener resuming them only through its session cache */
+	listener_ctx = create_ctx ();
+	opts = nopoll_conn_opts_new ();
+	nopoll_conn_opts_set_ssl_session_cache (opts, 0, 0);
+	listener = nopoll_listener_tls_new_opts (listener_ctx, opts, "0.0.0.0", "22369");
+	if (! nopoll_conn_is_ok (listener) || ! nopoll_listener_set_certificate (listener, "server.pem", "server.pem", NULL)) {
+		printf ("ERROR: expected proper TLS listener creation..\n");
+		return nopoll_false;
+	} /* end if */
+	opts = nopoll_conn_opts_new ();
+	nopoll_conn_opts_set_ssl_session_tickets (opts, nopoll_false, 0);
+	listener2 = nopoll_listener_tls_new_opts (listener_ctx, opts, "0.0.0.0", "22370");
+	if (! nopoll_conn_is_ok (listener2) || ! nopoll_listener_set_certificate (listener2, "server.pem", "server.pem", NULL)) {
+		printf ("ERROR: expected proper TLS listener creation..\n");
+		return nopoll_false;
+	} /* end if */
+
+	/* served by 4 loop workers, each one with its own listener
+	 * sharing the port */
+	if (pthread_create (&thread, NULL, test_41_run, listener_ctx) != 0) {
+		printf ("ERROR: failed to create thread..\n");
+		return nopoll_false;
+	} /* end if */
+
+	/* TLSv1.2 so sessions are received during the handshake */
+	client_ctx = SSL_CTX_new (TLS_client_method ());
+	SSL_CTX_set_max_proto_version (client_ctx, TLS1_2_VERSION);
+	iterator = 0;
+	while (test_55_handshake (client_ctx, "22369", NULL, &ticket) != 0 || test_55_handshake (client_ctx, "22370", NULL, &session) != 0) {
+		/* workers still starting */
+		if (iterator++ > 100) {
+			printf ("ERROR: expected full handshakes..\n");
+			return nopoll_false;
+		} /* end if */
+		nopoll_sleep (10000);
+	} /* end while */
+
+	/* let the worker finishing the handshake cache the session */
+	nopoll_sleep (100000);
+
+	/* the kernel balances connections among the listeners of
+	 * every worker: sessions must be resumed whatever listener
+	 * accepts the connection */
+	for (iterator = 0; iterator < 20; iterator++) {
+		if (test_55_handshake (client_ctx, "22369", ticket, NULL) != 1) {
+			printf ("ERROR: expected session resumed with ticket (iteration %d)..\n", iterator);
+			return nopoll_false;
+		} /* end if */
+		if (test_55_handshake (client_ctx, "22370", session, NULL) != 1) {
+			printf ("ERROR: expected session resumed from session cache (iteration %d)..\n", iterator);
+			return nopoll_false;
+		} /* end if */
+	} /* end for */
+
+	/* certificates updated: listeners sharing the port use them
+	 * and drop the contexts (and ticket keys) configured */
+	if (! nopoll_listener_set_certificate (listener, "./server.pem", "./server.pem", NULL)) {
+		printf ("ERROR: expected certificate updated..\n");
+		return nopoll_false;
+	} /* end if */
+	test_60_updated = 0;
+	nopoll_ctx_foreach_conn (listener_ctx, test_60_count_updated, listener);
+	if (test_60_updated != 3) {
+		printf ("ERROR: expected certificate updated on 3 listeners sharing the port, but found %d..\n", test_60_updated);
+		return nopoll_false;
+	} /* end if */
+	for (iterator = 0; iterator < 20; iterator++) {
+		if (test_55_handshake (client_ctx, "22369", ticket, NULL) != 0) {
+			printf ("ERROR: expected full handshake after updating certificates (iteration %d)..\n", iterator);
+			return nopoll_false;
+		} /* end if */
+	} /* end for */
+	SSL_SESSION_free (ticket);
+	SSL_SESSION_free (session);
+	SSL_CTX_free (client_ctx);
+
+	nopoll_loop_stop (listener_ctx);
+	pthread_join (thread, &thread_result);
+	if (thread_result != NULL) {
+		printf ("ERROR: expected nopoll_loop_run_threads to finish without error..\n");
+		return nopoll_false;
+	} /* end if */
+	nopoll_conn_close (listener);
+	nopoll_conn_close (listener2);
+	nopoll_ctx_unref (listener_ctx);
+
+	return nopoll_true;
+}
+
+NOPOLL_SOCKET test_61_blackhole (const char * port, NOPOLL_SOCKET * filler)
+{
+	NOPOLL_SOCKET        sock;
+	struct sockaddr_in   addr;
+
+	/* listener on 127.0.0.2 whose accept queue is full (the
+	 * connection queued is never accepted) so SYNs received are
+	 * dropped */
+	sock = socket (AF_INET, SOCK_STREAM, 0);
+	memset (&addr, 0, sizeof (addr));
+	addr.sin_family      = AF_INET;
+	addr.sin_port        = htons (atoi (port));
+	addr.sin_addr.s_addr = htonl (0x7f000002);
+	if (bind (sock, (struct sockaddr *) &addr, sizeof (addr)) != 0 || listen (sock, 0) != 0) {
+		nopoll_close_socket (sock);
+		return NOPOLL_INVALID_SOCKET;
+	} /* end if */
+
+	(*filler) = socket (AF_INET, SOCK_STREAM, 0);
+	nopoll_conn_set_sock_block (*filler, nopoll_false);
+	connect (*filler, (struct sockaddr *) &addr, sizeof (addr));
+	nopoll_sleep (100000);
+	return sock;
+}
+
+nopoll_bool test_61 (void) {
+	noPollCtx      * listener_ctx;
+	noPollConn     * listener;
+	noPollCtx      * ctx;
+	noPollConn     * conns[2];
+	NOPOLL_SOCKET    blackhole;
+	NOPOLL_SOCKET    filler;
+	pthread_t        listener_thread;
+	pthread_t        thread;
+	struct timeval   start, stop, diff;
+	long             elapsed;
+
+	/* echo listener on 127.0.0.1 and blackholed port on
+	 * 127.0.0.2 */
+	listener_ctx = create_ctx ();
+	nopoll_ctx_set_on_msg (listener_ctx, test_46_on_msg, NULL);
+	listener = nopoll_listener_new (listener_ctx, "127.0.0.1", "22371");
+	if (! nopoll_conn_is_ok (listener)) {
+		printf ("ERROR: expected proper listener creation..\n");
+		return nopoll_false;
+	} /* end if */
+	if (pthread_create (&listener_thread, NULL, test_42_run, listener_ctx) != 0) {
+		printf ("ERROR: failed to create thread..\n");
+		return nopoll_false;
+	} /* end if */
+	blackhole = test_61_blackhole ("22371", &filler);
+	if (blackhole == NOPOLL_INVALID_SOCKET) {
+		printf ("ERROR: failed to create blackholed listener..\n");
+		return nopoll_false;
+	} /* end if */
+
+	test_58_ready  = 0;
+	test_58_echoes = 0;
+	test_58_closed = 0;
+
+	/* only one resolver thread */
+	ctx = create_ctx ();
+	nopoll_ctx_set_on_ready (ctx, test_58_on_ready, NULL);
+	nopoll_ctx_set_on_msg (ctx, test_58_on_msg, NULL);
+	nopoll_ctx_set_resolver_threads (ctx, 1);
+	if (! nopoll_ctx_set_host_addresses (ctx, "blackhole.nopoll.test", "127.0.0.2,127.0.0.1")) {
+		printf ("ERROR: expected host addresses to be defined..\n");
+		return nopoll_false;
+	} /* end if */
+	if (pthread_create (&thread, NULL, test_42_run, ctx) != 0) {
+		printf ("ERROR: failed to create thread..\n");
+		return nopoll_false;
+	} /* end if */
+
+	/* first address blackholed: the loop tries the next one
+	 * after the attempt delay, while the resolver thread serves
+	 * the host name resolved next */
+	gettimeofday (&start, NULL);
+	conns[0] = test_59_connect (ctx, "blackhole.nopoll.test", "22371");
+	conns[1] = test_59_connect (ctx, "localhost", "22371");
+	if (! nopoll_conn_is_ok (conns[0]) || ! nopoll_conn_is_ok (conns[1])) {
+		printf ("ERROR: expected connections to be created..\n");
+		return nopoll_false;
+	} /* end if */
+	if (! test_59_wait (1, 1, 0, NULL))
+		return nopoll_false;
+	if (! nopoll_conn_is_ready (conns[1]) || nopoll_conn_is_ready (conns[0])) {
+		printf ("ERROR: expected host name resolved to be ready before the blackholed one (ready: %d, %d)..\n",
+			nopoll_conn_is_ready (conns[0]), nopoll_conn_is_ready (conns[1]));
+		return nopoll_false;
+	} /* end if */
+
+	if (! test_59_wait (2, 2, 0, NULL))
+		return nopoll_false;
+	gettimeofday (&stop, NULL);
+	nopoll_timeval_substract (&stop, &start, &diff);
+	elapsed = (diff.tv_sec * 1000) + (diff.tv_usec / 1000);
+	printf ("Test 61: blackholed address skipped in %ld ms\n", elapsed);
+	if (elapsed < 200) {
+		printf ("ERROR: expected the next address to be tried after the attempt delay..\n");
+		return nopoll_false;
+	} /* end if */
+
+	nopoll_loop_stop (ctx);
+	pthread_join (thread, NULL);
+	nopoll_conn_close (conns[0]);
+	nopoll_conn_close (conns[1]);
+	nopoll_ctx_unref (ctx);
+
+	nopoll_close_socket (filler);
+	nopoll_close_socket (blackhole);
+
+	nopoll_loop_stop (listener_ctx);
+	pthread_join (listener_thread, NULL);
+	nopoll_conn_close (listener);
+	nopoll_ctx_unref (listener_ctx);
+
+	return nopoll_true;
+}
+
+int main (int argc, char ** argv)
+{
+	int iterator;
+
+	printf ("** NoPoll: Websocket toolkit (regression test).\n");
+	printf ("** Copyright (C) 2025 Advanced Software Production Line, S.L.\n**\n");
+	printf ("** NoPoll regression tests: version=%s\n**\n",
+		VERSION);
+	printf ("** To gather information about time performance you can use:\n**\n");
+	printf ("**     >> time ./nopoll-regression-client [--debug,--show-critical-only]\n**\n");
+	printf ("** To gather information about memory consumed (and leaks) use:\n**\n");
+	printf ("**     >> libtool --mode=execute valgrind --leak-check=yes --error-limit=no ./nopoll-regression-client\n**\n");
+	printf ("**\n");
+	printf ("** Report bugs to:\n**\n");
+	printf ("**     <nopoll@lists.aspl.es> noPoll mailing list\n**\n");
+	printf ("**     <info@aspl.es> ASPL's contact \n**\n");
+
+	iterator = 1;
+	while (iterator < argc) {
+		/* check for debug */
+		printf ("Checking agument: %s\n", argv[iterator]);
+		if (nopoll_cmp (argv[iterator], "--debug")) {
+			printf ("Activating debug..\n");
+			debug = nopoll_true;
+		} /* end if */
+		if (nopoll_cmp (argv[iterator], "--show-critical-only")) {
+			printf ("Activating reporting of critical messages..\n");
+			show_critical_only = nopoll_true;
+		} /* end if */
+
+		/* next position */
+		iterator++;
+	}
+
+#if defined(__NOPOLL_PTHREAD_SUPPORT__)	
+	printf ("INFO: install default threading functions to check noPoll locking code..\n");
+	nopoll_thread_handlers (__nopoll_regtest_mutex_create,
+				__nopoll_regtest_mutex_destroy,
+				__nopoll_regtest_mutex_lock,
+				__nopoll_regtest_mutex_unlock);
+	nopoll_thread_create_handlers (__nopoll_regtest_thread_create,
+				       __nopoll_regtest_thread_join);
+	nopoll_thread_cond_handlers (__nopoll_regtest_cond_create,
+				     __nopoll_regtest_cond_destroy,
+				     __nopoll_regtest_cond_wait,
+				     __nopoll_regtest_cond_signal,
+				     __nopoll_regtest_cond_broadcast);
+#endif
+
+	printf ("INFO: starting tests with pid: %d\n", getpid ());
+	if (test_01_strings ()) {
+		printf ("Test 01-strings: Library strings support [   OK   ]\n");
+	}else {
+		printf ("Test 01-strings: Library strings support [ FAILED ]\n");
+		return -1;
+	}
+
+	if (test_01_base64 ()) {
+		printf ("Test 01-base64: Library base64 support [   OK   ]\n");
+	}else {
+		printf ("Test 01-base64: Library base64 support [ FAILED ]\n");
+		return -1;
+	}
+
+	if (test_01_masking ()) {
+		printf ("Test 01-masking: Library websocket content masking support [   OK   ]\n");
+	}else {
+		printf ("Test 01-masking: Library websocket content masking support [ FAILED ]\n");
+		return -1;
+	}
+
+	if (test_01 ()) {	
+		printf ("Test 01: Simple connect and disconnect [   OK   ]\n");
+	}else {
+		printf ("Test 01: Simple connect and disconnect [ FAILED ]\n");
+		return -1;
+	}
+
+	if (test_02 ()) {	
+		printf ("Test 02: Simple request/reply [   OK   ]\n");
+	}else {
+		printf ("Test 02: Simple request/reply [ FAILED ]\n");
+		return -1;
+	}
+
+	if (test_02a ()) {	
+		printf ("Test 02a: Simple request/reply (IPv6) [   OK   ]\n");
+	}else {
+		printf ("Test 02a: Simple request/reply (IPv6) [ FAILED ]\n");
+		return -1;
+	}
+
+	/* test sending ping */
+	if (test_02b ()) {	
+		printf ("Test 02b: test sending ping [   OK   ]\n");
+	}else {
+		printf ("Test 02a: test sending ping [ FAILED ]\n");
+		return -1;
+	}
+
+	/* test sending pong (without ping) */
+
+	/* test streaming api */
+	if (test_03 ()) {	
+		printf ("Test 03: test streaming api [   OK   ]\n");
+	}else {
+		printf ("Test 03: test streaming api [ FAILED ]\n");
+		return -1;
+	}
+
+	if (test_04 (1024)) {	
+		printf ("Test 04: test streaming api (II) [   OK   ]\n");
+	}else {
+		printf ("Test 04: test streaming api (II) [ FAILED ]\n");
+		return -1;
+	}
+
+	if (test_04 (512)) {	
+		printf ("Test 04-a: test streaming api (III) [   OK   ]\n");
+	}else {
+		printf ("Test 04-a: test streaming api (III) [ FAILED ]\n");
+		return -1;
+	}
+
+	if (test_04 (137)) {	
+		printf ("Test 04-b: test streaming api (IV) [   OK   ]\n");
+	}else {
+		printf ("Test 04-b: test streaming api (IV) [ FAILED ]\n");
+		return -1;
+	}
+
+	if (test_04 (17)) {	
+		printf ("Test 04-c: test streaming api (V) [   OK   ]\n");
+	}else {
+		printf ("Test 04-c: test streaming api (V) [ FAILED ]\n");
+		return -1;
+	}
+
+	if (test_04a ()) {
+		printf ("Test 04-a: check non-blocking streaming and message based API  [   OK   ]\n");
+	} else {
+		printf ("Test 04-a: check non-blocking streaming and message based API [ FAILED ]\n");
+		return -1;
+	}
+
+	if (test_04b ()) {
+		printf ("Test 04-b: try to overflow write access and recover from it  [   OK   ]\n");
+	} else {
+		printf ("Test 04-b: try to overflow write access and recover from it [ FAILED ]\n");
+		return -1;
+	}
+
+	if (test_04c ()) {
+		printf ("Test 04-c: send a file and try to overflow (but retry)  [   OK   ]\n");
+	} else {
+		printf ("Test 04-c: send a file and try to overflow (but retry) [ FAILED ]\n");
+		return -1;
+	}
+
+	if (test_05 ()) {
+		printf ("Test 05: sending utf-8 content [   OK   ]\n");
+	} else {
+		printf ("Test 05: sending utf-8 content [ FAILED ]\n");
+		return -1;
+	}
+
+	if (test_06 ()) {
+		printf ("Test 06: testing basic TLS connect [   OK   ]\n");
+	} else {
+		printf ("Test 06: testing basic TLS connect [ FAILED ]\n");
+		return -1;
+	}
+
+	if (test_06a ()) {
+		printf ("Test 06a: testing basic TLS connect (IPv6) [   OK   ]\n");
+	} else {
+		printf ("Test 06a: testing basic TLS connect (IPv6) [ FAILED ]\n");
+		return -1;
+	}
+
+	if (test_07 ()) {
+		printf ("Test 07: testing TLS request/reply [   OK   ]\n");
+	} else {
+		printf ("Test 07: testing TLS request/reply [ FAILED ]\n");
+		return -1;
+	}
+
+	if (test_08 ()) {
+		printf ("Test 08: test normal connect to TLS port [   OK   ]\n");
+	} else {
+		printf ("Test 08: test normal connect to TLS port [ FAILED ]\n");
+		return -1;
+	}
+
+	if (test_09 ()) {
+		printf ("Test 09: ensure we only support Sec-WebSocket-Version: 13 [   OK   ]\n");
+	} else {
+		printf ("Test 09: ensure we only support Sec-WebSocket-Version: 13 [ FAILED ]\n");
+		return -1;
 	}
 
 	if (test_10 ()) {
@@ -3272,6 +6422,183 @@ int main (int argc, char ** argv)
 		return -1;
 	} /* end if */
 
+	if (test_37 ()) {
+		printf ("Test 37: check loop using available IO wait engines [   OK    ]\n");
+	} else {
+		printf ("Test 37: check loop using available IO wait engines [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+
+	if (test_38 ()) {
+		printf ("Test 38: check loop keeps IO registration in sync with connections [   OK    ]\n");
+	} else {
+		printf ("Test 38: check loop keeps IO registration in sync with connections [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+
+#if defined(NOPOLL_HAVE_POLL)
+	if (test_39 ()) {
+		printf ("Test 39: check poll(2) engine with sockets above 1024 [   OK    ]\n");
+	} else {
+		printf ("Test 39: check poll(2) engine with sockets above 1024 [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+#endif
+
+	if (test_40 ()) {
+		printf ("Test 40: check loop stop from other thread is noticed without delay [   OK    ]\n");
+	} else {
+		printf ("Test 40: check loop stop from other thread is noticed without delay [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+
+	if (test_41 ()) {
+		printf ("Test 41: check loop workers serving connections from several threads [   OK    ]\n");
+	} else {
+		printf ("Test 41: check loop workers serving connections from several threads [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+
+	if (test_42 ()) {
+		printf ("Test 42: check loop drains messages received on each readiness event [   OK    ]\n");
+	} else {
+		printf ("Test 42: check loop drains messages received on each readiness event [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+
+	if (test_43 ()) {
+		printf ("Test 43: check frames read through a small read buffer [   OK    ]\n");
+	} else {
+		printf ("Test 43: check frames read through a small read buffer [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+
+	if (test_44 ()) {
+		printf ("Test 44: check server frames sent without copying the payload [   OK    ]\n");
+	} else {
+		printf ("Test 44: check server frames sent without copying the payload [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+
+	if (test_45 ()) {
+		printf ("Test 45: check broadcast of prepared frames [   OK    ]\n");
+	} else {
+		printf ("Test 45: check broadcast of prepared frames [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+
+	if (test_46 ()) {
+		printf ("Test 46: check loop writes content queued when the socket is writable [   OK    ]\n");
+	} else {
+		printf ("Test 46: check loop writes content queued when the socket is writable [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+
+	if (test_47 ()) {
+		printf ("Test 47: check write watermarks and limit [   OK    ]\n");
+	} else {
+		printf ("Test 47: check write watermarks and limit [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+
+	if (test_48 ()) {
+		printf ("Test 48: check received messages are reused [   OK    ]\n");
+	} else {
+		printf ("Test 48: check received messages are reused [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+
+	if (test_49 ()) {
+		printf ("Test 49: check references updated from several threads [   OK    ]\n");
+	} else {
+		printf ("Test 49: check references updated from several threads [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+
+	if (test_50 ()) {
+		printf ("Test 50: check connections are found by id [   OK    ]\n");
+	} else {
+		printf ("Test 50: check connections are found by id [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+
+	if (test_51 ()) {
+		printf ("Test 51: check connections iterated while registry changes [   OK    ]\n");
+	} else {
+		printf ("Test 51: check connections iterated while registry changes [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+
+	if (test_52 ()) {
+		printf ("Test 52: check log level [   OK    ]\n");
+	} else {
+		printf ("Test 52: check log level [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+
+	if (test_53 ()) {
+		printf ("Test 53: check asynchronous log delivery [   OK    ]\n");
+	} else {
+		printf ("Test 53: check asynchronous log delivery [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+
+	if (test_54 ()) {
+		printf ("Test 54: check ssl contexts shared by TLS connections accepted [   OK    ]\n");
+	} else {
+		printf ("Test 54: check ssl contexts shared by TLS connections accepted [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+
+	if (test_55 ()) {
+		printf ("Test 55: check TLS session resumption (session cache and tickets) [   OK    ]\n");
+	} else {
+		printf ("Test 55: check TLS session resumption (session cache and tickets) [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+
+	if (test_56 ()) {
+		printf ("Test 56: check client TLS sessions reused [   OK    ]\n");
+	} else {
+		printf ("Test 56: check client TLS sessions reused [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+
+	if (test_57 ()) {
+		printf ("Test 57: check kernel TLS offload (with fallback) [   OK    ]\n");
+	} else {
+		printf ("Test 57: check kernel TLS offload (with fallback) [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+
+	if (test_58 ()) {
+		printf ("Test 58: check asynchronous client connect driven by the loop [   OK    ]\n");
+	} else {
+		printf ("Test 58: check asynchronous client connect driven by the loop [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+
+	if (test_59 ()) {
+		printf ("Test 59: check host names resolved and connected by resolver threads [   OK    ]\n");
+	} else {
+		printf ("Test 59: check host names resolved and connected by resolver threads [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+
+	if (test_60 ()) {
+		printf ("Test 60: check TLS sessions resumed by listeners sharing their port [   OK    ]\n");
+	} else {
+		printf ("Test 60: check TLS sessions resumed by listeners sharing their port [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+
+	if (test_61 ()) {
+		printf ("Test 61: check asynchronous connects skip blackholed addresses on the loop [   OK    ]\n");
+	} else {
+		printf ("Test 61: check asynchronous connects skip blackholed addresses on the loop [ FAILED  ]\n");
+		return -1;
+	} /* end if */
+
 	/* add support to reply with redirect 301 to an opening
 	 * request: page 19 and 22 */
 
@@ -113,4 +113,66 @@ void __nopoll_regtest_mutex_unlock (noPollPtr _mutex) {
 	} /* end if */
 	return;
 }
+
+noPollPtr __nopoll_regtest_thread_create (noPollThreadFunc func, noPollPtr user_data) {
+	pthread_t * thread;
+
+	thread = nopoll_new (pthread_t, 1);
+	if (thread == NULL)
+		return NULL;
+
+	/* create thread */
+	if (pthread_create (thread, NULL, func, user_data) != 0) {
+		nopoll_free (thread);
+		return NULL;
+	} /* end if */
+	return thread;
+}
+
+void __nopoll_regtest_thread_join (noPollPtr _thread) {
+	pthread_t * thread = _thread;
+
+	/* wait thread and release it */
+	pthread_join (*thread, NULL);
+	nopoll_free (thread);
+	return;
+}
+
+noPollPtr __nopoll_regtest_cond_create (void) {
+	pthread_cond_t * cond;
+
+	cond = nopoll_new (pthread_cond_t, 1);
+	if (cond == NULL)
+		return NULL;
+
+	/* init the condition using default values */
+	if (pthread_cond_init (cond, NULL) != 0) {
+		nopoll_free (cond);
+		return NULL;
+	} /* end if */
+	return cond;
+}
+
+void __nopoll_regtest_cond_destroy (noPollPtr _cond) {
+	pthread_cond_t * cond = _cond;
+
+	pthread_cond_destroy (cond);
+	nopoll_free (cond);
+	return;
+}
+
+void __nopoll_regtest_cond_wait (noPollPtr _cond, noPollPtr _mutex) {
+	pthread_cond_wait (_cond, _mutex);
+	return;
+}
+
+void __nopoll_regtest_cond_signal (noPollPtr _cond) {
+	pthread_cond_signal (_cond);
+	return;
+}
+
+void __nopoll_regtest_cond_broadcast (noPollPtr _cond) {
+	pthread_cond_broadcast (_cond);
+	return;
+}
 #endif
@@ -47,6 +47,20 @@ void __nopoll_regtest_mutex_destroy (noPollPtr _mutex);
 void __nopoll_regtest_mutex_lock (noPollPtr _mutex);
 
 void __nopoll_regtest_mutex_unlock (noPollPtr _mutex);
+
+noPollPtr __nopoll_regtest_thread_create (noPollThreadFunc func, noPollPtr user_data);
+
+void __nopoll_regtest_thread_join (noPollPtr _thread);
+
+noPollPtr __nopoll_regtest_cond_create (void);
+
+void __nopoll_regtest_cond_destroy (noPollPtr _cond);
+
+void __nopoll_regtest_cond_wait (noPollPtr _cond, noPollPtr _mutex);
+
+void __nopoll_regtest_cond_signal (noPollPtr _cond);
+
+void __nopoll_regtest_cond_broadcast (noPollPtr _cond);
 #endif
 
 #include <nopoll_private.h>
@@ -407,6 +407,13 @@ int main (int argc, char ** argv)
 				__nopoll_regtest_mutex_destroy,
 				__nopoll_regtest_mutex_lock,
 				__nopoll_regtest_mutex_unlock);
+	nopoll_thread_create_handlers (__nopoll_regtest_thread_create,
+				       __nopoll_regtest_thread_join);
+	nopoll_thread_cond_handlers (__nopoll_regtest_cond_create,
+				     __nopoll_regtest_cond_destroy,
+				     __nopoll_regtest_cond_wait,
+				     __nopoll_regtest_cond_signal,
+				     __nopoll_regtest_cond_broadcast);
 #endif
 
 	/* create the context */